@@ -0,0 +1,376 @@
+/**
+ * Animation benchmark: measures the skeletal animation update on generated
+ * skeletons (see synthetic_skeleton.h), on the CPU only, in nanoseconds per
+ * bone per update and, where the perf counters are available, in cache
+ * misses per bone per update.
+ *
+ * Every case times four phases over all of its characters:
+ *  - sample:    Bone::Update of every bone, the keyframe lookup and interpolation
+ *  - find:      Animation::FindBone of every node of the hierarchy
+ *  - hierarchy: Animator::CalculateBoneTransform from the root
+ *  - update:    Animator::UpdateAnimation, all of the above as the viewer runs it
+ *
+ * Without arguments it runs four sweeps, each varying one dimension: the
+ * bone count (20 to 2000), the keys per channel (10 to 10000), the shape of
+ * the skeleton and the number of characters. A single case is given with
+ * --bones, --keys, --shape and --characters.
+ *
+ *   animation_benchmark [--workers N] [--time MS] [--report report.json]
+ */
+#include <Animator.h>
+
+#include "perf_counters.h"
+#include "synthetic_skeleton.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum AnimationPhase
+{
+    PHASE_SAMPLE,
+    PHASE_FIND,
+    PHASE_HIERARCHY,
+    PHASE_UPDATE,
+    PHASE_COUNT
+};
+
+static const char *PHASE_NAMES[PHASE_COUNT] = {"sample", "find", "hierarchy", "update"};
+
+/*One skeleton animated by the benchmark, on 'characters' characters*/
+struct AnimationCase
+{
+    std::string sweep;
+    SyntheticSkeletonSettings settings;
+    int characters = 1;
+};
+
+/*What a phase measured, per bone per update*/
+struct PhaseResult
+{
+    int updates = 0;
+    double nanoseconds = 0.0;
+    double misses[(int)PerfEvent::Count] = {};
+};
+
+struct AnimationResult
+{
+    AnimationCase animationCase;
+    int depth = 0;
+    PhaseResult phases[PHASE_COUNT];
+
+    /*Time of the update of every character in a frame*/
+    double FrameMilliseconds() const
+    {
+        return phases[PHASE_UPDATE].nanoseconds * animationCase.settings.bones * animationCase.characters / 1e6;
+    }
+};
+
+/**
+ * The characters of a case: each has an animation with bones of its own and
+ * an animator playing it from a time of its own.
+ */
+struct Crowd
+{
+    std::vector<std::unique_ptr<Animation>> animations;
+    std::vector<std::unique_ptr<Animator>> animators;
+    std::vector<std::vector<StringId>> nodeIds; // the hierarchy of each animation, depth first
+};
+
+static void collectNodeIds(const AssimpNodeData &node, std::vector<StringId> &ids)
+{
+    ids.push_back(node.id);
+    for (const AssimpNodeData &child : node.children)
+        collectNodeIds(child, ids);
+}
+
+/**
+ * Runs 'update' for as many updates as fit in 'milliseconds', after one
+ * update to warm the caches up and estimate the count. Update i samples
+ * the clip at 0.618 * i of its duration: the golden ratio spreads the times
+ * over the whole clip, so the keyframe lookups average over it instead of
+ * staying at its start.
+ */
+template <typename Function>
+static PhaseResult measure(PerfCounters &counters, double milliseconds, size_t bonesPerUpdate, Function update)
+{
+    auto start = std::chrono::steady_clock::now();
+    update(0);
+    double once = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    PhaseResult result;
+    result.updates = (int)std::max(3.0, std::min(100000.0, milliseconds / std::max(once, 1e-6)));
+
+    counters.Start();
+    start = std::chrono::steady_clock::now();
+    for (int i = 1; i <= result.updates; i++)
+        update(i);
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    counters.Stop();
+
+    double boneUpdates = (double)bonesPerUpdate * result.updates;
+    result.nanoseconds = elapsed / boneUpdates;
+    for (int event = 0; event < (int)PerfEvent::Count; event++)
+        result.misses[event] = counters.Value((PerfEvent)event) / boneUpdates;
+    return result;
+}
+
+static AnimationResult runCase(const AnimationCase &animationCase, PerfCounters &counters, double milliseconds)
+{
+    SyntheticSkeleton skeleton(animationCase.settings);
+    Crowd crowd;
+    for (int i = 0; i < animationCase.characters; i++)
+    {
+        crowd.animations.push_back(skeleton.CreateAnimation());
+        crowd.animators.emplace_back(new Animator(crowd.animations.back().get()));
+        crowd.nodeIds.emplace_back();
+        collectNodeIds(crowd.animations.back()->GetRootNode(), crowd.nodeIds.back());
+    }
+
+    AnimationResult result;
+    result.animationCase = animationCase;
+    result.depth = skeleton.Depth();
+    size_t bonesPerUpdate = (size_t)animationCase.settings.bones * animationCase.characters;
+
+    /*Characters play from times of their own, spread over the clip*/
+    const float GOLDEN = 0.618034f;
+    float duration = crowd.animations[0]->GetDuration();
+    auto clipTime = [duration, GOLDEN](int update, int character)
+    { return fmodf((update + character * 0.5f) * GOLDEN * duration, duration); };
+
+    result.phases[PHASE_SAMPLE] = measure(counters, milliseconds, bonesPerUpdate, [&](int update)
+                                          {
+                                              for (size_t c = 0; c < crowd.animations.size(); c++)
+                                              {
+                                                  float time = clipTime(update, (int)c);
+                                                  for (Bone &bone : crowd.animations[c]->GetBones())
+                                                      bone.Update(time);
+                                              }
+                                          });
+
+    volatile int found = 0;
+    result.phases[PHASE_FIND] = measure(counters, milliseconds, bonesPerUpdate, [&](int)
+                                        {
+                                            int count = 0;
+                                            for (size_t c = 0; c < crowd.animations.size(); c++)
+                                                for (StringId id : crowd.nodeIds[c])
+                                                    count += crowd.animations[c]->FindBone(id) != nullptr;
+                                            found = count;
+                                        });
+
+    result.phases[PHASE_HIERARCHY] = measure(counters, milliseconds, bonesPerUpdate, [&](int)
+                                             {
+                                                 for (size_t c = 0; c < crowd.animators.size(); c++)
+                                                     crowd.animators[c]->CalculateBoneTransform(&crowd.animations[c]->GetRootNode(), glm::mat4(1.0f));
+                                             });
+
+    /*The animators step by the golden ratio of the clip too, their own times start apart*/
+    for (size_t c = 0; c < crowd.animators.size(); c++)
+        crowd.animators[c]->UpdateAnimation(clipTime(0, (int)c) / crowd.animations[c]->GetTicksPerSecond());
+    float step = GOLDEN * skeleton.Seconds();
+    result.phases[PHASE_UPDATE] = measure(counters, milliseconds, bonesPerUpdate, [&](int)
+                                          {
+                                              for (std::unique_ptr<Animator> &animator : crowd.animators)
+                                                  animator->UpdateAnimation(step);
+                                          });
+    return result;
+}
+
+/*The default sweeps, each varying one dimension around one character of 100 bones in a quad tree with 100 keys*/
+static std::vector<AnimationCase> defaultCases()
+{
+    std::vector<AnimationCase> cases;
+    for (int bones : {20, 50, 100, 200, 500, 1000, 2000})
+    {
+        AnimationCase animationCase;
+        animationCase.sweep = "bones";
+        animationCase.settings.bones = bones;
+        cases.push_back(animationCase);
+    }
+    for (int keys : {10, 30, 100, 300, 1000, 3000, 10000})
+    {
+        AnimationCase animationCase;
+        animationCase.sweep = "keys";
+        animationCase.settings.keys = keys;
+        cases.push_back(animationCase);
+    }
+    for (SkeletonShape shape : {SkeletonShape::Chain, SkeletonShape::Binary, SkeletonShape::Quad, SkeletonShape::Flat})
+    {
+        AnimationCase animationCase;
+        animationCase.sweep = "shape";
+        animationCase.settings.bones = 500;
+        animationCase.settings.shape = shape;
+        cases.push_back(animationCase);
+    }
+    for (int characters : {1, 4, 16, 64, 256})
+    {
+        AnimationCase animationCase;
+        animationCase.sweep = "characters";
+        animationCase.settings.bones = 60;
+        animationCase.characters = characters;
+        cases.push_back(animationCase);
+    }
+    return cases;
+}
+
+static void printHeader(const PerfCounters &counters)
+{
+    std::cout << std::left << std::setw(11) << "sweep" << std::setw(7) << "shape" << std::right << std::setw(6) << "bones" << std::setw(6)
+              << "depth" << std::setw(7) << "keys" << std::setw(6) << "chars";
+    for (const char *phase : PHASE_NAMES)
+        std::cout << std::setw(11) << phase;
+    if (counters.Available(PerfEvent::CacheMisses))
+        std::cout << std::setw(10) << "LLC miss";
+    if (counters.Available(PerfEvent::L1DataMisses))
+        std::cout << std::setw(10) << "L1D miss";
+    std::cout << std::setw(10) << "frame ms" << std::endl;
+}
+
+static void printResult(const AnimationResult &result, const PerfCounters &counters)
+{
+    const AnimationCase &animationCase = result.animationCase;
+    std::cout << std::left << std::setw(11) << animationCase.sweep << std::setw(7) << SkeletonShapeName(animationCase.settings.shape) << std::right
+              << std::setw(6) << animationCase.settings.bones << std::setw(6) << result.depth << std::setw(7) << animationCase.settings.keys
+              << std::setw(6) << animationCase.characters << std::fixed << std::setprecision(1);
+    for (const PhaseResult &phase : result.phases)
+        std::cout << std::setw(11) << phase.nanoseconds;
+    std::cout << std::setprecision(3);
+    if (counters.Available(PerfEvent::CacheMisses))
+        std::cout << std::setw(10) << result.phases[PHASE_UPDATE].misses[(int)PerfEvent::CacheMisses];
+    if (counters.Available(PerfEvent::L1DataMisses))
+        std::cout << std::setw(10) << result.phases[PHASE_UPDATE].misses[(int)PerfEvent::L1DataMisses];
+    std::cout << std::setw(10) << result.FrameMilliseconds() << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
+
+/*The cases grouped by sweep, each sweep a curve of the phases over the dimension it varies*/
+static bool writeReport(const std::string &path, const std::vector<AnimationResult> &results, const PerfCounters &counters, unsigned int workers)
+{
+    std::ofstream file(path);
+    file << "{\n    \"workers\": " << workers << ",\n    \"cacheMisses\": " << (counters.Available(PerfEvent::CacheMisses) ? "true" : "false")
+         << ",\n    \"l1DataMisses\": " << (counters.Available(PerfEvent::L1DataMisses) ? "true" : "false") << ",\n    \"sweeps\": {";
+
+    std::vector<std::string> sweeps;
+    for (const AnimationResult &result : results)
+        if (std::find(sweeps.begin(), sweeps.end(), result.animationCase.sweep) == sweeps.end())
+            sweeps.push_back(result.animationCase.sweep);
+
+    for (size_t s = 0; s < sweeps.size(); s++)
+    {
+        file << (s ? "," : "") << "\n        \"" << sweeps[s] << "\": [";
+        bool first = true;
+        for (const AnimationResult &result : results)
+        {
+            if (result.animationCase.sweep != sweeps[s])
+                continue;
+            const AnimationCase &animationCase = result.animationCase;
+            file << (first ? "" : ",") << "\n            {\"shape\": \"" << SkeletonShapeName(animationCase.settings.shape)
+                 << "\", \"bones\": " << animationCase.settings.bones << ", \"depth\": " << result.depth << ", \"keys\": " << animationCase.settings.keys
+                 << ", \"characters\": " << animationCase.characters << ", \"frameMs\": " << result.FrameMilliseconds();
+            for (int phase = 0; phase < PHASE_COUNT; phase++)
+            {
+                const PhaseResult &measured = result.phases[phase];
+                file << ",\n             \"" << PHASE_NAMES[phase] << "\": {\"updates\": " << measured.updates << ", \"nsPerBone\": " << measured.nanoseconds;
+                if (counters.Available(PerfEvent::CacheMisses))
+                    file << ", \"cacheMissesPerBone\": " << measured.misses[(int)PerfEvent::CacheMisses];
+                if (counters.Available(PerfEvent::L1DataMisses))
+                    file << ", \"l1DataMissesPerBone\": " << measured.misses[(int)PerfEvent::L1DataMisses];
+                file << "}";
+            }
+            file << "}";
+            first = false;
+        }
+        file << "\n        ]";
+    }
+    file << "\n    }\n}\n";
+    if (!file)
+    {
+        std::cout << "ERROR::ANIMATION_BENCHMARK::REPORT_NOT_WRITTEN " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static int usage(const char *program)
+{
+    std::cout << "Usage: " << program << " [--workers N] [--time MS] [--report FILE]\n"
+              << "       [--bones N] [--keys N] [--shape chain|binary|quad|flat] [--characters N]" << std::endl;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int workers = 0;
+    double milliseconds = 200.0;
+    std::string reportPath;
+    bool single = false;
+    AnimationCase custom;
+    custom.sweep = "custom";
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--workers" && hasValue)
+            workers = (unsigned int)std::max(0, atoi(argv[++i]));
+        else if (argument == "--time" && hasValue)
+            milliseconds = std::max(1.0, atof(argv[++i]));
+        else if (argument == "--report" && hasValue)
+            reportPath = argv[++i];
+        else if (argument == "--bones" && hasValue)
+            custom.settings.bones = std::max(1, atoi(argv[++i])), single = true;
+        else if (argument == "--keys" && hasValue)
+            custom.settings.keys = std::max(2, atoi(argv[++i])), single = true;
+        else if (argument == "--characters" && hasValue)
+            custom.characters = std::max(1, atoi(argv[++i])), single = true;
+        else if (argument == "--shape" && hasValue)
+        {
+            std::string shape = argv[++i];
+            if (shape == "chain")
+                custom.settings.shape = SkeletonShape::Chain;
+            else if (shape == "binary")
+                custom.settings.shape = SkeletonShape::Binary;
+            else if (shape == "quad")
+                custom.settings.shape = SkeletonShape::Quad;
+            else if (shape == "flat")
+                custom.settings.shape = SkeletonShape::Flat;
+            else
+                return usage(argv[0]);
+            single = true;
+        }
+        else
+            return usage(argv[0]);
+    }
+
+    /**
+     * Serial by default: the perf counters only see the calling thread, and
+     * the sampling of UpdateAnimation() is the only phase the workers share
+     */
+    JobSystem::Instance().Start(workers);
+    PerfCounters counters;
+    std::cout << "Animating with " << workers << " workers, " << milliseconds << " ms per phase, ns and misses per bone per update";
+    if (!counters.Available(PerfEvent::CacheMisses) && !counters.Available(PerfEvent::L1DataMisses))
+        std::cout << " (no perf counters)";
+    std::cout << std::endl;
+
+    std::vector<AnimationCase> cases = single ? std::vector<AnimationCase>{custom} : defaultCases();
+    printHeader(counters);
+    std::vector<AnimationResult> results;
+    for (const AnimationCase &animationCase : cases)
+    {
+        results.push_back(runCase(animationCase, counters, milliseconds));
+        printResult(results.back(), counters);
+    }
+
+    if (!reportPath.empty() && !writeReport(reportPath, results, counters, workers))
+        return 1;
+    return 0;
+}
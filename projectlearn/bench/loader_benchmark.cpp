@@ -0,0 +1,303 @@
+/**
+ * Loader benchmark: generates models of a controlled size in the formats
+ * the viewer reads (see synthetic_model.h) and measures how long each phase
+ * of Model's loading takes, the throughput in triangles and bytes per second
+ * and the peak memory, so loading can be followed well beyond the house.
+ *
+ * Without arguments it runs four sweeps, each varying one dimension: the
+ * triangle count, the mesh count, the texture count and, for COLLADA and
+ * glTF, the bone count. A single case is given with --meshes, --vertices,
+ * --textures, --texture-size and --bones.
+ *
+ *   loader_benchmark [--format obj|dae|gltf|all] [--large] [--serial] [--cache DIR] [--report report.json]
+ */
+#include <glad/glad.h>
+
+#include <headless.h>
+#include <job_system.h>
+#include <model.h>
+#include <resource_manager.h>
+
+#include "synthetic_model.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*One model loaded by the benchmark*/
+struct LoaderCase
+{
+    std::string sweep;
+    SyntheticFormat format;
+    SyntheticModelSettings settings;
+};
+
+/*What loading a case measured*/
+struct LoaderResult
+{
+    LoaderCase loaderCase;
+    ModelLoadStats stats;
+    double totalMilliseconds = 0.0;
+    size_t fileBytes = 0;
+    size_t peakKilobytes = 0; // peak resident set of the process while loading, 0 when unknown
+
+    double TrianglesPerSecond() const { return totalMilliseconds > 0.0 ? stats.triangles / (totalMilliseconds / 1000.0) : 0.0; }
+    double MegabytesPerSecond() const { return totalMilliseconds > 0.0 ? fileBytes / 1048576.0 / (totalMilliseconds / 1000.0) : 0.0; }
+};
+
+/**
+ * Resets the peak resident set size of the process to the current one, so
+ * the next read gives the peak of what follows. Linux only, through the
+ * clear_refs file.
+ */
+static void resetPeakMemory()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs)
+        clearRefs << "5";
+}
+
+/*Peak resident set size in kilobytes since the last reset, 0 where /proc/self/status has none*/
+static size_t peakMemoryKilobytes()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return strtoull(line.c_str() + 6, NULL, 10);
+    return 0;
+}
+
+/*The default sweeps, each varying one dimension around a model of 16 meshes of 10000 vertices*/
+static std::vector<LoaderCase> defaultCases(const std::vector<SyntheticFormat> &formats, bool large)
+{
+    std::vector<LoaderCase> cases;
+    for (SyntheticFormat format : formats)
+    {
+        std::vector<int> vertices = {2500, 10000, 40000, 160000};
+        if (large)
+            vertices.insert(vertices.end(), {640000, 1600000}); // 20 and 51 million triangles
+        for (int count : vertices)
+        {
+            SyntheticModelSettings settings;
+            settings.verticesPerMesh = count;
+            cases.push_back({"triangles", format, settings});
+        }
+
+        for (int count : {1, 64, 512, large ? 8192 : 2048})
+        {
+            SyntheticModelSettings settings;
+            settings.meshes = count;
+            settings.verticesPerMesh = 2500;
+            cases.push_back({"meshes", format, settings});
+        }
+
+        for (int count : {0, 8, 32, large ? 256 : 64})
+        {
+            SyntheticModelSettings settings;
+            settings.textures = count;
+            settings.textureSize = 512;
+            cases.push_back({"textures", format, settings});
+        }
+
+        if (format == SyntheticFormat::Obj)
+            continue;
+        for (int count : {0, 32, 128, large ? 2048 : 512})
+        {
+            SyntheticModelSettings settings;
+            settings.bones = count;
+            cases.push_back({"bones", format, settings});
+        }
+    }
+    return cases;
+}
+
+/*Directory of the generated files of a case, named after its settings so later runs reuse them*/
+static std::string caseDirectory(const std::string &cache, const LoaderCase &loaderCase)
+{
+    const SyntheticModelSettings &settings = loaderCase.settings;
+    return cache + "/" + SyntheticFormatName(loaderCase.format) + "_m" + std::to_string(settings.meshes) + "_v" +
+           std::to_string(settings.GridSide() * settings.GridSide()) + "_t" + std::to_string(settings.textures) + "x" +
+           std::to_string(settings.textureSize) + "_b" + std::to_string(settings.bones);
+}
+
+/*Generates the files of a case unless an earlier run left them, then loads them into a Model*/
+static bool runCase(const std::string &cache, const LoaderCase &loaderCase, LoaderResult &result)
+{
+    std::string directory = caseDirectory(cache, loaderCase);
+    std::string path = directory + "/model." + SyntheticFormatName(loaderCase.format);
+    if (!std::filesystem::exists(path) && SyntheticModel::Write(directory, loaderCase.format, loaderCase.settings).empty())
+        return false;
+
+    result.loaderCase = loaderCase;
+    result.fileBytes = SyntheticModel::DirectoryBytes(directory);
+
+    resetPeakMemory();
+    auto start = std::chrono::steady_clock::now();
+    {
+        Model model(path);
+        glFinish();
+        result.totalMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        result.stats = model.LoadStats();
+    }
+    result.peakKilobytes = peakMemoryKilobytes();
+    return result.stats.triangles > 0;
+}
+
+static void printHeader()
+{
+    std::cout << std::left << std::setw(10) << "sweep" << std::setw(6) << "fmt" << std::right << std::setw(7) << "meshes" << std::setw(11)
+              << "triangles" << std::setw(6) << "tex" << std::setw(6) << "bones" << std::setw(10) << "total ms" << std::setw(9) << "import"
+              << std::setw(9) << "texture" << std::setw(9) << "geometry" << std::setw(9) << "mesh" << std::setw(9) << "bone" << std::setw(9)
+              << "upload" << std::setw(10) << "Mtri/s" << std::setw(8) << "MB/s" << std::setw(10) << "peak MB" << std::endl;
+}
+
+static void printResult(const LoaderResult &result)
+{
+    const LoaderCase &loaderCase = result.loaderCase;
+    const ModelLoadStats &stats = result.stats;
+    std::cout << std::left << std::setw(10) << loaderCase.sweep << std::setw(6) << SyntheticFormatName(loaderCase.format) << std::right
+              << std::fixed << std::setprecision(1) << std::setw(7) << loaderCase.settings.meshes << std::setw(11) << stats.triangles
+              << std::setw(6) << stats.textures << std::setw(6) << stats.bones << std::setw(10) << result.totalMilliseconds << std::setw(9)
+              << stats.importMilliseconds << std::setw(9) << stats.textureMilliseconds << std::setw(9) << stats.geometryMilliseconds
+              << std::setw(9) << stats.meshMilliseconds << std::setw(9) << stats.boneMilliseconds << std::setw(9) << stats.uploadMilliseconds
+              << std::setw(10) << std::setprecision(2) << result.TrianglesPerSecond() / 1e6 << std::setw(8) << std::setprecision(1)
+              << result.MegabytesPerSecond() << std::setw(10) << result.peakKilobytes / 1024.0 << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+}
+
+static bool writeReport(const std::string &path, const std::vector<LoaderResult> &results, const std::string &renderer, unsigned int workers)
+{
+    std::ofstream file(path);
+    file << "{\n    \"renderer\": \"" << renderer << "\",\n    \"workers\": " << workers << ",\n    \"cases\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const LoaderResult &result = results[i];
+        const SyntheticModelSettings &settings = result.loaderCase.settings;
+        const ModelLoadStats &stats = result.stats;
+        file << (i ? "," : "") << "\n        {\"sweep\": \"" << result.loaderCase.sweep << "\", \"format\": \""
+             << SyntheticFormatName(result.loaderCase.format) << "\", \"meshes\": " << settings.meshes << ", \"vertices\": " << stats.vertices
+             << ", \"triangles\": " << stats.triangles << ", \"textures\": " << stats.textures << ", \"textureSize\": " << settings.textureSize
+             << ", \"bones\": " << stats.bones << ", \"fileBytes\": " << result.fileBytes << ",\n         \"totalMs\": " << result.totalMilliseconds
+             << ", \"importMs\": " << stats.importMilliseconds << ", \"hierarchyMs\": " << stats.hierarchyMilliseconds
+             << ", \"textureMs\": " << stats.textureMilliseconds << ", \"geometryMs\": " << stats.geometryMilliseconds
+             << ", \"meshMs\": " << stats.meshMilliseconds << ", \"boneMs\": " << stats.boneMilliseconds
+             << ", \"lightmapMs\": " << stats.lightmapMilliseconds << ", \"uploadMs\": " << stats.uploadMilliseconds
+             << ",\n         \"trianglesPerSecond\": " << result.TrianglesPerSecond() << ", \"megabytesPerSecond\": " << result.MegabytesPerSecond()
+             << ", \"peakKilobytes\": " << result.peakKilobytes << "}";
+    }
+    file << "\n    ]\n}\n";
+    if (!file)
+    {
+        std::cout << "ERROR::LOADER_BENCHMARK::REPORT_NOT_WRITTEN " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static int usage(const char *program)
+{
+    std::cout << "Usage: " << program << " [--format obj|dae|gltf|all] [--large] [--serial] [--cache DIR] [--report FILE]\n"
+              << "       [--meshes N] [--vertices N] [--textures N] [--texture-size N] [--bones N]" << std::endl;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<SyntheticFormat> formats = {SyntheticFormat::Obj, SyntheticFormat::Collada, SyntheticFormat::Gltf};
+    std::string cache = "loader_benchmark_models";
+    std::string reportPath;
+    bool large = false, serialJobs = false, single = false;
+    SyntheticModelSettings custom;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--large")
+            large = true;
+        else if (argument == "--serial")
+            serialJobs = true;
+        else if (argument == "--format" && hasValue)
+        {
+            std::string format = argv[++i];
+            if (format == "obj")
+                formats = {SyntheticFormat::Obj};
+            else if (format == "dae")
+                formats = {SyntheticFormat::Collada};
+            else if (format == "gltf")
+                formats = {SyntheticFormat::Gltf};
+            else if (format != "all")
+                return usage(argv[0]);
+        }
+        else if (argument == "--cache" && hasValue)
+            cache = argv[++i];
+        else if (argument == "--report" && hasValue)
+            reportPath = argv[++i];
+        else if (argument == "--meshes" && hasValue)
+            custom.meshes = std::max(1, atoi(argv[++i])), single = true;
+        else if (argument == "--vertices" && hasValue)
+            custom.verticesPerMesh = std::max(4, atoi(argv[++i])), single = true;
+        else if (argument == "--textures" && hasValue)
+            custom.textures = std::max(0, atoi(argv[++i])), single = true;
+        else if (argument == "--texture-size" && hasValue)
+            custom.textureSize = std::max(1, atoi(argv[++i])), single = true;
+        else if (argument == "--bones" && hasValue)
+            custom.bones = std::max(0, atoi(argv[++i])), single = true;
+        else
+            return usage(argv[0]);
+    }
+
+    /*The meshes and texture pages are created on a context like the viewer's, no window needed*/
+    HeadlessContext context;
+    if (!context.Create())
+        return 1;
+    if (!gladLoadGLLoader(HeadlessContext::Loader()))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return 1;
+    }
+    std::string renderer = (const char *)glGetString(GL_RENDERER);
+
+    /*The same workers as the viewer, one core is left to the loading thread*/
+    unsigned int cores = std::thread::hardware_concurrency();
+    JobSystem::Instance().Start(serialJobs ? 0 : std::max(1u, cores) - 1);
+    std::cout << "Loading on " << renderer << " with " << JobSystem::Instance().WorkerCount() << " workers, models in " << cache << std::endl;
+
+    std::vector<LoaderCase> cases;
+    if (single)
+        for (SyntheticFormat format : formats)
+            cases.push_back({"custom", format, custom});
+    else
+        cases = defaultCases(formats, large);
+
+    printHeader();
+    std::vector<LoaderResult> results;
+    int exitCode = 0;
+    for (const LoaderCase &loaderCase : cases)
+    {
+        LoaderResult result;
+        if (!runCase(cache, loaderCase, result))
+        {
+            std::cout << "ERROR::LOADER_BENCHMARK::CASE_FAILED " << caseDirectory(cache, loaderCase) << std::endl;
+            exitCode = 1;
+            continue;
+        }
+        printResult(result);
+        results.push_back(result);
+    }
+
+    if (!reportPath.empty() && !writeReport(reportPath, results, renderer, JobSystem::Instance().WorkerCount()))
+        exitCode = 1;
+
+    /*Deleting the shared textures, buffers and programs while the context exists*/
+    ResourceManager::Instance().Shutdown();
+    return exitCode;
+}
@@ -0,0 +1,108 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*Hardware events counted by PerfCounters*/
+enum class PerfEvent
+{
+    CacheMisses,  // last level cache misses
+    L1DataMisses, // level 1 data cache read misses
+    Count
+};
+
+/**
+ * Hardware cache miss counters of the calling thread, through Linux's
+ * perf_event_open. Events the machine or the kernel doesn't grant, e.g.
+ * in virtual machines or with a restrictive perf_event_paranoid, read as
+ * unavailable and the benchmarks print no value for them.
+ *
+ * Only user space is counted, and only the thread that opened the
+ * counters: work the job system hands to its workers is not included.
+ */
+class PerfCounters
+{
+public:
+    PerfCounters()
+    {
+#ifdef __linux__
+        descriptors[(int)PerfEvent::CacheMisses] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        descriptors[(int)PerfEvent::L1DataMisses] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                                                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int descriptor : descriptors)
+            if (descriptor >= 0)
+                close(descriptor);
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool Available(PerfEvent event) const { return descriptors[(int)event] >= 0; }
+
+    /*Zeroes the counters and starts counting*/
+    void Start()
+    {
+#ifdef __linux__
+        for (int descriptor : descriptors)
+        {
+            if (descriptor < 0)
+                continue;
+            ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+            ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /*Stops counting, the counts since Start() are read with Value()*/
+    void Stop()
+    {
+#ifdef __linux__
+        for (int i = 0; i < (int)PerfEvent::Count; i++)
+        {
+            values[i] = 0;
+            if (descriptors[i] < 0)
+                continue;
+            ioctl(descriptors[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(descriptors[i], &values[i], sizeof(values[i])) != sizeof(values[i]))
+                values[i] = 0;
+        }
+#endif
+    }
+
+    uint64_t Value(PerfEvent event) const { return values[(int)event]; }
+
+private:
+    int descriptors[(int)PerfEvent::Count] = {-1, -1};
+    uint64_t values[(int)PerfEvent::Count] = {};
+
+#ifdef __linux__
+    static int open(uint32_t type, uint64_t config)
+    {
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        return (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+    }
+#endif
+};
+#endif
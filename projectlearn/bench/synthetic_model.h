@@ -0,0 +1,618 @@
+#ifndef SYNTHETIC_MODEL_H
+#define SYNTHETIC_MODEL_H
+
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+enum class SyntheticFormat
+{
+    Obj,
+    Collada,
+    Gltf
+};
+
+inline const char *SyntheticFormatName(SyntheticFormat format)
+{
+    return format == SyntheticFormat::Obj ? "obj" : format == SyntheticFormat::Collada ? "dae" : "gltf";
+}
+
+/*Size of a generated model, see SyntheticModel*/
+struct SyntheticModelSettings
+{
+    int meshes = 16;
+    int verticesPerMesh = 10000; // rounded to a square grid of at least 2 by 2
+    int textures = 0;            // diffuse images, one material each, the meshes use them in turn
+    int textureSize = 256;
+    int bones = 0; // one chain skinning every mesh, OBJ has no skeletons and ignores it
+
+    /*Side of the vertex grid of a mesh*/
+    int GridSide() const { return std::max(2, (int)std::lround(std::sqrt((double)verticesPerMesh))); }
+
+    size_t Triangles() const
+    {
+        size_t side = GridSide();
+        return (size_t)meshes * (side - 1) * (side - 1) * 2;
+    }
+};
+
+/**
+ * Writes models of a controlled size in the formats the loader reads, for
+ * measuring how loading scales beyond the house.
+ *
+ * Every mesh is a grid of 10 by 10 units, waved by a height field of its own
+ * so no two meshes are identical and the loader can't instance them, laid
+ * out in rows of 32. The textures are PNG checkerboards of distinct colors.
+ * With bones, a chain of them runs along the x axis of the meshes and every
+ * vertex is weighted to the two bones nearest to it.
+ *
+ * Files go into a directory of their own, with the textures and the MTL or
+ * binary buffer next to the model. Write() returns the path of the model.
+ */
+class SyntheticModel
+{
+public:
+    static std::string Write(const std::string &directory, SyntheticFormat format, const SyntheticModelSettings &settings)
+    {
+        std::filesystem::create_directories(directory);
+        for (int i = 0; i < settings.textures; i++)
+            writeTexture(directory + "/" + textureName(i), i, settings.textureSize);
+
+        std::string path = directory + "/model." + SyntheticFormatName(format);
+        bool written = format == SyntheticFormat::Obj       ? writeObj(directory, path, settings)
+                       : format == SyntheticFormat::Collada ? writeCollada(path, settings)
+                                                            : writeGltf(directory, path, settings);
+        if (!written)
+        {
+            std::cout << "ERROR::SYNTHETIC_MODEL::WRITE_FAILED " << path << std::endl;
+            return std::string();
+        }
+        return path;
+    }
+
+    /*Bytes of the model and every file it references in 'directory'*/
+    static size_t DirectoryBytes(const std::string &directory)
+    {
+        size_t bytes = 0;
+        for (const auto &entry : std::filesystem::directory_iterator(directory))
+            if (entry.is_regular_file())
+                bytes += entry.file_size();
+        return bytes;
+    }
+
+private:
+    /*Distance between the bones of the chain, the chain spans the width of a mesh*/
+    static float boneSpacing(const SyntheticModelSettings &settings)
+    {
+        return settings.bones > 1 ? MESH_SIZE / (settings.bones - 1) : 0.0f;
+    }
+
+    static constexpr float MESH_SIZE = 10.0f;
+    static constexpr float MESH_SPACING = 12.0f;
+    static constexpr int MESHES_PER_ROW = 32;
+
+    /*Vertex 'x', 'z' of the grid of mesh 'mesh'*/
+    struct GridVertex
+    {
+        float position[3];
+        float normal[3];
+        float uv[2];
+        int bones[2];
+        float weights[2];
+    };
+
+    static GridVertex gridVertex(int mesh, int x, int z, const SyntheticModelSettings &settings)
+    {
+        int side = settings.GridSide();
+        float u = (float)x / (side - 1), v = (float)z / (side - 1);
+
+        /*A height field of its own for every mesh, with its analytic normal*/
+        float frequency = 2.0f + (mesh % 7);
+        float phase = mesh * 0.37f;
+        float height = 0.5f * std::sin(u * frequency + phase) * std::cos(v * frequency);
+        float slopeU = 0.5f * frequency * std::cos(u * frequency + phase) * std::cos(v * frequency) / MESH_SIZE;
+        float slopeV = -0.5f * frequency * std::sin(u * frequency + phase) * std::sin(v * frequency) / MESH_SIZE;
+        float length = std::sqrt(slopeU * slopeU + 1.0f + slopeV * slopeV);
+
+        GridVertex vertex;
+        vertex.position[0] = (mesh % MESHES_PER_ROW) * MESH_SPACING + u * MESH_SIZE;
+        vertex.position[1] = height;
+        vertex.position[2] = (mesh / MESHES_PER_ROW) * MESH_SPACING + v * MESH_SIZE;
+        vertex.normal[0] = -slopeU / length;
+        vertex.normal[1] = 1.0f / length;
+        vertex.normal[2] = -slopeV / length;
+        vertex.uv[0] = u;
+        vertex.uv[1] = v;
+
+        /*Blending between the two bones of the chain on either side of the vertex*/
+        float bone = u * std::max(0, settings.bones - 1);
+        vertex.bones[0] = std::min((int)bone, std::max(0, settings.bones - 1));
+        vertex.bones[1] = std::min(vertex.bones[0] + 1, std::max(0, settings.bones - 1));
+        vertex.weights[1] = bone - vertex.bones[0];
+        vertex.weights[0] = 1.0f - vertex.weights[1];
+        return vertex;
+    }
+
+    /*Calls 'triangle' with the grid indices of the two triangles of every cell*/
+    template <typename Function>
+    static void gridTriangles(int side, Function triangle)
+    {
+        for (int z = 0; z + 1 < side; z++)
+        {
+            for (int x = 0; x + 1 < side; x++)
+            {
+                int corner = z * side + x;
+                triangle(corner, corner + side, corner + 1);
+                triangle(corner + 1, corner + side, corner + side + 1);
+            }
+        }
+    }
+
+    static std::string textureName(int index)
+    {
+        return "texture_" + std::to_string(index) + ".png";
+    }
+
+    static int materialCount(const SyntheticModelSettings &settings)
+    {
+        return std::max(1, settings.textures);
+    }
+
+    static void writeTexture(const std::string &path, int index, int size)
+    {
+        unsigned char color[3] = {(unsigned char)(64 + index * 53 % 192), (unsigned char)(64 + index * 97 % 192), (unsigned char)(64 + index * 151 % 192)};
+        std::vector<unsigned char> pixels((size_t)size * size * 4);
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                bool light = ((x / 16) + (y / 16)) % 2 == 0;
+                unsigned char *pixel = &pixels[((size_t)y * size + x) * 4];
+                for (int c = 0; c < 3; c++)
+                    pixel[c] = light ? color[c] : color[c] / 2;
+                pixel[3] = 255;
+            }
+        }
+        ImageWriter::WritePng(path, size, size, pixels.data());
+    }
+
+    /*Files of many megabytes are written through a large buffer*/
+    class Output
+    {
+    public:
+        explicit Output(const std::string &path) : file(fopen(path.c_str(), "wb"))
+        {
+            if (file)
+                setvbuf(file, NULL, _IOFBF, 1 << 20);
+        }
+        ~Output()
+        {
+            if (file)
+                fclose(file);
+        }
+        Output(const Output &) = delete;
+        Output &operator=(const Output &) = delete;
+
+        bool Good() const { return file != NULL && !ferror(file); }
+        FILE *File() const { return file; }
+
+    private:
+        FILE *file;
+    };
+
+    static bool writeObj(const std::string &directory, const std::string &path, const SyntheticModelSettings &settings)
+    {
+        Output material(directory + "/model.mtl");
+        for (int i = 0; i < materialCount(settings) && material.Good(); i++)
+        {
+            fprintf(material.File(), "newmtl material_%d\nKa 0.2 0.2 0.2\nKd 0.8 0.8 0.8\nKs 0.1 0.1 0.1\nNs 16\n", i);
+            if (i < settings.textures)
+                fprintf(material.File(), "map_Kd %s\n", textureName(i).c_str());
+        }
+
+        Output obj(path);
+        if (!obj.Good() || !material.Good())
+            return false;
+        FILE *file = obj.File();
+        fprintf(file, "mtllib model.mtl\n");
+
+        int side = settings.GridSide();
+        size_t first = 1;
+        for (int mesh = 0; mesh < settings.meshes; mesh++)
+        {
+            fprintf(file, "o mesh_%d\n", mesh);
+            for (int z = 0; z < side; z++)
+            {
+                for (int x = 0; x < side; x++)
+                {
+                    GridVertex vertex = gridVertex(mesh, x, z, settings);
+                    fprintf(file, "v %.5f %.5f %.5f\nvt %.5f %.5f\nvn %.5f %.5f %.5f\n", vertex.position[0], vertex.position[1], vertex.position[2],
+                            vertex.uv[0], vertex.uv[1], vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+                }
+            }
+
+            fprintf(file, "usemtl material_%d\n", mesh % materialCount(settings));
+            gridTriangles(side, [&](int a, int b, int c)
+                          {
+                              size_t i = first + a, j = first + b, k = first + c;
+                              fprintf(file, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", i, i, i, j, j, j, k, k, k);
+                          });
+            first += (size_t)side * side;
+        }
+        return obj.Good();
+    }
+
+    static bool writeCollada(const std::string &path, const SyntheticModelSettings &settings)
+    {
+        Output output(path);
+        if (!output.Good())
+            return false;
+        FILE *file = output.File();
+        int side = settings.GridSide();
+        int vertices = side * side;
+        int triangles = (side - 1) * (side - 1) * 2;
+
+        fprintf(file, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                      "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n"
+                      "<asset><unit name=\"meter\" meter=\"1\"/><up_axis>Y_UP</up_axis></asset>\n");
+
+        /*Materials, a Phong effect per texture sampling it, or one plain material*/
+        if (settings.textures > 0)
+        {
+            fprintf(file, "<library_images>\n");
+            for (int i = 0; i < settings.textures; i++)
+                fprintf(file, "<image id=\"image_%d\"><init_from>%s</init_from></image>\n", i, textureName(i).c_str());
+            fprintf(file, "</library_images>\n");
+        }
+        fprintf(file, "<library_effects>\n");
+        for (int i = 0; i < materialCount(settings); i++)
+        {
+            fprintf(file, "<effect id=\"effect_%d\"><profile_COMMON>\n", i);
+            if (i < settings.textures)
+                fprintf(file, "<newparam sid=\"surface_%d\"><surface type=\"2D\"><init_from>image_%d</init_from></surface></newparam>\n"
+                              "<newparam sid=\"sampler_%d\"><sampler2D><source>surface_%d</source></sampler2D></newparam>\n",
+                        i, i, i, i);
+            fprintf(file, "<technique sid=\"common\"><phong><ambient><color>0.2 0.2 0.2 1</color></ambient><diffuse>");
+            if (i < settings.textures)
+                fprintf(file, "<texture texture=\"sampler_%d\" texcoord=\"UVMap\"/>", i);
+            else
+                fprintf(file, "<color>0.8 0.8 0.8 1</color>");
+            fprintf(file, "</diffuse><specular><color>0.1 0.1 0.1 1</color></specular><shininess><float>16</float></shininess>"
+                          "</phong></technique></profile_COMMON></effect>\n");
+        }
+        fprintf(file, "</library_effects>\n<library_materials>\n");
+        for (int i = 0; i < materialCount(settings); i++)
+            fprintf(file, "<material id=\"material_%d\" name=\"material_%d\"><instance_effect url=\"#effect_%d\"/></material>\n", i, i, i);
+        fprintf(file, "</library_materials>\n");
+
+        /*Geometry, the positions, normals and texture coordinates share their indices*/
+        fprintf(file, "<library_geometries>\n");
+        for (int mesh = 0; mesh < settings.meshes; mesh++)
+        {
+            fprintf(file, "<geometry id=\"mesh_%d\" name=\"mesh_%d\"><mesh>\n", mesh, mesh);
+            const char *names[3] = {"positions", "normals", "uvs"};
+            for (int attribute = 0; attribute < 3; attribute++)
+            {
+                int components = attribute == 2 ? 2 : 3;
+                fprintf(file, "<source id=\"mesh_%d-%s\"><float_array id=\"mesh_%d-%s-array\" count=\"%d\">", mesh, names[attribute], mesh,
+                        names[attribute], vertices * components);
+                for (int z = 0; z < side; z++)
+                {
+                    for (int x = 0; x < side; x++)
+                    {
+                        GridVertex vertex = gridVertex(mesh, x, z, settings);
+                        const float *values = attribute == 0 ? vertex.position : attribute == 1 ? vertex.normal : vertex.uv;
+                        for (int c = 0; c < components; c++)
+                            fprintf(file, "%.5f ", values[c]);
+                    }
+                }
+                fprintf(file, "</float_array>\n<technique_common><accessor source=\"#mesh_%d-%s-array\" count=\"%d\" stride=\"%d\">", mesh,
+                        names[attribute], vertices, components);
+                const char *params = attribute == 2 ? "ST" : "XYZ";
+                for (int c = 0; c < components; c++)
+                    fprintf(file, "<param name=\"%c\" type=\"float\"/>", params[c]);
+                fprintf(file, "</accessor></technique_common></source>\n");
+            }
+
+            fprintf(file, "<vertices id=\"mesh_%d-vertices\"><input semantic=\"POSITION\" source=\"#mesh_%d-positions\"/></vertices>\n"
+                          "<triangles material=\"material\" count=\"%d\">\n"
+                          "<input semantic=\"VERTEX\" source=\"#mesh_%d-vertices\" offset=\"0\"/>\n"
+                          "<input semantic=\"NORMAL\" source=\"#mesh_%d-normals\" offset=\"0\"/>\n"
+                          "<input semantic=\"TEXCOORD\" source=\"#mesh_%d-uvs\" offset=\"0\" set=\"0\"/>\n<p>",
+                    mesh, mesh, triangles, mesh, mesh, mesh);
+            gridTriangles(side, [&](int a, int b, int c)
+                          { fprintf(file, "%d %d %d ", a, b, c); });
+            fprintf(file, "</p>\n</triangles>\n</mesh></geometry>\n");
+        }
+        fprintf(file, "</library_geometries>\n");
+
+        /*A skin per mesh over the whole chain, every vertex weighted to two bones*/
+        float spacing = boneSpacing(settings);
+        if (settings.bones > 0)
+        {
+            fprintf(file, "<library_controllers>\n");
+            for (int mesh = 0; mesh < settings.meshes; mesh++)
+            {
+                fprintf(file, "<controller id=\"skin_%d\"><skin source=\"#mesh_%d\">\n"
+                              "<bind_shape_matrix>1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1</bind_shape_matrix>\n"
+                              "<source id=\"skin_%d-joints\"><Name_array id=\"skin_%d-joints-array\" count=\"%d\">",
+                        mesh, mesh, mesh, mesh, settings.bones);
+                for (int bone = 0; bone < settings.bones; bone++)
+                    fprintf(file, "bone_%d ", bone);
+                fprintf(file, "</Name_array>\n<technique_common><accessor source=\"#skin_%d-joints-array\" count=\"%d\" stride=\"1\">"
+                              "<param name=\"JOINT\" type=\"name\"/></accessor></technique_common></source>\n"
+                              "<source id=\"skin_%d-bind_poses\"><float_array id=\"skin_%d-bind_poses-array\" count=\"%d\">",
+                        mesh, settings.bones, mesh, mesh, settings.bones * 16);
+                for (int bone = 0; bone < settings.bones; bone++)
+                    fprintf(file, "1 0 0 %.5f 0 1 0 0 0 0 1 0 0 0 0 1 ", -(bone * spacing + (mesh % MESHES_PER_ROW) * MESH_SPACING));
+                fprintf(file, "</float_array>\n<technique_common><accessor source=\"#skin_%d-bind_poses-array\" count=\"%d\" stride=\"16\">"
+                              "<param name=\"TRANSFORM\" type=\"float4x4\"/></accessor></technique_common></source>\n"
+                              "<source id=\"skin_%d-weights\"><float_array id=\"skin_%d-weights-array\" count=\"%d\">",
+                        mesh, settings.bones, mesh, mesh, vertices * 2);
+                for (int z = 0; z < side; z++)
+                {
+                    for (int x = 0; x < side; x++)
+                    {
+                        GridVertex vertex = gridVertex(mesh, x, z, settings);
+                        fprintf(file, "%.5f %.5f ", vertex.weights[0], vertex.weights[1]);
+                    }
+                }
+                fprintf(file, "</float_array>\n<technique_common><accessor source=\"#skin_%d-weights-array\" count=\"%d\" stride=\"1\">"
+                              "<param name=\"WEIGHT\" type=\"float\"/></accessor></technique_common></source>\n"
+                              "<joints><input semantic=\"JOINT\" source=\"#skin_%d-joints\"/>"
+                              "<input semantic=\"INV_BIND_MATRIX\" source=\"#skin_%d-bind_poses\"/></joints>\n"
+                              "<vertex_weights count=\"%d\"><input semantic=\"JOINT\" source=\"#skin_%d-joints\" offset=\"0\"/>"
+                              "<input semantic=\"WEIGHT\" source=\"#skin_%d-weights\" offset=\"1\"/>\n<vcount>",
+                        mesh, vertices * 2, mesh, mesh, vertices, mesh, mesh);
+                for (int i = 0; i < vertices; i++)
+                    fprintf(file, "2 ");
+                fprintf(file, "</vcount>\n<v>");
+                for (int z = 0; z < side; z++)
+                {
+                    for (int x = 0; x < side; x++)
+                    {
+                        GridVertex vertex = gridVertex(mesh, x, z, settings);
+                        int weight = (z * side + x) * 2;
+                        fprintf(file, "%d %d %d %d ", vertex.bones[0], weight, vertex.bones[1], weight + 1);
+                    }
+                }
+                fprintf(file, "</v></vertex_weights>\n</skin></controller>\n");
+            }
+            fprintf(file, "</library_controllers>\n");
+        }
+
+        /*The scene: the nested bones of the chain, then one node per mesh*/
+        fprintf(file, "<library_visual_scenes><visual_scene id=\"scene\" name=\"scene\">\n");
+        for (int bone = 0; bone < settings.bones; bone++)
+            fprintf(file, "<node id=\"bone_%d\" name=\"bone_%d\" sid=\"bone_%d\" type=\"JOINT\">"
+                          "<matrix sid=\"transform\">1 0 0 %.5f 0 1 0 0 0 0 1 0 0 0 0 1</matrix>\n",
+                    bone, bone, bone, bone == 0 ? 0.0f : spacing);
+        for (int bone = 0; bone < settings.bones; bone++)
+            fprintf(file, "</node>");
+        if (settings.bones > 0)
+            fprintf(file, "\n");
+
+        for (int mesh = 0; mesh < settings.meshes; mesh++)
+        {
+            const char *instance = settings.bones > 0 ? "instance_controller" : "instance_geometry";
+            fprintf(file, "<node id=\"node_%d\" name=\"mesh_%d\" type=\"NODE\"><%s url=\"#%s_%d\">", mesh, mesh, instance,
+                    settings.bones > 0 ? "skin" : "mesh", mesh);
+            if (settings.bones > 0)
+                fprintf(file, "<skeleton>#bone_0</skeleton>");
+            fprintf(file, "<bind_material><technique_common><instance_material symbol=\"material\" target=\"#material_%d\">"
+                          "<bind_vertex_input semantic=\"UVMap\" input_semantic=\"TEXCOORD\" input_set=\"0\"/>"
+                          "</instance_material></technique_common></bind_material></%s></node>\n",
+                    mesh % materialCount(settings), instance);
+        }
+        fprintf(file, "</visual_scene></library_visual_scenes>\n"
+                      "<scene><instance_visual_scene url=\"#scene\"/></scene>\n</COLLADA>\n");
+        return output.Good();
+    }
+
+    /*One glTF accessor into the binary buffer, written into the JSON once the buffer is complete*/
+    struct GltfAccessor
+    {
+        size_t offset;
+        size_t count;
+        int componentType;
+        const char *type;
+        float minimum[3];
+        float maximum[3];
+        bool bounds;
+    };
+
+    static bool writeGltf(const std::string &directory, const std::string &path, const SyntheticModelSettings &settings)
+    {
+        Output buffer(directory + "/model.bin");
+        if (!buffer.Good())
+            return false;
+
+        /*The binary buffer: the attributes and indices of every mesh, then the inverse bind matrices*/
+        int side = settings.GridSide();
+        size_t vertices = (size_t)side * side;
+        size_t offset = 0;
+        std::vector<GltfAccessor> accessors;
+        auto append = [&](const void *data, size_t bytes)
+        {
+            fwrite(data, 1, bytes, buffer.File());
+            offset += bytes;
+        };
+
+        for (int mesh = 0; mesh < settings.meshes; mesh++)
+        {
+            GltfAccessor position = {offset, vertices, 5126, "VEC3", {INFINITY, INFINITY, INFINITY}, {-INFINITY, -INFINITY, -INFINITY}, true};
+            for (int z = 0; z < side; z++)
+            {
+                for (int x = 0; x < side; x++)
+                {
+                    GridVertex vertex = gridVertex(mesh, x, z, settings);
+                    append(vertex.position, sizeof(vertex.position));
+                    for (int c = 0; c < 3; c++)
+                    {
+                        position.minimum[c] = std::min(position.minimum[c], vertex.position[c]);
+                        position.maximum[c] = std::max(position.maximum[c], vertex.position[c]);
+                    }
+                }
+            }
+            accessors.push_back(position);
+
+            accessors.push_back({offset, vertices, 5126, "VEC3", {}, {}, false});
+            for (int z = 0; z < side; z++)
+                for (int x = 0; x < side; x++)
+                    append(gridVertex(mesh, x, z, settings).normal, sizeof(float) * 3);
+
+            accessors.push_back({offset, vertices, 5126, "VEC2", {}, {}, false});
+            for (int z = 0; z < side; z++)
+                for (int x = 0; x < side; x++)
+                    append(gridVertex(mesh, x, z, settings).uv, sizeof(float) * 2);
+
+            if (settings.bones > 0)
+            {
+                accessors.push_back({offset, vertices, 5123, "VEC4", {}, {}, false});
+                for (int z = 0; z < side; z++)
+                {
+                    for (int x = 0; x < side; x++)
+                    {
+                        GridVertex vertex = gridVertex(mesh, x, z, settings);
+                        uint16_t joints[4] = {(uint16_t)vertex.bones[0], (uint16_t)vertex.bones[1], 0, 0};
+                        append(joints, sizeof(joints));
+                    }
+                }
+
+                accessors.push_back({offset, vertices, 5126, "VEC4", {}, {}, false});
+                for (int z = 0; z < side; z++)
+                {
+                    for (int x = 0; x < side; x++)
+                    {
+                        GridVertex vertex = gridVertex(mesh, x, z, settings);
+                        float weights[4] = {vertex.weights[0], vertex.weights[1], 0.0f, 0.0f};
+                        append(weights, sizeof(weights));
+                    }
+                }
+            }
+
+            accessors.push_back({offset, (size_t)(side - 1) * (side - 1) * 6, 5125, "SCALAR", {}, {}, false});
+            gridTriangles(side, [&](int a, int b, int c)
+                          {
+                              uint32_t triangle[3] = {(uint32_t)a, (uint32_t)b, (uint32_t)c};
+                              append(triangle, sizeof(triangle));
+                          });
+        }
+
+        float spacing = boneSpacing(settings);
+        size_t inverseBindMatrices = accessors.size();
+        if (settings.bones > 0)
+        {
+            accessors.push_back({offset, (size_t)settings.bones, 5126, "MAT4", {}, {}, false});
+            for (int bone = 0; bone < settings.bones; bone++)
+            {
+                float matrix[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, -bone * spacing, 0, 0, 1}; // column major
+                append(matrix, sizeof(matrix));
+            }
+        }
+        if (!buffer.Good())
+            return false;
+
+        /*The JSON: one buffer view per accessor, nodes of the meshes under a root, then the chain of bones*/
+        std::ostringstream json;
+        json << "{\n\"asset\": {\"version\": \"2.0\", \"generator\": \"projectlearn loader benchmark\"},\n";
+        json << "\"buffers\": [{\"uri\": \"model.bin\", \"byteLength\": " << offset << "}],\n";
+        json << "\"bufferViews\": [";
+        for (size_t i = 0; i < accessors.size(); i++)
+        {
+            size_t end = i + 1 < accessors.size() ? accessors[i + 1].offset : offset;
+            json << (i ? "," : "") << "\n{\"buffer\": 0, \"byteOffset\": " << accessors[i].offset << ", \"byteLength\": " << end - accessors[i].offset << "}";
+        }
+        json << "],\n\"accessors\": [";
+        for (size_t i = 0; i < accessors.size(); i++)
+        {
+            const GltfAccessor &accessor = accessors[i];
+            json << (i ? "," : "") << "\n{\"bufferView\": " << i << ", \"componentType\": " << accessor.componentType
+                 << ", \"count\": " << accessor.count << ", \"type\": \"" << accessor.type << "\"";
+            if (accessor.bounds)
+                json << ", \"min\": [" << accessor.minimum[0] << ", " << accessor.minimum[1] << ", " << accessor.minimum[2] << "], \"max\": ["
+                     << accessor.maximum[0] << ", " << accessor.maximum[1] << ", " << accessor.maximum[2] << "]";
+            json << "}";
+        }
+        json << "],\n";
+
+        if (settings.textures > 0)
+        {
+            json << "\"samplers\": [{}],\n\"images\": [";
+            for (int i = 0; i < settings.textures; i++)
+                json << (i ? ", " : "") << "{\"uri\": \"" << textureName(i) << "\"}";
+            json << "],\n\"textures\": [";
+            for (int i = 0; i < settings.textures; i++)
+                json << (i ? ", " : "") << "{\"sampler\": 0, \"source\": " << i << "}";
+            json << "],\n";
+        }
+        json << "\"materials\": [";
+        for (int i = 0; i < materialCount(settings); i++)
+        {
+            json << (i ? "," : "") << "\n{\"name\": \"material_" << i << "\", \"pbrMetallicRoughness\": {";
+            if (i < settings.textures)
+                json << "\"baseColorTexture\": {\"index\": " << i << "}, ";
+            json << "\"metallicFactor\": 0.0, \"roughnessFactor\": 0.8}}";
+        }
+        json << "],\n\"meshes\": [";
+
+        size_t accessor = 0;
+        size_t perMesh = settings.bones > 0 ? 6 : 4;
+        for (int mesh = 0; mesh < settings.meshes; mesh++, accessor += perMesh)
+        {
+            json << (mesh ? "," : "") << "\n{\"name\": \"mesh_" << mesh << "\", \"primitives\": [{\"attributes\": {\"POSITION\": " << accessor
+                 << ", \"NORMAL\": " << accessor + 1 << ", \"TEXCOORD_0\": " << accessor + 2;
+            if (settings.bones > 0)
+                json << ", \"JOINTS_0\": " << accessor + 3 << ", \"WEIGHTS_0\": " << accessor + 4;
+            json << "}, \"indices\": " << accessor + perMesh - 1 << ", \"material\": " << mesh % materialCount(settings) << "}]}";
+        }
+        json << "],\n";
+
+        int firstBone = settings.meshes + 1;
+        json << "\"nodes\": [\n{\"name\": \"root\", \"children\": [";
+        for (int mesh = 0; mesh < settings.meshes; mesh++)
+            json << (mesh ? ", " : "") << mesh + 1;
+        if (settings.bones > 0)
+            json << ", " << firstBone;
+        json << "]}";
+        for (int mesh = 0; mesh < settings.meshes; mesh++)
+        {
+            json << ",\n{\"name\": \"mesh_" << mesh << "\", \"mesh\": " << mesh;
+            if (settings.bones > 0)
+                json << ", \"skin\": 0";
+            json << "}";
+        }
+        for (int bone = 0; bone < settings.bones; bone++)
+        {
+            json << ",\n{\"name\": \"bone_" << bone << "\", \"translation\": [" << (bone == 0 ? 0.0f : spacing) << ", 0, 0]";
+            if (bone + 1 < settings.bones)
+                json << ", \"children\": [" << firstBone + bone + 1 << "]";
+            json << "}";
+        }
+        json << "],\n";
+
+        if (settings.bones > 0)
+        {
+            json << "\"skins\": [{\"inverseBindMatrices\": " << inverseBindMatrices << ", \"skeleton\": " << firstBone << ", \"joints\": [";
+            for (int bone = 0; bone < settings.bones; bone++)
+                json << (bone ? ", " : "") << firstBone + bone;
+            json << "]}],\n";
+        }
+        json << "\"scenes\": [{\"nodes\": [0]}],\n\"scene\": 0\n}\n";
+
+        Output gltf(path);
+        if (!gltf.Good())
+            return false;
+        std::string text = json.str();
+        fwrite(text.data(), 1, text.size(), gltf.File());
+        return gltf.Good();
+    }
+};
+#endif
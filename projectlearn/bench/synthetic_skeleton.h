@@ -0,0 +1,178 @@
+#ifndef SYNTHETIC_SKELETON_H
+#define SYNTHETIC_SKELETON_H
+
+#include <Animation.h>
+
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*How the bones of a generated skeleton hang together*/
+enum class SkeletonShape
+{
+    Chain,  // every bone the child of the previous one
+    Binary, // two children per bone, breadth first
+    Quad,   // four children per bone, breadth first
+    Flat    // every bone a child of the first one
+};
+
+inline const char *SkeletonShapeName(SkeletonShape shape)
+{
+    switch (shape)
+    {
+    case SkeletonShape::Chain:
+        return "chain";
+    case SkeletonShape::Binary:
+        return "binary";
+    case SkeletonShape::Quad:
+        return "quad";
+    default:
+        return "flat";
+    }
+}
+
+/*Size of a generated skeleton and clip, see SyntheticSkeleton*/
+struct SyntheticSkeletonSettings
+{
+    int bones = 100;
+    int keys = 100; // position, rotation and scaling keys of every bone, one per tick
+    SkeletonShape shape = SkeletonShape::Quad;
+};
+
+/**
+ * Builds a skeleton and a clip animating all of its bones the way Assimp
+ * hands them to Animation, so the benchmarks go through the same Bone and
+ * Animation code as the character loaded from Sitting.dae.
+ *
+ * The node tree has a root node that isn't a bone, like the scene roots of
+ * imported files, with the bones below it in the chosen shape. Every bone
+ * wobbles around its parent with a motion of its own, keyed once per tick
+ * at 30 ticks per second.
+ *
+ * Each CreateAnimation() is an Animation with bones of its own, one per
+ * character; they all share the bone ids of the skeleton.
+ */
+class SyntheticSkeleton
+{
+public:
+    explicit SyntheticSkeleton(const SyntheticSkeletonSettings &settings) : settings(settings)
+    {
+        int bones = std::max(1, settings.bones);
+        int keys = std::max(2, settings.keys);
+
+        /*Bone i hangs below bone parent(i), which always comes first*/
+        std::vector<aiNode *> nodes(bones);
+        std::vector<int> depths(bones);
+        root.reset(new aiNode("root"));
+        for (int bone = 0; bone < bones; bone++)
+        {
+            nodes[bone] = new aiNode(boneName(bone));
+            nodes[bone]->mParent = bone == 0 ? root.get() : nodes[parent(bone)];
+            depths[bone] = bone == 0 ? 1 : depths[parent(bone)] + 1;
+            depth = std::max(depth, depths[bone]);
+        }
+
+        std::vector<std::vector<aiNode *>> children(bones);
+        for (int bone = 1; bone < bones; bone++)
+            children[parent(bone)].push_back(nodes[bone]);
+        attach(root.get(), {nodes[0]});
+        for (int bone = 0; bone < bones; bone++)
+            attach(nodes[bone], children[bone]);
+
+        clip.reset(new aiAnimation());
+        clip->mDuration = keys - 1;
+        clip->mTicksPerSecond = 30.0;
+        clip->mNumChannels = bones;
+        clip->mChannels = new aiNodeAnim *[bones];
+        for (int bone = 0; bone < bones; bone++)
+            clip->mChannels[bone] = channel(bone, keys);
+
+        /*Identity offsets, the bind pose doesn't change the cost of an update*/
+        for (int bone = 0; bone < bones; bone++)
+            boneInfoMap[StringTable::Instance().Intern(boneName(bone))] = {bone, glm::mat4(1.0f)};
+        boneCount = bones;
+    }
+
+    SyntheticSkeleton(const SyntheticSkeleton &) = delete;
+    SyntheticSkeleton &operator=(const SyntheticSkeleton &) = delete;
+
+    /*A new animation of the skeleton, with keyframes and bones of its own*/
+    std::unique_ptr<Animation> CreateAnimation()
+    {
+        return std::unique_ptr<Animation>(new Animation(clip.get(), root.get(), boneInfoMap, boneCount));
+    }
+
+    const SyntheticSkeletonSettings &Settings() const { return settings; }
+
+    /*Bones on the longest path from the first bone to a leaf*/
+    int Depth() const { return depth; }
+
+    /*Duration of the clip in seconds*/
+    float Seconds() const { return (float)(clip->mDuration / clip->mTicksPerSecond); }
+
+private:
+    SyntheticSkeletonSettings settings;
+    std::unique_ptr<aiNode> root; // owns the whole node tree
+    std::unique_ptr<aiAnimation> clip;
+    std::unordered_map<StringId, BoneInfo> boneInfoMap;
+    int boneCount = 0;
+    int depth = 0;
+
+    static std::string boneName(int bone)
+    {
+        return "bone_" + std::to_string(bone);
+    }
+
+    int parent(int bone) const
+    {
+        switch (settings.shape)
+        {
+        case SkeletonShape::Chain:
+            return bone - 1;
+        case SkeletonShape::Binary:
+            return (bone - 1) / 2;
+        case SkeletonShape::Quad:
+            return (bone - 1) / 4;
+        default:
+            return 0;
+        }
+    }
+
+    static void attach(aiNode *node, const std::vector<aiNode *> &children)
+    {
+        if (children.empty())
+            return;
+        node->mNumChildren = (unsigned int)children.size();
+        node->mChildren = new aiNode *[children.size()];
+        std::copy(children.begin(), children.end(), node->mChildren);
+    }
+
+    /*Keys of bone 'bone', one unit from its parent and swinging about an axis of its own*/
+    static aiNodeAnim *channel(int bone, int keys)
+    {
+        aiNodeAnim *channel = new aiNodeAnim();
+        channel->mNodeName = aiString(boneName(bone));
+        channel->mNumPositionKeys = channel->mNumRotationKeys = channel->mNumScalingKeys = keys;
+        channel->mPositionKeys = new aiVectorKey[keys];
+        channel->mRotationKeys = new aiQuatKey[keys];
+        channel->mScalingKeys = new aiVectorKey[keys];
+
+        float axis[3] = {(float)(bone % 3 == 0), (float)(bone % 3 == 1), (float)(bone % 3 == 2)};
+        for (int key = 0; key < keys; key++)
+        {
+            float phase = 0.1f * key + 0.7f * bone;
+            float angle = 0.5f * sinf(phase);
+            channel->mPositionKeys[key] = aiVectorKey(key, aiVector3D(0.05f * sinf(phase), 1.0f, 0.05f * cosf(phase)));
+            channel->mRotationKeys[key] = aiQuatKey(key, aiQuaternion(cosf(angle / 2), axis[0] * sinf(angle / 2), axis[1] * sinf(angle / 2),
+                                                                      axis[2] * sinf(angle / 2)));
+            channel->mScalingKeys[key] = aiVectorKey(key, aiVector3D(1.0f, 1.0f, 1.0f));
+        }
+        return channel;
+    }
+};
+#endif
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include "Bone.h"
@@ -18,6 +19,7 @@ struct AssimpNodeData
 {
 	glm::mat4 transformation;			  // Represent transformation matrix
 	std::string name;					  // Holds the name of the node
+	StringId id;						  // Interned name, used for the bone lookups
 	int childrenCount;					  // Holds the count of child nodes
 	std::vector<AssimpNodeData> children; // Vector that holds the instance of AssimpNodeData
 };
@@ -62,27 +64,40 @@ public:
 		ReadHeirarchyData(m_RootNode, scene->mRootNode);
 
 		/*Reading and populating bone-related data for animation*/
-		ReadMissingBones(animation, *model);
+		ReadMissingBones(animation, model->GetBoneInfoMap(), model->GetBoneCount());
+	}
+
+	/**
+	 * Constructor taking a clip and node hierarchy already in memory, such as
+	 * the generated skeletons of the animation benchmark. Bones missing from
+	 * 'boneInfoMap' are added to it, numbered from 'boneCount' on.
+	 */
+	Animation(const aiAnimation *animation, const aiNode *rootNode, std::unordered_map<StringId, BoneInfo> &boneInfoMap, int &boneCount)
+	{
+		m_Duration = animation->mDuration;
+		m_TicksPerSecond = animation->mTicksPerSecond;
+
+		ReadHeirarchyData(m_RootNode, rootNode);
+		ReadMissingBones(animation, boneInfoMap, boneCount);
 	}
 
 	/**
 	 * Searches for a bone with a given name within the list of bones
 	 * stored in the 'm_Bones' vector of animations
 	 */
-	Bone *FindBone(const std::string &name)
+	Bone *FindBone(StringId id)
 	{
-		auto iter = std::find_if(m_Bones.begin(), m_Bones.end(),
-								 [&](const Bone &Bone)
-								 {
-									 return Bone.GetBoneName() == name;
-								 });
+		auto iter = m_BoneIndex.find(id);
 
-		if (iter == m_Bones.end())
+		if (iter == m_BoneIndex.end())
 			return nullptr;
 		else
-			return &(*iter);
+			return &m_Bones[iter->second];
 	}
 
+	/*Returns the bones driven by the animation channels*/
+	inline std::vector<Bone> &GetBones() { return m_Bones; }
+
 	/*Returns the number of animation ticks per second*/
 	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
 
@@ -93,7 +108,7 @@ public:
 	inline const AssimpNodeData &GetRootNode() { return m_RootNode; }
 
 	/*Returns a reference to a map that stores bone information*/
-	inline const std::map<std::string, BoneInfo> &GetBoneIDMap()
+	inline const std::unordered_map<StringId, BoneInfo> &GetBoneIDMap()
 	{
 		return m_BoneInfoMap;
 	}
@@ -102,23 +117,20 @@ private:
 
 	/**
 	 * Reading bone information from animation channels and
-	 * adding any missing bones to the bone information map.
+	 * adding any missing bones to 'boneInfoMap', with ids
+	 * counted on from 'boneCount', which is advanced past them.
 	 */
-	void ReadMissingBones(const aiAnimation *animation, Model &model)
+	void ReadMissingBones(const aiAnimation *animation, std::unordered_map<StringId, BoneInfo> &boneInfoMap, int &boneCount)
 	{
 		/*Retrieves the number of animation channels*/
 		int size = animation->mNumChannels;
 
-		/*Retrieve the reference to the bone information map from 'model' object*/
-		auto &boneInfoMap = model.GetBoneInfoMap(); // getting m_BoneInfoMap from Model class
-		int &boneCount = model.GetBoneCount();		// getting the m_BoneCounter from Model class
-
 		/*Reading channels(bones engaged in an animation and their keyframes)*/
 
 		for (int i = 0; i < size; i++)
 		{
 			auto channel = animation->mChannels[i];
-			std::string boneName = channel->mNodeName.data;
+			StringId boneName = StringTable::Instance().Intern(channel->mNodeName.data);
 
 			if (boneInfoMap.find(boneName) == boneInfoMap.end())
 			{
@@ -128,7 +140,8 @@ private:
 
 
 			m_Bones.push_back(Bone(channel->mNodeName.data,
-								   boneInfoMap[channel->mNodeName.data].id, channel));
+								   boneInfoMap[boneName].id, channel));
+			m_BoneIndex[boneName] = (int)m_Bones.size() - 1;
 		}
 
 		/*Update boneInfoMap*/
@@ -148,6 +161,7 @@ private:
 		/*Copies name of source node, transformation matrix, and set the number of children node*/
 
 		dest.name = src->mName.data;
+		dest.id = StringTable::Instance().Intern(dest.name);
 		dest.transformation = AssimpGLMHelpers::ConvertMatrixToGLMFormat(src->mTransformation);
 		dest.childrenCount = src->mNumChildren;
 
@@ -168,5 +182,8 @@ private:
 	int m_TicksPerSecond;
 	std::vector<Bone> m_Bones;
 	AssimpNodeData m_RootNode;
-	std::map<std::string, BoneInfo> m_BoneInfoMap;
+	std::unordered_map<StringId, BoneInfo> m_BoneInfoMap;
+
+	/*Index into 'm_Bones' by bone name id*/
+	std::unordered_map<StringId, int> m_BoneIndex;
 };
@@ -6,6 +6,7 @@
 #include <assimp/Importer.hpp>
 #include "Animation.h"
 #include "Bone.h"
+#include "job_system.h"
 
 class Animator
 {
@@ -28,6 +29,8 @@ public:
 
 		for (int i = 0; i < 1000; i++)
 			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
+
+		FitBoneMatrices();
 	}
 
 	/*Updates the animation based on the given time increment*/
@@ -39,6 +42,13 @@ public:
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
 			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
 
+			/*Sampling the keyframes of every bone is independent, so it is spread over the job system*/
+			std::vector<Bone> &bones = m_CurrentAnimation->GetBones();
+			float currentTime = m_CurrentTime;
+			JobSystem::Instance().ParallelFor(bones.size(), 16, [&bones, currentTime](size_t i)
+											  { bones[i].Update(currentTime); });
+
+			/*The hierarchy walk depends on the parents, it stays serial*/
 			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
 		}
 	}
@@ -49,6 +59,7 @@ public:
 	{
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+		FitBoneMatrices();
 	}
 
 	/**
@@ -57,8 +68,8 @@ public:
 	 * */
 	void CalculateBoneTransform(const AssimpNodeData *node, glm::mat4 parentTransform)
 	{
-		/*Retrieves the name of current node*/
-		std::string nodeName = node->name;
+		/*Retrieves the name id of current node*/
+		StringId nodeName = node->id;
 		/*Retrieves the transformation matrix of current node*/
 		glm::mat4 nodeTransform = node->transformation;
 
@@ -68,10 +79,7 @@ public:
 		/*If respective bone is found or not*/
 		if (Bone)
 		{
-			/*Update bone transformation based on the current animation time.*/
-			Bone->Update(m_CurrentTime);
-
-			/*Retrieves the local transformation matrix of the matrix*/
+			/*Retrieves the local transformation matrix of the bone, sampled in UpdateAnimation()*/
 			nodeTransform = Bone->GetLocalTransform();
 		}
 
@@ -82,16 +90,17 @@ public:
 		glm::mat4 globalTransformation = parentTransform * nodeTransform;
 
 		/*Retrieve the map of bone information from the current animation*/
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
+		const auto &boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
 
 		/*Checks if the current node's name exists in the bone information map.*/
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
+		auto boneInfo = boneInfoMap.find(nodeName);
+		if (boneInfo != boneInfoMap.end())
 		{
 			/*Retrieve bone index*/
-			int index = boneInfoMap[nodeName].id;
+			int index = boneInfo->second.id;
 
 			/*Retrieve bone offset matrix*/
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
+			glm::mat4 offset = boneInfo->second.offset;
 
 			/*Calculate and assign the final transformation matrix for the bone*/
 			m_FinalBoneMatrices[index] = globalTransformation * offset;
@@ -104,13 +113,23 @@ public:
 
 
 	/*Return the vector of final bone transformation matrices that were calculated during animation update*/
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	const std::vector<glm::mat4> &GetFinalBoneMatrices() const
 	{
 		return m_FinalBoneMatrices;
 	}
 
 private:
 
+	/*Grows m_FinalBoneMatrices to the bone ids of skeletons of more than 1000 bones*/
+	void FitBoneMatrices()
+	{
+		if (!m_CurrentAnimation)
+			return;
+		for (const auto &boneInfo : m_CurrentAnimation->GetBoneIDMap())
+			if (boneInfo.second.id >= (int)m_FinalBoneMatrices.size())
+				m_FinalBoneMatrices.resize(boneInfo.second.id + 1, glm::mat4(1.0f));
+	}
+
 	std::vector<glm::mat4> m_FinalBoneMatrices;
 	Animation *m_CurrentAnimation = nullptr;
 	float m_CurrentTime = 0.0f;
@@ -8,6 +8,7 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
 #include <assimp_glm_helpers.h>
+#include "string_id.h"
 #include <vector>
 
 /**
@@ -48,6 +49,7 @@ public:
 	 */
 	Bone(const std::string &name, int ID, const aiNodeAnim *channel)
 		: m_Name(name),
+		  m_Key(StringTable::Instance().Intern(name)),
 		  m_ID(ID),
 		  m_LocalTransform(1.0f)
 	{
@@ -128,7 +130,10 @@ public:
 	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
 
 	/*Return the name of the bone*/
-	std::string GetBoneName() const { return m_Name; }
+	const std::string &GetBoneName() const { return m_Name; }
+
+	/*Return the interned id of the bone's name*/
+	StringId GetBoneKey() const { return m_Key; }
 
 	/*Returns the id of the bone*/
 	int GetBoneID() { return m_ID; }
@@ -252,5 +257,6 @@ private:
 
 	glm::mat4 m_LocalTransform;
 	std::string m_Name;
+	StringId m_Key;
 	int m_ID;
 };
@@ -0,0 +1,219 @@
+#ifndef BAKE_CACHE_H
+#define BAKE_CACHE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*How long a key has to stay wanted before a bake starts for it, so dragging a light slider doesn't bake every step*/
+const std::chrono::milliseconds BAKE_SETTLE_TIME(400);
+
+/*Bytes of results of one kind kept on disk, the least recently used files are deleted beyond it*/
+const uintmax_t BAKE_CACHE_BYTES = 256ull << 20;
+
+/**
+ * Runs the bakes of one kind of data in the background and keeps their
+ * results on disk, keyed by a hash of everything they depend on.
+ *
+ * Only one bake runs at a time. Callers poll every frame with the key they
+ * currently want; a bake started for an older key still completes and is
+ * handed out (and cached) first, then the latest key is loaded or baked.
+ * Keys found on disk are loaded right away, a new bake only starts once the
+ * key has been wanted for BAKE_SETTLE_TIME. The first key of a session
+ * bakes immediately.
+ */
+class BakeCache
+{
+public:
+    typedef std::function<std::vector<float>()> BakeFunction;
+
+    /*Files are named '<directory>/<name>_<key>.bin' and start with 'magic'*/
+    BakeCache(const std::string &directory, const std::string &name, uint32_t magic)
+        : directory(directory), name(name), magic(magic)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+    }
+
+    ~BakeCache()
+    {
+        if (job.valid())
+            job.wait();
+    }
+
+    /**
+     * Returns true with 'data' and 'dataKey' set when data became available:
+     * a background bake finished, or the cache holds 'key'. Otherwise starts
+     * 'bake' for 'key' unless a bake is already running, and returns false.
+     *
+     * 'header' describes the layout of the data (sizes), files with another
+     * header or not holding 'count' floats are ignored.
+     */
+    bool Poll(uint64_t key, const std::vector<uint32_t> &header, size_t count, const BakeFunction &bake,
+              std::vector<float> &data, uint64_t &dataKey)
+    {
+        if (job.valid())
+        {
+            if (job.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return false;
+
+            data = job.get();
+            dataKey = jobKey;
+            store(jobKey, jobHeader, data);
+            return true;
+        }
+
+        if (load(key, header, count, data))
+        {
+            waiting = false;
+            dataKey = key;
+            return true;
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!waiting || key != waitingKey)
+        {
+            waitingSince = polled ? now : now - BAKE_SETTLE_TIME;
+            waitingKey = key;
+            waiting = true;
+        }
+        polled = true;
+        if (now - waitingSince < BAKE_SETTLE_TIME)
+            return false;
+
+        waiting = false;
+        jobKey = key;
+        jobHeader = header;
+        job = std::async(std::launch::async, bake);
+        return false;
+    }
+
+    /*Forgets the key waiting to settle, called when the caller already has the data it wants*/
+    void Cancel()
+    {
+        waiting = false;
+    }
+
+    /*True while a bake is running in the background, or waiting for its key to settle*/
+    bool Baking() const
+    {
+        return waiting || (job.valid() && job.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+    }
+
+private:
+    std::string directory;
+    std::string name;
+    uint32_t magic;
+
+    std::future<std::vector<float>> job;
+    uint64_t jobKey = 0;
+    std::vector<uint32_t> jobHeader;
+
+    bool polled = false;  // false until the first Poll(), whose key bakes without settling
+    bool waiting = false; // 'waitingKey' is wanted but neither cached nor baking yet
+    uint64_t waitingKey = 0;
+    std::chrono::steady_clock::time_point waitingSince;
+
+    std::string pathFor(uint64_t key) const
+    {
+        char suffix[24];
+        std::snprintf(suffix, sizeof(suffix), "_%016llx.bin", (unsigned long long)key);
+        return directory + '/' + name + suffix;
+    }
+
+    /*Layout: magic, header size, header, float count, floats. A file that is read counts as used for the LRU deletion*/
+    bool load(uint64_t key, const std::vector<uint32_t> &header, size_t expectedCount, std::vector<float> &data) const
+    {
+        std::string path = pathFor(key);
+        std::ifstream file(path, std::ios::binary);
+        uint32_t fileMagic = 0, headerSize = 0;
+        if (!file || !file.read(reinterpret_cast<char *>(&fileMagic), sizeof(uint32_t)) ||
+            !file.read(reinterpret_cast<char *>(&headerSize), sizeof(uint32_t)) ||
+            fileMagic != magic || headerSize != header.size())
+            return false;
+
+        std::vector<uint32_t> fileHeader(headerSize);
+        uint64_t count = 0;
+        if (!file.read(reinterpret_cast<char *>(fileHeader.data()), headerSize * sizeof(uint32_t)) || fileHeader != header ||
+            !file.read(reinterpret_cast<char *>(&count), sizeof(uint64_t)) || count != expectedCount)
+            return false;
+
+        data.resize(count);
+        if (!file.read(reinterpret_cast<char *>(data.data()), count * sizeof(float)))
+            return false;
+
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        return true;
+    }
+
+    /*Written to a temporary file first, so an interrupted write never leaves a truncated entry*/
+    void store(uint64_t key, const std::vector<uint32_t> &header, const std::vector<float> &data) const
+    {
+        std::string path = pathFor(key);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                std::cout << "ERROR::BAKE_CACHE::CANNOT_WRITE: " << temporary << std::endl;
+                return;
+            }
+            uint32_t headerSize = (uint32_t)header.size();
+            uint64_t count = data.size();
+            file.write(reinterpret_cast<const char *>(&magic), sizeof(uint32_t));
+            file.write(reinterpret_cast<const char *>(&headerSize), sizeof(uint32_t));
+            file.write(reinterpret_cast<const char *>(header.data()), headerSize * sizeof(uint32_t));
+            file.write(reinterpret_cast<const char *>(&count), sizeof(uint64_t));
+            file.write(reinterpret_cast<const char *>(data.data()), count * sizeof(float));
+        }
+        std::remove(path.c_str());
+        std::rename(temporary.c_str(), path.c_str());
+        evict(path);
+    }
+
+    /*Deletes the least recently used files of this kind until they fit in BAKE_CACHE_BYTES, never 'keep'*/
+    void evict(const std::string &keep) const
+    {
+        struct Entry
+        {
+            std::filesystem::file_time_type used;
+            uintmax_t bytes;
+            std::filesystem::path path;
+        };
+        std::vector<Entry> entries;
+        uintmax_t total = 0;
+
+        std::error_code error;
+        for (const auto &file : std::filesystem::directory_iterator(directory, error))
+        {
+            std::string fileName = file.path().filename().string();
+            if (fileName.compare(0, name.size() + 1, name + '_') != 0 || file.path().extension() != ".bin")
+                continue;
+            Entry entry = {file.last_write_time(error), file.file_size(error), file.path()};
+            if (error)
+                continue;
+            total += entry.bytes;
+            entries.push_back(entry);
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.used < b.used; });
+        for (const Entry &entry : entries)
+        {
+            if (total <= BAKE_CACHE_BYTES)
+                break;
+            if (entry.path == std::filesystem::path(keep) || !std::filesystem::remove(entry.path, error))
+                continue;
+            total -= entry.bytes;
+        }
+    }
+};
+#endif
@@ -0,0 +1,254 @@
+#ifndef BAKE_SCENE_H
+#define BAKE_SCENE_H
+
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "model.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/*Light configuration a bake depends on besides the geometry*/
+struct BakeLights
+{
+    glm::vec3 sunPosition;
+    glm::vec3 sunDiffuse;
+    bool night; // the bulbs only shine at night
+};
+
+/*Static triangle in world space, with its lightmap coordinates in the atlas*/
+struct BakeTriangle
+{
+    glm::vec3 position[3];
+    glm::vec3 normal[3];
+    glm::vec2 lightmap[3];
+    glm::vec3 albedo;
+};
+
+/*Closest surface found by BakeScene::Trace()*/
+struct SurfaceHit
+{
+    const BakeTriangle *triangle;
+    glm::vec3 position;
+    glm::vec3 normal;   // interpolated vertex normal
+    glm::vec2 lightmap; // position in the lightmap atlas
+    bool front;         // false when the ray hit the back of the surface, e.g. from inside a wall
+};
+
+/**
+ * The static geometry and lights of a model as seen by the CPU bakers
+ * (lightmaps, irradiance volume): world space triangles, a BVH of the ones
+ * that block light, and the light model of lighting.fs without the specular
+ * term. Glass, water and the bulbs themselves receive light but don't cast
+ * shadows.
+ *
+ * The scene is read only once set, any number of threads can query it.
+ */
+class BakeScene
+{
+public:
+    /*Collects the lightmapped triangles and the bulbs of a model placed with 'transform'*/
+    void Set(const Model &model, const glm::mat4 &transform)
+    {
+        triangles.clear();
+        occluders.clear();
+        bulbs.clear();
+        for (size_t i = 0; i < model.bulbs.size() && i < MAX_BULBS; i++)
+            bulbs.push_back(PlaceBulb(model.bulbs[i], transform));
+
+        std::vector<glm::vec3> occluderPositions;
+        if (model.lightmapDensity > 0.0f)
+        {
+            for (const Mesh &mesh : model.meshes)
+            {
+                for (const InstanceData &instance : mesh.instances)
+                {
+                    if (instance.lightmapST.x <= 0.0f)
+                        continue;
+
+                    glm::mat4 world = transform * instance.transform;
+                    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+                    bool occluder = !mesh.isBulb && !mesh.isGlass && !mesh.isWater;
+
+                    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+                    {
+                        BakeTriangle triangle;
+                        for (int k = 0; k < 3; k++)
+                        {
+                            const Vertex &vertex = mesh.vertices[mesh.indices[i + k]];
+                            triangle.position[k] = glm::vec3(world * glm::vec4(vertex.Position, 1.0f));
+                            triangle.normal[k] = glm::normalize(normalMatrix * vertex.Normal);
+                            triangle.lightmap[k] = glm::vec2(vertex.LightmapUV.x * instance.lightmapST.x + instance.lightmapST.z,
+                                                             vertex.LightmapUV.y * instance.lightmapST.y + instance.lightmapST.w);
+                        }
+                        triangle.albedo = glm::vec3(model.materials[instance.material].diffuse);
+
+                        if (occluder)
+                        {
+                            occluders.push_back((unsigned int)triangles.size());
+                            for (int k = 0; k < 3; k++)
+                                occluderPositions.push_back(triangle.position[k]);
+                        }
+                        triangles.push_back(triangle);
+                    }
+                }
+            }
+        }
+        bvh.Build(occluderPositions);
+
+        minimum = glm::vec3(0.0f);
+        maximum = glm::vec3(0.0f);
+        for (size_t i = 0; i < triangles.size(); i++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                minimum = i == 0 && k == 0 ? triangles[i].position[k] : glm::min(minimum, triangles[i].position[k]);
+                maximum = i == 0 && k == 0 ? triangles[i].position[k] : glm::max(maximum, triangles[i].position[k]);
+            }
+        }
+
+        /*Hash of everything the bakes read from the scene, the triangles and bulbs are plain floats*/
+        hash = 14695981039346656037ull;
+        for (const BakeTriangle &triangle : triangles)
+            hash = HashBytes(hash, &triangle, sizeof(BakeTriangle));
+        for (const Bulbs &bulb : bulbs)
+            hash = HashBytes(hash, &bulb, sizeof(Bulbs));
+    }
+
+    const std::vector<BakeTriangle> &Triangles() const { return triangles; }
+    bool Empty() const { return triangles.empty(); }
+
+    /*Axis aligned bounds of the triangles*/
+    glm::vec3 Minimum() const { return minimum; }
+    glm::vec3 Maximum() const { return maximum; }
+
+    /*Hash of the scene combined with a light configuration, for cache keys*/
+    uint64_t Key(const BakeLights &lights) const
+    {
+        uint64_t key = hash;
+        key = HashBytes(key, &lights.sunPosition, sizeof(glm::vec3));
+        key = HashBytes(key, &lights.sunDiffuse, sizeof(glm::vec3));
+        return HashBytes(key, &lights.night, sizeof(bool));
+    }
+
+    /*Finds the closest light blocking surface along a ray*/
+    bool Trace(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, SurfaceHit &surface) const
+    {
+        TriangleBVH::Hit hit;
+        if (!bvh.Intersect(origin, direction, maxDistance, hit))
+            return false;
+
+        const BakeTriangle &triangle = triangles[occluders[hit.triangle]];
+        float w = 1.0f - hit.u - hit.v;
+        surface.triangle = &triangle;
+        surface.position = origin + direction * hit.distance;
+        surface.normal = glm::normalize(triangle.normal[0] * w + triangle.normal[1] * hit.u + triangle.normal[2] * hit.v);
+        surface.lightmap = triangle.lightmap[0] * w + triangle.lightmap[1] * hit.u + triangle.lightmap[2] * hit.v;
+
+        /*Orienting the face normal like the vertex normals to tell the sides apart*/
+        glm::vec3 face = glm::cross(triangle.position[1] - triangle.position[0], triangle.position[2] - triangle.position[0]);
+        if (glm::dot(face, triangle.normal[0]) < 0.0f)
+            face = -face;
+        surface.front = glm::dot(face, direction) < 0.0f;
+        return true;
+    }
+
+    /**
+     * Calls 'visit(direction, intensity)' for every light reaching 'position'
+     * unblocked, 'direction' pointing towards the light. Shadow rays start
+     * slightly above the surface along 'normal', which may be zero for points
+     * in the air.
+     */
+    template <typename Visit>
+    void ForEachLight(const glm::vec3 &position, const glm::vec3 &normal, const BakeLights &lights, const Visit &visit) const
+    {
+        glm::vec3 origin = position + normal * 1e-3f;
+
+        if (lights.sunDiffuse != glm::vec3(0.0f))
+        {
+            glm::vec3 toSun = lights.sunPosition - position;
+            float distance = glm::length(toSun);
+            glm::vec3 direction = toSun / distance;
+            if (!bvh.Occluded(origin, direction, distance))
+                visit(direction, lights.sunDiffuse);
+        }
+
+        if (lights.night)
+        {
+            for (const Bulbs &bulb : bulbs)
+            {
+                /*The bulb direction is used unnormalized, exactly as the shader receives it*/
+                glm::vec3 fromBulb = glm::normalize(position - bulb.position);
+                if (glm::dot(fromBulb, bulb.normal) <= cos(bulb.angle * 3.1415 / 180))
+                    continue;
+
+                glm::vec3 toBulb = bulb.position - position;
+                float distance = glm::length(toBulb);
+                glm::vec3 direction = toBulb / distance;
+                if (bvh.Occluded(origin, direction, distance))
+                    continue;
+
+                float attenuation = bulb.constant + bulb.linear * distance + bulb.exp * distance * distance;
+                visit(direction, bulb.diffuse / attenuation);
+            }
+        }
+    }
+
+    /*Diffuse irradiance of a surface from the lights, as lighting.fs computes it*/
+    glm::vec3 DirectLight(const glm::vec3 &position, const glm::vec3 &normal, const BakeLights &lights) const
+    {
+        glm::vec3 result(0.0f);
+        ForEachLight(position, normal, lights, [&](const glm::vec3 &direction, const glm::vec3 &intensity)
+                     { result += intensity * std::max(0.0f, glm::dot(normal, direction)); });
+        return result;
+    }
+
+    /*Runs 'work(i)' for i in [0, count) on every core*/
+    template <typename Work>
+    static void ParallelFor(size_t count, const Work &work)
+    {
+        std::atomic<size_t> next(0);
+        const size_t chunk = 64;
+        auto worker = [&]()
+        {
+            for (size_t begin = next.fetch_add(chunk); begin < count; begin = next.fetch_add(chunk))
+                for (size_t i = begin; i < std::min(begin + chunk, count); i++)
+                    work(i);
+        };
+
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> threads;
+        for (unsigned int t = 1; t < threadCount; t++)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    /*FNV-1a, continuing from 'hash'*/
+    static uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+private:
+    std::vector<BakeTriangle> triangles;
+    std::vector<unsigned int> occluders; // triangle index of every BVH triangle
+    std::vector<Bulbs> bulbs;
+    TriangleBVH bvh;
+    glm::vec3 minimum = glm::vec3(0.0f);
+    glm::vec3 maximum = glm::vec3(0.0f);
+    uint64_t hash = 0;
+};
+#endif
@@ -0,0 +1,400 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <glm/glm.hpp>
+
+#include "camera_script.h"
+#include "frame_packet.h"
+#include "json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*Warm-up frames of every case at least, until then the render status still describes the previous case*/
+const int BENCHMARK_MIN_WARMUP_FRAMES = FRAME_PACKETS + 2;
+
+/*Lights of a benchmark case, the values of the sliders of the debug bar*/
+struct LightingPreset
+{
+    glm::vec3 position;
+    glm::vec3 color;
+    float ambientIntensity;
+    float diffuseIntensity;
+    float specularIntensity;
+};
+
+/**
+ * How much a metric may grow over the baseline before it counts as a
+ * regression, as a fraction of the baseline value. Negative fractions leave
+ * the metric out of the comparison. Frame times within 'slackMilliseconds'
+ * of the baseline always pass, sub-millisecond passes jitter by more than
+ * any fraction.
+ */
+struct BenchmarkThresholds
+{
+    double mean = 0.10;
+    double p50 = 0.10;
+    double p95 = 0.15;
+    double p99 = 0.25;
+    double max = -1.0; // single frames, too noisy to compare by default
+    double drawCalls = 0.02;
+    double triangles = 0.02;
+    double slackMilliseconds = 0.05;
+};
+
+/*Values of one measurement over the measured frames of a case*/
+struct BenchmarkSeries
+{
+    std::vector<double> samples;
+
+    double Mean() const
+    {
+        double sum = 0.0;
+        for (double sample : samples)
+            sum += sample;
+        return samples.empty() ? 0.0 : sum / samples.size();
+    }
+
+    /*The 'percent' percentile, sorts a copy so only for the report*/
+    double Percentile(double percent) const
+    {
+        if (samples.empty())
+            return 0.0;
+        std::vector<double> sorted = samples;
+        size_t index = std::min(sorted.size() - 1, (size_t)(percent / 100.0 * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+        return sorted[index];
+    }
+
+    double Max() const
+    {
+        return samples.empty() ? 0.0 : *std::max_element(samples.begin(), samples.end());
+    }
+};
+
+/*One camera path under one lighting preset, and what its measured frames recorded*/
+struct BenchmarkCase
+{
+    std::string name;
+    CameraScript camera;
+    LightingPreset lighting;
+    int warmupFrames = 0;
+    int measuredFrames = 0;
+
+    /*Filled by the render thread, one sample per measured frame (the GPU time whenever a measurement came in)*/
+    BenchmarkSeries cpuMilliseconds;   // recording the frame on the render thread
+    BenchmarkSeries gpuMilliseconds;   // executing it, a few frames late (see GpuTimer)
+    BenchmarkSeries frameMilliseconds; // between the starts of consecutive frames
+    BenchmarkSeries drawCalls;
+    BenchmarkSeries triangles;
+};
+
+/*What the simulation stage renders next during a benchmark*/
+struct BenchmarkFrame
+{
+    int caseIndex = -1;
+    bool measured = false; // warm-up frames are rendered but not recorded
+    float pathPosition = 0.0f; // along the camera path of the case, the warm-up stays at its start
+};
+
+/**
+ * Scripted flythroughs measuring the render path, run headless (see
+ * HeadlessSettings) from a suite file:
+ *
+ *     {
+ *         "warmupFrames": 60, "measuredFrames": 300,
+ *         "thresholds": {"p95": 0.15, "drawCalls": 0.0},
+ *         "cases": [
+ *             {"name": "walk night", "camera": "house_walk.json", "lighting": {"ambient": 0, "diffuse": 0, "specular": 0}}
+ *         ]
+ *     }
+ *
+ * Camera paths are CameraScript files relative to the suite, the lighting
+ * preset ("position", "color", "ambient", "diffuse", "specular") defaults to
+ * the debug bar's initial values, and cases may override the frame counts.
+ *
+ * Each case warms up at the start of its path for its warm-up frames and
+ * until the bakes of its lights and the models around the start are loaded,
+ * then renders its measured frames along the path. The report lists the
+ * mean, percentiles and maximum of the CPU, GPU and whole frame times, and
+ * the draw calls and triangles per frame, as JSON a later run compares
+ * against.
+ */
+class Benchmark
+{
+public:
+    /*Reads the suite at 'path', returns false after reporting what is wrong with it*/
+    bool Load(const std::string &path, const LightingPreset &defaults)
+    {
+        cases.clear();
+
+        JsonValue document;
+        if (!JsonReader::ReadFile(path, document))
+            return false;
+
+        const JsonValue &limits = document["thresholds"];
+        thresholds.mean = limits["mean"].AsNumber(thresholds.mean);
+        thresholds.p50 = limits["p50"].AsNumber(thresholds.p50);
+        thresholds.p95 = limits["p95"].AsNumber(thresholds.p95);
+        thresholds.p99 = limits["p99"].AsNumber(thresholds.p99);
+        thresholds.max = limits["max"].AsNumber(thresholds.max);
+        thresholds.drawCalls = limits["drawCalls"].AsNumber(thresholds.drawCalls);
+        thresholds.triangles = limits["triangles"].AsNumber(thresholds.triangles);
+        thresholds.slackMilliseconds = limits["slackMilliseconds"].AsNumber(thresholds.slackMilliseconds);
+
+        int warmupFrames = (int)document["warmupFrames"].AsNumber(60.0);
+        int measuredFrames = (int)document["measuredFrames"].AsNumber(300.0);
+        std::filesystem::path directory = std::filesystem::path(path).parent_path();
+        for (const JsonValue &entry : document["cases"].array)
+        {
+            cases.emplace_back();
+            BenchmarkCase &benchmarkCase = cases.back();
+            benchmarkCase.name = entry["name"].AsString();
+            benchmarkCase.warmupFrames = std::max(BENCHMARK_MIN_WARMUP_FRAMES, (int)entry["warmupFrames"].AsNumber(warmupFrames));
+            benchmarkCase.measuredFrames = (int)entry["measuredFrames"].AsNumber(measuredFrames);
+            if (benchmarkCase.name.empty() || benchmarkCase.measuredFrames <= 0)
+            {
+                std::cout << "ERROR::BENCHMARK::INVALID_CASE " << cases.size() - 1 << " in " << path << std::endl;
+                return false;
+            }
+
+            std::string camera = entry["camera"].AsString();
+            if (camera.empty() || !benchmarkCase.camera.Load((directory / camera).lexically_normal().string()))
+            {
+                std::cout << "ERROR::BENCHMARK::NO_CAMERA_PATH " << benchmarkCase.name << std::endl;
+                return false;
+            }
+
+            const JsonValue &lighting = entry["lighting"];
+            benchmarkCase.lighting.position = vector3(lighting["position"], defaults.position);
+            benchmarkCase.lighting.color = vector3(lighting["color"], defaults.color);
+            benchmarkCase.lighting.ambientIntensity = (float)lighting["ambient"].AsNumber(defaults.ambientIntensity);
+            benchmarkCase.lighting.diffuseIntensity = (float)lighting["diffuse"].AsNumber(defaults.diffuseIntensity);
+            benchmarkCase.lighting.specularIntensity = (float)lighting["specular"].AsNumber(defaults.specularIntensity);
+
+            /*Recording a frame doesn't allocate*/
+            for (BenchmarkSeries *series : {&benchmarkCase.cpuMilliseconds, &benchmarkCase.gpuMilliseconds, &benchmarkCase.frameMilliseconds,
+                                            &benchmarkCase.drawCalls, &benchmarkCase.triangles})
+                series->samples.reserve(benchmarkCase.measuredFrames);
+        }
+        if (cases.empty())
+        {
+            std::cout << "ERROR::BENCHMARK::NO_CASES " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Chooses the next frame for the simulation stage from the latest render
+     * status, returns false once every case was measured
+     */
+    bool Next(const RenderStatus &status, BenchmarkFrame &frame)
+    {
+        while (current < cases.size())
+        {
+            const BenchmarkCase &benchmarkCase = cases[current];
+            frame.caseIndex = (int)current;
+
+            bool settling = status.lightmapBaking || status.irradianceBaking || status.loadingModels > 0;
+            if (!measuring && (warmedUp < benchmarkCase.warmupFrames || settling))
+            {
+                if (warmedUp++ == 0)
+                    std::cout << "BENCHMARK::" << benchmarkCase.name << " warming up" << std::endl;
+                frame.measured = false;
+                frame.pathPosition = 0.0f;
+                return true;
+            }
+
+            measuring = true;
+            if (measured < benchmarkCase.measuredFrames)
+            {
+                frame.measured = true;
+                frame.pathPosition = benchmarkCase.measuredFrames > 1 ? (float)measured / (benchmarkCase.measuredFrames - 1) : 0.0f;
+                measured++;
+                return true;
+            }
+
+            current++;
+            measuring = false;
+            warmedUp = 0;
+            measured = 0;
+        }
+        return false;
+    }
+
+    const BenchmarkCase &Case(int index) const { return cases[index]; }
+
+    /**
+     * Records a measured frame of case 'index', called by the render thread
+     * once the frame was recorded. The simulation stage only reads the
+     * settings of the cases, never the series
+     */
+    void Record(int index, double cpuMilliseconds, double frameMilliseconds, const RenderStatus &status)
+    {
+        BenchmarkCase &benchmarkCase = cases[index];
+        benchmarkCase.cpuMilliseconds.samples.push_back(cpuMilliseconds);
+        if (status.gpuMeasured)
+            benchmarkCase.gpuMilliseconds.samples.push_back(status.gpuMilliseconds);
+        benchmarkCase.frameMilliseconds.samples.push_back(frameMilliseconds);
+        benchmarkCase.drawCalls.samples.push_back(status.drawCalls);
+        benchmarkCase.triangles.samples.push_back((double)status.triangles);
+    }
+
+    /*One line per case for the build logs*/
+    void Print() const
+    {
+        for (const BenchmarkCase &benchmarkCase : cases)
+        {
+            printf("BENCHMARK::%s %d frames, CPU p50 %.2f p95 %.2f ms, GPU p50 %.2f p95 %.2f ms, frame p50 %.2f p95 %.2f ms, "
+                   "%.0f draw calls, %.0f triangles per frame\n",
+                   benchmarkCase.name.c_str(), benchmarkCase.measuredFrames,
+                   benchmarkCase.cpuMilliseconds.Percentile(50.0), benchmarkCase.cpuMilliseconds.Percentile(95.0),
+                   benchmarkCase.gpuMilliseconds.Percentile(50.0), benchmarkCase.gpuMilliseconds.Percentile(95.0),
+                   benchmarkCase.frameMilliseconds.Percentile(50.0), benchmarkCase.frameMilliseconds.Percentile(95.0),
+                   benchmarkCase.drawCalls.Mean(), benchmarkCase.triangles.Mean());
+        }
+        fflush(stdout);
+    }
+
+    /*Writes the report to 'path', 'renderer' names the GPU and driver the frames were measured on*/
+    bool WriteReport(const std::string &path, const std::string &renderer, int width, int height) const
+    {
+        std::ofstream file(path);
+        file << "{\n    \"renderer\": \"" << escape(renderer) << "\",\n";
+        file << "    \"size\": [" << width << ", " << height << "],\n";
+        file << "    \"cases\": {";
+        for (size_t i = 0; i < cases.size(); i++)
+        {
+            const BenchmarkCase &benchmarkCase = cases[i];
+            file << (i > 0 ? "," : "") << "\n        \"" << escape(benchmarkCase.name) << "\": {\n";
+            file << "            \"frames\": " << benchmarkCase.measuredFrames << ",\n";
+            writeSeries(file, "cpuMilliseconds", benchmarkCase.cpuMilliseconds, true);
+            writeSeries(file, "gpuMilliseconds", benchmarkCase.gpuMilliseconds, true);
+            writeSeries(file, "frameMilliseconds", benchmarkCase.frameMilliseconds, true);
+            writeSeries(file, "drawCalls", benchmarkCase.drawCalls, true);
+            writeSeries(file, "triangles", benchmarkCase.triangles, false);
+            file << "        }";
+        }
+        file << "\n    }\n}\n";
+
+        if (!file)
+        {
+            std::cout << "ERROR::BENCHMARK::REPORT_NOT_WRITTEN " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Compares the measured cases with the report at 'path', printing every
+     * metric beyond its threshold. Returns the number of regressions, or -1
+     * when the baseline can't be read. Cases the baseline doesn't have are
+     * reported and skipped
+     */
+    int Compare(const std::string &path, const std::string &renderer) const
+    {
+        JsonValue baseline;
+        if (!JsonReader::ReadFile(path, baseline))
+            return -1;
+        if (baseline["renderer"].AsString() != renderer)
+            std::cout << "BENCHMARK::BASELINE_RENDERER_DIFFERS " << baseline["renderer"].AsString() << std::endl;
+
+        int regressions = 0;
+        for (const BenchmarkCase &benchmarkCase : cases)
+        {
+            const JsonValue &reference = baseline["cases"][benchmarkCase.name];
+            if (!reference.IsObject())
+            {
+                std::cout << "BENCHMARK::NOT_IN_BASELINE " << benchmarkCase.name << std::endl;
+                continue;
+            }
+
+            const std::pair<const char *, const BenchmarkSeries *> timings[] = {{"cpuMilliseconds", &benchmarkCase.cpuMilliseconds},
+                                                                                {"gpuMilliseconds", &benchmarkCase.gpuMilliseconds},
+                                                                                {"frameMilliseconds", &benchmarkCase.frameMilliseconds}};
+            for (const auto &timing : timings)
+            {
+                const char *times = timing.first;
+                const BenchmarkSeries &series = *timing.second;
+                const JsonValue &values = reference[times];
+                regressions += check(benchmarkCase.name, times, "mean", series.Mean(), values["mean"], thresholds.mean, thresholds.slackMilliseconds);
+                regressions += check(benchmarkCase.name, times, "p50", series.Percentile(50.0), values["p50"], thresholds.p50, thresholds.slackMilliseconds);
+                regressions += check(benchmarkCase.name, times, "p95", series.Percentile(95.0), values["p95"], thresholds.p95, thresholds.slackMilliseconds);
+                regressions += check(benchmarkCase.name, times, "p99", series.Percentile(99.0), values["p99"], thresholds.p99, thresholds.slackMilliseconds);
+                regressions += check(benchmarkCase.name, times, "max", series.Max(), values["max"], thresholds.max, thresholds.slackMilliseconds);
+            }
+            regressions += check(benchmarkCase.name, "drawCalls", "mean", benchmarkCase.drawCalls.Mean(), reference["drawCalls"]["mean"], thresholds.drawCalls, 0.0);
+            regressions += check(benchmarkCase.name, "triangles", "mean", benchmarkCase.triangles.Mean(), reference["triangles"]["mean"], thresholds.triangles, 0.0);
+        }
+
+        if (regressions == 0)
+            std::cout << "BENCHMARK::NO_REGRESSIONS against " << path << std::endl;
+        else
+            std::cout << "BENCHMARK::REGRESSIONS " << regressions << " against " << path << std::endl;
+        return regressions;
+    }
+
+private:
+    std::vector<BenchmarkCase> cases;
+    BenchmarkThresholds thresholds;
+
+    /*Progress of the simulation stage through the cases*/
+    size_t current = 0;
+    bool measuring = false;
+    int warmedUp = 0;
+    int measured = 0;
+
+    /*1 when 'value' grew beyond 'threshold' over the baseline 'reference', after printing it*/
+    static int check(const std::string &name, const char *metric, const char *statistic, double value, const JsonValue &reference,
+                     double threshold, double slack)
+    {
+        if (threshold < 0.0 || !reference.IsNumber())
+            return 0;
+        double limit = reference.AsNumber() * (1.0 + threshold) + slack;
+        if (value <= limit)
+            return 0;
+
+        double growth = reference.AsNumber() > 0.0 ? (value / reference.AsNumber() - 1.0) * 100.0 : INFINITY;
+        printf("BENCHMARK::REGRESSION %s %s.%s %.3f -> %.3f (+%.1f%%, allowed %.1f%%)\n", name.c_str(), metric, statistic,
+               reference.AsNumber(), value, growth, threshold * 100.0);
+        fflush(stdout);
+        return 1;
+    }
+
+    static void writeSeries(std::ofstream &file, const char *name, const BenchmarkSeries &series, bool more)
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "            \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+                 name, series.Mean(), series.Percentile(50.0), series.Percentile(95.0), series.Percentile(99.0), series.Max(), more ? "," : "");
+        file << line;
+    }
+
+    static std::string escape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if ((unsigned char)c >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+
+    static glm::vec3 vector3(const JsonValue &value, glm::vec3 fallback)
+    {
+        if (!value.IsArray())
+            return fallback;
+        return glm::vec3((float)value[0].AsNumber(fallback.x), (float)value[1].AsNumber(fallback.y), (float)value[2].AsNumber(fallback.z));
+    }
+};
+#endif
@@ -0,0 +1,211 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+/**
+ * Bounding volume hierarchy over a static triangle soup, used for CPU ray casts
+ * (lightmap baking). Nodes are split at the median centroid along their longest
+ * axis, which builds fast and is good enough for architectural geometry.
+ *
+ * The hierarchy is read only once built, so any number of threads can trace
+ * rays through it at the same time.
+ */
+class TriangleBVH
+{
+public:
+    /*Closest intersection found by Intersect()*/
+    struct Hit
+    {
+        unsigned int triangle;
+        float distance;
+        float u, v; // barycentric coordinates of the hit relative to the 2nd and 3rd vertex
+    };
+
+    /*Builds the hierarchy, 'positions' holds three vertices per triangle*/
+    void Build(const std::vector<glm::vec3> &positions)
+    {
+        size_t count = positions.size() / 3;
+        vertices = positions;
+        order.resize(count);
+        centroids.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            order[i] = (unsigned int)i;
+            centroids[i] = (positions[i * 3] + positions[i * 3 + 1] + positions[i * 3 + 2]) / 3.0f;
+        }
+
+        nodes.clear();
+        nodes.reserve(count * 2 + 1);
+        nodes.push_back(Node());
+        if (count > 0)
+            split(0, 0, (unsigned int)count);
+
+        centroids.clear();
+        centroids.shrink_to_fit();
+    }
+
+    /*True when anything is hit closer than 'maxDistance', for shadow rays*/
+    bool Occluded(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) const
+    {
+        Hit hit;
+        return traverse(origin, direction, maxDistance, true, hit);
+    }
+
+    /*Finds the closest hit closer than 'maxDistance'*/
+    bool Intersect(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, Hit &hit) const
+    {
+        return traverse(origin, direction, maxDistance, false, hit);
+    }
+
+private:
+    /*Inner nodes keep their children at 'first' and 'first + 1', leaves 'count' triangles from 'first' in 'order'*/
+    struct Node
+    {
+        glm::vec3 minimum;
+        glm::vec3 maximum;
+        unsigned int first = 0;
+        unsigned int count = 0;
+    };
+
+    static const unsigned int LEAF_SIZE = 4;
+
+    std::vector<glm::vec3> vertices;
+    std::vector<unsigned int> order;
+    std::vector<glm::vec3> centroids;
+    std::vector<Node> nodes;
+
+    void split(size_t nodeIndex, unsigned int begin, unsigned int end)
+    {
+        glm::vec3 minimum(std::numeric_limits<float>::max());
+        glm::vec3 maximum(-std::numeric_limits<float>::max());
+        glm::vec3 centroidMin = minimum, centroidMax = maximum;
+        for (unsigned int i = begin; i < end; i++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                minimum = glm::min(minimum, vertices[order[i] * 3 + k]);
+                maximum = glm::max(maximum, vertices[order[i] * 3 + k]);
+            }
+            centroidMin = glm::min(centroidMin, centroids[order[i]]);
+            centroidMax = glm::max(centroidMax, centroids[order[i]]);
+        }
+        nodes[nodeIndex].minimum = minimum;
+        nodes[nodeIndex].maximum = maximum;
+
+        glm::vec3 extent = centroidMax - centroidMin;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        if (end - begin <= LEAF_SIZE || extent[axis] <= 0.0f)
+        {
+            nodes[nodeIndex].first = begin;
+            nodes[nodeIndex].count = end - begin;
+            return;
+        }
+
+        unsigned int middle = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                         [this, axis](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+        unsigned int children = (unsigned int)nodes.size();
+        nodes[nodeIndex].first = children;
+        nodes[nodeIndex].count = 0;
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        split(children, begin, middle);
+        split(children + 1, middle, end);
+    }
+
+    static bool hitsBox(const Node &node, const glm::vec3 &origin, const glm::vec3 &inverse, float maxDistance)
+    {
+        float near = 0.0f, far = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (node.minimum[axis] - origin[axis]) * inverse[axis];
+            float t1 = (node.maximum[axis] - origin[axis]) * inverse[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            near = std::max(near, t0);
+            far = std::min(far, t1);
+            if (near > far)
+                return false;
+        }
+        return true;
+    }
+
+    /*Möller-Trumbore intersection, two sided*/
+    bool hitsTriangle(unsigned int triangle, const glm::vec3 &origin, const glm::vec3 &direction, float &distance, float &u, float &v) const
+    {
+        const glm::vec3 &v0 = vertices[triangle * 3];
+        glm::vec3 edge1 = vertices[triangle * 3 + 1] - v0;
+        glm::vec3 edge2 = vertices[triangle * 3 + 2] - v0;
+
+        glm::vec3 p = glm::cross(direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (fabs(determinant) < 1e-9f)
+            return false;
+
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - v0;
+        u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        glm::vec3 q = glm::cross(s, edge1);
+        v = glm::dot(direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        distance = glm::dot(edge2, q) * inverse;
+        return distance > 0.0f;
+    }
+
+    bool traverse(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, bool anyHit, Hit &hit) const
+    {
+        if (order.empty())
+            return false;
+
+        glm::vec3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        bool found = false;
+        hit.distance = maxDistance;
+
+        unsigned int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node &node = nodes[stack[--top]];
+            if (!hitsBox(node, origin, inverse, hit.distance))
+                continue;
+
+            if (node.count > 0)
+            {
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                {
+                    float distance, u, v;
+                    if (hitsTriangle(order[i], origin, direction, distance, u, v) && distance < hit.distance)
+                    {
+                        hit.triangle = order[i];
+                        hit.distance = distance;
+                        hit.u = u;
+                        hit.v = v;
+                        found = true;
+                        if (anyHit)
+                            return true;
+                    }
+                }
+            }
+            else if (top + 2 <= 64)
+            {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+        return found;
+    }
+};
+#endif
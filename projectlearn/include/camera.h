@@ -33,6 +33,7 @@ const float SPEED = 7.5f;
 const float SENSITIVITY = 0.05f; // Mouse sensitivity
 const float ZOOM = 45.0f;		 // Initial FOV(Field of View)
 const float EULERFACTOR = 30.f;	 // Factor for converting mouse movement
+const float FAR_PLANE = 1000.0f; // Far plane of the views of the scene, deep enough for the impostors of a large scene to show
 
 class Camera
 {
@@ -147,6 +148,15 @@ public:
 		updateCameraVectors();
 	}
 
+	/*Moves the camera to 'position', looking along 'yaw' and 'pitch' in degrees*/
+	void Place(glm::vec3 position, float yaw, float pitch)
+	{
+		Position = position;
+		Yaw = yaw;
+		Pitch = pitch;
+		updateCameraVectors();
+	}
+
 	/*Updated the camera's zoom level based on the mouse scroll wheel movement*/
 	void ProcessMouseScroll(float yoffset)
 	{
@@ -0,0 +1,95 @@
+#ifndef CAMERA_SCRIPT_H
+#define CAMERA_SCRIPT_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "camera.h"
+#include "json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*A pose the scripted camera passes through*/
+struct CameraKey
+{
+    glm::vec3 position;
+    float yaw = -90.0f;  // degrees, as in Camera
+    float pitch = 0.0f;
+};
+
+/**
+ * Camera path of the headless runs, so every run renders the same frames.
+ *
+ * Read from a JSON file of evenly spaced keys,
+ *     {"keys": [{"position": [0, 5, -40], "yaw": 90, "pitch": -5}, ...]}
+ * and interpolated linearly over the run. Without a file the camera circles
+ * the origin once, at the distance and height it starts from.
+ */
+class CameraScript
+{
+public:
+    /*Reads the keys from 'path', returns false after reporting what is wrong with the file*/
+    bool Load(const std::string &path)
+    {
+        keys.clear();
+
+        JsonValue document;
+        if (!JsonReader::ReadFile(path, document))
+            return false;
+        for (const JsonValue &entry : document["keys"].array)
+        {
+            const JsonValue &position = entry["position"];
+            CameraKey key;
+            key.position = glm::vec3((float)position[0].AsNumber(), (float)position[1].AsNumber(), (float)position[2].AsNumber());
+            key.yaw = (float)entry["yaw"].AsNumber(key.yaw);
+            key.pitch = (float)entry["pitch"].AsNumber(key.pitch);
+            keys.push_back(key);
+        }
+        if (keys.empty())
+        {
+            std::cout << "ERROR::CAMERA_SCRIPT::NO_KEYS " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /*Circles the origin from 'start', looking at it, in 'steps' keys*/
+    void Orbit(const glm::vec3 &start, int steps = 16)
+    {
+        keys.clear();
+        float radius = glm::length(glm::vec2(start.x, start.z));
+        float startAngle = atan2(start.z, start.x);
+        for (int i = 0; i <= steps; i++)
+        {
+            float angle = startAngle + 2.0f * glm::pi<float>() * i / steps;
+            CameraKey key;
+            key.position = glm::vec3(cos(angle) * radius, start.y, sin(angle) * radius);
+            key.yaw = glm::degrees(angle) + 180.0f;
+            key.pitch = 0.0f;
+            keys.push_back(key);
+        }
+    }
+
+    /*Places 'camera' at 't' along the path, from 0 at the first key to 1 at the last*/
+    void Apply(Camera &camera, float t) const
+    {
+        if (keys.empty())
+            return;
+
+        float position = std::min(std::max(t, 0.0f), 1.0f) * (keys.size() - 1);
+        size_t index = std::min((size_t)position, keys.size() - 1);
+        size_t next = std::min(index + 1, keys.size() - 1);
+        float blend = position - index;
+
+        const CameraKey &a = keys[index], &b = keys[next];
+        camera.Place(glm::mix(a.position, b.position, blend), a.yaw + (b.yaw - a.yaw) * blend, a.pitch + (b.pitch - a.pitch) * blend);
+    }
+
+private:
+    std::vector<CameraKey> keys;
+};
+#endif
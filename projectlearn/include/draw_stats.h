@@ -0,0 +1,47 @@
+#ifndef DRAW_STATS_H
+#define DRAW_STATS_H
+
+#include <cstddef>
+
+/**
+ * Draw calls and triangles submitted since the last Reset(), for the debug
+ * interface and the benchmark reports. Every draw of the renderer goes
+ * through Count(), the triangles are the ones submitted, before any culling
+ * the GPU does.
+ *
+ * Only the thread the OpenGL context is current on draws, so the counts are
+ * plain integers.
+ */
+class DrawStats
+{
+public:
+    /*Access to the counters shared by every draw*/
+    static DrawStats &Instance()
+    {
+        static DrawStats stats;
+        return stats;
+    }
+
+    /*Counts one draw of 'triangles' triangles for each of 'instances' instances*/
+    void Count(size_t triangles, size_t instances = 1)
+    {
+        drawCalls++;
+        this->triangles += triangles * instances;
+    }
+
+    void Reset()
+    {
+        drawCalls = 0;
+        triangles = 0;
+    }
+
+    int DrawCalls() const { return drawCalls; }
+    size_t Triangles() const { return triangles; }
+
+private:
+    DrawStats() = default;
+
+    int drawCalls = 0;
+    size_t triangles = 0;
+};
+#endif
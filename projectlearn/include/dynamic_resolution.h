@@ -0,0 +1,209 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include "draw_stats.h"
+#include "resource_manager.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+
+/*Queries in flight, a result is read this many frames after it was issued so reading it never waits*/
+const int GPU_TIMER_QUERIES = 4;
+
+/*Lowest fraction of the window's width and height the scene is rendered at*/
+const float MIN_RENDER_SCALE = 0.5f;
+
+/**
+ * Measures the GPU time between Begin() and End() with GL_TIME_ELAPSED
+ * queries. The result of a frame is only read once the GPU has finished it,
+ * a few frames later, so the measurement never stalls the pipeline.
+ */
+class GpuTimer
+{
+public:
+    GpuTimer()
+    {
+        glGenQueries(GPU_TIMER_QUERIES, queries);
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(GPU_TIMER_QUERIES, queries);
+    }
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    void Begin()
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    /**
+     * Ends the measurement and collects the oldest one that is available.
+     * Returns true when 'milliseconds' was set.
+     */
+    bool End(double &milliseconds)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[next] = true;
+        next = (next + 1) % GPU_TIMER_QUERIES;
+
+        /*The slot used next is the oldest one*/
+        if (!issued[next])
+            return false;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[next], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[next], GL_QUERY_RESULT, &nanoseconds);
+        issued[next] = false;
+        milliseconds = nanoseconds / 1000000.0;
+        return true;
+    }
+
+private:
+    GLuint queries[GPU_TIMER_QUERIES];
+    bool issued[GPU_TIMER_QUERIES] = {};
+    int next = 0;
+};
+
+/*What the simulation stage asks of the dynamic resolution, see FramePacket*/
+struct ResolutionSettings
+{
+    bool enabled = false;
+    float targetMilliseconds = 16.0f; // GPU time per frame to hold
+    float sharpness = 0.25f;          // strength of the sharpening applied while upscaling, 0 for plain bilinear
+};
+
+/**
+ * Renders the scene at a fraction of the window's resolution chosen to hold
+ * a GPU frame time target, and upscales it to the window.
+ *
+ * The scene goes into an offscreen target of the window's size, a transient
+ * target of the render graph, of which only the scaled viewport is used:
+ * changing the scale never reallocates.
+ * The scale follows the measured GPU time of whole frames, assuming their
+ * cost grows with the pixel count, in damped steps so it settles instead of
+ * chasing the latency of the measurement.
+ *
+ * While disabled the scene is rendered into the window directly, only the
+ * GPU time is measured.
+ */
+class DynamicResolution
+{
+public:
+    /*'upscaleShader' draws the scaled scene over the window, see upscale.fs*/
+    DynamicResolution(Shader &upscaleShader) : upscaleShader(upscaleShader)
+    {
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        emptyVertexArray = ResourceManager::Instance().Adopt<ResourceType::VertexArray>(0, vao);
+    }
+
+    /*Starts measuring the GPU time of a frame drawn into a window of 'width' by 'height' pixels*/
+    void BeginFrame(const ResolutionSettings &frameSettings, int width, int height)
+    {
+        settings = frameSettings;
+        if (!settings.enabled)
+            scale = 1.0f;
+        windowWidth = width;
+        windowHeight = height;
+        timer.Begin();
+    }
+
+    /**
+     * Stops measuring the frame, adapting the scale to the latest measurement
+     * that is available. Returns true when a new one came in
+     */
+    bool EndFrame()
+    {
+        double milliseconds;
+        if (!timer.End(milliseconds))
+            return false;
+
+        gpuMilliseconds = milliseconds;
+        if (settings.enabled && milliseconds > 0.0)
+            adjust(milliseconds);
+        return true;
+    }
+
+    /*True when the scene of this frame goes into an offscreen target of the window's size and is upscaled*/
+    bool Offscreen() const
+    {
+        return settings.enabled && windowWidth > 0 && windowHeight > 0;
+    }
+
+    /**
+     * Draws the scene rendered into the scaled viewport of 'sceneColor', a
+     * texture of the window's size, over the bound framebuffer
+     */
+    void Upscale(GLuint sceneColor)
+    {
+        glDisable(GL_DEPTH_TEST);
+
+        upscaleShader.use();
+        upscaleShader.setVec2("sourceSize", (float)ScaledWidth(), (float)ScaledHeight());
+        upscaleShader.setVec2("targetSize", (float)windowWidth, (float)windowHeight);
+        upscaleShader.setFloat("sharpness", settings.sharpness);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sceneColor);
+
+        /*One triangle covering the window, its corners are generated from gl_VertexID*/
+        glBindVertexArray(emptyVertexArray.Get());
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        DrawStats::Instance().Count(1);
+
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    /*Fraction of the window's width and height the scene is rendered at*/
+    float Scale() const { return scale; }
+    int ScaledWidth() const { return std::max(1, (int)std::lround(windowWidth * scale)); }
+    int ScaledHeight() const { return std::max(1, (int)std::lround(windowHeight * scale)); }
+
+    /*GPU time of the latest frame measured*/
+    double GpuMilliseconds() const { return gpuMilliseconds; }
+
+    /*Points the scene sampler of the upscale shader at texture unit 0*/
+    static void ConfigureShader(const Shader &shader)
+    {
+        shader.use();
+        shader.setInt("sceneColor", 0);
+    }
+
+private:
+    Shader &upscaleShader;
+    ResolutionSettings settings;
+    GpuTimer timer;
+
+    float scale = 1.0f;
+    double gpuMilliseconds = 0.0;
+    int windowWidth = 0, windowHeight = 0;
+    VertexArrayHandle emptyVertexArray;
+
+    /**
+     * Moves the scale towards the one that would have met the target: the
+     * cost follows the pixel count, the square of the scale. Only half the
+     * way per measurement, by at most a tenth, and not at all within 3% of the
+     * target, the measurements lag a few frames behind the scale.
+     */
+    void adjust(double milliseconds)
+    {
+        double ratio = settings.targetMilliseconds / milliseconds;
+        if (fabs(ratio - 1.0) < 0.03)
+            return;
+
+        float wanted = scale * (float)sqrt(ratio);
+        float step = std::max(-0.1f, std::min(0.1f, (wanted - scale) * 0.5f));
+        scale = std::max(MIN_RENDER_SCALE, std::min(1.0f, scale + step));
+    }
+};
+#endif
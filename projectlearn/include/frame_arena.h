@@ -0,0 +1,250 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+/*Bytes a thread's arena starts with, it grows to the largest frame seen*/
+const size_t FRAME_ARENA_INITIAL_SIZE = 64 * 1024;
+
+/**
+ * Linear allocator for memory that only lives during one frame.
+ *
+ * Allocating bumps an offset into one block and freeing does nothing: the
+ * whole frame is released at once by Reset() at the frame boundary. Every
+ * thread has its own arena (Current()), so the simulation and the render
+ * stages reset theirs independently. A frame that doesn't fit continues in
+ * overflow blocks, and the next Reset() grows the block to the whole frame,
+ * so steady frames never touch the heap.
+ *
+ * Nothing allocated from the arena may be kept past the end of the frame.
+ */
+class FrameArena
+{
+public:
+    /*Arena of the calling thread*/
+    static FrameArena &Current()
+    {
+        static thread_local FrameArena arena;
+        return arena;
+    }
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    ~FrameArena()
+    {
+        releaseOverflow();
+        std::free(block);
+    }
+
+    void *Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        size_t offset = (used + alignment - 1) & ~(alignment - 1);
+        if (offset + bytes <= capacity)
+        {
+            used = offset + bytes;
+            return block + offset;
+        }
+        return allocateOverflow(bytes, alignment);
+    }
+
+    /*Releases everything allocated since the last call, at the frame boundary of the calling thread*/
+    void Reset()
+    {
+        if (!overflow.empty())
+        {
+            size_t needed = used + overflowBytes;
+            releaseOverflow();
+
+            std::free(block);
+            capacity = std::max(capacity * 2, needed);
+            block = (char *)std::malloc(capacity);
+        }
+        used = 0;
+    }
+
+    /*Bytes handed out since the last Reset()*/
+    size_t Used() const
+    {
+        return used + overflowBytes;
+    }
+
+    size_t Capacity() const
+    {
+        return capacity;
+    }
+
+private:
+    char *block;
+    size_t capacity = FRAME_ARENA_INITIAL_SIZE;
+    size_t used = 0;
+
+    /*Blocks of the frame that didn't fit, freed at the next Reset()*/
+    std::vector<void *> overflow;
+    size_t overflowBytes = 0;
+
+    FrameArena()
+    {
+        block = (char *)std::malloc(capacity);
+    }
+
+    void *allocateOverflow(size_t bytes, size_t alignment)
+    {
+        char *memory = (char *)std::malloc(bytes + alignment);
+        overflow.push_back(memory);
+        overflowBytes += bytes + alignment;
+
+        size_t address = ((size_t)memory + alignment - 1) & ~(alignment - 1);
+        return (void *)address;
+    }
+
+    void releaseOverflow()
+    {
+        for (void *memory : overflow)
+            std::free(memory);
+        overflow.clear();
+        overflowBytes = 0;
+    }
+};
+
+/**
+ * STL allocator on a FrameArena, the calling thread's arena by default.
+ * Deallocation is a no-op, the memory comes back with the arena's Reset().
+ */
+template <typename T>
+class FrameAllocator
+{
+public:
+    typedef T value_type;
+
+    FrameAllocator() : arena(&FrameArena::Current()) {}
+    explicit FrameAllocator(FrameArena &arena) : arena(&arena) {}
+
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count)
+    {
+        return (T *)arena->Allocate(count * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U> &other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U> &other) const { return arena != other.arena; }
+
+private:
+    template <typename U>
+    friend class FrameAllocator;
+
+    FrameArena *arena;
+};
+
+/*Containers for per-frame scratch data*/
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+/*Frames a stage runs before its allocations are checked, while pools, caches and arenas warm up*/
+const int FRAME_ALLOCATION_WARMUP = 120;
+
+/**
+ * Debug check that steady frames don't use the general heap, enabled by
+ * defining FRAME_ALLOCATION_CHECK (done for Debug builds).
+ *
+ * The global operator new and ImGui's allocator count the allocations of
+ * every thread. A stage opens a scope at the start of its frame and calls
+ * Check() at the end; past the warmup, a frame the stage calls steady (no
+ * loading, baking or streaming going on) must not have allocated at all.
+ */
+class FrameAllocationScope
+{
+public:
+    explicit FrameAllocationScope(const char *stage) : stage(stage), start(Count()) {}
+
+    void Check(bool steady)
+    {
+#ifdef FRAME_ALLOCATION_CHECK
+        static thread_local int frames = 0;
+        size_t allocations = Count() - start;
+        if (++frames > FRAME_ALLOCATION_WARMUP && steady && allocations != 0)
+        {
+            std::cout << "ERROR::FRAME_ARENA::HEAP_ALLOCATIONS " << allocations << " in a steady " << stage << " frame" << std::endl;
+            assert(allocations == 0);
+        }
+#else
+        (void)steady;
+#endif
+    }
+
+    /*Heap allocations made by the calling thread so far, only counted with FRAME_ALLOCATION_CHECK*/
+    static size_t &Count()
+    {
+        static thread_local size_t count = 0;
+        return count;
+    }
+
+    /*Counting allocator functions for ImGui::SetAllocatorFunctions()*/
+    static void *CountedAlloc(size_t size, void *)
+    {
+        Count()++;
+        return std::malloc(size);
+    }
+
+    static void CountedFree(void *memory, void *)
+    {
+        std::free(memory);
+    }
+
+private:
+    const char *stage;
+    size_t start;
+};
+
+/**
+ * Counting replacement of the global allocation functions. It has to be
+ * compiled into one translation unit only, the one defining
+ * FRAME_ARENA_IMPLEMENTATION before including this header.
+ */
+#if defined(FRAME_ALLOCATION_CHECK) && defined(FRAME_ARENA_IMPLEMENTATION)
+void *operator new(size_t size)
+{
+    FrameAllocationScope::Count()++;
+    if (void *memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
+#endif
+#endif
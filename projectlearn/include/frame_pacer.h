@@ -0,0 +1,132 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <thread>
+
+/*Frame times kept for the percentiles, a few seconds worth*/
+const int FRAME_TIME_SAMPLES = 240;
+
+/*Frames drawn after the last change before idling, ImGui shows some changes only a frame later*/
+const int FRAMES_AFTER_CHANGE = 3;
+
+/*The last stretch before a deadline is spun through, sleeping isn't that precise*/
+const std::chrono::microseconds PACING_SPIN_MARGIN(1500);
+
+/*How the application loop paces itself, set from the debug interface*/
+struct PacingSettings
+{
+    bool renderOnDemand = false; // only draw frames while something changes
+    int frameCap = 0;            // frames per second at most, 0 for no cap
+    double idleTimeout = 0.5;    // seconds an idle loop waits for events before drawing a frame anyway
+};
+
+/**
+ * Frame times of the last FRAME_TIME_SAMPLES frames drawn back to back, the
+ * intervals that include an idle wait are left out since they say nothing
+ * about the pacing.
+ */
+class FrameTimes
+{
+public:
+    void Add(double milliseconds)
+    {
+        samples[next] = milliseconds;
+        next = (next + 1) % FRAME_TIME_SAMPLES;
+        count = std::min(count + 1, FRAME_TIME_SAMPLES);
+    }
+
+    /*The 'percent' percentile of the recorded frame times, 0 when there are none*/
+    double Percentile(double percent) const
+    {
+        if (count == 0)
+            return 0.0;
+
+        std::copy(samples.begin(), samples.begin() + count, sorted.begin());
+        int index = std::min(count - 1, (int)(percent / 100.0 * count));
+        std::nth_element(sorted.begin(), sorted.begin() + index, sorted.begin() + count);
+        return sorted[index];
+    }
+
+    int Count() const { return count; }
+
+private:
+    std::array<double, FRAME_TIME_SAMPLES> samples = {};
+    mutable std::array<double, FRAME_TIME_SAMPLES> sorted = {};
+    int next = 0;
+    int count = 0;
+};
+
+/**
+ * Decides whether the application loop draws the next frame right away or
+ * waits for events, and holds the frame rate below the cap.
+ *
+ * In render-on-demand mode the loop goes idle once FRAMES_AFTER_CHANGE
+ * frames were drawn without a change. The cap is held by sleeping until the
+ * deadline of the next frame, the deadlines advance by whole periods so
+ * the rate doesn't drift with the oversleep of single frames.
+ */
+class FramePacer
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /*Reports whether the frame just prepared differed from the previous one*/
+    void FrameChanged(bool changed)
+    {
+        if (changed)
+            quietFrames = 0;
+        else if (quietFrames < FRAMES_AFTER_CHANGE)
+            quietFrames++;
+    }
+
+    /*True when the loop should wait for events instead of drawing the next frame*/
+    bool Idle(const PacingSettings &settings) const
+    {
+        return settings.renderOnDemand && quietFrames >= FRAMES_AFTER_CHANGE;
+    }
+
+    /**
+     * Sleeps until the next frame may start under the cap, then records the
+     * time since the previous frame started. 'waited' tells that the loop
+     * was idle in between, that frame time is not recorded.
+     */
+    void Pace(const PacingSettings &settings, bool waited)
+    {
+        Clock::time_point now = Clock::now();
+        if (settings.frameCap > 0)
+        {
+            Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / settings.frameCap));
+
+            /*Starting over from now after an idle wait or a frame that took longer than a whole period*/
+            deadline += period;
+            if (waited || deadline < now)
+                deadline = now;
+
+            if (deadline - now > PACING_SPIN_MARGIN)
+                std::this_thread::sleep_for(deadline - now - PACING_SPIN_MARGIN);
+            while (Clock::now() < deadline)
+                std::this_thread::yield();
+            now = Clock::now();
+        }
+        else
+            deadline = now;
+
+        if (started && !waited)
+            times.Add(std::chrono::duration<double, std::milli>(now - frameStart).count());
+        frameStart = now;
+        started = true;
+    }
+
+    const FrameTimes &Times() const { return times; }
+
+private:
+    int quietFrames = 0;
+    bool started = false;
+    Clock::time_point frameStart;
+    Clock::time_point deadline;
+    FrameTimes times;
+};
+#endif
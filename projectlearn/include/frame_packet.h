@@ -0,0 +1,237 @@
+#ifndef FRAME_PACKET_H
+#define FRAME_PACKET_H
+
+#include <glm/glm.hpp>
+
+#include "dynamic_resolution.h"
+#include "imgui.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+/*Packets in flight: the simulation prepares frame N+1 while the render thread submits frame N*/
+const int FRAME_PACKETS = 2;
+
+/**
+ * Everything the render stage needs to draw one frame, filled by the
+ * simulation stage. Render state that lives on the GPU (bakes, texture
+ * residency, shadow caches) stays with the render thread.
+ */
+struct FramePacket
+{
+    /*Viewport and camera*/
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPos;
+    float screenScale = 0.0f; // pixels covered by one unit at distance one, at the window's resolution
+    ResolutionSettings resolution;
+    int captureIndex = -1; // headless frame written to the output directory after rendering, none when negative
+    int benchmarkCase = -1; // benchmark case this frame is a measured frame of, none when negative
+
+    /*Sun*/
+    glm::vec3 lightPos;
+    glm::vec3 lightDir;
+    glm::vec3 lightColor;
+    glm::vec3 ambientColor;
+    glm::vec3 diffuseColor;
+    glm::vec3 specularColor;
+    bool night = false;
+
+    /*World and normal matrices of the scene graph node the character is drawn at, static models are placed in their instances*/
+    glm::mat4 animationTransform;
+    glm::mat3 animationNormal;
+
+    /*Animated character*/
+    std::vector<glm::mat4> boneMatrices;
+    glm::vec3 characterCenter;
+    float characterRadius = 0.0f;
+
+    /*Debug interface, a copy of the draw lists ImGui built during the simulation stage*/
+    ImDrawData drawData;
+    bool hasDrawData = false;
+
+    FramePacket() = default;
+    FramePacket(const FramePacket &) = delete;
+    FramePacket &operator=(const FramePacket &) = delete;
+
+    ~FramePacket()
+    {
+        for (int i = 0; i < drawLists.Size; i++)
+            IM_DELETE(drawLists[i]);
+    }
+
+    /**
+     * Copies the draw data, ImGui reuses its own lists as soon as the next frame
+     * starts. The copies go into draw lists the packet keeps from frame to
+     * frame, so once they are large enough copying doesn't allocate. Returns
+     * whether any of them had to grow.
+     */
+    bool CopyDrawData(const ImDrawData *source)
+    {
+        hasDrawData = source != NULL && source->Valid;
+        if (!hasDrawData)
+            return false;
+
+        bool grew = drawLists.Size < source->CmdLists.Size || drawData.CmdLists.Capacity < source->CmdLists.Size;
+        while (drawLists.Size < source->CmdLists.Size)
+            drawLists.push_back(IM_NEW(ImDrawList)(source->CmdLists[drawLists.Size]->_Data));
+
+        drawData.Valid = true;
+        drawData.CmdListsCount = source->CmdListsCount;
+        drawData.TotalIdxCount = source->TotalIdxCount;
+        drawData.TotalVtxCount = source->TotalVtxCount;
+        drawData.DisplayPos = source->DisplayPos;
+        drawData.DisplaySize = source->DisplaySize;
+        drawData.FramebufferScale = source->FramebufferScale;
+        drawData.OwnerViewport = source->OwnerViewport;
+
+        drawData.CmdLists.resize(source->CmdLists.Size);
+        for (int i = 0; i < source->CmdLists.Size; i++)
+        {
+            const ImDrawList &list = *source->CmdLists[i];
+            ImDrawList &copy = *drawLists[i];
+            grew |= copyBuffer(copy.CmdBuffer, list.CmdBuffer);
+            grew |= copyBuffer(copy.IdxBuffer, list.IdxBuffer);
+            grew |= copyBuffer(copy.VtxBuffer, list.VtxBuffer);
+            copy.Flags = list.Flags;
+            drawData.CmdLists[i] = &copy;
+        }
+        return grew;
+    }
+
+private:
+    /*Draw lists owned by the packet, 'drawData' points at the first CmdLists.Size of them*/
+    ImVector<ImDrawList *> drawLists;
+
+    /*Resizing keeps the capacity, it only allocates when a buffer grows, which is returned*/
+    template <typename T>
+    static bool copyBuffer(ImVector<T> &destination, const ImVector<T> &source)
+    {
+        bool grew = destination.Capacity < source.Size;
+        destination.resize(source.Size);
+        if (source.Size > 0)
+            memcpy(destination.Data, source.Data, source.size_in_bytes());
+        return grew;
+    }
+};
+
+/*What the render thread reports back for the debug interface, one frame late*/
+struct RenderStatus
+{
+    bool lightmapReady = false;
+    bool lightmapBaking = false;
+    bool irradianceReady = false;
+    bool irradianceBaking = false;
+    size_t textureBytes = 0;
+    size_t textureBudget = 0;
+    size_t geometryBytes = 0;
+    size_t geometryBudget = 0;
+    size_t geometryUploadBytes = 0;
+    double geometryUploadMilliseconds = 0.0;
+    int drawnCells = 0;
+    int totalCells = 0;
+    int loadingModels = 0;
+    int impostorInstances = 0;
+    float renderScale = 1.0f;
+    int renderWidth = 0;
+    int renderHeight = 0;
+    double gpuMilliseconds = 0.0;
+    bool gpuMeasured = false; // a new GPU time came in this frame
+    int drawCalls = 0;
+    size_t triangles = 0;
+    int renderPasses = 0;
+    int culledPasses = 0;
+    int renderTargets = 0;
+    int renderTargetTextures = 0;
+    size_t renderTargetBytes = 0;
+    bool steady = false; // nothing was baked, streamed or uploaded, drawing the same frame again gives the same picture
+};
+
+/**
+ * Hands frame packets from the simulation thread to the render thread.
+ *
+ * A ring of FRAME_PACKETS packets: the simulation writes into a free packet
+ * and submits it, the render thread reads submitted packets in order and
+ * releases them. Each side only blocks when the other one is a whole ring
+ * behind, so preparing a frame overlaps with submitting the previous one.
+ */
+class FramePipeline
+{
+public:
+    /*Returns the next packet to fill, waiting until the render thread released it*/
+    FramePacket &BeginWrite()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [this]() { return submitted - read < FRAME_PACKETS; });
+        return packets[submitted % FRAME_PACKETS];
+    }
+
+    /*Publishes the packet returned by BeginWrite()*/
+    void Submit()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            submitted++;
+        }
+        available.notify_one();
+    }
+
+    /*Returns the oldest submitted packet, or NULL once the pipeline is closed and drained*/
+    FramePacket *BeginRead()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this]() { return reading < submitted || closed; });
+        if (reading == submitted)
+            return NULL;
+        return &packets[reading++ % FRAME_PACKETS];
+    }
+
+    /*Gives the packet returned by BeginRead() back to the simulation*/
+    void EndRead()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            read++;
+        }
+        released.notify_one();
+    }
+
+    /*No more packets will be submitted, the render thread stops after the pending ones*/
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        available.notify_one();
+    }
+
+    void PublishStatus(const RenderStatus &renderStatus)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        status = renderStatus;
+    }
+
+    RenderStatus Status()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return status;
+    }
+
+private:
+    FramePacket packets[FRAME_PACKETS];
+    std::mutex mutex;
+    std::condition_variable available; // a packet was submitted
+    std::condition_variable released;  // a packet was given back
+    size_t submitted = 0;              // packets submitted so far
+    size_t reading = 0;                // packets handed to the render thread
+    size_t read = 0;                   // packets released by the render thread
+    bool closed = false;
+    RenderStatus status;
+};
+#endif
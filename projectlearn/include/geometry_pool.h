@@ -0,0 +1,241 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include <glad/glad.h>
+
+#include "resource_manager.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <unordered_map>
+
+/**
+ * First-fit allocator of byte ranges within a fixed capacity. Free ranges are
+ * kept sorted by offset and merged with their neighbours when released, so
+ * the pool doesn't fragment into pieces too small for the next mesh.
+ *
+ * Sizes are rounded up to RANGE_ALIGNMENT, which keeps every offset a valid
+ * vertex attribute and index offset.
+ */
+class RangeAllocator
+{
+public:
+    static const size_t RANGE_ALIGNMENT = 16;
+    static const size_t INVALID_RANGE = (size_t)-1;
+
+    explicit RangeAllocator(size_t capacity) : capacity(capacity - capacity % RANGE_ALIGNMENT)
+    {
+        if (this->capacity > 0)
+            freeRanges[0] = this->capacity;
+    }
+
+    /*Offset of a new range of at least 'size' bytes, INVALID_RANGE when no free range is large enough*/
+    size_t Allocate(size_t size)
+    {
+        size = (size + RANGE_ALIGNMENT - 1) / RANGE_ALIGNMENT * RANGE_ALIGNMENT;
+        if (size == 0)
+            size = RANGE_ALIGNMENT;
+
+        for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range)
+        {
+            if (range->second < size)
+                continue;
+
+            size_t offset = range->first;
+            size_t remaining = range->second - size;
+            freeRanges.erase(range);
+            if (remaining > 0)
+                freeRanges[offset + size] = remaining;
+
+            allocated[offset] = size;
+            used += size;
+            return offset;
+        }
+        return INVALID_RANGE;
+    }
+
+    /*Returns a range to the free list, merging it with the free ranges around it*/
+    void Free(size_t offset)
+    {
+        auto found = allocated.find(offset);
+        if (found == allocated.end())
+        {
+            std::cout << "ERROR::GEOMETRY_POOL::FREE_UNKNOWN_RANGE " << offset << std::endl;
+            return;
+        }
+        size_t size = found->second;
+        allocated.erase(found);
+        used -= size;
+
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset)
+            {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges[offset] = size;
+    }
+
+    size_t Used() const { return used; }
+    size_t Capacity() const { return capacity; }
+
+    /*Size of the largest range that can still be allocated*/
+    size_t LargestFree() const
+    {
+        size_t largest = 0;
+        for (const auto &range : freeRanges)
+            largest = std::max(largest, range.second);
+        return largest;
+    }
+
+private:
+    size_t capacity;
+    size_t used = 0;
+    std::map<size_t, size_t> freeRanges;         // offset -> size, sorted so neighbours can merge
+    std::unordered_map<size_t, size_t> allocated; // offset -> size
+};
+
+class GeometryPool;
+
+/**
+ * Vertices and indices of one mesh in a GeometryPool. Move-only, the ranges
+ * go back to the pool when it is reset or destroyed.
+ */
+class PoolRange
+{
+public:
+    PoolRange() = default;
+
+    ~PoolRange()
+    {
+        Reset();
+    }
+
+    PoolRange(PoolRange &&other) noexcept
+        : pool(other.pool), vertexOffset(other.vertexOffset), indexOffset(other.indexOffset)
+    {
+        other.pool = nullptr;
+    }
+
+    PoolRange &operator=(PoolRange &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            pool = other.pool;
+            vertexOffset = other.vertexOffset;
+            indexOffset = other.indexOffset;
+            other.pool = nullptr;
+        }
+        return *this;
+    }
+
+    PoolRange(const PoolRange &) = delete;
+    PoolRange &operator=(const PoolRange &) = delete;
+
+    bool Valid() const { return pool != nullptr; }
+
+    /*Byte offsets of the vertices in the pool's vertex buffer and of the indices in its index buffer*/
+    size_t VertexOffset() const { return vertexOffset; }
+    size_t IndexOffset() const { return indexOffset; }
+
+    inline void Reset();
+
+private:
+    friend class GeometryPool;
+
+    GeometryPool *pool = nullptr;
+    size_t vertexOffset = 0;
+    size_t indexOffset = 0;
+};
+
+/**
+ * A vertex buffer and an index buffer of fixed size that the streamed meshes
+ * share. The budget is the size of the two buffers: geometry only goes in
+ * while there is room, the streamer evicts meshes to make more.
+ *
+ * Used from the thread owning the context only.
+ */
+class GeometryPool
+{
+public:
+    GeometryPool(size_t vertexBytes, size_t indexBytes) : vertices(vertexBytes), indices(indexBytes)
+    {
+        vertexBuffer = createBuffer(vertices.Capacity());
+        indexBuffer = createBuffer(indices.Capacity());
+    }
+
+    /**
+     * Reserves room for 'vertexBytes' of vertices and 'indexBytes' of indices,
+     * both or none. The range is left empty when the pool is full.
+     */
+    PoolRange Allocate(size_t vertexBytes, size_t indexBytes)
+    {
+        PoolRange range;
+        size_t vertexOffset = vertices.Allocate(vertexBytes);
+        if (vertexOffset == RangeAllocator::INVALID_RANGE)
+            return range;
+
+        size_t indexOffset = indices.Allocate(indexBytes);
+        if (indexOffset == RangeAllocator::INVALID_RANGE)
+        {
+            vertices.Free(vertexOffset);
+            return range;
+        }
+
+        range.pool = this;
+        range.vertexOffset = vertexOffset;
+        range.indexOffset = indexOffset;
+        return range;
+    }
+
+    GLuint VertexBuffer() const { return vertexBuffer.Get(); }
+    GLuint IndexBuffer() const { return indexBuffer.Get(); }
+
+    size_t UsedBytes() const { return vertices.Used() + indices.Used(); }
+    size_t BudgetBytes() const { return vertices.Capacity() + indices.Capacity(); }
+
+private:
+    friend class PoolRange;
+
+    RangeAllocator vertices;
+    RangeAllocator indices;
+    BufferHandle vertexBuffer, indexBuffer;
+
+    void release(PoolRange &range)
+    {
+        vertices.Free(range.vertexOffset);
+        indices.Free(range.indexOffset);
+    }
+
+    /*Allocated through the copy target, binding an element buffer outside of a vertex array is not allowed*/
+    static BufferHandle createBuffer(size_t bytes)
+    {
+        GLuint name;
+        glGenBuffers(1, &name);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return ResourceManager::Instance().Adopt<ResourceType::Buffer>(0, name);
+    }
+};
+
+inline void PoolRange::Reset()
+{
+    if (pool)
+        pool->release(*this);
+    pool = nullptr;
+}
+#endif
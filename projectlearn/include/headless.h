@@ -0,0 +1,306 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#ifdef HEADLESS_RENDERING
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "image_writer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*Simulated time between two headless frames, they don't follow the clock so every run is the same*/
+const float HEADLESS_FRAME_DELTA = 1.0f / 60.0f;
+
+enum class CaptureFormat
+{
+    Png,
+    Exr
+};
+
+/**
+ * Options of a run without a window, for build machines without a display
+ * or GPU (Mesa's llvmpipe is enough):
+ *
+ *     MyProject [scene.json] --headless [--size 1280x720] [--frames 300]
+ *               [--camera path.json] [--output directory] [--every 30] [--format png|exr]
+ *     MyProject [scene.json] --benchmark suite.json [--size 1280x720] [--report report.json] [--baseline report.json]
+ *
+ * The scene is rendered into an offscreen framebuffer for the given number
+ * of frames along the camera script (see CameraScript), without the debug
+ * interface. With an output directory the last frame, and every Nth with
+ * --every, are written there as frame_0042.png and so on.
+ *
+ * --benchmark runs the cases of a benchmark suite instead, headless as well,
+ * writes their report and compares it with a baseline report.
+ */
+struct HeadlessSettings
+{
+    bool enabled = false;
+    int width = 1280;
+    int height = 720;
+    int frames = 300;
+    std::string cameraScript; // the camera circles the scene when empty
+    std::string outputDirectory;
+    int captureEvery = 0;
+    CaptureFormat format = CaptureFormat::Png;
+
+    /*Benchmark suite run instead of the camera script, and where its report goes and is compared against (see Benchmark)*/
+    std::string benchmarkSuite;
+    std::string reportPath;
+    std::string baselinePath;
+
+    /**
+     * Reads the command line, the first argument that isn't an option is the
+     * scene file. Returns false after printing the usage when it can't be read
+     */
+    bool Parse(int argc, char **argv, std::string &scenePath)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char *argument = argv[i];
+            const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+            if (strcmp(argument, "--headless") == 0)
+                enabled = true;
+            else if (argument[0] != '-')
+                scenePath = argument;
+            else if (value == NULL)
+                return usage(argv[0], argument);
+            else
+            {
+                i++;
+                if (strcmp(argument, "--size") == 0)
+                {
+                    if (sscanf(value, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+                        return usage(argv[0], argument);
+                }
+                else if (strcmp(argument, "--frames") == 0)
+                    frames = atoi(value);
+                else if (strcmp(argument, "--camera") == 0)
+                    cameraScript = value;
+                else if (strcmp(argument, "--output") == 0)
+                    outputDirectory = value;
+                else if (strcmp(argument, "--every") == 0)
+                    captureEvery = atoi(value);
+                else if (strcmp(argument, "--benchmark") == 0)
+                {
+                    benchmarkSuite = value;
+                    enabled = true;
+                }
+                else if (strcmp(argument, "--report") == 0)
+                    reportPath = value;
+                else if (strcmp(argument, "--baseline") == 0)
+                    baselinePath = value;
+                else if (strcmp(argument, "--format") == 0 && (strcmp(value, "png") == 0 || strcmp(value, "exr") == 0))
+                    format = strcmp(value, "png") == 0 ? CaptureFormat::Png : CaptureFormat::Exr;
+                else
+                    return usage(argv[0], argument);
+            }
+        }
+        if (frames <= 0)
+            return usage(argv[0], "--frames");
+        return true;
+    }
+
+    /*True when frame 'index' of the run is written to the output directory*/
+    bool Captures(int index) const
+    {
+        if (outputDirectory.empty())
+            return false;
+        return index == frames - 1 || (captureEvery > 0 && index % captureEvery == 0);
+    }
+
+private:
+    static bool usage(const char *program, const char *argument)
+    {
+        std::cout << "ERROR::COMMAND_LINE::INVALID_ARGUMENT " << argument << std::endl
+                  << "Usage: " << program << " [scene.json] [--headless] [--size WIDTHxHEIGHT] [--frames N] [--camera path.json]"
+                  << " [--output directory] [--every N] [--format png|exr]"
+                  << " [--benchmark suite.json] [--report report.json] [--baseline report.json]" << std::endl;
+        return false;
+    }
+};
+
+/**
+ * OpenGL 3.3 core context without a window or display, from EGL's Mesa
+ * surfaceless platform when there is one and its default display otherwise.
+ * The context has no default framebuffer, everything goes into a
+ * HeadlessTarget.
+ *
+ * Only available when the build found EGL (HEADLESS_RENDERING), Create()
+ * fails otherwise.
+ */
+class HeadlessContext
+{
+public:
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+#ifdef HEADLESS_RENDERING
+    ~HeadlessContext()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    /*Creates the context and makes it current on the calling thread*/
+    bool Create()
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            std::cout << "ERROR::HEADLESS::NO_EGL_DISPLAY" << std::endl;
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+
+        const EGLint configAttributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0 || !eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "ERROR::HEADLESS::NO_OPENGL_CONFIG" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+                                            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE};
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            return false;
+        }
+        return MakeCurrent(true);
+    }
+
+    /*Makes the context current on the calling thread, or releases it from it*/
+    bool MakeCurrent(bool current)
+    {
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, current ? context : EGL_NO_CONTEXT))
+        {
+            std::cout << "ERROR::HEADLESS::MAKE_CURRENT_FAILED 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    /*Loader of the GL functions for gladLoadGLLoader and the program cache*/
+    static GLADloadproc Loader()
+    {
+        return (GLADloadproc)eglGetProcAddress;
+    }
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#else
+    bool Create()
+    {
+        std::cout << "ERROR::HEADLESS::NOT_SUPPORTED built without EGL" << std::endl;
+        return false;
+    }
+
+    bool MakeCurrent(bool) { return false; }
+    static GLADloadproc Loader() { return NULL; }
+#endif
+};
+
+/**
+ * Framebuffer the headless frames are rendered into, in place of the
+ * window's. The color is 8 bit for PNG output and half float for EXR, so
+ * the captures keep what the target holds.
+ */
+class HeadlessTarget
+{
+public:
+    HeadlessTarget(int width, int height, CaptureFormat format) : width(width), height(height), format(format)
+    {
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, format == CaptureFormat::Exr ? GL_RGBA16F : GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::HEADLESS::FRAMEBUFFER_INCOMPLETE" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~HeadlessTarget()
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(2, renderbuffers);
+    }
+
+    HeadlessTarget(const HeadlessTarget &) = delete;
+    HeadlessTarget &operator=(const HeadlessTarget &) = delete;
+
+    GLuint Framebuffer() const { return framebuffer; }
+
+    /**
+     * Reads the frame back and writes it as frame_<index> into 'directory',
+     * waiting for the GPU to finish the frame. The alpha the scene leaves
+     * is made opaque, as the window shows it
+     */
+    bool Capture(const std::string &directory, int index)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%04d.%s", index, format == CaptureFormat::Exr ? "exr" : "png");
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        bool written;
+        if (format == CaptureFormat::Exr)
+        {
+            floatPixels.resize((size_t)width * height * 4);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, floatPixels.data());
+            for (size_t i = 3; i < floatPixels.size(); i += 4)
+                floatPixels[i] = 1.0f;
+            written = ImageWriter::WriteExr(directory + name, width, height, floatPixels.data());
+        }
+        else
+        {
+            pixels.resize((size_t)width * height * 4);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            for (size_t i = 3; i < pixels.size(); i += 4)
+                pixels[i] = 255;
+            written = ImageWriter::WritePng(directory + name, width, height, pixels.data());
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        return written;
+    }
+
+private:
+    int width, height;
+    CaptureFormat format;
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = {}; // color and depth
+    std::vector<unsigned char> pixels;
+    std::vector<float> floatPixels;
+};
+#endif
@@ -0,0 +1,237 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Writers of the frames captured by the headless mode, without further
+ * dependencies: PNG with stored (uncompressed) deflate blocks and EXR with
+ * uncompressed half float scanlines. The files are larger than they could
+ * be, but every viewer and image diff tool reads them.
+ *
+ * Pixels are given bottom row first, as glReadPixels returns them.
+ */
+class ImageWriter
+{
+public:
+    /*Writes 'rgba', 4 bytes per pixel, as an 8 bit RGBA PNG*/
+    static bool WritePng(const std::string &path, int width, int height, const unsigned char *rgba)
+    {
+        /*Filter byte 0 (none) in front of every row, top row first*/
+        size_t rowBytes = (size_t)width * 4;
+        std::vector<unsigned char> raw((rowBytes + 1) * height);
+        for (int y = 0; y < height; y++)
+        {
+            unsigned char *row = &raw[(rowBytes + 1) * y];
+            row[0] = 0;
+            memcpy(row + 1, rgba + rowBytes * (height - 1 - y), rowBytes);
+        }
+
+        /*zlib stream of stored blocks of at most 65535 bytes*/
+        std::vector<unsigned char> zlib = {0x78, 0x01};
+        size_t offset = 0;
+        do
+        {
+            size_t length = std::min<size_t>(65535, raw.size() - offset);
+            bool last = offset + length == raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(length & 0xff);
+            zlib.push_back(length >> 8);
+            zlib.push_back(~length & 0xff);
+            zlib.push_back((~length >> 8) & 0xff);
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+            offset += length;
+        } while (offset < raw.size());
+        putBigEndian(zlib, adler32(raw));
+
+        std::vector<unsigned char> header;
+        putBigEndian(header, width);
+        putBigEndian(header, height);
+        header.insert(header.end(), {8, 6, 0, 0, 0}); // 8 bit RGBA, deflate, adaptive filtering, no interlace
+
+        std::vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        putChunk(png, "IHDR", header);
+        putChunk(png, "IDAT", zlib);
+        putChunk(png, "IEND", std::vector<unsigned char>());
+        return writeFile(path, png);
+    }
+
+    /*Writes 'rgba', 4 floats per pixel, as a half float RGBA EXR*/
+    static bool WriteExr(const std::string &path, int width, int height, const float *rgba)
+    {
+        std::vector<unsigned char> exr = {0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0}; // magic number, version 2, scanline image
+
+        /*Channels in alphabetical order, as EXR requires: name, half type, linear, sampling 1 by 1*/
+        std::vector<unsigned char> channels;
+        for (const char *name : {"A", "B", "G", "R"})
+        {
+            channels.insert(channels.end(), name, name + 2);
+            putLittleEndian(channels, 1);
+            putLittleEndian(channels, 0);
+            putLittleEndian(channels, 1);
+            putLittleEndian(channels, 1);
+        }
+        channels.push_back(0);
+        putAttribute(exr, "channels", "chlist", channels);
+
+        putAttribute(exr, "compression", "compression", std::vector<unsigned char>{0});
+
+        std::vector<unsigned char> window;
+        for (int value : {0, 0, width - 1, height - 1})
+            putLittleEndian(window, value);
+        putAttribute(exr, "dataWindow", "box2i", window);
+        putAttribute(exr, "displayWindow", "box2i", window);
+
+        putAttribute(exr, "lineOrder", "lineOrder", std::vector<unsigned char>{0});
+
+        std::vector<unsigned char> aspect;
+        putFloat(aspect, 1.0f);
+        putAttribute(exr, "pixelAspectRatio", "float", aspect);
+
+        std::vector<unsigned char> center;
+        putFloat(center, 0.0f);
+        putFloat(center, 0.0f);
+        putAttribute(exr, "screenWindowCenter", "v2f", center);
+
+        std::vector<unsigned char> screenWidth;
+        putFloat(screenWidth, 1.0f);
+        putAttribute(exr, "screenWindowWidth", "float", screenWidth);
+        exr.push_back(0);
+
+        /*Offset table, then one block per scanline: y, size, then each channel's row*/
+        size_t lineBytes = (size_t)width * 4 * 2;
+        uint64_t blockStart = exr.size() + (uint64_t)height * 8;
+        for (int y = 0; y < height; y++)
+            putLittleEndian64(exr, blockStart + (uint64_t)y * (lineBytes + 8));
+        for (int y = 0; y < height; y++)
+        {
+            putLittleEndian(exr, y);
+            putLittleEndian(exr, (int)lineBytes);
+            const float *row = rgba + (size_t)width * 4 * (height - 1 - y);
+            for (int channel : {3, 2, 1, 0})
+                for (int x = 0; x < width; x++)
+                {
+                    uint16_t half = toHalf(row[x * 4 + channel]);
+                    exr.push_back(half & 0xff);
+                    exr.push_back(half >> 8);
+                }
+        }
+        return writeFile(path, exr);
+    }
+
+private:
+    static bool writeFile(const std::string &path, const std::vector<unsigned char> &bytes)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.write((const char *)bytes.data(), bytes.size()))
+        {
+            std::cout << "ERROR::IMAGE::WRITE_FAILED " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static void putBigEndian(std::vector<unsigned char> &out, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back((value >> shift) & 0xff);
+    }
+
+    static void putLittleEndian(std::vector<unsigned char> &out, int value)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+            out.push_back(((uint32_t)value >> shift) & 0xff);
+    }
+
+    static void putLittleEndian64(std::vector<unsigned char> &out, uint64_t value)
+    {
+        for (int shift = 0; shift < 64; shift += 8)
+            out.push_back((value >> shift) & 0xff);
+    }
+
+    static void putFloat(std::vector<unsigned char> &out, float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        putLittleEndian(out, (int)bits);
+    }
+
+    static void putChunk(std::vector<unsigned char> &png, const char *type, const std::vector<unsigned char> &data)
+    {
+        putBigEndian(png, (uint32_t)data.size());
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        putBigEndian(png, crc32(&png[start], png.size() - start));
+    }
+
+    static void putAttribute(std::vector<unsigned char> &exr, const char *name, const char *type, const std::vector<unsigned char> &value)
+    {
+        exr.insert(exr.end(), name, name + strlen(name) + 1);
+        exr.insert(exr.end(), type, type + strlen(type) + 1);
+        putLittleEndian(exr, (int)value.size());
+        exr.insert(exr.end(), value.begin(), value.end());
+    }
+
+    static uint32_t crc32(const unsigned char *data, size_t length)
+    {
+        static uint32_t table[256];
+        static bool initialized = false;
+        if (!initialized)
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            initialized = true;
+        }
+
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = 0; i < length; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return crc ^ 0xffffffffu;
+    }
+
+    static uint32_t adler32(const std::vector<unsigned char> &data)
+    {
+        uint32_t a = 1, b = 0;
+        for (unsigned char byte : data)
+        {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    /*Rounds to the nearest half, values past its range become infinite and denormals flush to zero*/
+    static uint16_t toHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        uint16_t sign = (bits >> 16) & 0x8000;
+        int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if (((bits >> 23) & 0xff) == 0xff)
+            return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+        if (exponent <= 0)
+            return sign;
+        if (exponent >= 31)
+            return sign | 0x7c00;
+
+        uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000)
+            half++;
+        return half;
+    }
+};
+#endif
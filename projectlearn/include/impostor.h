@@ -0,0 +1,271 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "draw_stats.h"
+#include "model.h"
+#include "resource_manager.h"
+#include "shader.h"
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*Texture units of the impostor atlases, after the irradiance volume (units 16 to 22)*/
+const int IMPOSTOR_ALBEDO_UNIT = 23;
+const int IMPOSTOR_NORMAL_UNIT = 24;
+const int IMPOSTOR_DEPTH_UNIT = 25;
+
+/*Views per side of the octahedral grid, and the edge length of one view in the atlases*/
+const int IMPOSTOR_FRAMES = 8;
+const int IMPOSTOR_FRAME_SIZE = 128;
+
+/**
+ * Direction from the center of a model towards the camera of the view at
+ * grid cell ('x', 'y'), the views cover the upper hemisphere in a
+ * hemi-octahedral layout. Must match FrameDirection() in impostor.fs.
+ */
+inline glm::vec3 ImpostorFrameDirection(int x, int y, int frames)
+{
+    glm::vec2 p = glm::vec2((float)x, (float)y) / (float)(frames - 1) * 2.0f - glm::vec2(1.0f);
+    glm::vec3 direction((p.x + p.y) * 0.5f, 0.0f, (p.x - p.y) * 0.5f);
+    direction.y = 1.0f - fabs(direction.x) - fabs(direction.z);
+    return glm::normalize(direction);
+}
+
+/**
+ * A model baked into views from all around, drawn as one camera-facing quad
+ * per instance.
+ *
+ * The fragment shader blends the four views closest to the viewing direction,
+ * reprojecting each through its depth so the views line up, and writes the
+ * depth of the reconstructed surface. Together with the matching dither in
+ * the lighting shader the geometry crossfades into the impostor within
+ * 'impostorFade' without popping or sorting.
+ */
+class Impostor
+{
+public:
+    Impostor(TextureHandle albedo, TextureHandle normal, TextureHandle depth, const glm::vec3 &center, float radius, int frames)
+        : albedo(std::move(albedo)), normal(std::move(normal)), depth(std::move(depth)), center(center), radius(radius), frames(frames)
+    {
+        setupQuad();
+    }
+
+    /*Replaces the instances by one per transform, the buffer only grows*/
+    void Place(const std::vector<glm::mat4> &transforms)
+    {
+        instances = transforms.size();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.Get());
+        if (transforms.size() > instanceCapacity)
+        {
+            instanceCapacity = transforms.size();
+            glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4), transforms.data(), GL_DYNAMIC_DRAW);
+        }
+        else if (!transforms.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, transforms.size() * sizeof(glm::mat4), transforms.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    size_t Instances() const { return instances; }
+
+    /*Draws every instance with 'shader', which must be in use with the camera uniforms set*/
+    void Draw(const Shader &shader) const
+    {
+        if (instances == 0)
+            return;
+
+        glActiveTexture(GL_TEXTURE0 + IMPOSTOR_ALBEDO_UNIT);
+        glBindTexture(GL_TEXTURE_2D, albedo.Get());
+        glActiveTexture(GL_TEXTURE0 + IMPOSTOR_NORMAL_UNIT);
+        glBindTexture(GL_TEXTURE_2D, normal.Get());
+        glActiveTexture(GL_TEXTURE0 + IMPOSTOR_DEPTH_UNIT);
+        glBindTexture(GL_TEXTURE_2D, depth.Get());
+        glActiveTexture(GL_TEXTURE0);
+
+        shader.setVec3("impostorCenter", center);
+        shader.setFloat("impostorRadius", radius);
+        shader.setInt("impostorFrames", frames);
+
+        glBindVertexArray(vertexArray.Get());
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)instances);
+        glBindVertexArray(0);
+        DrawStats::Instance().Count(2, instances);
+    }
+
+    /*Points the atlas samplers of a shader at their texture units*/
+    static void ConfigureShader(const Shader &shader)
+    {
+        shader.use();
+        shader.setInt("impostorAlbedo", IMPOSTOR_ALBEDO_UNIT);
+        shader.setInt("impostorNormal", IMPOSTOR_NORMAL_UNIT);
+        shader.setInt("impostorDepth", IMPOSTOR_DEPTH_UNIT);
+    }
+
+private:
+    TextureHandle albedo, normal, depth;
+    glm::vec3 center; // bounding sphere of the model in its own space
+    float radius;
+    int frames;
+
+    VertexArrayHandle vertexArray;
+    BufferHandle quadBuffer, instanceBuffer;
+    size_t instances = 0;
+    size_t instanceCapacity = 0;
+
+    void setupQuad()
+    {
+        static const float corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+
+        GLuint vao, vbo, instanceVBO;
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &instanceVBO);
+        vertexArray = ResourceManager::Instance().Adopt<ResourceType::VertexArray>(0, vao);
+        quadBuffer = ResourceManager::Instance().Adopt<ResourceType::Buffer>(0, vbo);
+        instanceBuffer = ResourceManager::Instance().Adopt<ResourceType::Buffer>(0, instanceVBO);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+
+        /*Placement of the instance at locations 7 to 10, like the instance matrix of the meshes*/
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(7 + column);
+            glVertexAttribPointer(7 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(7 + column, 1);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+/**
+ * Renders models into impostor atlases offscreen.
+ *
+ * Every view of the IMPOSTOR_FRAMES x IMPOSTOR_FRAMES grid is an orthographic
+ * projection of the model's bounding sphere from the direction given by
+ * ImpostorFrameDirection(), written to three atlases at once: albedo with
+ * coverage, the normal in model space, and the depth from the view's camera
+ * over the sphere's diameter. The lighting is applied when the impostor is
+ * drawn, so it follows the sun.
+ */
+class ImpostorBaker
+{
+public:
+    /*'shader' is the bake program, configured with ConfigureMaterialShader()*/
+    ImpostorBaker(Shader &shader, int frames = IMPOSTOR_FRAMES, int frameSize = IMPOSTOR_FRAME_SIZE)
+        : shader(shader), frames(frames), frameSize(frameSize)
+    {
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, frames * frameSize, frames * frameSize);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
+    ~ImpostorBaker()
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+    }
+
+    ImpostorBaker(const ImpostorBaker &) = delete;
+    ImpostorBaker &operator=(const ImpostorBaker &) = delete;
+
+    /**
+     * Bakes the views of 'model' at the placement of its file, before
+     * Model::Place() moved its instances. Returns null for an empty model.
+     */
+    std::unique_ptr<Impostor> Bake(Model &model)
+    {
+        if (model.Placed())
+        {
+            std::cout << "ERROR::IMPOSTOR::MODEL_ALREADY_PLACED" << std::endl;
+            return nullptr;
+        }
+
+        glm::vec3 center;
+        float radius;
+        model.GetBounds(glm::mat4(1.0f), center, radius);
+        if (radius <= 0.0f)
+            return nullptr;
+
+        int size = frames * frameSize;
+        TextureHandle albedo = createAtlas(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_LINEAR, size);
+        TextureHandle normal = createAtlas(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_NEAREST, size);
+        TextureHandle depth = createAtlas(GL_R16F, GL_RED, GL_FLOAT, GL_NEAREST, size);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo.Get(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal.Get(), 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, depth.Get(), 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        static const GLenum attachments[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+        glDrawBuffers(3, attachments);
+
+        /*Uncovered texels keep zero coverage, the clear color of the frame is restored by the caller*/
+        glViewport(0, 0, size, size);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        shader.use();
+        glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius);
+        shader.setMat4("projection", projection);
+        for (int y = 0; y < frames; y++)
+        {
+            for (int x = 0; x < frames; x++)
+            {
+                /*Up vector as in FrameBasis() of impostor.fs*/
+                glm::vec3 direction = ImpostorFrameDirection(x, y, frames);
+                glm::vec3 up = fabs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+                shader.setMat4("view", glm::lookAt(center + direction * radius, center, up));
+
+                glViewport(x * frameSize, y * frameSize, frameSize, frameSize);
+                model.Draw(shader, false);
+            }
+        }
+
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        return std::unique_ptr<Impostor>(new Impostor(std::move(albedo), std::move(normal), std::move(depth), center, radius, frames));
+    }
+
+private:
+    Shader &shader;
+    int frames;
+    int frameSize;
+
+    GLuint framebuffer = 0;
+    GLuint depthBuffer = 0;
+
+    static TextureHandle createAtlas(GLint internalFormat, GLenum format, GLenum type, GLint filter, int size)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, size, size, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return ResourceManager::Instance().Adopt<ResourceType::Texture>(0, texture);
+    }
+};
+#endif
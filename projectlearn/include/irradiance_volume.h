@@ -0,0 +1,314 @@
+#ifndef IRRADIANCE_VOLUME_H
+#define IRRADIANCE_VOLUME_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "bake_cache.h"
+#include "bake_scene.h"
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*Texture units of the spherical harmonics volumes, after the lightmap*/
+const int IRRADIANCE_UNIT = 16;
+
+/*9 RGB coefficients per probe take 27 floats, spread over 7 RGBA volumes*/
+const int IRRADIANCE_TEXTURES = 7;
+const int IRRADIANCE_COEFFICIENTS = 9;
+
+/*Probe grid resolution: at most this many probes per axis, at least this far apart*/
+const int IRRADIANCE_MAX_PROBES_PER_AXIS = 32;
+const float IRRADIANCE_MIN_SPACING = 0.5f;
+
+/*Rays per probe gathering the light bounced by the surrounding surfaces*/
+const int IRRADIANCE_SAMPLES = 128;
+
+/*Probes seeing more backfaces than this are inside geometry, they take the values of their neighbours*/
+const float IRRADIANCE_MAX_BACKFACES = 0.25f;
+
+/**
+ * Irradiance volume for the dynamic objects.
+ *
+ * A grid of probes over the bounds of the BakeScene stores the irradiance
+ * arriving from every direction as L2 spherical harmonics, already convolved
+ * with the cosine lobe. Each probe adds the sun and the bulbs it sees directly
+ * to the light of the surfaces its rays hit. Probes are baked in the
+ * background on all cores, like the lightmap, and cached on disk.
+ *
+ * A dynamic mesh then lights itself with one trilinear lookup and a 9 term
+ * polynomial in its normal, whatever the number of bulbs.
+ */
+class IrradianceVolume
+{
+public:
+    /*'scene' must be set before and outlive the volume, results are cached in 'cacheDirectory'*/
+    IrradianceVolume(const BakeScene &scene, const std::string &cacheDirectory)
+        : scene(scene), cache(cacheDirectory, "irradiance", 0x49525631) // "IRV1"
+    {
+        glm::vec3 extent = scene.Maximum() - scene.Minimum();
+        float largest = std::max(extent.x, std::max(extent.y, extent.z));
+        spacing = std::max(IRRADIANCE_MIN_SPACING, largest / (IRRADIANCE_MAX_PROBES_PER_AXIS - 1));
+        origin = scene.Minimum();
+        for (int axis = 0; axis < 3; axis++)
+            grid[axis] = std::min(IRRADIANCE_MAX_PROBES_PER_AXIS, (int)std::ceil(extent[axis] / spacing) + 1);
+    }
+
+    /**
+     * Called every frame with the current lights. Returns true when their
+     * volume is bound by Bind(), otherwise makes sure it is being produced.
+     */
+    bool Request(const BakeLights &lights)
+    {
+        if (scene.Empty())
+            return false;
+
+        uint64_t key = keyFor(lights);
+        if (textures[0] && textureKey == key)
+        {
+            cache.Cancel();
+            return true;
+        }
+
+        std::vector<float> data;
+        uint64_t dataKey;
+        std::vector<uint32_t> header = {(uint32_t)grid.x, (uint32_t)grid.y, (uint32_t)grid.z};
+        while (cache.Poll(key, header, probeCount() * IRRADIANCE_TEXTURES * 4, [this, lights]() { return run(lights); }, data, dataKey))
+        {
+            upload(data, dataKey);
+            if (dataKey == key)
+                return true;
+        }
+        return false;
+    }
+
+    /*True while a bake is running in the background*/
+    bool Baking() const
+    {
+        return cache.Baking();
+    }
+
+    /*Binds the coefficient volumes to their texture units, starting at IRRADIANCE_UNIT*/
+    void Bind() const
+    {
+        for (int i = 0; i < IRRADIANCE_TEXTURES; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + IRRADIANCE_UNIT + i);
+            glBindTexture(GL_TEXTURE_3D, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /*Sets the placement of the grid, 'ready' tells the shader whether the volume can be sampled*/
+    void SetUniforms(const Shader &shader, bool ready) const
+    {
+        shader.setBool("irradianceReady", ready);
+        shader.setVec3("irradianceMin", origin);
+        shader.setVec3("irradianceGrid", glm::vec3(grid));
+        shader.setFloat("irradianceSpacing", spacing);
+    }
+
+    /*Points the 'irradianceSH' sampler array of a shader at its texture units*/
+    static void ConfigureShader(const Shader &shader)
+    {
+        shader.use();
+        for (int i = 0; i < IRRADIANCE_TEXTURES; i++)
+            shader.setInt(StringTable::Instance().Intern("irradianceSH[" + std::to_string(i) + "]"), IRRADIANCE_UNIT + i);
+    }
+
+private:
+    const BakeScene &scene;
+    BakeCache cache;
+
+    glm::vec3 origin;
+    glm::ivec3 grid;
+    float spacing;
+
+    GLuint textures[IRRADIANCE_TEXTURES] = {};
+    uint64_t textureKey = 0;
+
+    uint64_t keyFor(const BakeLights &lights) const
+    {
+        const int parameters[5] = {grid.x, grid.y, grid.z, IRRADIANCE_SAMPLES, IRRADIANCE_COEFFICIENTS};
+        uint64_t key = BakeScene::HashBytes(scene.Key(lights), parameters, sizeof(parameters));
+        return BakeScene::HashBytes(key, &spacing, sizeof(float));
+    }
+
+    size_t probeCount() const
+    {
+        return (size_t)grid.x * grid.y * grid.z;
+    }
+
+    void upload(const std::vector<float> &data, uint64_t key)
+    {
+        size_t count = probeCount();
+        if (data.size() != count * IRRADIANCE_TEXTURES * 4)
+            return;
+
+        if (!textures[0])
+            glGenTextures(IRRADIANCE_TEXTURES, textures);
+        for (int i = 0; i < IRRADIANCE_TEXTURES; i++)
+        {
+            glBindTexture(GL_TEXTURE_3D, textures[i]);
+            glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, grid.x, grid.y, grid.z, 0, GL_RGBA, GL_FLOAT, data.data() + i * count * 4);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_3D, 0);
+        textureKey = key;
+    }
+
+    /*Real spherical harmonics up to band 2, in the order the shader evaluates them*/
+    static void basis(const glm::vec3 &d, float y[IRRADIANCE_COEFFICIENTS])
+    {
+        y[0] = 0.282095f;
+        y[1] = 0.488603f * d.y;
+        y[2] = 0.488603f * d.z;
+        y[3] = 0.488603f * d.x;
+        y[4] = 1.092548f * d.x * d.y;
+        y[5] = 1.092548f * d.y * d.z;
+        y[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+        y[7] = 1.092548f * d.x * d.z;
+        y[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+    }
+
+    /*Cosine lobe convolution per band, pi, 2pi/3 and pi/4*/
+    static float lobe(int coefficient)
+    {
+        return coefficient == 0 ? 3.141593f : coefficient < 4 ? 2.094395f : 0.785398f;
+    }
+
+    /**
+     * Bakes one probe, returns false when it lies inside geometry. The bounced
+     * light is gathered over the sphere and divided by pi, like the lightmap
+     * bounce; the lights are added as deltas so that a light of intensity I
+     * gives I * dot(n, l) as the lighting shader does.
+     */
+    bool bakeProbe(const glm::vec3 &position, const BakeLights &lights, glm::vec3 coefficients[IRRADIANCE_COEFFICIENTS]) const
+    {
+        float y[IRRADIANCE_COEFFICIENTS];
+        for (int c = 0; c < IRRADIANCE_COEFFICIENTS; c++)
+            coefficients[c] = glm::vec3(0.0f);
+
+        /*Fibonacci sphere, evenly spread deterministic directions*/
+        int backfaces = 0;
+        for (int s = 0; s < IRRADIANCE_SAMPLES; s++)
+        {
+            float z = 1.0f - (2.0f * s + 1.0f) / IRRADIANCE_SAMPLES;
+            float r = sqrt(std::max(0.0f, 1.0f - z * z));
+            float phi = 2.399963f * s;
+            glm::vec3 direction(r * cos(phi), r * sin(phi), z);
+
+            SurfaceHit hit;
+            if (!scene.Trace(position, direction, 100.0f, hit))
+                continue;
+            if (!hit.front)
+            {
+                backfaces++;
+                continue;
+            }
+
+            glm::vec3 radiance = hit.triangle->albedo * scene.DirectLight(hit.position, hit.normal, lights);
+            basis(direction, y);
+            for (int c = 0; c < IRRADIANCE_COEFFICIENTS; c++)
+                coefficients[c] += radiance * y[c];
+        }
+
+        /*Sphere integral (4 pi / samples), convolved and divided by pi*/
+        for (int c = 0; c < IRRADIANCE_COEFFICIENTS; c++)
+            coefficients[c] *= 4.0f * lobe(c) / IRRADIANCE_SAMPLES;
+
+        scene.ForEachLight(position, glm::vec3(0.0f), lights, [&](const glm::vec3 &direction, const glm::vec3 &intensity)
+                           {
+                               basis(direction, y);
+                               for (int c = 0; c < IRRADIANCE_COEFFICIENTS; c++)
+                                   coefficients[c] += intensity * (y[c] * lobe(c));
+                           });
+
+        return backfaces <= IRRADIANCE_MAX_BACKFACES * IRRADIANCE_SAMPLES;
+    }
+
+    /*Bake of one light configuration, runs on a background thread and returns the packed volumes*/
+    std::vector<float> run(BakeLights lights) const
+    {
+        size_t count = probeCount();
+        std::vector<glm::vec3> coefficients(count * IRRADIANCE_COEFFICIENTS);
+        std::vector<bool> valid(count);
+        std::vector<char> validBytes(count); // vector<bool> can't be written from several threads
+        BakeScene::ParallelFor(count, [&](size_t i)
+                               {
+                                   glm::ivec3 cell((int)(i % grid.x), (int)(i / grid.x % grid.y), (int)(i / grid.x / grid.y));
+                                   glm::vec3 position = origin + glm::vec3(cell) * spacing;
+                                   validBytes[i] = bakeProbe(position, lights, &coefficients[i * IRRADIANCE_COEFFICIENTS]);
+                               });
+        for (size_t i = 0; i < count; i++)
+            valid[i] = validBytes[i] != 0;
+        fillInvalid(coefficients, valid);
+
+        /*Coefficient c, channel k goes to float c * 3 + k of a probe, 4 floats per volume*/
+        std::vector<float> data(count * IRRADIANCE_TEXTURES * 4, 0.0f);
+        for (size_t i = 0; i < count; i++)
+        {
+            for (int f = 0; f < IRRADIANCE_COEFFICIENTS * 3; f++)
+                data[(f / 4) * count * 4 + i * 4 + f % 4] = coefficients[i * IRRADIANCE_COEFFICIENTS + f / 3][f % 3];
+        }
+        return data;
+    }
+
+    /*Probes inside walls would darken their surroundings through filtering, they copy their valid neighbours*/
+    void fillInvalid(std::vector<glm::vec3> &coefficients, std::vector<bool> &valid) const
+    {
+        for (int pass = 0; pass < IRRADIANCE_MAX_PROBES_PER_AXIS; pass++)
+        {
+            std::vector<size_t> filled;
+            for (int z = 0; z < grid.z; z++)
+            {
+                for (int y = 0; y < grid.y; y++)
+                {
+                    for (int x = 0; x < grid.x; x++)
+                    {
+                        size_t index = ((size_t)z * grid.y + y) * grid.x + x;
+                        if (valid[index])
+                            continue;
+
+                        int count = 0;
+                        glm::vec3 sum[IRRADIANCE_COEFFICIENTS] = {};
+                        const glm::ivec3 neighbours[6] = {glm::ivec3(-1, 0, 0), glm::ivec3(1, 0, 0), glm::ivec3(0, -1, 0),
+                                                          glm::ivec3(0, 1, 0), glm::ivec3(0, 0, -1), glm::ivec3(0, 0, 1)};
+                        for (const glm::ivec3 &offset : neighbours)
+                        {
+                            glm::ivec3 n = glm::ivec3(x, y, z) + offset;
+                            if (n.x < 0 || n.y < 0 || n.z < 0 || n.x >= grid.x || n.y >= grid.y || n.z >= grid.z)
+                                continue;
+                            size_t neighbour = ((size_t)n.z * grid.y + n.y) * grid.x + n.x;
+                            if (!valid[neighbour])
+                                continue;
+                            for (int c = 0; c < IRRADIANCE_COEFFICIENTS; c++)
+                                sum[c] += coefficients[neighbour * IRRADIANCE_COEFFICIENTS + c];
+                            count++;
+                        }
+                        if (count == 0)
+                            continue;
+
+                        for (int c = 0; c < IRRADIANCE_COEFFICIENTS; c++)
+                            coefficients[index * IRRADIANCE_COEFFICIENTS + c] = sum[c] / (float)count;
+                        filled.push_back(index);
+                    }
+                }
+            }
+            if (filled.empty())
+                break;
+            for (size_t index : filled)
+                valid[index] = true;
+        }
+    }
+};
+#endif
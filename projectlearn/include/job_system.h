@@ -0,0 +1,389 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+/*A queued job: either a std::function, or a range of a ParallelFor, which needs no allocation*/
+struct Job
+{
+    std::function<void()> work;
+    void (*range)(const void *context, size_t begin, size_t end) = nullptr;
+    const void *context = nullptr;
+    size_t begin = 0;
+    size_t end = 0;
+    JobCounter *counter = nullptr;
+
+    void operator()() const
+    {
+        if (range)
+            range(context, begin, end);
+        else
+            work();
+    }
+};
+
+/**
+ * Completion counter of a group of jobs. Every job run with the counter
+ * increments it and decrements it when done, so waiting is a poll of one
+ * atomic and only the last job of the group takes the counter's lock. Jobs
+ * can also be made to start only once a counter reaches zero, which is how
+ * dependencies between groups are expressed.
+ */
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    /*True once every job of the group has finished*/
+    bool Done() const
+    {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> pending{0};
+
+    /*Jobs waiting for this counter to reach zero, the count only drops to zero under this lock*/
+    std::mutex mutex;
+    std::vector<Job> continuations;
+};
+
+/**
+ * Work-stealing job system shared by the whole program.
+ *
+ * Every worker thread owns a deque: it pushes and pops its own jobs at the
+ * back, which keeps nested work hot in its cache, and idle workers steal the
+ * oldest jobs from the front of the others. Threads that are not workers (the
+ * main thread, the render thread) submit to a shared deque. A thread waiting
+ * for a counter helps running the jobs of that counter only, so a frame
+ * waiting for its own short jobs never picks up a long one like a model
+ * import.
+ *
+ * Started with no worker threads, every job runs inline on the submitting
+ * thread in submission order: the deterministic single threaded fallback for
+ * debugging.
+ */
+class JobSystem
+{
+public:
+    static JobSystem &Instance()
+    {
+        static JobSystem instance;
+        return instance;
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    ~JobSystem()
+    {
+        stop();
+    }
+
+    /*Starts 'threadCount' workers, 0 runs every job inline. Called once before any job is submitted*/
+    void Start(unsigned int threadCount)
+    {
+        stop();
+
+        queues.clear();
+        for (unsigned int i = 0; i <= threadCount; i++)
+            queues.emplace_back(new Queue());
+
+        running = true;
+        for (unsigned int i = 0; i < threadCount; i++)
+            threads.emplace_back([this, i]() { workerLoop((int)i); });
+    }
+
+    /*Number of worker threads, 0 in the single threaded mode*/
+    unsigned int WorkerCount() const
+    {
+        return (unsigned int)threads.size();
+    }
+
+    /**
+     * Queues 'job'. When 'counter' is given it counts the job until it has
+     * finished; when 'after' is given the job only starts once that counter
+     * reached zero.
+     */
+    void Run(std::function<void()> work, JobCounter *counter = nullptr, JobCounter *after = nullptr)
+    {
+        Job job;
+        job.work = std::move(work);
+        job.counter = counter;
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+        if (after)
+        {
+            std::lock_guard<std::mutex> lock(after->mutex);
+            if (!after->Done())
+            {
+                after->continuations.push_back(std::move(job));
+                return;
+            }
+        }
+        submit(std::move(job));
+    }
+
+    /*Returns once 'counter' reached zero, running its queued jobs in the meantime*/
+    void Wait(JobCounter &counter)
+    {
+        while (!counter.Done())
+        {
+            if (!runOne(&counter))
+                std::this_thread::yield();
+        }
+
+        /*The last job may still hold the lock, the counter can only go away once it let go*/
+        std::lock_guard<std::mutex> lock(counter.mutex);
+    }
+
+    /**
+     * Calls 'work(i)' for every i in [0, count), in jobs of 'grain' indices, and
+     * returns once all of them are done. The jobs point at 'work' instead of
+     * copying it, so a parallel loop doesn't allocate.
+     */
+    template <typename Work>
+    void ParallelFor(size_t count, size_t grain, const Work &work)
+    {
+        grain = std::max<size_t>(1, grain);
+        if (threads.empty() || count <= grain)
+        {
+            for (size_t i = 0; i < count; i++)
+                work(i);
+            return;
+        }
+
+        JobCounter counter;
+        for (size_t begin = 0; begin < count; begin += grain)
+        {
+            Job job;
+            job.range = [](const void *context, size_t begin, size_t end)
+            {
+                const Work &work = *(const Work *)context;
+                for (size_t i = begin; i < end; i++)
+                    work(i);
+            };
+            job.context = &work;
+            job.begin = begin;
+            job.end = std::min(count, begin + grain);
+            job.counter = &counter;
+            counter.pending.fetch_add(1, std::memory_order_relaxed);
+            submit(std::move(job));
+        }
+        Wait(counter);
+    }
+
+private:
+    /*Ring buffer of jobs, it only allocates when it has to grow*/
+    struct Queue
+    {
+        std::mutex mutex;
+        std::vector<Job> slots = std::vector<Job>(64); // power of two
+        size_t head = 0;                                 // oldest job
+        size_t tail = 0;                                 // one past the newest job
+
+        bool Empty() const { return head == tail; }
+
+        void PushBack(Job job)
+        {
+            if (tail - head == slots.size())
+            {
+                std::vector<Job> grown(slots.size() * 2);
+                for (size_t i = head; i < tail; i++)
+                    grown[i - head] = std::move(slots[i & (slots.size() - 1)]);
+                slots.swap(grown);
+                tail -= head;
+                head = 0;
+            }
+            slots[tail++ & (slots.size() - 1)] = std::move(job);
+        }
+
+        Job PopBack() { return std::move(slots[--tail & (slots.size() - 1)]); }
+        Job PopFront() { return std::move(slots[head++ & (slots.size() - 1)]); }
+
+        /*Removes the oldest job of 'counter', the jobs after it move up to keep their order*/
+        bool Take(const JobCounter *counter, Job &job)
+        {
+            size_t mask = slots.size() - 1;
+            for (size_t i = head; i < tail; i++)
+            {
+                if (slots[i & mask].counter != counter)
+                    continue;
+                job = std::move(slots[i & mask]);
+                for (size_t j = i; j + 1 < tail; j++)
+                    slots[j & mask] = std::move(slots[(j + 1) & mask]);
+                tail--;
+                return true;
+            }
+            return false;
+        }
+    };
+
+    /*queues[i] belongs to worker i, the last one is shared by the threads that aren't workers*/
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{false};
+    std::atomic<int> queued{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    JobSystem() = default;
+
+    /*Index of the worker running on this thread, -1 for the other threads*/
+    static int &currentWorker()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (std::thread &thread : threads)
+            thread.join();
+        threads.clear();
+    }
+
+    void submit(Job job)
+    {
+        if (threads.empty())
+        {
+            execute(std::move(job));
+            return;
+        }
+
+        int worker = currentWorker();
+        Queue &queue = *queues[worker >= 0 ? worker : queues.size() - 1];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.PushBack(std::move(job));
+        }
+        queued.fetch_add(1, std::memory_order_release);
+
+        /*Taking the lock orders the notification after a worker's check of 'queued'*/
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    /*Runs a job, then signals its counter and releases what waited for it*/
+    void execute(Job job)
+    {
+        job();
+
+        JobCounter *counter = job.counter;
+        if (!counter)
+            return;
+
+        /*Other jobs of the group are still running, no lock needed*/
+        int pending = counter->pending.load(std::memory_order_relaxed);
+        while (pending > 1)
+        {
+            if (counter->pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel))
+                return;
+        }
+
+        std::vector<Job> continuations;
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return; // a job joined the group in the meantime, it signals the end instead
+            continuations.swap(counter->continuations);
+        }
+        for (Job &continuation : continuations)
+            submit(std::move(continuation));
+    }
+
+    /**
+     * Own jobs newest first, then the shared queue and the other workers oldest
+     * first. With a 'counter' only the jobs of that counter are taken.
+     */
+    bool pop(Job &job, const JobCounter *counter)
+    {
+        int worker = currentWorker();
+        size_t count = queues.size();
+        if (counter)
+        {
+            size_t own = worker >= 0 ? (size_t)worker : count - 1;
+            for (size_t i = 0; i < count; i++)
+            {
+                Queue &queue = *queues[(own + i) % count];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (queue.Take(counter, job))
+                    return true;
+            }
+            return false;
+        }
+
+        if (worker >= 0)
+        {
+            Queue &own = *queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.Empty())
+            {
+                job = own.PopBack();
+                return true;
+            }
+        }
+
+        size_t start = worker >= 0 ? (size_t)worker + 1 : count - 1;
+        for (size_t i = 0; i < count; i++)
+        {
+            Queue &victim = *queues[(start + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.Empty())
+            {
+                job = victim.PopFront();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*Runs one queued job, of 'counter' only when one is given*/
+    bool runOne(const JobCounter *counter = nullptr)
+    {
+        Job job;
+        if (!pop(job, counter))
+            return false;
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        execute(std::move(job));
+        return true;
+    }
+
+    void workerLoop(int index)
+    {
+        currentWorker() = index;
+        while (true)
+        {
+            if (runOne())
+                continue;
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]() { return !running || queued.load(std::memory_order_acquire) > 0; });
+            if (!running)
+                return;
+        }
+    }
+};
+#endif
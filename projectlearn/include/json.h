@@ -0,0 +1,403 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Value of a JSON document.
+ *
+ * Only what the scene files need: the reader keeps numbers as double and
+ * objects as sorted maps, and there is no writer. Accessors return a
+ * fallback instead of failing when a value is missing or of another type,
+ * so optional fields read in one line.
+ */
+class JsonValue
+{
+public:
+    enum Type
+    {
+        NullType,
+        BoolType,
+        NumberType,
+        StringType,
+        ArrayType,
+        ObjectType
+    };
+
+    Type type = NullType;
+    bool boolean = false;
+    double number = 0.0;
+    std::string string;
+    std::vector<JsonValue> array;
+    std::map<std::string, JsonValue> object;
+
+    bool IsNull() const { return type == NullType; }
+    bool IsNumber() const { return type == NumberType; }
+    bool IsArray() const { return type == ArrayType; }
+    bool IsObject() const { return type == ObjectType; }
+
+    /*Member of an object, a null value when there is none*/
+    const JsonValue &operator[](const std::string &name) const
+    {
+        auto found = object.find(name);
+        return found != object.end() ? found->second : null();
+    }
+
+    /*Element of an array, a null value past its end*/
+    const JsonValue &operator[](size_t index) const
+    {
+        return index < array.size() ? array[index] : null();
+    }
+
+    size_t Size() const { return type == ArrayType ? array.size() : type == ObjectType ? object.size() : 0; }
+
+    double AsNumber(double fallback = 0.0) const { return type == NumberType ? number : fallback; }
+    bool AsBool(bool fallback = false) const { return type == BoolType ? boolean : fallback; }
+    std::string AsString(const std::string &fallback = std::string()) const { return type == StringType ? string : fallback; }
+
+private:
+    static const JsonValue &null()
+    {
+        static const JsonValue value;
+        return value;
+    }
+};
+
+/**
+ * Recursive descent reader of RFC 8259 JSON. Errors are reported with the
+ * line they occur on and leave the document null.
+ */
+class JsonReader
+{
+public:
+    /*Parses the file at 'path', returns false after reporting the error*/
+    static bool ReadFile(const std::string &path, JsonValue &document)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::JSON::FILE_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+
+        std::stringstream contents;
+        contents << file.rdbuf();
+        return Read(contents.str(), document, path);
+    }
+
+    /*Parses 'text', 'source' names it in the error messages*/
+    static bool Read(const std::string &text, JsonValue &document, const std::string &source = "<string>")
+    {
+        JsonReader reader(text);
+        document = JsonValue();
+        if (!reader.value(document, 0) || (reader.skipSpace(), reader.position != text.size()))
+        {
+            if (reader.error.empty())
+                reader.error = "TRAILING_CHARACTERS";
+            std::cout << "ERROR::JSON::" << reader.error << " " << source << ":" << reader.line() << std::endl;
+            document = JsonValue();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    /*Deeper documents are rejected instead of overflowing the stack*/
+    static const int MAX_DEPTH = 64;
+
+    const std::string &text;
+    size_t position = 0;
+    std::string error;
+
+    explicit JsonReader(const std::string &text) : text(text) {}
+
+    bool fail(const char *reason)
+    {
+        if (error.empty())
+            error = reason;
+        return false;
+    }
+
+    int line() const
+    {
+        int count = 1;
+        for (size_t i = 0; i < position && i < text.size(); i++)
+            if (text[i] == '\n')
+                count++;
+        return count;
+    }
+
+    void skipSpace()
+    {
+        while (position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r'))
+            position++;
+    }
+
+    bool consume(const char *literal)
+    {
+        size_t length = std::char_traits<char>::length(literal);
+        if (text.compare(position, length, literal) != 0)
+            return false;
+        position += length;
+        return true;
+    }
+
+    bool value(JsonValue &out, int depth)
+    {
+        if (depth > MAX_DEPTH)
+            return fail("TOO_DEEP");
+
+        skipSpace();
+        if (position >= text.size())
+            return fail("UNEXPECTED_END");
+
+        char c = text[position];
+        if (c == '{')
+            return objectValue(out, depth);
+        if (c == '[')
+            return arrayValue(out, depth);
+        if (c == '"')
+        {
+            out.type = JsonValue::StringType;
+            return stringValue(out.string);
+        }
+        if (c == '-' || (c >= '0' && c <= '9'))
+            return numberValue(out);
+        if (consume("true"))
+        {
+            out.type = JsonValue::BoolType;
+            out.boolean = true;
+            return true;
+        }
+        if (consume("false"))
+        {
+            out.type = JsonValue::BoolType;
+            out.boolean = false;
+            return true;
+        }
+        if (consume("null"))
+        {
+            out.type = JsonValue::NullType;
+            return true;
+        }
+        return fail("UNEXPECTED_CHARACTER");
+    }
+
+    bool objectValue(JsonValue &out, int depth)
+    {
+        out.type = JsonValue::ObjectType;
+        position++;
+        skipSpace();
+        if (position < text.size() && text[position] == '}')
+        {
+            position++;
+            return true;
+        }
+
+        while (true)
+        {
+            skipSpace();
+            std::string name;
+            if (position >= text.size() || text[position] != '"')
+                return fail("EXPECTED_MEMBER_NAME");
+            if (!stringValue(name))
+                return false;
+
+            skipSpace();
+            if (position >= text.size() || text[position] != ':')
+                return fail("EXPECTED_COLON");
+            position++;
+
+            if (!value(out.object[name], depth + 1))
+                return false;
+
+            skipSpace();
+            if (position < text.size() && text[position] == ',')
+            {
+                position++;
+                continue;
+            }
+            if (position < text.size() && text[position] == '}')
+            {
+                position++;
+                return true;
+            }
+            return fail("EXPECTED_COMMA_OR_BRACE");
+        }
+    }
+
+    bool arrayValue(JsonValue &out, int depth)
+    {
+        out.type = JsonValue::ArrayType;
+        position++;
+        skipSpace();
+        if (position < text.size() && text[position] == ']')
+        {
+            position++;
+            return true;
+        }
+
+        while (true)
+        {
+            out.array.emplace_back();
+            if (!value(out.array.back(), depth + 1))
+                return false;
+
+            skipSpace();
+            if (position < text.size() && text[position] == ',')
+            {
+                position++;
+                continue;
+            }
+            if (position < text.size() && text[position] == ']')
+            {
+                position++;
+                return true;
+            }
+            return fail("EXPECTED_COMMA_OR_BRACKET");
+        }
+    }
+
+    bool numberValue(JsonValue &out)
+    {
+        size_t start = position;
+        if (text[position] == '-')
+            position++;
+        if (position >= text.size() || !isdigit((unsigned char)text[position]))
+            return fail("INVALID_NUMBER");
+        while (position < text.size() && (isdigit((unsigned char)text[position]) || text[position] == '.' || text[position] == 'e' ||
+                                          text[position] == 'E' || text[position] == '+' || text[position] == '-'))
+            position++;
+
+        std::string number = text.substr(start, position - start);
+        char *end = nullptr;
+        out.type = JsonValue::NumberType;
+        out.number = std::strtod(number.c_str(), &end);
+        if (end != number.c_str() + number.size())
+        {
+            position = start;
+            return fail("INVALID_NUMBER");
+        }
+        return true;
+    }
+
+    bool stringValue(std::string &out)
+    {
+        position++;
+        while (position < text.size())
+        {
+            char c = text[position++];
+            if (c == '"')
+                return true;
+            if ((unsigned char)c < 0x20)
+                return fail("CONTROL_CHARACTER_IN_STRING");
+            if (c != '\\')
+            {
+                out += c;
+                continue;
+            }
+
+            if (position >= text.size())
+                break;
+            char escape = text[position++];
+            switch (escape)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                out += escape;
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u':
+            {
+                unsigned int code;
+                if (!hex4(code))
+                    return fail("INVALID_UNICODE_ESCAPE");
+                /*Surrogate pairs are combined, a lone surrogate is kept as is*/
+                if (code >= 0xD800 && code < 0xDC00 && text.compare(position, 2, "\\u") == 0)
+                {
+                    size_t save = position;
+                    position += 2;
+                    unsigned int low;
+                    if (hex4(low) && low >= 0xDC00 && low < 0xE000)
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    else
+                        position = save;
+                }
+                appendUtf8(out, code);
+                break;
+            }
+            default:
+                return fail("INVALID_ESCAPE");
+            }
+        }
+        return fail("UNTERMINATED_STRING");
+    }
+
+    bool hex4(unsigned int &code)
+    {
+        if (position + 4 > text.size())
+            return false;
+        code = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            char c = text[position++];
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+                code |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                code |= c - 'A' + 10;
+            else
+                return false;
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string &out, unsigned int code)
+    {
+        if (code < 0x80)
+            out += (char)code;
+        else if (code < 0x800)
+        {
+            out += (char)(0xC0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            out += (char)(0xE0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            out += (char)(0xF0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3F));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+};
+#endif
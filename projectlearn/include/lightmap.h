@@ -0,0 +1,319 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/*Edge length of the lightmap atlas shared by all static instances of a model*/
+const int LIGHTMAP_SIZE = 1024;
+
+/*Preferred lightmap resolution, lowered step by step until every instance fits in the atlas*/
+const float LIGHTMAP_TEXELS_PER_UNIT = 4.0f;
+const float LIGHTMAP_MIN_TEXELS_PER_UNIT = 0.25f;
+
+/*Empty texels around every chart, so bilinear filtering never reads a neighbouring chart*/
+const int LIGHTMAP_PADDING = 2;
+
+/**
+ * Generates the lightmap UVs of the static meshes of a model.
+ *
+ * Every mesh is cut into charts of connected, coplanar triangles, each chart
+ * is projected onto its plane, and the charts are shelf packed into a tile per
+ * mesh. Every instance of a mesh then gets its own copy of that tile in the
+ * atlas, so instances share vertices but not lighting: Vertex::LightmapUV
+ * addresses the tile and InstanceData::lightmapST places it in the atlas.
+ *
+ * Node transforms may scale instances. A scaled up instance gets a
+ * proportionally larger copy of the tile, so its texel density matches the
+ * unscaled ones; a scaled down instance keeps the mesh's tile, which keeps
+ * the padding between charts at LIGHTMAP_PADDING texels at least. The
+ * copies made by Model::Place() reuse these tiles, a placement's scale
+ * changes their density.
+ */
+class LightmapLayout
+{
+public:
+    /**
+     * Lays out every mesh without bones in 'meshes', duplicating the vertices
+     * shared by several charts. Returns the resolution used in texels per unit,
+     * 0 when the meshes don't fit even at the lowest resolution.
+     */
+    static float Build(vector<MeshData> &meshes)
+    {
+        vector<vector<Chart>> charts(meshes.size());
+        size_t chartCount = 0;
+        for (size_t m = 0; m < meshes.size(); m++)
+        {
+            if (!meshes[m].skinned)
+                charts[m] = makeCharts(meshes[m]);
+            chartCount += charts[m].size();
+        }
+        if (chartCount == 0)
+            return 0.0f;
+
+        for (float density = LIGHTMAP_TEXELS_PER_UNIT; density >= LIGHTMAP_MIN_TEXELS_PER_UNIT; density *= 0.75f)
+        {
+            /*Packing the charts of each mesh into its tile*/
+            vector<glm::ivec2> tiles(meshes.size(), glm::ivec2(0));
+            bool fits = true;
+            for (size_t m = 0; m < meshes.size() && fits; m++)
+            {
+                if (charts[m].empty())
+                    continue;
+                tiles[m] = packCharts(charts[m], density);
+                fits = tiles[m].x <= LIGHTMAP_SIZE && tiles[m].y <= LIGHTMAP_SIZE;
+            }
+            if (!fits)
+                continue;
+
+            /*Packing one tile per instance into the atlas, enlarged by the scale of the instance*/
+            vector<Rect> rects;
+            for (size_t m = 0; m < meshes.size(); m++)
+            {
+                for (size_t i = 0; i < meshes[m].instances.size() && !charts[m].empty(); i++)
+                {
+                    float scale = instanceScale(meshes[m].instances[i].transform);
+                    rects.push_back(Rect{(int)ceil(tiles[m].x * scale), (int)ceil(tiles[m].y * scale), 0, 0, m, i});
+                }
+            }
+            if (!shelfPack(rects, LIGHTMAP_SIZE, LIGHTMAP_SIZE))
+                continue;
+
+            for (size_t m = 0; m < meshes.size(); m++)
+                if (!charts[m].empty())
+                    applyCharts(meshes[m], charts[m], tiles[m], density);
+
+            for (const Rect &rect : rects)
+            {
+                meshes[rect.item].instances[rect.instance].lightmapST =
+                    glm::vec4(rect.width, rect.height, rect.x, rect.y) / (float)LIGHTMAP_SIZE;
+            }
+
+            return density;
+        }
+
+        cout << "ERROR::MODEL::LIGHTMAP_ATLAS_FULL" << endl;
+        return 0.0f;
+    }
+
+private:
+    /*Coplanar triangles projected onto their plane, in world units*/
+    struct Chart
+    {
+        vector<unsigned int> triangles; // triangle indices into the mesh
+        vector<glm::vec2> corners;      // projected position of the 3 corners of every triangle
+        glm::vec2 minimum;
+        glm::vec2 maximum;
+        int x = 0, y = 0;               // texel position inside the mesh tile
+    };
+
+    /*Item for the shelf packer, 'item' is the chart or mesh and 'instance' the instance it belongs to*/
+    struct Rect
+    {
+        int width, height;
+        int x, y;
+        size_t item, instance;
+    };
+
+    /*Largest scale along the axes of 'transform', at least 1, see the class comment*/
+    static float instanceScale(const glm::mat4 &transform)
+    {
+        float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+        return std::max(1.0f, scale);
+    }
+
+    /*Triangles sharing an edge belong to one chart when their normals differ by less than ~2.5 degrees*/
+    static constexpr float COPLANAR_COSINE = 0.999f;
+
+    static vector<Chart> makeCharts(const MeshData &mesh)
+    {
+        size_t triangleCount = mesh.indices.size() / 3;
+
+        /*Vertices are often duplicated per face, adjacency is found through quantized positions*/
+        std::map<std::tuple<int64_t, int64_t, int64_t>, unsigned int> positionIds;
+        vector<unsigned int> positionOf(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+        {
+            const glm::vec3 &p = mesh.vertices[i].Position;
+            auto key = std::make_tuple(llround(p.x * 10000.0), llround(p.y * 10000.0), llround(p.z * 10000.0));
+            auto found = positionIds.emplace(key, (unsigned int)positionIds.size());
+            positionOf[i] = found.first->second;
+        }
+
+        std::map<std::pair<unsigned int, unsigned int>, vector<unsigned int>> edgeTriangles;
+        vector<glm::vec3> normals(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3 &a = mesh.vertices[mesh.indices[t * 3]].Position;
+            const glm::vec3 &b = mesh.vertices[mesh.indices[t * 3 + 1]].Position;
+            const glm::vec3 &c = mesh.vertices[mesh.indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            normals[t] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int p0 = positionOf[mesh.indices[t * 3 + k]];
+                unsigned int p1 = positionOf[mesh.indices[t * 3 + (k + 1) % 3]];
+                edgeTriangles[std::make_pair(std::min(p0, p1), std::max(p0, p1))].push_back((unsigned int)t);
+            }
+        }
+
+        /*Flood filling coplanar neighbours from every triangle that has no chart yet*/
+        vector<Chart> charts;
+        vector<bool> assigned(triangleCount, false);
+        for (size_t seed = 0; seed < triangleCount; seed++)
+        {
+            if (assigned[seed])
+                continue;
+
+            Chart chart;
+            glm::vec3 normal = normals[seed];
+            vector<unsigned int> open(1, (unsigned int)seed);
+            assigned[seed] = true;
+            while (!open.empty())
+            {
+                unsigned int t = open.back();
+                open.pop_back();
+                chart.triangles.push_back(t);
+
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int p0 = positionOf[mesh.indices[t * 3 + k]];
+                    unsigned int p1 = positionOf[mesh.indices[t * 3 + (k + 1) % 3]];
+                    for (unsigned int neighbour : edgeTriangles[std::make_pair(std::min(p0, p1), std::max(p0, p1))])
+                    {
+                        if (!assigned[neighbour] && glm::dot(normals[neighbour], normal) > COPLANAR_COSINE)
+                        {
+                            assigned[neighbour] = true;
+                            open.push_back(neighbour);
+                        }
+                    }
+                }
+            }
+
+            /*Projecting onto the plane of the seed triangle*/
+            glm::vec3 axisU = glm::normalize(glm::cross(normal, fabs(normal.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0)));
+            glm::vec3 axisV = glm::cross(normal, axisU);
+            for (unsigned int t : chart.triangles)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    const glm::vec3 &p = mesh.vertices[mesh.indices[t * 3 + k]].Position;
+                    glm::vec2 corner(glm::dot(p, axisU), glm::dot(p, axisV));
+                    chart.minimum = chart.corners.empty() ? corner : glm::min(chart.minimum, corner);
+                    chart.maximum = chart.corners.empty() ? corner : glm::max(chart.maximum, corner);
+                    chart.corners.push_back(corner);
+                }
+            }
+            charts.push_back(std::move(chart));
+        }
+        return charts;
+    }
+
+    static glm::ivec2 chartSize(const Chart &chart, float density)
+    {
+        glm::vec2 extent = (chart.maximum - chart.minimum) * density;
+        return glm::ivec2((int)std::ceil(extent.x) + 1 + 2 * LIGHTMAP_PADDING, (int)std::ceil(extent.y) + 1 + 2 * LIGHTMAP_PADDING);
+    }
+
+    /*Places the charts of a mesh in its tile and returns the tile size in texels*/
+    static glm::ivec2 packCharts(vector<Chart> &charts, float density)
+    {
+        vector<Rect> rects;
+        int area = 0, widest = 0;
+        for (size_t c = 0; c < charts.size(); c++)
+        {
+            glm::ivec2 size = chartSize(charts[c], density);
+            rects.push_back(Rect{size.x, size.y, 0, 0, c, 0});
+            area += size.x * size.y;
+            widest = std::max(widest, size.x);
+        }
+
+        /*A roughly square tile, unbounded in height*/
+        int width = std::max(widest, (int)std::ceil(std::sqrt((float)area) * 1.2f));
+        shelfPack(rects, width, INT32_MAX);
+
+        glm::ivec2 tile(0);
+        for (const Rect &rect : rects)
+        {
+            charts[rect.item].x = rect.x;
+            charts[rect.item].y = rect.y;
+            tile = glm::max(tile, glm::ivec2(rect.x + rect.width, rect.y + rect.height));
+        }
+        return tile;
+    }
+
+    /*Shelf packing, tallest items first. Returns false when the items don't fit in 'height'*/
+    static bool shelfPack(vector<Rect> &rects, int width, int height)
+    {
+        vector<size_t> order(rects.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&rects](size_t a, size_t b) { return rects[a].height > rects[b].height; });
+
+        int x = 0, y = 0, shelfHeight = 0;
+        for (size_t i : order)
+        {
+            Rect &rect = rects[i];
+            if (rect.width > width)
+                return false;
+            if (x + rect.width > width)
+            {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            if ((int64_t)y + rect.height > height)
+                return false;
+
+            rect.x = x;
+            rect.y = y;
+            x += rect.width;
+            shelfHeight = std::max(shelfHeight, rect.height);
+        }
+        return true;
+    }
+
+    /*Rewrites the vertices of a mesh with their lightmap UVs, a vertex used by several charts is duplicated*/
+    static void applyCharts(MeshData &mesh, const vector<Chart> &charts, const glm::ivec2 &tile, float density)
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices(mesh.indices.size());
+        for (const Chart &chart : charts)
+        {
+            std::map<unsigned int, unsigned int> remap;
+            for (size_t i = 0; i < chart.triangles.size(); i++)
+            {
+                unsigned int t = chart.triangles[i];
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int original = mesh.indices[t * 3 + k];
+                    auto found = remap.find(original);
+                    if (found == remap.end())
+                    {
+                        Vertex vertex = mesh.vertices[original];
+                        glm::vec2 texel = glm::vec2(chart.x + LIGHTMAP_PADDING, chart.y + LIGHTMAP_PADDING) +
+                                          (chart.corners[i * 3 + k] - chart.minimum) * density + glm::vec2(0.5f);
+                        vertex.LightmapUV = texel / glm::vec2(tile);
+                        found = remap.emplace(original, (unsigned int)vertices.size()).first;
+                        vertices.push_back(vertex);
+                    }
+                    indices[t * 3 + k] = found->second;
+                }
+            }
+        }
+        mesh.vertices = std::move(vertices);
+        mesh.indices = std::move(indices);
+    }
+};
+#endif
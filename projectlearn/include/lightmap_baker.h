@@ -0,0 +1,283 @@
+#ifndef LIGHTMAP_BAKER_H
+#define LIGHTMAP_BAKER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "bake_cache.h"
+#include "bake_scene.h"
+#include "lightmap.h"
+#include "shader.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*Texture unit of the lightmap, after the sun shadow maps*/
+const int LIGHTMAP_UNIT = 15;
+
+/*Hemisphere rays per texel gathering the first bounce*/
+const int LIGHTMAP_BOUNCE_SAMPLES = 16;
+
+/**
+ * CPU baker of the static lighting of a model into its lightmap atlas.
+ *
+ * Direct light from the sun and the bulbs, with shadows, plus one bounce is
+ * gathered for every lightmap texel by tracing rays through the BakeScene,
+ * spread over all cores. Bakes run in the background: Request() returns false
+ * and the renderer keeps its dynamic lighting until the lightmap of the
+ * current light configuration is ready.
+ *
+ * Only the diffuse response is baked, specular highlights and the per-bulb
+ * ambient terms are left out.
+ */
+class LightmapBaker
+{
+public:
+    /*'scene' must outlive the baker, results are cached in 'cacheDirectory'*/
+    LightmapBaker(const BakeScene &scene, const std::string &cacheDirectory)
+        : scene(scene), cache(cacheDirectory, "lightmap", 0x4C4D5031) // "LMP1"
+    {
+    }
+
+    /**
+     * Called every frame with the current lights. Returns true when their
+     * lightmap is bound by Bind(), otherwise makes sure it is being produced,
+     * from the disk cache or by a new bake once the running one is done.
+     */
+    bool Request(const BakeLights &lights)
+    {
+        if (scene.Empty())
+            return false;
+
+        uint64_t key = keyFor(lights);
+        if (texture && textureKey == key)
+        {
+            cache.Cancel();
+            return true;
+        }
+
+        std::vector<float> data;
+        uint64_t dataKey;
+        std::vector<uint32_t> header = {(uint32_t)LIGHTMAP_SIZE};
+        while (cache.Poll(key, header, (size_t)LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3, [this, lights]() { return run(lights); }, data, dataKey))
+        {
+            upload(data, dataKey);
+            if (dataKey == key)
+                return true;
+        }
+        return false;
+    }
+
+    /*True while a bake is running in the background*/
+    bool Baking() const
+    {
+        return cache.Baking();
+    }
+
+    /*Binds the current lightmap to LIGHTMAP_UNIT*/
+    void Bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + LIGHTMAP_UNIT);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /*Points the 'lightmap' sampler of a shader at its texture unit*/
+    static void ConfigureShader(const Shader &shader)
+    {
+        shader.use();
+        shader.setInt("lightmap", LIGHTMAP_UNIT);
+    }
+
+private:
+    /*Texel covered by a triangle, with the surface point it stands for*/
+    struct Texel
+    {
+        size_t index;
+        glm::vec3 position;
+        glm::vec3 normal;
+    };
+
+    const BakeScene &scene;
+    BakeCache cache;
+
+    GLuint texture = 0;
+    uint64_t textureKey = 0;
+
+    uint64_t keyFor(const BakeLights &lights) const
+    {
+        const int parameters[2] = {LIGHTMAP_SIZE, LIGHTMAP_BOUNCE_SAMPLES};
+        return BakeScene::HashBytes(scene.Key(lights), parameters, sizeof(parameters));
+    }
+
+    void upload(const std::vector<float> &data, uint64_t key)
+    {
+        if (data.size() != (size_t)LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3)
+            return;
+
+        if (!texture)
+            glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, LIGHTMAP_SIZE, LIGHTMAP_SIZE, 0, GL_RGB, GL_FLOAT, data.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        textureKey = key;
+    }
+
+    /*Bake of one light configuration, runs on a background thread and returns RGB irradiance per texel*/
+    std::vector<float> run(BakeLights lights) const
+    {
+        const size_t texelCount = (size_t)LIGHTMAP_SIZE * LIGHTMAP_SIZE;
+        std::vector<Texel> texels = rasterize();
+
+        /*Direct light first, the bounce reads it back at the ray hits*/
+        std::vector<glm::vec3> direct(texelCount, glm::vec3(0.0f));
+        BakeScene::ParallelFor(texels.size(), [&](size_t i)
+                               { direct[texels[i].index] = scene.DirectLight(texels[i].position, texels[i].normal, lights); });
+
+        std::vector<glm::vec3> irradiance = direct;
+        BakeScene::ParallelFor(texels.size(), [&](size_t i)
+                               { irradiance[texels[i].index] += bounceLight(texels[i], direct, (uint32_t)i * 9781u + 1u); });
+
+        std::vector<bool> covered(texelCount, false);
+        for (const Texel &texel : texels)
+            covered[texel.index] = true;
+        dilate(irradiance, covered);
+
+        std::vector<float> result(texelCount * 3);
+        for (size_t i = 0; i < texelCount; i++)
+        {
+            result[i * 3] = irradiance[i].x;
+            result[i * 3 + 1] = irradiance[i].y;
+            result[i * 3 + 2] = irradiance[i].z;
+        }
+        return result;
+    }
+
+    /*Finds the texels whose centers lie inside a triangle, with the interpolated position and normal*/
+    std::vector<Texel> rasterize() const
+    {
+        std::vector<Texel> texels;
+        std::vector<bool> taken((size_t)LIGHTMAP_SIZE * LIGHTMAP_SIZE, false);
+        for (const BakeTriangle &triangle : scene.Triangles())
+        {
+            glm::vec2 a = triangle.lightmap[0] * (float)LIGHTMAP_SIZE;
+            glm::vec2 b = triangle.lightmap[1] * (float)LIGHTMAP_SIZE;
+            glm::vec2 c = triangle.lightmap[2] * (float)LIGHTMAP_SIZE;
+            float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+            if (fabs(area) < 1e-8f)
+                continue;
+
+            int x0 = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+            int y0 = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+            int x1 = std::min(LIGHTMAP_SIZE - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+            int y1 = std::min(LIGHTMAP_SIZE - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    glm::vec2 p(x + 0.5f, y + 0.5f);
+                    float w1 = ((p.x - a.x) * (c.y - a.y) - (p.y - a.y) * (c.x - a.x)) / area;
+                    float w2 = ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / area;
+                    float w0 = 1.0f - w1 - w2;
+                    size_t index = (size_t)y * LIGHTMAP_SIZE + x;
+                    if (w0 < -1e-4f || w1 < -1e-4f || w2 < -1e-4f || taken[index])
+                        continue;
+
+                    taken[index] = true;
+                    Texel texel;
+                    texel.index = index;
+                    texel.position = triangle.position[0] * w0 + triangle.position[1] * w1 + triangle.position[2] * w2;
+                    texel.normal = glm::normalize(triangle.normal[0] * w0 + triangle.normal[1] * w1 + triangle.normal[2] * w2);
+                    texels.push_back(texel);
+                }
+            }
+        }
+        return texels;
+    }
+
+    /**
+     * First bounce: cosine distributed rays pick up the direct light stored at
+     * the texel they hit, tinted by its albedo. With cosine sampling the mean of
+     * those values is the bounced irradiance.
+     */
+    glm::vec3 bounceLight(const Texel &texel, const std::vector<glm::vec3> &direct, uint32_t seed) const
+    {
+        glm::vec3 axisU = glm::normalize(glm::cross(texel.normal, fabs(texel.normal.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0)));
+        glm::vec3 axisV = glm::cross(texel.normal, axisU);
+        glm::vec3 origin = texel.position + texel.normal * 1e-3f;
+
+        auto random = [&seed]()
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            return (seed & 0xFFFFFF) / 16777216.0f;
+        };
+
+        glm::vec3 sum(0.0f);
+        for (int s = 0; s < LIGHTMAP_BOUNCE_SAMPLES; s++)
+        {
+            float phi = 6.2831853f * random();
+            float r2 = random();
+            float r = sqrt(r2);
+            glm::vec3 direction = axisU * (r * cos(phi)) + axisV * (r * sin(phi)) + texel.normal * sqrt(1.0f - r2);
+
+            /*Only the lit front side of a surface reflects*/
+            SurfaceHit hit;
+            if (!scene.Trace(origin, direction, 100.0f, hit) || !hit.front)
+                continue;
+
+            int x = std::min(LIGHTMAP_SIZE - 1, std::max(0, (int)(hit.lightmap.x * LIGHTMAP_SIZE)));
+            int y = std::min(LIGHTMAP_SIZE - 1, std::max(0, (int)(hit.lightmap.y * LIGHTMAP_SIZE)));
+            sum += hit.triangle->albedo * direct[(size_t)y * LIGHTMAP_SIZE + x];
+        }
+        return sum / (float)LIGHTMAP_BOUNCE_SAMPLES;
+    }
+
+    /*Spreads the texels into the chart padding, so filtering at chart borders doesn't pull in black*/
+    static void dilate(std::vector<glm::vec3> &irradiance, std::vector<bool> &covered)
+    {
+        for (int pass = 0; pass < LIGHTMAP_PADDING; pass++)
+        {
+            std::vector<size_t> filled;
+            for (int y = 0; y < LIGHTMAP_SIZE; y++)
+            {
+                for (int x = 0; x < LIGHTMAP_SIZE; x++)
+                {
+                    size_t index = (size_t)y * LIGHTMAP_SIZE + x;
+                    if (covered[index])
+                        continue;
+
+                    glm::vec3 sum(0.0f);
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < 0 || ny < 0 || nx >= LIGHTMAP_SIZE || ny >= LIGHTMAP_SIZE || !covered[(size_t)ny * LIGHTMAP_SIZE + nx])
+                                continue;
+                            sum += irradiance[(size_t)ny * LIGHTMAP_SIZE + nx];
+                            count++;
+                        }
+                    }
+                    if (count > 0)
+                    {
+                        irradiance[index] = sum / (float)count;
+                        filled.push_back(index);
+                    }
+                }
+            }
+            for (size_t index : filled)
+                covered[index] = true;
+        }
+    }
+};
+#endif
@@ -7,12 +7,19 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "shader_variants.h"
+#include "draw_stats.h"
+#include "geometry_pool.h"
+#include "resource_manager.h"
+#include "string_id.h"
+#include "texture_array.h"
 
 #include <string>
 #include <vector>
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
+#define MAX_BONES 100 // length of 'finalBonesMatrices' in animation.vs and shadow.vs
 
 
 /**
@@ -42,6 +49,9 @@ struct Vertex
      */
     int m_BoneIDs[MAX_BONE_INFLUENCE];
     float m_Weights[MAX_BONE_INFLUENCE];
+
+    /*Position of the vertex in the lightmap tile of its mesh, see lightmap.h*/
+    glm::vec2 LightmapUV;
 };
 
 /**
@@ -66,9 +76,63 @@ struct Material
  */
 struct Texture
 {
-    unsigned int id;
-    string type;
+    unsigned int id; // id of the texture page (GL_TEXTURE_2D_ARRAY) holding the image
+    StringId type; // sampler name, e.g. "texture_diffuse"
     string path;
+    int page;  // index of the page within the model
+    int layer; // layer of the image inside its page
+};
+
+/**
+ * Material as laid out in the std140 'Materials' uniform block of the shaders,
+ * meshes only carry an index into this buffer.
+ */
+struct GPUMaterial
+{
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 params; // x: shininess, y: diffuse texture page (-1 without texture), z: diffuse texture layer
+};
+
+const int MAX_MATERIALS = 256;         // 256 * 64 bytes, the minimum uniform block size GL guarantees
+const GLuint MATERIAL_BLOCK_BINDING = 0; // uniform buffer binding point of the 'Materials' block
+
+/**
+ * Per-instance data of a mesh, stored in the instance buffer
+ * and advanced once per drawn instance
+ */
+struct InstanceData
+{
+    glm::mat4 transform; // placement of the instance
+    glm::vec4 lightmapST; // scale (xy) and offset (zw) of the instance's tile in the lightmap atlas
+    GLint material;      // index into the model's material buffer
+    GLint probe;         // reflection probe of reflective instances, -1 for the skybox
+    GLint padding[2];
+};
+
+/*Points the samplers and the material block of a shader at the bindings used by Model::Draw*/
+inline void ConfigureMaterialShader(const Shader &shader)
+{
+    TexturePages::ConfigureShader(shader);
+    shader.setBlockBinding("Materials", MATERIAL_BLOCK_BINDING);
+}
+
+/**
+ * CPU side data of a mesh gathered by the loader, before it is turned into
+ * a Mesh with GPU buffers.
+ */
+struct MeshData
+{
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures;
+    Material mat;
+    aiString name;
+    StringId tag;                 // hashed name, compared instead of the string
+    int material;                 // index of the material in the model's material buffer
+    bool skinned;                 // bone weighted meshes are kept in model space and never instanced
+    vector<InstanceData> instances; // placement and material of every occurrence of this geometry
 };
 
 class Mesh
@@ -77,14 +141,26 @@ public:
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
+    vector<InstanceData> instances; // per-instance transforms and materials, drawn in one instanced call
     Material mat;
     bool isBulb;
     bool isGlass;
     bool isWater;
+    unsigned int variantFlags; // ShaderVariantFlags describing this mesh
+    glm::vec3 boundsCenter;    // bounding sphere of the mesh in its local frame
+    float boundsRadius;
+    float uvDensity;           // UV units per local unit of surface, used for texture streaming feedback
     aiString name;
-    unsigned int VAO;
+    StringId tag; // hashed name, compared instead of the string
 
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Material mat, aiString name)
+    /**
+     * Meshes given a 'pool' keep their geometry in it instead of buffers of
+     * their own: they are created without it and only drawn while Resident(),
+     * see MakeResident() and Evict().
+     */
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Material mat, aiString name,
+         vector<InstanceData> instances, GeometryPool *pool = nullptr)
+        : pool(pool)
     {
         /*Initializing the variable of Mesh Class*/
         this->vertices = vertices;
@@ -92,190 +168,322 @@ public:
         this->textures = textures;
         this->mat = mat;
         this->name = name;
+        this->tag = StringId(name.C_Str(), name.length);
+        this->instances = instances;
 
 
         /**
          * Identifying certain type of mesh based on name,
          * and setting up bolean falags
          */
-        if (strcmp(this->name.C_Str(), "light") == 0 || strcmp(this->name.C_Str(), "spotlight") == 0)
-            this->isBulb = true;
-        else
-            this->isBulb = false;
-
-        if (strcmp(this->name.C_Str(), "glass") == 0)
-            this->isGlass = true;
-        else
-            this->isGlass = false;
-
-        if (strcmp(this->name.C_Str(), "water") == 0)
-            this->isWater = true;
-        else
-            this->isWater = false;
+        this->isBulb = this->tag == "light"_id || this->tag == "spotlight"_id;
+        this->isGlass = this->tag == "glass"_id;
+        this->isWater = this->tag == "water"_id;
+
+        /*Selecting the lighting shader permutation that matches the mesh*/
+        this->variantFlags = 0;
+        if (this->mat.hasTexture)
+            this->variantFlags |= VARIANT_TEXTURED;
+        if (this->isBulb)
+            this->variantFlags |= VARIANT_BULB;
+        if (this->isGlass)
+            this->variantFlags |= VARIANT_GLASS;
+        if (this->isWater)
+            this->variantFlags |= VARIANT_WATER;
+
+        computeTextureDensity();
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader &shader, bool isLighting, GLuint cubetex)
+    /**
+     * Render every instance of the mesh
+     *
+     * Textures and materials are bound once for the whole model (see Model::Draw),
+     * each instance finds its material through the index in the instance buffer.
+     */
+    void Draw(bool isLighting)
     {
+        if (!Resident())
+            return;
+
         /* Enabling blending */
         if (isLighting && this->isGlass)
             glEnable(GL_BLEND);
 
-        /*Configuring the material properties and related value for the mesh to be rendered*/
-        if (isLighting)
-        {
-            shader.setVec4("material.ambient", mat.Ka);
-            shader.setVec4("material.diffuse", mat.Kd);
-            shader.setVec4("material.specular", mat.Ks);
-            shader.setFloat("material.shininess", mat.shininess);
-
-            shader.setBool("material.hasTexture", mat.hasTexture);
-        }
-
-        /**
-         * Variable to keep track of the unit indices for different types of Texture
-         * associated with the materials of the mesh
-         */
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
+        /* Rendering every instance of the Mesh using defined OpenGL VAO*/
+        glBindVertexArray(vertexArray.Get()); // Binds previously selected VAO
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, (void *)poolRange.IndexOffset(),
+                                static_cast<GLsizei>(instances.size())); // Initiates rendering process, pooled indices start at their range
+        glBindVertexArray(0);   // Unbinds the previously selected VAO
+        DrawStats::Instance().Count(indices.size() / 3, instances.size());
 
+        /* Disabling gl_blend*/
+        if (isLighting && this->isGlass)
+            glDisable(GL_BLEND);
+    }
 
-        for (unsigned int i = 1; i <= (textures.size()); i++)
+    /*Uploads the instance data again after it has been changed, the buffer grows when instances were added*/
+    void UpdateInstances()
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.Get());
+        if (instances.size() > instanceCapacity)
         {
-            /*Activating texture unit correponsing to the current texture*/
-            glActiveTexture(GL_TEXTURE0 + i);
+            instanceCapacity = instances.size();
+            glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_STATIC_DRAW);
+        }
+        else if (!instances.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-            /*Retrieves the texture type from current texture for texture vector*/
-            string number;
-            string name = textures[i - 1].type;
+    /*True while the geometry can be drawn, always for meshes with buffers of their own*/
+    bool Resident() const
+    {
+        return !pool || poolRange.Valid();
+    }
 
-            /*Checking the texture type and incrementing the appropriate counter*/
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
+    /*Bytes of vertices and indices the mesh takes in the pool*/
+    size_t GeometryBytes() const
+    {
+        return vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+    }
 
+    /**
+     * Uploads the geometry of a pooled mesh into its pool and points the
+     * vertex array at it. Returns false when the pool has no room left.
+     */
+    bool MakeResident()
+    {
+        if (Resident())
+            return true;
+
+        PoolRange range = pool->Allocate(vertices.size() * sizeof(Vertex), indices.size() * sizeof(unsigned int));
+        if (!range.Valid())
+            return false;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool->VertexBuffer());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.VertexOffset(), vertices.size() * sizeof(Vertex), vertices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, pool->IndexBuffer());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range.IndexOffset(), indices.size() * sizeof(unsigned int), indices.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        glBindVertexArray(vertexArray.Get());
+        glBindBuffer(GL_ARRAY_BUFFER, pool->VertexBuffer());
+        setupVertexAttributes(range.VertexOffset());
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool->IndexBuffer());
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        poolRange = std::move(range);
+        return true;
+    }
 
-            /*Retrieving the location of the shader variable corresponding to the current texture type and number*/
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+    /*Gives the pool space of a pooled mesh back, the vertices stay in memory to make it resident again*/
+    void Evict()
+    {
+        poolRange.Reset();
+    }
 
-            /*Activating texture unit again*/
-            glActiveTexture(GL_TEXTURE0 + i);
+private:
+    /**
+     * Vertex array, vertex and element buffers and the per-instance transforms.
+     * The vertex and element buffers are keyed by their content, a mesh of
+     * another model with the same geometry uses the same ones.
+     */
+    VertexArrayHandle vertexArray;
+    BufferHandle vertexBuffer, indexBuffer, instanceBuffer;
+    size_t instanceCapacity = 0; // instances the instance buffer has room for
 
-            /*Binds the actual texture to the currently active texture unit*/
-            glBindTexture(GL_TEXTURE_2D, textures[i - 1].id);
-        }
+    /*Pool holding the geometry instead of the vertex and element buffers, and the mesh's place in it*/
+    GeometryPool *pool;
+    PoolRange poolRange;
 
-        if (isLighting)
+    /**
+     * Binds a buffer holding 'data', shared with the meshes that uploaded the
+     * same target, size and content hash, creating it when there is none.
+     * Buffers with the same hash but a different size are caught, a collision
+     * of the 64-bit hash between equally sized buffers is assumed not to happen.
+     */
+    static BufferHandle sharedBuffer(GLenum target, const void *data, size_t bytes)
+    {
+        uint64_t key = HashName((const char *)data, bytes);
+        key = (key ^ (uint64_t)target) * 0x100000001b3ull;
+        key = (key ^ (uint64_t)bytes) * 0x100000001b3ull;
+        BufferHandle buffer = ResourceManager::Instance().Find<ResourceType::Buffer>(key);
+        if (buffer.Valid())
         {
-            shader.setBool("isBulb", isBulb);
-            shader.setBool("isGlass", isGlass);
-            shader.setBool("isWater", isWater);
+            glBindBuffer(target, buffer.Get());
+            GLint size = 0;
+            glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
+            if ((size_t)size == bytes)
+                return buffer;
+
+            /*Not the same data after all, this mesh gets a buffer of its own*/
+            key = 0;
         }
 
+        GLuint name;
+        glGenBuffers(1, &name);
+        glBindBuffer(target, name);
+        glBufferData(target, bytes, data, GL_STATIC_DRAW);
+        return ResourceManager::Instance().Adopt<ResourceType::Buffer>(key, name);
+    }
 
-        /* Rendering the Mesh using defined OpenGL VAO*/
-        glBindVertexArray(VAO);                                                                      // Binds previously selected VAO
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0); // Initiates rendering process
-        glBindVertexArray(0);                                                                        // Unbinds the previously selected VAO
+    /**
+     * Measures the bounding sphere and the average UV density of the mesh,
+     * the ratio of texture area to surface area tells how many texels of a
+     * texture land on one unit of surface.
+     */
+    void computeTextureDensity()
+    {
+        glm::vec3 minimum(0.0f), maximum(0.0f);
+        if (!vertices.empty())
+            minimum = maximum = vertices[0].Position;
+        for (const Vertex &vertex : vertices)
+        {
+            minimum = glm::min(minimum, vertex.Position);
+            maximum = glm::max(maximum, vertex.Position);
+        }
+        boundsCenter = (minimum + maximum) * 0.5f;
+        boundsRadius = glm::length(maximum - minimum) * 0.5f;
 
-        /*Setting everything back to defaults once configured.*/
-        glActiveTexture(GL_TEXTURE0);
+        float surfaceArea = 0.0f, uvArea = 0.0f;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const Vertex &a = vertices[indices[i]];
+            const Vertex &b = vertices[indices[i + 1]];
+            const Vertex &c = vertices[indices[i + 2]];
 
-        /* Disabling gl_blend*/
-        if (isLighting && this->isGlass)
-            glDisable(GL_BLEND);
+            surfaceArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position)) * 0.5f;
+            glm::vec2 du = b.TexCoords - a.TexCoords, dv = c.TexCoords - a.TexCoords;
+            uvArea += fabs(du.x * dv.y - du.y * dv.x) * 0.5f;
+        }
+        uvDensity = surfaceArea > 0.0f ? sqrt(uvArea / surfaceArea) : 0.0f;
     }
 
-private:
-    /*Variable to store vertex array and element buffers*/
-    unsigned int VBO, EBO;
-
     void setupMesh()
     {
-        /**Generating VAO(Vertex Array Object), VBO(Vertex Buffer Object) and EBO(Element buffers objects)*/
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        /**Generating VAO(Vertex Array Object), every mesh has its own since it also points at the instance buffer*/
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        vertexArray = ResourceManager::Instance().Adopt<ResourceType::VertexArray>(0, vao);
 
+        /**
+         * Binding the VAO, then the VBO and EBO in preparation for specifying
+         * vertex attribute pointer and rendering.
+         *
+         * The custom vertex structures and index values are sent to OpenGL using
+         * their sequential memory layout, unless the same data has been uploaded
+         * already.
+         */
+        glBindVertexArray(vao);
+        if (!pool)
+        {
+            vertexBuffer = sharedBuffer(GL_ARRAY_BUFFER, vertices.data(), vertices.size() * sizeof(Vertex));
+            indexBuffer = sharedBuffer(GL_ELEMENT_ARRAY_BUFFER, indices.data(), indices.size() * sizeof(unsigned int));
+            setupVertexAttributes(0);
+        }
 
         /**
-         * Binding VBO,EBO and VAO in preparation for specifying vertex
-         * attribute pointer and renderingI
+         * Setting up vertex array pointer 7 to 10 from the instance buffer
+         * A mat4 attribute takes four vec4 slots, advanced once per instance instead of once per vertex
          */
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        GLuint instanceVBO;
+        glGenBuffers(1, &instanceVBO);
+        instanceBuffer = ResourceManager::Instance().Adopt<ResourceType::Buffer>(0, instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), instances.data(), GL_STATIC_DRAW);
+        instanceCapacity = instances.size();
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(7 + column);
+            glVertexAttribPointer(7 + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(offsetof(InstanceData, transform) + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(7 + column, 1);
+        }
 
         /**
-         * Allocating GPU memory for the vertex data and index data and efficiently sending
-         * the custom vertex structures and index value from the vertices vector and indices vector to
-         * OpenGL using their sequential memory layout.
+         * Setting up vertex array pointer to index 11
+         * Material index and reflection probe of the instance, read together as an ivec2
          */
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(11);
+        glVertexAttribIPointer(11, 2, GL_INT, sizeof(InstanceData), (void *)offsetof(InstanceData, material));
+        glVertexAttribDivisor(11, 1);
 
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        /**
+         * Setting up vertex array pointer to index 13
+         * Per-instance placement of the mesh's lightmap tile in the atlas
+         */
+        glEnableVertexAttribArray(13);
+        glVertexAttribPointer(13, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)offsetof(InstanceData, lightmapST));
+        glVertexAttribDivisor(13, 1);
 
+        /*Unbinds the currently bound Vertex Array Object*/
+        glBindVertexArray(0);
+    }
+
+    /**
+     * Points the per-vertex attributes of the bound vertex array at the vertex
+     * data in the bound GL_ARRAY_BUFFER, starting 'base' bytes into it
+     */
+    void setupVertexAttributes(size_t base)
+    {
         /**
          * Setting up vertex array pointer to index 0
          * Specify layout position attribute and associated it with the vertex structure
          */
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)base);
 
         /**
          * Setting up vertex array pointer to index 1
          * Specify how normal attribute in interpreted by OpenGL
          */
         glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(base + offsetof(Vertex, Normal)));
 
         /**
          * Setting up vertex array pointer to index 2
          * Specify how texture coordinates shouldbe interpreted by OpenGL
          */
         glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(base + offsetof(Vertex, TexCoords)));
 
         /**
          * Setting up vertex array pointer to index 3
          * Specify how tangent attributes should be interpreted by OpenGL
          */
         glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Tangent));
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(base + offsetof(Vertex, Tangent)));
 
         /**
          * Setting up vertex array pointer to index 4
          * Specify how bitangent attributes should be interpreted by OpenGL
          */
         glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Bitangent));
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(base + offsetof(Vertex, Bitangent)));
 
         /**
          * Setting up vertex array pointer to index 5
          * Specify how bone IDs attribute should be interpreted by OpenGL
          */
         glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void *)offsetof(Vertex, m_BoneIDs));
+        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void *)(base + offsetof(Vertex, m_BoneIDs)));
 
         /**
          * Setting up vertex array pointer to index 6
          * Specify how weights attribute should be interpreted by OpenGL
          */
         glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, m_Weights));
+        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(base + offsetof(Vertex, m_Weights)));
 
-        /*Unbinds the currently bound Vertex Array Object*/
-        glBindVertexArray(0);
+        /**
+         * Setting up vertex array pointer to index 12
+         * Lightmap coordinates within the mesh tile
+         */
+        glEnableVertexAttribArray(12);
+        glVertexAttribPointer(12, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(base + offsetof(Vertex, LightmapUV)));
     }
 };
 #endif
@@ -15,16 +15,26 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "mesh.h"
+#include "geometry_pool.h"
+#include "resource_manager.h"
+#include "scene_graph.h"
 #include "shader.h"
+#include "reflection_probes.h"
+#include "lightmap.h"
+#include "job_system.h"
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <math.h>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <cstdint>
 #include "animdata.h"
 
 using namespace std;
@@ -50,58 +60,546 @@ struct Bulbs
     float exp;
 };
 
+const int MAX_BULBS = 50; // size of the 'bulbs' array of lighting.fs
+
+/*Copy of 'bulb' moved by 'transform', its direction keeps its length since the shader uses it unnormalized*/
+inline Bulbs PlaceBulb(const Bulbs &bulb, const glm::mat4 &transform)
+{
+    Bulbs placed = bulb;
+    placed.position = glm::vec3(transform * glm::vec4(bulb.position, 1.0f));
+    glm::vec3 direction = glm::mat3(transform) * bulb.normal;
+    if (glm::length(direction) > 0.0f)
+        placed.normal = glm::normalize(direction) * glm::length(bulb.normal);
+    return placed;
+}
+
+/*Fields of a MaterialOverride that replace the material's own values*/
+enum MaterialOverrideFields
+{
+    OVERRIDE_AMBIENT = 1 << 0,
+    OVERRIDE_DIFFUSE = 1 << 1,
+    OVERRIDE_SPECULAR = 1 << 2,
+    OVERRIDE_SHININESS = 1 << 3,
+};
+
+/*Material values replaced on the meshes with a given name, for one placement of a model*/
+struct MaterialOverride
+{
+    StringId mesh;
+    unsigned int fields = 0; // MaterialOverrideFields that are set
+    glm::vec3 ambient = glm::vec3(0.0f);
+    glm::vec3 diffuse = glm::vec3(0.0f);
+    glm::vec3 specular = glm::vec3(0.0f);
+    float shininess = 0.0f;
+};
+
+/*Time spent in each phase of loading a model and what was loaded, for the loader benchmark*/
+struct ModelLoadStats
+{
+    double importMilliseconds = 0.0;    // Assimp reading, triangulating and computing tangents
+    double hierarchyMilliseconds = 0.0; // walking the node tree
+    double textureMilliseconds = 0.0;   // decoding the images, in parallel
+    double geometryMilliseconds = 0.0;  // extracting vertices and indices, in parallel
+    double meshMilliseconds = 0.0;      // materials, texture slots and instancing, bones excluded
+    double boneMilliseconds = 0.0;      // bone weights of the vertices
+    double lightmapMilliseconds = 0.0;  // lightmap layout of the static instances
+    double uploadMilliseconds = 0.0;    // meshes, texture pages and materials created on the context's thread
+    size_t vertices = 0;
+    size_t triangles = 0;
+    int textures = 0;
+    int bones = 0;
+};
+
+/*One copy of a model in the scene*/
+struct ModelPlacement
+{
+    glm::mat4 transform;
+    vector<MaterialOverride> overrides;
+};
+
 class Model
 {
 public:
     // model data
     vector<Texture> textures_loaded; // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    TexturePages texturePages;       // all textures of the model packed into texture arrays
+    vector<GPUMaterial> materials;   // materials referenced by index from the instance buffers
     vector<Mesh> meshes;
     vector<Bulbs> bulbs;
+    SceneGraph hierarchy; // node tree of the file, world matrices are relative to the model's origin
+    float lightmapDensity = 0.0f; // lightmap texels per unit, 0 when the model has no lightmap layout
     string directory;
     bool gammaCorrection;
 
-    /* Loading the model from the specified files path*/
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    /**
+     * Loading the model from the specified files path
+     *
+     * With a 'pool' the model is streamed: the constructor only does the CPU
+     * work and can run on any thread, Upload() then creates the meshes on the
+     * thread owning the context and puts their geometry into the pool.
+     */
+    Model(string const &path, bool gamma = false, GeometryPool *pool = nullptr) : gammaCorrection(gamma), pool(pool)
     {
         loadModel(path);
     }
 
+    /**
+     * Finishes a streamed model step by step: the first call creates the
+     * meshes, textures and materials, then the geometry goes into the pool one
+     * mesh at a time while 'budget' bytes remain, at least one mesh per call.
+     * Returns the bytes uploaded, 'full' is set when the pool ran out of room.
+     */
+    size_t Upload(size_t budget, bool &full)
+    {
+        full = false;
+        size_t uploaded = 0;
+        if (!uniqueMeshes.empty())
+        {
+            size_t textureBytes = TextureStreamer::Instance().ResidentBytes();
+            createMeshes();
+            uploaded += TextureStreamer::Instance().ResidentBytes() - textureBytes + MAX_MATERIALS * sizeof(GPUMaterial);
+        }
+
+        for (Mesh &mesh : meshes)
+        {
+            if (mesh.Resident())
+                continue;
+            if (uploaded > 0 && uploaded + mesh.GeometryBytes() > budget)
+                break;
+            if (!mesh.MakeResident())
+            {
+                full = true;
+                break;
+            }
+            uploaded += mesh.GeometryBytes() + mesh.instances.size() * sizeof(InstanceData);
+        }
+        return uploaded;
+    }
+
+    /*True once every mesh can be drawn*/
+    bool Resident() const
+    {
+        if (!uniqueMeshes.empty())
+            return false;
+        for (const Mesh &mesh : meshes)
+            if (!mesh.Resident())
+                return false;
+        return true;
+    }
+
+    /*Gives the pool space of a streamed model back, Upload() makes it resident again*/
+    void Evict()
+    {
+        for (Mesh &mesh : meshes)
+            mesh.Evict();
+    }
+
+    /*How long each phase of loading took, the upload only once the meshes were created*/
+    const ModelLoadStats &LoadStats() const { return loadStats; }
+
+    /*Bytes of geometry of the model, what a streamed model takes in the pool*/
+    size_t GeometryBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh &mesh : meshes)
+            bytes += mesh.GeometryBytes();
+        for (const MeshData &data : uniqueMeshes)
+            bytes += data.vertices.size() * sizeof(Vertex) + data.indices.size() * sizeof(unsigned int);
+        return bytes;
+    }
+
     /* Draws the model, and thus all its meshes*/
-    void Draw(Shader &shader, bool isLighting, GLuint cubetex)
+    void Draw(Shader &shader, bool isLighting)
     {
-        if (bulbs.size() > 0)
+        bindMaterials();
+        setBulbUniforms(shader);
+
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Draw(isLighting);
+    }
+
+    /**
+     * Draws the model with the lighting shader permutations.
+     *
+     * Meshes are drawn bucket by bucket, each bucket using the variant that matches
+     * its mesh flags combined with the per-frame 'frameFlags' (e.g. VARIANT_NIGHT).
+     * 'setupFrame' is invoked once per bucket so the per-frame uniforms (camera,
+     * sun light, model matrix) reach every variant that is actually used.
+     */
+    void Draw(ShaderVariants &variants, unsigned int frameFlags, const function<void(Shader &)> &setupFrame)
+    {
+        bindMaterials();
+
+        for (auto &bucket : variantBuckets)
         {
-            shader.setInt("numBulbs", (int)bulbs.size());
-            // std::cerr << bulbs.size() << std::endl;
-            for (auto i = 0; i < bulbs.size(); ++i)
+            Shader &shader = variants.Get(bucket.first | frameFlags);
+            shader.use();
+            setupFrame(shader);
+
+            /*Bulb uniforms are only read by the night variants*/
+            if (frameFlags & VARIANT_NIGHT)
+                setBulbUniforms(shader);
+
+            for (unsigned int index : bucket.second)
+                meshes[index].Draw(true);
+        }
+    }
+
+    /**
+     * Reports to the texture streamer at which resolution every textured
+     * instance is seen this frame.
+     *
+     * 'screenScale' is the number of pixels covered by one unit at distance one,
+     * viewport height / (2 * tan(fov / 2)). The distance is taken to the nearest
+     * point of the instance's bounding sphere.
+     */
+    void RequestTextures(const glm::mat4 &model, const glm::vec3 &viewPos, float screenScale) const
+    {
+        for (const Mesh &mesh : meshes)
+        {
+            if (mesh.uvDensity <= 0.0f)
+                continue;
+
+            for (const InstanceData &instance : mesh.instances)
             {
-                shader.setVec3((string("bulbs[") + to_string(i) + string("].base.position")).c_str(), bulbs[i].position);
-                // shader.setVec3((string("bulbs[")+to_string(i)+string("].base.Color")).c_str(), bulbs[i].Color);
-                shader.setVec3((string("bulbs[") + to_string(i) + string("].base.base.ambient")).c_str(), bulbs[i].ambient);
-                shader.setVec3((string("bulbs[") + to_string(i) + string("].base.base.diffuse")).c_str(), bulbs[i].diffuse);
-                shader.setVec3((string("bulbs[") + to_string(i) + string("].base.base.specular")).c_str(), bulbs[i].specular);
-                shader.setFloat((string("bulbs[") + to_string(i) + string("].base.atten.constant")).c_str(), bulbs[i].constant);
-                shader.setFloat((string("bulbs[") + to_string(i) + string("].base.atten.linear")).c_str(), bulbs[i].linear);
-                shader.setFloat((string("bulbs[") + to_string(i) + string("].base.atten.exp")).c_str(), bulbs[i].exp);
-                shader.setFloat((string("bulbs[") + to_string(i) + string("].cutoff")).c_str(), cos(bulbs[i].angle * 3.1415 / 180));
-                shader.setVec3((string("bulbs[") + to_string(i) + string("].direction")).c_str(), bulbs[i].normal);
+                int page = (int)materials[instance.material].params.y;
+                if (page < 0)
+                    continue;
+
+                glm::mat4 world = model * instance.transform;
+                float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+                glm::vec3 center = glm::vec3(world * glm::vec4(mesh.boundsCenter, 1.0f));
+                float distance = std::max(glm::length(center - viewPos) - mesh.boundsRadius * scale, 0.1f);
+
+                texturePages.Request(page, mesh.uvDensity / scale, screenScale / distance);
             }
         }
-        else
+    }
+
+    /**
+     * Draws the meshes that cast sun shadows with the current (depth only) program,
+     * glass and water let the light through
+     */
+    void DrawShadowCasters()
+    {
+        for (Mesh &mesh : meshes)
+            if (!mesh.isGlass && !mesh.isWater)
+                mesh.Draw(false);
+    }
+
+    /**
+     * Replaces the instances of every mesh by one copy of the instances found
+     * in the file per placement. All the copies of a mesh are still drawn in a
+     * single instanced call, only the instance buffers grow with the number of
+     * placements while the geometry and textures are uploaded once.
+     *
+     * The placements are baked into the instance transforms, the model is
+     * drawn with an identity 'model' matrix afterwards. Copies share the
+     * lightmap tiles of the file's instances, and the reflection probes have
+     * to be assigned again.
+     *
+     * Every copy brings its own bulbs, up to MAX_BULBS for the whole model:
+     * the copies past that only get the bulb light baked into the lightmap,
+     * a model without one is lit by the sun alone there. Overrides that would
+     * take the model past MAX_MATERIALS leave the meshes their own material.
+     */
+    void Place(const vector<ModelPlacement> &placements)
+    {
+        if (fileInstances.empty())
         {
-            shader.setInt("numBulbs", 0);
+            for (const Mesh &mesh : meshes)
+                fileInstances.push_back(mesh.instances);
+            fileBulbs = bulbs;
         }
-        for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader, isLighting, cubetex);
+
+        size_t materialCount = materials.size();
+        int droppedOverrides = 0;
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            Mesh &mesh = meshes[i];
+            mesh.instances.clear();
+            mesh.instances.reserve(fileInstances[i].size() * placements.size());
+            for (const ModelPlacement &placement : placements)
+            {
+                for (InstanceData instance : fileInstances[i])
+                {
+                    instance.transform = placement.transform * instance.transform;
+                    instance.material = overrideMaterial(instance.material, mesh.tag, placement.overrides, droppedOverrides);
+                    mesh.instances.push_back(instance);
+                }
+            }
+            mesh.UpdateInstances();
+        }
+
+        /*Overrides add the materials they create*/
+        if (materials.size() != materialCount)
+            uploadMaterials();
+        if (droppedOverrides > 0)
+            cout << "ERROR::MODEL::TOO_MANY_MATERIALS " << droppedOverrides << " instances past " << MAX_MATERIALS
+                 << " materials keep their own material" << endl;
+
+        bulbs.clear();
+        for (const ModelPlacement &placement : placements)
+            for (const Bulbs &bulb : fileBulbs)
+                bulbs.push_back(PlaceBulb(bulb, placement.transform));
+        if (bulbs.size() > MAX_BULBS)
+        {
+            cout << "ERROR::MODEL::TOO_MANY_BULBS " << bulbs.size() << ", the placements past the first " << MAX_BULBS
+                 << " bulbs are only lit by the lightmap" << endl;
+            bulbs.resize(MAX_BULBS);
+        }
+        while (bulbUniforms.size() < bulbs.size())
+            bulbUniforms.push_back(BulbUniforms((int)bulbUniforms.size()));
+    }
+
+    /*True once Place() has replaced the instances found in the file*/
+    bool Placed() const
+    {
+        return !fileInstances.empty();
+    }
+
+    /*Bounding sphere of every instance of the model in world space*/
+    void GetBounds(const glm::mat4 &model, glm::vec3 &center, float &radius) const
+    {
+        glm::vec3 minimum(0.0f), maximum(0.0f);
+        bool first = true;
+        for (const Mesh &mesh : meshes)
+        {
+            for (const InstanceData &instance : mesh.instances)
+            {
+                glm::mat4 world = model * instance.transform;
+                float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+                glm::vec3 position = glm::vec3(world * glm::vec4(mesh.boundsCenter, 1.0f));
+                glm::vec3 extent(mesh.boundsRadius * scale);
+
+                minimum = first ? position - extent : glm::min(minimum, position - extent);
+                maximum = first ? position + extent : glm::max(maximum, position + extent);
+                first = false;
+            }
+        }
+        center = (minimum + maximum) * 0.5f;
+        radius = glm::length(maximum - minimum) * 0.5f;
+    }
+
+    /*World space centers of the glass and water instances, where reflection probes are needed*/
+    vector<glm::vec3> GetReflectivePositions(const glm::mat4 &model) const
+    {
+        vector<glm::vec3> positions;
+        for (const Mesh &mesh : meshes)
+        {
+            if (!mesh.isGlass && !mesh.isWater)
+                continue;
+            for (const InstanceData &instance : mesh.instances)
+                positions.push_back(glm::vec3(model * instance.transform * glm::vec4(mesh.boundsCenter, 1.0f)));
+        }
+        return positions;
+    }
+
+    /*Gives every glass and water instance the reflection probe closest to it*/
+    void AssignReflectionProbes(const ReflectionProbes &probes, const glm::mat4 &model)
+    {
+        for (Mesh &mesh : meshes)
+        {
+            if (!mesh.isGlass && !mesh.isWater)
+                continue;
+            for (InstanceData &instance : mesh.instances)
+                instance.probe = probes.Nearest(glm::vec3(model * instance.transform * glm::vec4(mesh.boundsCenter, 1.0f)));
+            mesh.UpdateInstances();
+        }
+    }
+
+    /*Returns the mesh flags of every shader variant this model draws with*/
+    vector<unsigned int> GetVariantFlags() const
+    {
+        vector<unsigned int> flags;
+        for (auto &bucket : variantBuckets)
+            flags.push_back(bucket.first);
+        return flags;
     }
 
     auto &GetBoneInfoMap() { return m_BoneInfoMap; }
     int &GetBoneCount() { return m_BoneCounter; }
 
 private:
-    std::map<string, BoneInfo> m_BoneInfoMap;
+    std::unordered_map<StringId, BoneInfo> m_BoneInfoMap;
     int m_BoneCounter = 0;
 
+    /*Uniform names of one element of the shader's 'bulbs' array*/
+    struct BulbUniforms
+    {
+        StringId position, ambient, diffuse, specular;
+        StringId constant, linear, exp, cutoff, direction;
+
+        explicit BulbUniforms(int index)
+        {
+            string prefix = "bulbs[" + std::to_string(index) + "].";
+            StringTable &table = StringTable::Instance();
+            position = table.Intern(prefix + "base.position");
+            ambient = table.Intern(prefix + "base.base.ambient");
+            diffuse = table.Intern(prefix + "base.base.diffuse");
+            specular = table.Intern(prefix + "base.base.specular");
+            constant = table.Intern(prefix + "base.atten.constant");
+            linear = table.Intern(prefix + "base.atten.linear");
+            exp = table.Intern(prefix + "base.atten.exp");
+            cutoff = table.Intern(prefix + "cutoff");
+            direction = table.Intern(prefix + "direction");
+        }
+    };
+    vector<BulbUniforms> bulbUniforms;
+
+    /*Mesh indices grouped by their shader variant flags, sorted so transparent meshes come last*/
+    std::map<unsigned int, vector<unsigned int>> variantBuckets;
+
+    /*Pool of the geometry of a streamed model, null when the meshes have buffers of their own*/
+    GeometryPool *pool;
+
+    /*Instances of every mesh and the bulbs as found in the file, before Place() copied them*/
+    vector<vector<InstanceData>> fileInstances;
+    vector<Bulbs> fileBulbs;
+
+    /*Unique geometry found while loading, and its content hash lookup used to detect repeated meshes*/
+    vector<MeshData> uniqueMeshes;
+    std::map<uint64_t, vector<size_t>> geometryLookup;
+
+    /*Images decoded ahead of the mesh processing, by texture path, an empty image marks a failed decode*/
+    std::map<string, ImageData> decodedImages;
+
+    ModelLoadStats loadStats;
+
+    /*Vertex data of an aiMesh, extracted on the job system before the meshes are processed in file order*/
+    struct MeshGeometry
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        glm::vec3 position; // last vertex, for light bulbs
+    };
+
+    /**
+     * Texture types read by processMesh(), in the order their textures are
+     * added to the pages. Only the diffuse maps are sampled by the shaders,
+     * the specular, normal and height maps aren't decoded or uploaded
+     */
+    static constexpr aiTextureType MATERIAL_TEXTURE_TYPES[1] = {aiTextureType_DIFFUSE};
+
+    /*Vertex attributes closer than 1/GEOMETRY_QUANTIZATION are considered identical*/
+    static constexpr float GEOMETRY_QUANTIZATION = 10000.0f;
+
+    /*Uniform buffer holding 'materials'*/
+    BufferHandle materialUBO;
+
+    /*Makes the texture pages and the material buffer of this model current*/
+    void bindMaterials()
+    {
+        texturePages.Bind();
+        glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, materialUBO.Get());
+    }
+
+    /**
+     * Creates the material uniform buffer, it is always allocated for MAX_MATERIALS
+     * entries since the size of the bound range must cover the whole block.
+     */
+    void uploadMaterials()
+    {
+        vector<GPUMaterial> block(MAX_MATERIALS);
+        std::copy(materials.begin(), materials.begin() + std::min<size_t>(materials.size(), MAX_MATERIALS), block.begin());
+
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        materialUBO = ResourceManager::Instance().Adopt<ResourceType::Buffer>(0, buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, block.size() * sizeof(GPUMaterial), block.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    /*Returns the index of a material in the material buffer, adding it if it is new, -1 when the buffer is full*/
+    int addMaterial(const GPUMaterial &material)
+    {
+        for (size_t i = 0; i < materials.size(); i++)
+            if (memcmp(&materials[i], &material, sizeof(GPUMaterial)) == 0)
+                return (int)i;
+
+        if (materials.size() >= MAX_MATERIALS)
+            return -1;
+        materials.push_back(material);
+        return (int)materials.size() - 1;
+    }
+
+    /*Index of the material in the full buffer that looks the most like 'material'*/
+    int closestMaterial(const GPUMaterial &material) const
+    {
+        int closest = 0;
+        float closestDistance = 0.0f;
+        for (size_t i = 0; i < materials.size(); i++)
+        {
+            float distance = glm::length(glm::vec3(materials[i].diffuse - material.diffuse)) +
+                             glm::length(glm::vec3(materials[i].ambient - material.ambient)) +
+                             (materials[i].params.y == material.params.y ? 0.0f : 1.0f);
+            if (i == 0 || distance < closestDistance)
+            {
+                closest = (int)i;
+                closestDistance = distance;
+            }
+        }
+        return closest;
+    }
+
+    /*Index of 'material' with the overrides of the mesh named 'tag' applied, counting in 'dropped' those that didn't fit*/
+    int overrideMaterial(int material, StringId tag, const vector<MaterialOverride> &overrides, int &dropped)
+    {
+        for (const MaterialOverride &change : overrides)
+        {
+            if (change.mesh != tag)
+                continue;
+
+            GPUMaterial changed = materials[material];
+            if (change.fields & OVERRIDE_AMBIENT)
+                changed.ambient = glm::vec4(change.ambient, changed.ambient.w);
+            if (change.fields & OVERRIDE_DIFFUSE)
+                changed.diffuse = glm::vec4(change.diffuse, changed.diffuse.w);
+            if (change.fields & OVERRIDE_SPECULAR)
+                changed.specular = glm::vec4(change.specular, changed.specular.w);
+            if (change.fields & OVERRIDE_SHININESS)
+                changed.params.x = change.shininess;
+
+            int index = addMaterial(changed);
+            if (index >= 0)
+                return index;
+            dropped++;
+            return material;
+        }
+        return material;
+    }
+
+    /*Uploads the light bulbs found in the model to the shader*/
+    void setBulbUniforms(Shader &shader)
+    {
+        if (bulbs.size() > 0)
+        {
+            int count = (int)std::min<size_t>(bulbs.size(), MAX_BULBS);
+            shader.setInt("numBulbs", count);
+            // std::cerr << bulbs.size() << std::endl;
+
+            /*Called every frame, the uniform names were interned when the bulbs were loaded*/
+            for (auto i = 0; i < count; ++i)
+            {
+                const BulbUniforms &names = bulbUniforms[i];
+                shader.setVec3(names.position, bulbs[i].position);
+                shader.setVec3(names.ambient, bulbs[i].ambient);
+                shader.setVec3(names.diffuse, bulbs[i].diffuse);
+                shader.setVec3(names.specular, bulbs[i].specular);
+                shader.setFloat(names.constant, bulbs[i].constant);
+                shader.setFloat(names.linear, bulbs[i].linear);
+                shader.setFloat(names.exp, bulbs[i].exp);
+                shader.setFloat(names.cutoff, cos(bulbs[i].angle * 3.1415 / 180));
+                shader.setVec3(names.direction, bulbs[i].normal);
+            }
+        }
+        else
+        {
+            shader.setInt("numBulbs", 0);
+        }
+    }
+
     /**
      *  Loads a model with supported ASSIMP extensions from file and
      * stores the resulting meshes in the meshes vector.
@@ -110,6 +608,7 @@ private:
     {
         /*Create an instance, used to read model file*/
         Assimp::Importer importer;
+        std::chrono::steady_clock::time_point phaseStart = std::chrono::steady_clock::now();
 
         /**
          * Attempt to load the model
@@ -130,38 +629,162 @@ private:
         /*Extract the directory path from the given file path*/
         directory = path.substr(0, path.find_last_of('/'));
 
+        loadStats.importMilliseconds = millisecondsSince(phaseStart);
+
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        phaseStart = std::chrono::steady_clock::now();
+        vector<aiMesh *> nodeMeshes;
+        vector<SceneNode> meshNodes;
+        processNode(scene->mRootNode, scene, SCENE_ROOT, nodeMeshes, meshNodes);
+        hierarchy.Update();
+        loadStats.hierarchyMilliseconds = millisecondsSince(phaseStart);
+
+        /**
+         * Decoding the images and extracting the vertex data are independent per
+         * texture and per mesh, so they run on the job system. Materials, bones
+         * and instancing stay serial in file order, which keeps the result the
+         * same as a single threaded load.
+         */
+        phaseStart = std::chrono::steady_clock::now();
+        decodeTextures(nodeMeshes, scene);
+        loadStats.textureMilliseconds = millisecondsSince(phaseStart);
+
+        phaseStart = std::chrono::steady_clock::now();
+        vector<MeshGeometry> geometry(nodeMeshes.size());
+        JobSystem::Instance().ParallelFor(nodeMeshes.size(), 1, [&](size_t i)
+                                          { geometry[i] = extractGeometry(nodeMeshes[i]); });
+        loadStats.geometryMilliseconds = millisecondsSince(phaseStart);
+
+        phaseStart = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < nodeMeshes.size(); i++)
+        {
+            loadStats.vertices += nodeMeshes[i]->mNumVertices;
+            loadStats.triangles += nodeMeshes[i]->mNumFaces;
+            addMesh(processMesh(nodeMeshes[i], scene, std::move(geometry[i]), meshNodes[i]), meshNodes[i]);
+        }
+        decodedImages.clear();
+        loadStats.meshMilliseconds = millisecondsSince(phaseStart) - loadStats.boneMilliseconds;
+        loadStats.textures = (int)textures_loaded.size();
+        loadStats.bones = m_BoneCounter;
+
+        /*Giving every static instance its own area of the lightmap atlas*/
+        phaseStart = std::chrono::steady_clock::now();
+        lightmapDensity = LightmapLayout::Build(uniqueMeshes);
+        geometryLookup.clear();
+        loadStats.lightmapMilliseconds = millisecondsSince(phaseStart);
+
+        /*Streamed models stop before the first GL call, building the mip chains is the last part that needs no context*/
+        if (pool)
+        {
+            texturePages.Prepare();
+            return;
+        }
+        createMeshes();
+    }
+
+    /*Creates the meshes, texture pages and material buffer of the loaded data, on the thread owning the context*/
+    void createMeshes()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        /*Uploading each unique geometry once, together with the placement of all its occurrences*/
+        for (MeshData &data : uniqueMeshes)
+            meshes.push_back(Mesh(data.vertices, data.indices, data.textures, data.mat, data.name, data.instances, pool));
+
+        uniqueMeshes.clear();
+
+        /*Uploading the texture pages and the material buffer every instance indexes into*/
+        texturePages.Upload();
+        for (Texture &texture : textures_loaded)
+            texture.id = texture.page >= 0 ? texturePages.pages[texture.page].texture.Get() : 0;
+        for (Mesh &mesh : meshes)
+            for (Texture &texture : mesh.textures)
+                texture.id = texture.page >= 0 ? texturePages.pages[texture.page].texture.Get() : 0;
+
+        uploadMaterials();
+
+        /*Grouping the meshes by the shader permutation they need*/
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            variantBuckets[meshes[i].variantFlags & VARIANT_MESH_MASK].push_back(i);
+        loadStats.uploadMilliseconds = millisecondsSince(start);
+    }
+
+    static double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     }
 
     /**
      * Recursively travering the node hierarchy of the imported model scene
-     * and processing each node's mesh data and its children.
+     * and collecting the meshes of each node and its children, in file order.
+     * The nodes and their transforms are kept in 'hierarchy', 'meshNodes'
+     * receives the node of every collected mesh.
      */
-    void processNode(aiNode *node, const aiScene *scene)
+    void processNode(aiNode *node, const aiScene *scene, SceneNode parent, vector<aiMesh *> &nodeMeshes, vector<SceneNode> &meshNodes)
     {
-        /* process each mesh located at the current node*/
+        SceneNode current = hierarchy.AddNode(parent, AssimpGLMHelpers::ConvertMatrixToGLMFormat(node->mTransformation),
+                                              StringTable::Instance().Intern(node->mName.C_Str()));
+
+        /* collect each mesh located at the current node*/
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            nodeMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+            meshNodes.push_back(current);
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        // after we've collected all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, current, nodeMeshes, meshNodes);
         }
     }
 
+    /**
+     * Decodes every image the meshes' materials reference into 'decodedImages',
+     * in parallel. Images that another model has already uploaded are shared
+     * instead, except by streamed models which can't look them up away from
+     * the context.
+     */
+    void decodeTextures(const vector<aiMesh *> &nodeMeshes, const aiScene *scene)
+    {
+        vector<string> paths;
+        for (aiMesh *mesh : nodeMeshes)
+        {
+            aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+            for (aiTextureType type : MATERIAL_TEXTURE_TYPES)
+            {
+                for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
+                {
+                    aiString str;
+                    material->GetTexture(type, i, &str);
+                    if (decodedImages.count(str.C_Str()) || (!pool && texturePages.Share(this->directory + '/' + str.C_Str()).page >= 0))
+                        continue;
+                    decodedImages.emplace(str.C_Str(), ImageData());
+                    paths.push_back(str.C_Str());
+                }
+            }
+        }
+
+        /*std::map nodes are stable, every job writes its own image*/
+        vector<ImageData *> images;
+        for (const string &path : paths)
+            images.push_back(&decodedImages[path]);
+
+        JobSystem::Instance().ParallelFor(paths.size(), 1, [&](size_t i)
+                                          {
+                                              if (!DecodeImage(this->directory + '/' + paths[i], *images[i]))
+                                                  *images[i] = ImageData();
+                                          });
+    }
+
     /**
      * Initialize the bone data of vertex to default values.
      *
      * In skeletal animation, this function is called reset the bone influence
      * data of vertex to a neutral state
      */
-    void SetVertexBoneDataToDefault(Vertex &vertex)
+    static void SetVertexBoneDataToDefault(Vertex &vertex)
     {
         for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
         {
@@ -170,15 +793,141 @@ private:
         }
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    /**
+     * Keeps a processed mesh, or only records one more instance of it when
+     * identical geometry has already been seen.
+     *
+     * Static geometry is first moved into a local frame centered on its bounds,
+     * so repeated objects placed at different spots in the file (bulbs, windows,
+     * furniture) compare equal and differ only by their instance transform and
+     * material index. The transform of the mesh's node in the file becomes
+     * part of the instance transform. Skinned meshes are placed by their bones.
+     */
+    void addMesh(MeshData data, SceneNode node)
+    {
+        glm::mat4 placement(1.0f);
+
+        if (!data.skinned && !data.vertices.empty())
+        {
+            placement = hierarchy.World(node) * moveToLocalFrame(data.vertices);
+
+            /*Looking for an earlier mesh with the same content, the hash only narrows down the candidates*/
+            vector<size_t> &candidates = geometryLookup[geometryHash(data)];
+            for (size_t index : candidates)
+            {
+                if (sameGeometry(uniqueMeshes[index], data))
+                {
+                    uniqueMeshes[index].instances.push_back(instanceOf(placement, data.material));
+                    return;
+                }
+            }
+            candidates.push_back(uniqueMeshes.size());
+        }
+
+        data.instances.push_back(instanceOf(placement, data.material));
+        uniqueMeshes.push_back(std::move(data));
+    }
+
+    static InstanceData instanceOf(const glm::mat4 &transform, int material)
+    {
+        InstanceData instance = {};
+        instance.transform = transform;
+        instance.material = material;
+        instance.probe = -1;
+        return instance;
+    }
+
+    /*Translates the vertices so their bounding box is centered on the origin, returns the inverse translation*/
+    static glm::mat4 moveToLocalFrame(vector<Vertex> &vertices)
+    {
+        glm::vec3 minimum = vertices[0].Position;
+        glm::vec3 maximum = vertices[0].Position;
+        for (const Vertex &vertex : vertices)
+        {
+            minimum = glm::min(minimum, vertex.Position);
+            maximum = glm::max(maximum, vertex.Position);
+        }
+
+        glm::vec3 center = (minimum + maximum) * 0.5f;
+        for (Vertex &vertex : vertices)
+            vertex.Position -= center;
+
+        return glm::translate(glm::mat4(1.0f), center);
+    }
+
+    /**
+     * Content hash over quantized vertex attributes, indices and the material name,
+     * the name selects the shader variant so it has to match, colors and textures may differ.
+     */
+    static uint64_t geometryHash(const MeshData &data)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto mix = [&hash](int64_t value)
+        {
+            hash ^= (uint64_t)value;
+            hash *= 1099511628211ull;
+        };
+        auto quantize = [](float value) { return (int64_t)llround(value * GEOMETRY_QUANTIZATION); };
+
+        for (const Vertex &vertex : data.vertices)
+        {
+            for (int i = 0; i < 3; i++)
+            {
+                mix(quantize(vertex.Position[i]));
+                mix(quantize(vertex.Normal[i]));
+            }
+            mix(quantize(vertex.TexCoords.x));
+            mix(quantize(vertex.TexCoords.y));
+        }
+        for (unsigned int index : data.indices)
+            mix(index);
+
+        mix(data.mat.hasTexture);
+        mix(data.tag.Hash());
+
+        return hash;
+    }
+
+    /*Exact comparison of two candidates with the same hash*/
+    static bool sameGeometry(const MeshData &a, const MeshData &b)
+    {
+        if (a.vertices.size() != b.vertices.size() || a.indices != b.indices)
+            return false;
+
+        if (a.tag != b.tag || a.mat.hasTexture != b.mat.hasTexture)
+            return false;
+
+        const float epsilon = 1.0f / GEOMETRY_QUANTIZATION;
+        for (size_t i = 0; i < a.vertices.size(); i++)
+        {
+            const Vertex &va = a.vertices[i];
+            const Vertex &vb = b.vertices[i];
+            for (int k = 0; k < 3; k++)
+            {
+                if (fabs(va.Position[k] - vb.Position[k]) > epsilon || fabs(va.Normal[k] - vb.Normal[k]) > epsilon)
+                    return false;
+            }
+            if (fabs(va.TexCoords.x - vb.TexCoords.x) > epsilon || fabs(va.TexCoords.y - vb.TexCoords.y) > epsilon)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Extracting the vertices and indices of a mesh. It only reads the aiMesh,
+     * so the meshes of a model are extracted in parallel.
+     */
+    static MeshGeometry extractGeometry(const aiMesh *mesh)
     {
         // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        MeshGeometry geometry;
+        vector<Vertex> &vertices = geometry.vertices;
+        vector<unsigned int> &indices = geometry.indices;
 
-        glm::vec3 position; // for light bulbs
+        glm::vec3 &position = geometry.position; // for light bulbs
         glm::vec3 normal;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve((size_t)mesh->mNumFaces * 3);
 
         /*Iterating through each vertex of the current aiMesh i.e *mesh */
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -188,6 +937,7 @@ private:
              * setting the bone data to default*/
             Vertex vertex;
             SetVertexBoneDataToDefault(vertex);
+            vertex.LightmapUV = glm::vec2(0.0f);
 
             /**
              * Declaring temp vector since assimp used its own vector class that doesnot
@@ -272,6 +1022,17 @@ private:
             for (unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
+        return geometry;
+    }
+
+    MeshData processMesh(aiMesh *mesh, const aiScene *scene, MeshGeometry geometry, SceneNode node)
+    {
+        // data to fill
+        vector<Vertex> vertices = std::move(geometry.vertices);
+        vector<unsigned int> indices = std::move(geometry.indices);
+        vector<Texture> textures;
+
+        glm::vec3 position = glm::vec3(hierarchy.World(node) * glm::vec4(geometry.position, 1.0f)); // for light bulbs
 
         /**
          * Processing the materials associated with the mesh
@@ -280,9 +1041,10 @@ private:
          */
         aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
         aiString meshName = material->GetName();
+        StringId meshTag(meshName.C_Str(), meshName.length);
 
-        bool condition1 = strcmp(meshName.C_Str(), "light") == 0;
-        bool condition2 = strcmp(meshName.C_Str(), "spotlight") == 0;
+        bool condition1 = meshTag == "light"_id;
+        bool condition2 = meshTag == "spotlight"_id;
 
         /*If meshName is either "light" and "spotlight"*/
         if (condition1 || condition2)
@@ -319,6 +1081,7 @@ private:
 
             /*Adding the 'bulb' structure to the 'bulbs' vector*/
             bulbs.push_back(bulb);
+            bulbUniforms.push_back(BulbUniforms((int)bulbs.size() - 1));
         }
 
         /**
@@ -337,7 +1100,7 @@ private:
         mat.shininess = shininess;
         material->Get(AI_MATKEY_COLOR_TRANSPARENT, transparency);
 
-        if (strcmp(meshName.C_Str(), "glass") == 0)
+        if (meshTag == "glass"_id)
             transparency = 0.9;
 
         material->Get(AI_MATKEY_COLOR_AMBIENT, color);
@@ -351,10 +1114,8 @@ private:
 
         /** we assume a convention for sampler names in the shaders. Each diffuse texture should be named
          * as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER.
-         * Same applies to other texture as the following list summarizes:
-         * diffuse: texture_diffuseN
-         * specular: texture_specularN
-         * normal: texture_normalN
+         * The specular, normal and height maps are left out until a shader samples them,
+         * see MATERIAL_TEXTURE_TYPES
          */
 
         if (material->GetTextureCount(aiTextureType_DIFFUSE) == 0)
@@ -362,26 +1123,43 @@ private:
         else
             mat.hasTexture = true;
 
-        // 1. diffuse maps
+        // diffuse maps
         vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
 
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-
-        // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        /*Describing the material for the material buffer, only the first diffuse map is sampled by the shaders*/
+        GPUMaterial gpuMaterial;
+        gpuMaterial.ambient = mat.Ka;
+        gpuMaterial.diffuse = mat.Kd;
+        gpuMaterial.specular = mat.Ks;
+        gpuMaterial.params = glm::vec4(mat.shininess, -1.0f, 0.0f, 0.0f);
+        if (!diffuseMaps.empty() && diffuseMaps[0].page >= 0)
+        {
+            gpuMaterial.params.y = (float)diffuseMaps[0].page;
+            gpuMaterial.params.z = (float)diffuseMaps[0].layer;
+        }
 
+        std::chrono::steady_clock::time_point boneStart = std::chrono::steady_clock::now();
         ExtractBoneWeightForVertices(vertices, mesh, scene);
-
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures, mat, meshName);
+        loadStats.boneMilliseconds += millisecondsSince(boneStart);
+
+        // return the extracted mesh data, it becomes a Mesh once instances have been merged
+        MeshData data;
+        data.vertices = std::move(vertices);
+        data.indices = std::move(indices);
+        data.textures = std::move(textures);
+        data.mat = mat;
+        data.name = meshName;
+        data.tag = meshTag;
+        data.material = addMaterial(gpuMaterial);
+        if (data.material < 0)
+        {
+            cout << "ERROR::MODEL::TOO_MANY_MATERIALS " << meshName.C_Str() << " is drawn with the closest of the first " << MAX_MATERIALS
+                 << " materials" << endl;
+            data.material = closestMaterial(gpuMaterial);
+        }
+        data.skinned = mesh->mNumBones > 0;
+        return data;
     }
 
     /**
@@ -420,7 +1198,7 @@ private:
             int boneID = -1;
 
             /*Getting the name of current bone*/
-            std::string boneName = mesh->mBones[boneIndex]->mName.C_Str();
+            StringId boneName = StringTable::Instance().Intern(mesh->mBones[boneIndex]->mName.C_Str());
 
             /**
              * Checking if bone name us present in boneInfoMap or not
@@ -475,7 +1253,7 @@ private:
      *
      * It returns vector of 'Texture' structure containing the loaded textures.
      */
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, StringId typeName)
     {
         /*Initializing a vector to store loaded textures.*/
         vector<Texture> textures;
@@ -516,9 +1294,32 @@ private:
             {
                 Texture texture;
 
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                /**
+                 * Using the page of another model that holds the image, or placing the image decoded
+                 * by decodeTextures() into a page, the GL texture only exists once the pages are uploaded
+                 */
+                string path = this->directory + '/' + string(str.C_Str());
+                TextureSlot slot = pool ? TextureSlot() : texturePages.Share(path);
+                if (slot.page < 0)
+                {
+                    ImageData image;
+                    auto decoded = decodedImages.find(str.C_Str());
+                    if (decoded != decodedImages.end())
+                        image = std::move(decoded->second);
+                    else
+                        DecodeImage(path, image);
+
+                    if (image.width > 0)
+                        slot = texturePages.Add(std::move(image), path);
+                    else
+                        std::cout << "Texture failed to load at path: " << str.C_Str() << std::endl;
+                }
+
+                texture.id = 0;
                 texture.type = typeName;
                 texture.path = str.C_Str();
+                texture.page = slot.page;
+                texture.layer = slot.layer;
 
                 textures.push_back(texture);
                 textures_loaded.push_back(texture); // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
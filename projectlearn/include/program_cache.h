@@ -0,0 +1,243 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Tokens of GL_ARB_get_program_binary (core in 4.1) and
+ * GL_KHR_parallel_shader_compile, our glad loader only covers GL 4.0 so they
+ * are defined here when missing.
+ */
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/**
+ * Process-wide cache of linked shader programs.
+ *
+ * Linked programs are stored on disk with glGetProgramBinary, keyed by a hash of
+ * both shader sources and the driver identification string, and restored with
+ * glProgramBinary on the next run. A driver update changes the key so stale
+ * binaries are simply never looked up again.
+ *
+ * It also enables KHR_parallel_shader_compile when available, so programs that
+ * miss the cache can be compiled by the driver in the background and only have
+ * their status queried once all of them have been submitted.
+ */
+class ProgramCache
+{
+public:
+    /*Access to the single cache instance used by every Shader*/
+    static ProgramCache &Instance()
+    {
+        static ProgramCache cache;
+        return cache;
+    }
+
+    /**
+     * Loads the entry points that are outside of our GL 4.0 loader and sets the
+     * directory where program binaries are kept.
+     *
+     * Needs a current context, an empty directory disables the disk cache.
+     */
+    void Init(GLADloadproc load, const std::string &cacheDirectory)
+    {
+        directory = cacheDirectory;
+
+        std::error_code error;
+        if (!directory.empty())
+            std::filesystem::create_directories(directory, error);
+
+        getProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+        programBinary = (ProgramBinaryProc)load("glProgramBinary");
+        programParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+
+        /*Binaries are only usable if the driver exposes at least one binary format*/
+        GLint numFormats = 0;
+        if (getProgramBinary && programBinary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        binarySupported = numFormats > 0 && !directory.empty();
+
+        /*Letting the driver compile on as many threads as it wants*/
+        if (hasExtension("GL_KHR_parallel_shader_compile"))
+            maxCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+        else if (hasExtension("GL_ARB_parallel_shader_compile"))
+            maxCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+
+        parallelSupported = maxCompilerThreads != nullptr;
+        if (parallelSupported)
+            maxCompilerThreads(0xFFFFFFFFu);
+
+        /*The driver string is part of every key, binaries are only valid for the driver that produced them*/
+        driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+    }
+
+    /*True when program completion can be polled without blocking*/
+    bool ParallelCompile() const { return parallelSupported; }
+
+    /*Hint that must be given before linking so the binary can be retrieved afterwards*/
+    void MarkRetrievable(GLuint program) const
+    {
+        if (binarySupported && programParameteri)
+            programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    /*Builds the cache key of a program from its final (define injected) sources*/
+    uint64_t Key(const std::string &vertexCode, const std::string &fragmentCode) const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        hash = fnv1a(hash, vertexCode);
+        hash = fnv1a(hash, std::string(1, '\0'));
+        hash = fnv1a(hash, fragmentCode);
+        hash = fnv1a(hash, std::string(1, '\0'));
+        hash = fnv1a(hash, driver);
+        return hash;
+    }
+
+    /**
+     * Tries to restore a program from its binary.
+     *
+     * Returns false when there is no binary or the driver rejected it, the
+     * caller then compiles from source.
+     */
+    bool Load(uint64_t key, GLuint program) const
+    {
+        if (!binarySupported)
+            return false;
+
+        std::ifstream file(pathFor(key), std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        std::streamoff fileSize = file.tellg();
+        file.seekg(0);
+
+        uint32_t header[3];
+        if (!file.read(reinterpret_cast<char *>(header), sizeof(header)) || header[0] != MAGIC)
+            return false;
+
+        /*The length comes from disk, a damaged file must not make us allocate whatever it says*/
+        if (header[2] == 0 || (std::streamoff)header[2] != fileSize - (std::streamoff)sizeof(header))
+            return false;
+
+        std::vector<char> binary(header[2]);
+        if (!file.read(binary.data(), binary.size()))
+            return false;
+
+        programBinary(program, (GLenum)header[1], binary.data(), (GLsizei)binary.size());
+
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success == GL_TRUE;
+    }
+
+    /*Stores the binary of a successfully linked program*/
+    void Store(uint64_t key, GLuint program) const
+    {
+        if (!binarySupported)
+            return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        getProgramBinary(program, length, nullptr, &format, binary.data());
+
+        /*Writing to a temporary file first, so a crash never leaves a truncated binary behind*/
+        std::string path = pathFor(key);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                std::cout << "ERROR::PROGRAM_CACHE::CANNOT_WRITE: " << temporary << std::endl;
+                return;
+            }
+
+            uint32_t header[3] = {MAGIC, (uint32_t)format, (uint32_t)length};
+            file.write(reinterpret_cast<const char *>(header), sizeof(header));
+            file.write(binary.data(), binary.size());
+        }
+        std::remove(path.c_str());
+        std::rename(temporary.c_str(), path.c_str());
+    }
+
+private:
+    typedef void(APIENTRYP GetProgramBinaryProc)(GLuint, GLsizei, GLsizei *, GLenum *, void *);
+    typedef void(APIENTRYP ProgramBinaryProc)(GLuint, GLenum, const void *, GLsizei);
+    typedef void(APIENTRYP ProgramParameteriProc)(GLuint, GLenum, GLint);
+    typedef void(APIENTRYP MaxShaderCompilerThreadsProc)(GLuint);
+
+    static const uint32_t MAGIC = 0x50524731; // "PRG1"
+
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    ProgramParameteriProc programParameteri = nullptr;
+    MaxShaderCompilerThreadsProc maxCompilerThreads = nullptr;
+
+    bool binarySupported = false;
+    bool parallelSupported = false;
+    std::string directory;
+    std::string driver;
+
+    ProgramCache() = default;
+
+    std::string pathFor(uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return directory + '/' + name;
+    }
+
+    static uint64_t fnv1a(uint64_t hash, const std::string &data)
+    {
+        for (unsigned char c : data)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::string glString(GLenum name)
+    {
+        const GLubyte *value = glGetString(name);
+        return value ? std::string(reinterpret_cast<const char *>(value)) : std::string();
+    }
+
+    static bool hasExtension(const char *name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const GLubyte *extension = glGetStringi(GL_EXTENSIONS, i);
+            if (extension && std::string(reinterpret_cast<const char *>(extension)) == name)
+                return true;
+        }
+        return false;
+    }
+};
+#endif
@@ -0,0 +1,246 @@
+#ifndef REFLECTION_PROBES_H
+#define REFLECTION_PROBES_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "camera.h"
+#include "shader.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*Texture units of the probe cube maps, after the texture pages (units 1 to 8)*/
+const int REFLECTION_PROBE_UNIT = 9;
+const int MAX_REFLECTION_PROBES = 4;
+
+/*Edge length of a probe face, reflections are blurred by the surfaces anyway*/
+const int REFLECTION_PROBE_SIZE = 128;
+
+/**
+ * Dynamic cube map probes for the reflective surfaces (glass and water).
+ *
+ * Probes are placed once around the reflective geometry and refreshed by a
+ * frame-budgeted scheduler: every frame only 'facesPerFrame' faces are
+ * rendered, round robin over all probes, so the reflections follow the
+ * lighting and the animated character at the cost of a fraction of a scene
+ * render per frame instead of six per probe.
+ */
+class ReflectionProbes
+{
+public:
+    /**
+     * Draws the scene for one probe face with the given view, projection and eye
+     * position, into the currently bound framebuffer.
+     */
+    typedef std::function<void(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye)> RenderFunction;
+
+    ReflectionProbes(int size = REFLECTION_PROBE_SIZE, int facesPerFrame = 1) : size(size), facesPerFrame(facesPerFrame)
+    {
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        /*Filtering across face edges, otherwise the low resolution faces show their seams*/
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    }
+
+    ~ReflectionProbes()
+    {
+        for (const Probe &probe : probes)
+            glDeleteTextures(1, &probe.cubemap);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &depthBuffer);
+    }
+
+    ReflectionProbes(const ReflectionProbes &) = delete;
+    ReflectionProbes &operator=(const ReflectionProbes &) = delete;
+
+    /**
+     * Places up to MAX_REFLECTION_PROBES probes so that they cover the given
+     * positions of reflective surfaces: seeds are picked farthest point first,
+     * then every probe moves to the average of the positions closest to it.
+     */
+    void Place(const std::vector<glm::vec3> &positions)
+    {
+        if (positions.empty())
+            return;
+
+        std::vector<glm::vec3> seeds(1, positions[0]);
+        while (seeds.size() < (size_t)MAX_REFLECTION_PROBES && seeds.size() < positions.size())
+        {
+            float farthest = 0.0f;
+            size_t index = 0;
+            for (size_t i = 0; i < positions.size(); i++)
+            {
+                float distance = glm::length(positions[i] - seeds[nearest(seeds, positions[i])]);
+                if (distance > farthest)
+                {
+                    farthest = distance;
+                    index = i;
+                }
+            }
+            if (farthest <= 0.0f)
+                break;
+            seeds.push_back(positions[index]);
+        }
+
+        std::vector<glm::vec3> sums(seeds.size(), glm::vec3(0.0f));
+        std::vector<int> counts(seeds.size(), 0);
+        for (const glm::vec3 &position : positions)
+        {
+            size_t seed = nearest(seeds, position);
+            sums[seed] += position;
+            counts[seed]++;
+        }
+
+        for (size_t i = 0; i < seeds.size(); i++)
+        {
+            Probe probe;
+            probe.position = counts[i] > 0 ? sums[i] / (float)counts[i] : seeds[i];
+            probe.cubemap = createCubemap();
+            probes.push_back(probe);
+        }
+    }
+
+    /*Index of the probe closest to 'position', -1 when there is no probe*/
+    int Nearest(const glm::vec3 &position) const
+    {
+        int result = -1;
+        float best = 0.0f;
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            float distance = glm::length(probes[i].position - position);
+            if (result < 0 || distance < best)
+            {
+                result = (int)i;
+                best = distance;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Refreshes the next faces in the schedule. Probes that were never rendered
+     * get all their faces at once so they are never sampled empty.
+     */
+    void Update(const RenderFunction &render)
+    {
+        if (probes.empty())
+            return;
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        glViewport(0, 0, size, size);
+
+        for (Probe &probe : probes)
+        {
+            if (!probe.rendered)
+            {
+                for (int face = 0; face < 6; face++)
+                    renderFace(probe, face, render);
+                probe.rendered = true;
+            }
+        }
+
+        for (int i = 0; i < facesPerFrame; i++)
+        {
+            renderFace(probes[nextProbe], nextFace, render);
+            if (++nextFace == 6)
+            {
+                nextFace = 0;
+                nextProbe = (nextProbe + 1) % probes.size();
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    /*Binds every probe to its texture unit, starting at REFLECTION_PROBE_UNIT*/
+    void Bind() const
+    {
+        for (size_t i = 0; i < probes.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + REFLECTION_PROBE_UNIT + (GLenum)i);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, probes[i].cubemap);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /*Points the 'reflectionProbes' sampler array of a shader at the probe texture units*/
+    static void ConfigureShader(const Shader &shader)
+    {
+        shader.use();
+        for (int i = 0; i < MAX_REFLECTION_PROBES; i++)
+            shader.setInt(StringTable::Instance().Intern("reflectionProbes[" + std::to_string(i) + "]"), REFLECTION_PROBE_UNIT + i);
+    }
+
+private:
+    struct Probe
+    {
+        glm::vec3 position;
+        GLuint cubemap = 0;
+        bool rendered = false;
+    };
+
+    std::vector<Probe> probes;
+    int size;
+    int facesPerFrame;
+    size_t nextProbe = 0;
+    int nextFace = 0;
+
+    GLuint framebuffer = 0;
+    GLuint depthBuffer = 0;
+
+    static size_t nearest(const std::vector<glm::vec3> &points, const glm::vec3 &position)
+    {
+        size_t result = 0;
+        for (size_t i = 1; i < points.size(); i++)
+            if (glm::length(points[i] - position) < glm::length(points[result] - position))
+                result = i;
+        return result;
+    }
+
+    GLuint createCubemap() const
+    {
+        GLuint cubemap;
+        glGenTextures(1, &cubemap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+        for (int face = 0; face < 6; face++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        return cubemap;
+    }
+
+    /*Renders one face of a probe, the framebuffer and viewport are set up by Update()*/
+    void renderFace(const Probe &probe, int face, const RenderFunction &render) const
+    {
+        /*Looking directions and up vectors of the cube map faces, in GL_TEXTURE_CUBE_MAP_POSITIVE_X order*/
+        static const glm::vec3 directions[6] = {glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                                glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+        static const glm::vec3 ups[6] = {glm::vec3(0, -1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+                                         glm::vec3(0, 0, -1), glm::vec3(0, -1, 0), glm::vec3(0, -1, 0)};
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, probe.cubemap, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        glm::mat4 view = glm::lookAt(probe.position, probe.position + directions[face], ups[face]);
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, FAR_PLANE);
+        render(view, projection, probe.position);
+    }
+};
+#endif
@@ -0,0 +1,523 @@
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+
+#include "resource_manager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+/*Resources one pass may read, and write, at most*/
+const int MAX_PASS_RESOURCES = 8;
+
+/*Index of a resource declared in the render graph of the frame*/
+typedef int RenderResource;
+
+/*Size and format of a transient render target*/
+struct RenderTargetDesc
+{
+    int width = 0;
+    int height = 0;
+    GLenum internalFormat = GL_RGBA8; // GL_RGBA8, GL_RGBA16F, GL_R16F or GL_DEPTH_COMPONENT24
+
+    bool operator==(const RenderTargetDesc &other) const
+    {
+        return width == other.width && height == other.height && internalFormat == other.internalFormat;
+    }
+};
+
+/*What the last compiled graph executes, for the debug interface*/
+struct RenderGraphStats
+{
+    int passes = 0;
+    int culledPasses = 0;
+    int targets = 0;     // transient targets used by the executed passes
+    int textures = 0;    // textures backing them, targets whose lifetimes don't overlap share one
+    size_t bytes = 0;    // memory of these textures
+    int compilations = 0;
+};
+
+/**
+ * Orders the passes of a frame and provides their intermediate render targets.
+ *
+ * The passes are declared every frame, in an order where every resource is
+ * written before it is read, together with the resources they read and
+ * write:
+ *  - the backbuffer of the window,
+ *  - transient targets, which only live during the frame and are created,
+ *    pooled and bound by the graph,
+ *  - imported resources, persistent ones like the shadow maps that the
+ *    writing pass renders into itself, declared for the ordering only.
+ *
+ * Compiling culls the passes whose results nothing uses, that is which
+ * neither write the backbuffer nor a resource read by a kept pass, and
+ * backs the transient targets with pooled textures: targets whose lifetimes
+ * don't overlap share a texture when their descriptions match. Every pass
+ * writing transient targets gets a framebuffer with them attached. The
+ * compiled graph is kept as long as the declarations stay the same, so
+ * steady frames only execute the ordered list, without allocating.
+ *
+ * A transient target starts undefined, it is cleared before the first pass
+ * writing it, and so is the backbuffer.
+ */
+class RenderGraph
+{
+public:
+    class PassBuilder
+    {
+    public:
+        PassBuilder &Read(RenderResource resource)
+        {
+            graph.addResource(graph.passes[pass].reads, graph.passes[pass].readCount, resource);
+            return *this;
+        }
+
+        PassBuilder &Write(RenderResource resource)
+        {
+            graph.addResource(graph.passes[pass].writes, graph.passes[pass].writeCount, resource);
+            return *this;
+        }
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph &graph, int pass) : graph(graph), pass(pass) {}
+
+        RenderGraph &graph;
+        int pass;
+    };
+
+    RenderGraph() = default;
+    RenderGraph(const RenderGraph &) = delete;
+    RenderGraph &operator=(const RenderGraph &) = delete;
+
+    ~RenderGraph()
+    {
+        if (!framebuffers.empty())
+            glDeleteFramebuffers((GLsizei)framebuffers.size(), framebuffers.data());
+    }
+
+    /**
+     * Starts declaring the passes of a frame drawn into a window of 'width' by
+     * 'height' pixels. 'backbuffer' is the framebuffer standing in for the
+     * window's when there is none, see HeadlessTarget
+     */
+    void Begin(int width, int height, GLuint backbuffer = 0)
+    {
+        resources.clear();
+        passes.clear();
+        windowWidth = width;
+        windowHeight = height;
+        backbufferFramebuffer = backbuffer;
+        declare(ResourceKind::Backbuffer, "backbuffer", RenderTargetDesc());
+    }
+
+    RenderResource Backbuffer() const { return 0; }
+
+    /*A persistent resource its writer renders into itself, see the class description*/
+    RenderResource Import(const char *name)
+    {
+        return declare(ResourceKind::Imported, name, RenderTargetDesc());
+    }
+
+    /*A render target that only lives during the frame*/
+    RenderResource CreateTarget(const char *name, const RenderTargetDesc &desc)
+    {
+        return declare(ResourceKind::Transient, name, desc);
+    }
+
+    /**
+     * Declares a pass, 'execute' renders it once the graph bound its targets.
+     * Hand larger lambdas over with std::ref, see renderFrame in main.cpp.
+     */
+    PassBuilder AddPass(const char *name, std::function<void()> execute)
+    {
+        passes.emplace_back();
+        passes.back().name = name;
+        passes.back().execute = std::move(execute);
+        return PassBuilder(*this, (int)passes.size() - 1);
+    }
+
+    /*Texture of a transient target, for the passes reading it*/
+    GLuint Texture(RenderResource resource) const
+    {
+        int texture = compiled.resources[resource].texture;
+        return texture >= 0 ? pool[texture].texture.Get() : 0;
+    }
+
+    /*Compiles the graph if the declarations changed since the last frame, and runs the passes that weren't culled*/
+    void Execute()
+    {
+        if (!sameAsCompiled())
+            compile();
+
+        for (const CompiledPass &step : order)
+        {
+            const Pass &pass = passes[step.pass];
+            if (step.framebuffer != NO_FRAMEBUFFER)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, step.framebuffer);
+                glViewport(0, 0, step.width, step.height);
+                if (step.clear)
+                    glClear(step.clear);
+            }
+            pass.execute();
+        }
+    }
+
+    const RenderGraphStats &Stats() const { return stats; }
+
+private:
+    enum class ResourceKind
+    {
+        Backbuffer,
+        Imported,
+        Transient
+    };
+
+    struct Resource
+    {
+        ResourceKind kind = ResourceKind::Transient;
+        const char *name = nullptr;
+        RenderTargetDesc desc;
+        int texture = -1; // index into the pool once compiled
+    };
+
+    struct Pass
+    {
+        const char *name = nullptr;
+        std::function<void()> execute;
+        RenderResource reads[MAX_PASS_RESOURCES];
+        RenderResource writes[MAX_PASS_RESOURCES];
+        int readCount = 0;
+        int writeCount = 0;
+    };
+
+    /*The declarations the execution list was compiled from, without the callbacks*/
+    struct Declaration
+    {
+        std::vector<Resource> resources;
+        std::vector<Pass> passes;
+        int windowWidth = 0;
+        int windowHeight = 0;
+        GLuint backbufferFramebuffer = 0;
+    };
+
+    /*A texture of the pool, 'used' while a target of the compiled graph is aliased to it*/
+    struct PooledTexture
+    {
+        RenderTargetDesc desc;
+        TextureHandle texture;
+        bool used = false;
+    };
+
+    static const GLuint NO_FRAMEBUFFER = ~0u;
+
+    /*A kept pass in execution order, with the framebuffer it renders into*/
+    struct CompiledPass
+    {
+        int pass = 0;
+        GLuint framebuffer = NO_FRAMEBUFFER; // the backbuffer's when it writes it, none when it only writes imported resources
+        int width = 0;
+        int height = 0;
+        GLbitfield clear = 0;
+    };
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    int windowWidth = 0;
+    int windowHeight = 0;
+    GLuint backbufferFramebuffer = 0;
+
+    Declaration compiled;
+    std::vector<CompiledPass> order;
+    std::vector<PooledTexture> pool;
+    std::vector<GLuint> framebuffers;
+    RenderGraphStats stats;
+
+    RenderResource declare(ResourceKind kind, const char *name, const RenderTargetDesc &desc)
+    {
+        resources.emplace_back();
+        resources.back().kind = kind;
+        resources.back().name = name;
+        resources.back().desc = desc;
+        return (RenderResource)resources.size() - 1;
+    }
+
+    void addResource(RenderResource *list, int &count, RenderResource resource)
+    {
+        if (resource < 0 || resource >= (int)resources.size())
+            std::cout << "ERROR::RENDER_GRAPH::UNKNOWN_RESOURCE " << resource << std::endl;
+        else if (count == MAX_PASS_RESOURCES)
+            std::cout << "ERROR::RENDER_GRAPH::TOO_MANY_RESOURCES " << resources[resource].name << std::endl;
+        else
+            list[count++] = resource;
+    }
+
+    static bool isDepth(GLenum internalFormat)
+    {
+        return internalFormat == GL_DEPTH_COMPONENT24;
+    }
+
+    static size_t bytesPerPixel(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_RGBA16F:
+            return 8;
+        case GL_R16F:
+            return 2;
+        default:
+            return 4;
+        }
+    }
+
+    static bool writes(const Pass &pass, RenderResource resource)
+    {
+        for (int i = 0; i < pass.writeCount; i++)
+            if (pass.writes[i] == resource)
+                return true;
+        return false;
+    }
+
+    /*True when the frame declared the same passes and resources as the compiled graph*/
+    bool sameAsCompiled() const
+    {
+        if (stats.compilations == 0 || windowWidth != compiled.windowWidth || windowHeight != compiled.windowHeight ||
+            backbufferFramebuffer != compiled.backbufferFramebuffer ||
+            resources.size() != compiled.resources.size() || passes.size() != compiled.passes.size())
+            return false;
+
+        for (size_t i = 0; i < resources.size(); i++)
+        {
+            const Resource &a = resources[i], &b = compiled.resources[i];
+            if (a.kind != b.kind || !(a.desc == b.desc) || strcmp(a.name, b.name) != 0)
+                return false;
+        }
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            const Pass &a = passes[i], &b = compiled.passes[i];
+            if (strcmp(a.name, b.name) != 0 || a.readCount != b.readCount || a.writeCount != b.writeCount ||
+                !std::equal(a.reads, a.reads + a.readCount, b.reads) || !std::equal(a.writes, a.writes + a.writeCount, b.writes))
+                return false;
+        }
+        return true;
+    }
+
+    void compile()
+    {
+        stats = RenderGraphStats{0, 0, 0, 0, 0, stats.compilations + 1};
+
+        /*Culling from the back: a pass is kept when it writes the backbuffer or a resource a kept pass reads*/
+        std::vector<bool> kept(passes.size(), false), needed(resources.size(), false);
+        needed[Backbuffer()] = true;
+        for (int p = (int)passes.size() - 1; p >= 0; p--)
+        {
+            const Pass &pass = passes[p];
+            for (int i = 0; i < pass.writeCount && !kept[p]; i++)
+                kept[p] = needed[pass.writes[i]];
+            if (!kept[p])
+            {
+                stats.culledPasses++;
+                continue;
+            }
+            for (int i = 0; i < pass.readCount; i++)
+                needed[pass.reads[i]] = true;
+        }
+
+        /*Lifetime of each transient target, from the first to the last kept pass using it*/
+        std::vector<int> first(resources.size(), -1), last(resources.size(), -1);
+        for (int p = 0; p < (int)passes.size(); p++)
+        {
+            if (!kept[p])
+                continue;
+            const Pass &pass = passes[p];
+            for (int i = 0; i < pass.readCount; i++)
+            {
+                RenderResource r = pass.reads[i];
+                if (resources[r].kind == ResourceKind::Transient && first[r] < 0)
+                    std::cout << "ERROR::RENDER_GRAPH::READ_BEFORE_WRITE " << resources[r].name << " in " << pass.name << std::endl;
+                last[r] = p;
+            }
+            for (int i = 0; i < pass.writeCount; i++)
+            {
+                RenderResource r = pass.writes[i];
+                if (first[r] < 0)
+                    first[r] = p;
+                last[r] = p;
+            }
+        }
+
+        /**
+         * Backing the targets with pooled textures in execution order: a
+         * target takes a free texture of its description when its lifetime
+         * starts and frees it after its last pass. Textures no target uses any
+         * more, after a resize say, are released
+         */
+        for (PooledTexture &texture : pool)
+            texture.used = false;
+        for (int p = 0; p < (int)passes.size(); p++)
+        {
+            for (RenderResource r = 0; r < (RenderResource)resources.size(); r++)
+                if (first[r] == p && resources[r].kind == ResourceKind::Transient)
+                {
+                    resources[r].texture = acquire(resources[r].desc);
+                    stats.targets++;
+                }
+            for (RenderResource r = 0; r < (RenderResource)resources.size(); r++)
+                if (last[r] == p && resources[r].texture >= 0)
+                    pool[resources[r].texture].used = false;
+        }
+        std::vector<bool> referenced(pool.size(), false);
+        for (const Resource &resource : resources)
+            if (resource.texture >= 0)
+                referenced[resource.texture] = true;
+        for (int t = (int)pool.size() - 1; t >= 0; t--)
+            if (!referenced[t])
+            {
+                pool.erase(pool.begin() + t);
+                for (Resource &resource : resources)
+                    if (resource.texture > t)
+                        resource.texture--;
+            }
+        for (const PooledTexture &texture : pool)
+            stats.bytes += texture.desc.width * texture.desc.height * bytesPerPixel(texture.desc.internalFormat);
+        stats.textures = (int)pool.size();
+
+        /*The execution list, with a framebuffer for every pass writing transient targets*/
+        order.clear();
+        int usedFramebuffers = 0;
+        for (int p = 0; p < (int)passes.size(); p++)
+        {
+            if (!kept[p])
+                continue;
+            stats.passes++;
+
+            const Pass &pass = passes[p];
+            CompiledPass step;
+            step.pass = p;
+            if (writes(pass, Backbuffer()))
+            {
+                step.framebuffer = backbufferFramebuffer;
+                step.width = windowWidth;
+                step.height = windowHeight;
+                if (first[Backbuffer()] == p)
+                    step.clear = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT;
+            }
+            else
+            {
+                for (int i = 0; i < pass.writeCount; i++)
+                    if (resources[pass.writes[i]].kind == ResourceKind::Transient)
+                    {
+                        if (usedFramebuffers == (int)framebuffers.size())
+                        {
+                            framebuffers.push_back(0);
+                            glGenFramebuffers(1, &framebuffers.back());
+                        }
+                        step.framebuffer = framebuffers[usedFramebuffers++];
+                        break;
+                    }
+                if (step.framebuffer != NO_FRAMEBUFFER)
+                    attach(pass, step, first);
+            }
+            order.push_back(step);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        compiled.resources = resources;
+        compiled.passes = passes;
+        for (Pass &pass : compiled.passes)
+            pass.execute = nullptr;
+        compiled.windowWidth = windowWidth;
+        compiled.windowHeight = windowHeight;
+        compiled.backbufferFramebuffer = backbufferFramebuffer;
+    }
+
+    /*Returns a free pooled texture matching 'desc', creating one if there is none*/
+    int acquire(const RenderTargetDesc &desc)
+    {
+        for (int t = 0; t < (int)pool.size(); t++)
+            if (!pool[t].used && pool[t].desc == desc)
+            {
+                pool[t].used = true;
+                return t;
+            }
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (isDepth(desc.internalFormat))
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        PooledTexture pooled;
+        pooled.desc = desc;
+        pooled.texture = ResourceManager::Instance().Adopt<ResourceType::Texture>(0, texture);
+        pooled.used = true;
+        pool.push_back(std::move(pooled));
+        return (int)pool.size() - 1;
+    }
+
+    /*Attaches the transient targets 'pass' writes to the framebuffer of 'step', the first pass writing a target clears it*/
+    void attach(const Pass &pass, CompiledPass &step, const std::vector<int> &first)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, step.framebuffer);
+
+        GLenum drawBuffers[MAX_PASS_RESOURCES];
+        int colorCount = 0;
+        bool hasDepth = false;
+        for (int i = 0; i < pass.writeCount; i++)
+        {
+            const Resource &resource = resources[pass.writes[i]];
+            if (resource.kind != ResourceKind::Transient)
+                continue;
+
+            GLuint texture = pool[resource.texture].texture.Get();
+            step.width = resource.desc.width;
+            step.height = resource.desc.height;
+            bool cleared = first[pass.writes[i]] == step.pass;
+            if (isDepth(resource.desc.internalFormat))
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+                hasDepth = true;
+                if (cleared)
+                    step.clear |= GL_DEPTH_BUFFER_BIT;
+            }
+            else
+            {
+                drawBuffers[colorCount] = GL_COLOR_ATTACHMENT0 + colorCount;
+                glFramebufferTexture2D(GL_FRAMEBUFFER, drawBuffers[colorCount], GL_TEXTURE_2D, texture, 0);
+                colorCount++;
+                if (cleared)
+                    step.clear |= GL_COLOR_BUFFER_BIT;
+            }
+        }
+
+        /*Detaching what an earlier compilation left on the framebuffer*/
+        for (int i = colorCount; i < MAX_PASS_RESOURCES; i++)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, 0, 0);
+        if (!hasDepth)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+
+        if (colorCount > 0)
+            glDrawBuffers(colorCount, drawBuffers);
+        else
+        {
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::RENDER_GRAPH::FRAMEBUFFER_INCOMPLETE " << pass.name << std::endl;
+    }
+};
+#endif
@@ -0,0 +1,377 @@
+#ifndef RESOURCE_MANAGER_H
+#define RESOURCE_MANAGER_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*Kinds of GL objects owned by the ResourceManager, each kind has its own key space*/
+enum class ResourceType
+{
+    Texture,
+    Buffer,
+    VertexArray,
+    Program,
+    Count
+};
+
+/**
+ * How a resource is created and destroyed.
+ *
+ * 'load' builds the GL object from its source (files on disk) and is what
+ * Reload() runs again, resources built from data in memory leave it empty and
+ * can't be unloaded. 'unload' deletes the object, the glDelete* call of its
+ * type when empty.
+ */
+struct ResourceLoader
+{
+    std::function<GLuint()> load;
+    std::function<void(GLuint)> unload;
+};
+
+template <ResourceType Type>
+class ResourceHandle;
+
+/**
+ * Process-wide owner of the GL objects shared between models and shaders.
+ *
+ * Resources are looked up by a 64-bit key derived from their content or their
+ * source path, so a second model referencing the same image, geometry or
+ * program gets the object that already exists instead of uploading its own.
+ * Key 0 is for resources that are never shared.
+ *
+ * Every user holds a ResourceHandle. Handles are move-only and counted, the
+ * object is deleted when the last one goes away, so releasing a model returns
+ * its memory. Unload() and Reload() act on a resource in place while its
+ * handles stay valid.
+ *
+ * Like the GL calls it makes, the manager is used from the thread owning the
+ * context only.
+ */
+class ResourceManager
+{
+public:
+    /*Access to the single manager shared by every model*/
+    static ResourceManager &Instance()
+    {
+        static ResourceManager manager;
+        return manager;
+    }
+
+    /*Shares the resource stored under 'key', the handle is empty when there is none*/
+    template <ResourceType Type>
+    ResourceHandle<Type> Find(uint64_t key);
+
+    /*Shares the resource stored under 'key', loading it first when there is none*/
+    template <ResourceType Type>
+    ResourceHandle<Type> Load(uint64_t key, ResourceLoader loader);
+
+    /**
+     * Takes ownership of an object that has already been created, under 'key'.
+     * The loader is only run on Reload(). If 'key' is taken, the new object is
+     * deleted and the existing one shared.
+     */
+    template <ResourceType Type>
+    ResourceHandle<Type> Adopt(uint64_t key, GLuint name, ResourceLoader loader = ResourceLoader());
+
+    /*Deletes the GL object of a resource but keeps its handles, which see name 0 until it is reloaded*/
+    bool Unload(ResourceType type, uint64_t key)
+    {
+        int slot = findSlot(type, key, "UNLOAD");
+        if (slot < 0)
+            return false;
+
+        destroy(entries[slot]);
+        return true;
+    }
+
+    /*Recreates a resource from its source, the handles see the new object*/
+    bool Reload(ResourceType type, uint64_t key)
+    {
+        int slot = findSlot(type, key, "RELOAD");
+        if (slot < 0)
+            return false;
+
+        destroy(entries[slot]);
+        entries[slot].name = entries[slot].loader.load();
+        return true;
+    }
+
+    /**
+     * Deletes every GL object while the context still exists. Handles released
+     * afterwards only update the counts, for objects outliving the context.
+     */
+    void Shutdown()
+    {
+        for (Entry &entry : entries)
+            if (entry.refs > 0)
+                destroy(entry);
+        closed = true;
+    }
+
+    /*Number of live resources of a type*/
+    size_t Count(ResourceType type) const
+    {
+        size_t count = 0;
+        for (const Entry &entry : entries)
+            if (entry.refs > 0 && entry.type == type)
+                count++;
+        return count;
+    }
+
+private:
+    template <ResourceType Type>
+    friend class ResourceHandle;
+
+    struct Entry
+    {
+        ResourceType type = ResourceType::Texture;
+        uint64_t key = 0;
+        GLuint name = 0;
+        int refs = 0;
+        ResourceLoader loader;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int> freeSlots;
+    std::unordered_map<uint64_t, int> lookup[(int)ResourceType::Count];
+    bool closed = false;
+
+    ResourceManager() = default;
+
+    GLuint name(int slot) const
+    {
+        return entries[slot].name;
+    }
+
+    void acquire(int slot)
+    {
+        entries[slot].refs++;
+    }
+
+    /*Drops a reference, the last one deletes the object and frees the slot*/
+    void release(int slot)
+    {
+        Entry &entry = entries[slot];
+        if (--entry.refs > 0)
+            return;
+
+        destroy(entry);
+        if (entry.key != 0)
+            lookup[(int)entry.type].erase(entry.key);
+        entry = Entry();
+        freeSlots.push_back(slot);
+    }
+
+    int insert(ResourceType type, uint64_t key, GLuint name, ResourceLoader loader)
+    {
+        int slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            slot = (int)entries.size();
+            entries.emplace_back();
+        }
+
+        Entry &entry = entries[slot];
+        entry.type = type;
+        entry.key = key;
+        entry.name = name;
+        entry.loader = std::move(loader);
+        if (key != 0)
+            lookup[(int)type][key] = slot;
+        return slot;
+    }
+
+    int lookupSlot(ResourceType type, uint64_t key) const
+    {
+        if (key == 0)
+            return -1;
+        auto found = lookup[(int)type].find(key);
+        return found != lookup[(int)type].end() ? found->second : -1;
+    }
+
+    /*Slot of a resource that can be unloaded and reloaded, reports why when there is none*/
+    int findSlot(ResourceType type, uint64_t key, const char *operation) const
+    {
+        int slot = lookupSlot(type, key);
+        if (slot < 0)
+        {
+            std::cout << "ERROR::RESOURCE::" << operation << "::UNKNOWN_KEY " << key << std::endl;
+            return -1;
+        }
+        if (!entries[slot].loader.load)
+        {
+            std::cout << "ERROR::RESOURCE::" << operation << "::NOT_RELOADABLE " << key << std::endl;
+            return -1;
+        }
+        return slot;
+    }
+
+    void destroy(Entry &entry)
+    {
+        if (entry.name != 0 && !closed)
+            deleteObject(entry.type, entry.name, entry.loader);
+        entry.name = 0;
+    }
+
+    static void deleteObject(ResourceType type, GLuint name, const ResourceLoader &loader)
+    {
+        if (loader.unload)
+        {
+            loader.unload(name);
+            return;
+        }
+
+        switch (type)
+        {
+        case ResourceType::Texture:
+            glDeleteTextures(1, &name);
+            break;
+        case ResourceType::Buffer:
+            glDeleteBuffers(1, &name);
+            break;
+        case ResourceType::VertexArray:
+            glDeleteVertexArrays(1, &name);
+            break;
+        case ResourceType::Program:
+            glDeleteProgram(name);
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+/**
+ * Counted reference to a resource of the ResourceManager.
+ *
+ * Move-only: copying a handle by accident would hide an ownership, a second
+ * owner asks for it with Share(). An empty handle refers to nothing.
+ */
+template <ResourceType Type>
+class ResourceHandle
+{
+public:
+    ResourceHandle() = default;
+
+    ~ResourceHandle()
+    {
+        Reset();
+    }
+
+    ResourceHandle(ResourceHandle &&other) noexcept : slot(other.slot)
+    {
+        other.slot = -1;
+    }
+
+    ResourceHandle &operator=(ResourceHandle &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            slot = other.slot;
+            other.slot = -1;
+        }
+        return *this;
+    }
+
+    ResourceHandle(const ResourceHandle &) = delete;
+    ResourceHandle &operator=(const ResourceHandle &) = delete;
+
+    /*GL name of the resource, 0 when the handle is empty or the resource unloaded*/
+    GLuint Get() const
+    {
+        return slot >= 0 ? ResourceManager::Instance().name(slot) : 0;
+    }
+
+    /*Key the resource is stored under*/
+    uint64_t Key() const
+    {
+        return slot >= 0 ? ResourceManager::Instance().entries[slot].key : 0;
+    }
+
+    bool Valid() const
+    {
+        return slot >= 0;
+    }
+
+    /*A second reference to the same resource*/
+    ResourceHandle Share() const
+    {
+        if (slot >= 0)
+            ResourceManager::Instance().acquire(slot);
+        return ResourceHandle(slot);
+    }
+
+    /*Drops the reference, the handle becomes empty*/
+    void Reset()
+    {
+        if (slot >= 0)
+            ResourceManager::Instance().release(slot);
+        slot = -1;
+    }
+
+private:
+    friend class ResourceManager;
+
+    int slot = -1;
+
+    /*Takes over a reference that has already been counted*/
+    explicit ResourceHandle(int slot) : slot(slot) {}
+};
+
+typedef ResourceHandle<ResourceType::Texture> TextureHandle;
+typedef ResourceHandle<ResourceType::Buffer> BufferHandle;
+typedef ResourceHandle<ResourceType::VertexArray> VertexArrayHandle;
+typedef ResourceHandle<ResourceType::Program> ProgramHandle;
+
+template <ResourceType Type>
+ResourceHandle<Type> ResourceManager::Find(uint64_t key)
+{
+    int slot = lookupSlot(Type, key);
+    if (slot < 0)
+        return ResourceHandle<Type>();
+
+    acquire(slot);
+    return ResourceHandle<Type>(slot);
+}
+
+template <ResourceType Type>
+ResourceHandle<Type> ResourceManager::Load(uint64_t key, ResourceLoader loader)
+{
+    ResourceHandle<Type> found = Find<Type>(key);
+    if (found.Valid())
+        return found;
+
+    GLuint name = loader.load();
+    int slot = insert(Type, key, name, std::move(loader));
+    acquire(slot);
+    return ResourceHandle<Type>(slot);
+}
+
+template <ResourceType Type>
+ResourceHandle<Type> ResourceManager::Adopt(uint64_t key, GLuint name, ResourceLoader loader)
+{
+    ResourceHandle<Type> found = Find<Type>(key);
+    if (found.Valid())
+    {
+        deleteObject(Type, name, loader);
+        return found;
+    }
+
+    int slot = insert(Type, key, name, std::move(loader));
+    acquire(slot);
+    return ResourceHandle<Type>(slot);
+}
+#endif
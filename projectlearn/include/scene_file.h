@@ -0,0 +1,214 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "json.h"
+#include "model.h"
+#include "string_id.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/*A model file referenced by the scene, loaded once however many instances it has*/
+struct SceneAsset
+{
+    std::string name;
+    std::string modelPath;
+    std::string animationPath; // empty for static models
+    bool bake = false;         // static lighting of this asset is baked into the lightmap
+};
+
+/*One placement of an asset*/
+struct SceneInstance
+{
+    int asset;
+    StringId name;
+    glm::mat4 transform;
+    std::vector<MaterialOverride> overrides;
+};
+
+/**
+ * Contents of a scene file: the assets it uses and where their instances go.
+ *
+ *  {
+ *      "assets": {
+ *          "house": { "model": "models/house.obj", "bake": true },
+ *          "character": { "model": "models/Sitting.dae", "animation": "models/Sitting.dae" }
+ *      },
+ *      "instances": [
+ *          { "asset": "house", "position": [0, 0, 1],
+ *            "grid": { "count": [10, 10], "spacing": [40, 40] },
+ *            "materials": { "walls": { "diffuse": [0.8, 0.6, 0.5] } } },
+ *          { "asset": "character", "name": "character", "position": [11.09, 2.105, 10], "rotation": [0, 90, 0] }
+ *      ]
+ *  }
+ *
+ * Relative paths start at the directory of the scene file. An instance is
+ * placed by "position", "rotation" (degrees, applied around x, then y, then
+ * z) and "scale", a number or three. "grid" repeats it along the x and z
+ * axes, so a neighborhood is one entry. "materials" replaces the ambient,
+ * diffuse, specular or shininess of the meshes with the given names, for
+ * this instance only.
+ *
+ * A model holds MAX_MATERIALS materials, its own and the distinct ones its
+ * overrides create; overrides past that leave the meshes their own material.
+ * The bulbs of a model's instances shine up to MAX_BULBS bulbs in all, the
+ * instances past that are only lit by the bulbs baked into the lightmap.
+ *
+ * When no asset is marked "bake", the static one that comes first by name is.
+ */
+struct SceneDescription
+{
+    std::vector<SceneAsset> assets;
+    std::vector<SceneInstance> instances;
+
+    /*Reads the scene file at 'path', returns false after reporting what is wrong with it*/
+    bool Load(const std::string &path)
+    {
+        assets.clear();
+        instances.clear();
+
+        JsonValue document;
+        if (!JsonReader::ReadFile(path, document))
+            return false;
+        if (!document["assets"].IsObject() || !document["instances"].IsArray())
+        {
+            std::cout << "ERROR::SCENE::EXPECTED_ASSETS_AND_INSTANCES " << path << std::endl;
+            return false;
+        }
+
+        std::filesystem::path directory = std::filesystem::path(path).parent_path();
+        std::map<std::string, int> assetIndices;
+        for (const auto &entry : document["assets"].object)
+        {
+            SceneAsset asset;
+            asset.name = entry.first;
+            asset.modelPath = resolve(directory, entry.second["model"].AsString());
+            asset.animationPath = resolve(directory, entry.second["animation"].AsString());
+            asset.bake = entry.second["bake"].AsBool();
+            if (asset.modelPath.empty())
+            {
+                std::cout << "ERROR::SCENE::ASSET_WITHOUT_MODEL " << asset.name << std::endl;
+                return false;
+            }
+
+            assetIndices[asset.name] = (int)assets.size();
+            assets.push_back(asset);
+        }
+
+        bool baked = false;
+        for (const SceneAsset &asset : assets)
+            baked = baked || asset.bake;
+        for (SceneAsset &asset : assets)
+        {
+            if (!baked && asset.animationPath.empty())
+            {
+                asset.bake = true;
+                baked = true;
+            }
+        }
+
+        for (const JsonValue &entry : document["instances"].array)
+        {
+            auto found = assetIndices.find(entry["asset"].AsString());
+            if (found == assetIndices.end())
+            {
+                std::cout << "ERROR::SCENE::UNKNOWN_ASSET " << entry["asset"].AsString() << std::endl;
+                return false;
+            }
+            addInstances(found->second, entry);
+        }
+        return true;
+    }
+
+private:
+    static std::string resolve(const std::filesystem::path &directory, const std::string &path)
+    {
+        if (path.empty() || std::filesystem::path(path).is_absolute())
+            return path;
+        return (directory / path).lexically_normal().string();
+    }
+
+    static glm::vec3 vector3(const JsonValue &value, glm::vec3 fallback)
+    {
+        if (value.IsNumber())
+            return glm::vec3((float)value.AsNumber());
+        if (!value.IsArray())
+            return fallback;
+        return glm::vec3((float)value[0].AsNumber(fallback.x), (float)value[1].AsNumber(fallback.y), (float)value[2].AsNumber(fallback.z));
+    }
+
+    static std::vector<MaterialOverride> materialOverrides(const JsonValue &materials)
+    {
+        std::vector<MaterialOverride> overrides;
+        for (const auto &entry : materials.object)
+        {
+            MaterialOverride change;
+            change.mesh = StringTable::Instance().Intern(entry.first);
+            if (entry.second["ambient"].IsArray())
+            {
+                change.ambient = vector3(entry.second["ambient"], glm::vec3(0.0f));
+                change.fields |= OVERRIDE_AMBIENT;
+            }
+            if (entry.second["diffuse"].IsArray())
+            {
+                change.diffuse = vector3(entry.second["diffuse"], glm::vec3(0.0f));
+                change.fields |= OVERRIDE_DIFFUSE;
+            }
+            if (entry.second["specular"].IsArray())
+            {
+                change.specular = vector3(entry.second["specular"], glm::vec3(0.0f));
+                change.fields |= OVERRIDE_SPECULAR;
+            }
+            if (entry.second["shininess"].IsNumber())
+            {
+                change.shininess = (float)entry.second["shininess"].AsNumber();
+                change.fields |= OVERRIDE_SHININESS;
+            }
+            overrides.push_back(change);
+        }
+        return overrides;
+    }
+
+    /*Adds the instance described by 'entry', repeated over its grid*/
+    void addInstances(int asset, const JsonValue &entry)
+    {
+        glm::vec3 position = vector3(entry["position"], glm::vec3(0.0f));
+        glm::vec3 rotation = vector3(entry["rotation"], glm::vec3(0.0f));
+        glm::vec3 scale = vector3(entry["scale"], glm::vec3(1.0f));
+
+        glm::mat4 orientation(1.0f);
+        orientation = glm::rotate(orientation, glm::radians(rotation.z), glm::vec3(0.0f, 0.0f, 1.0f));
+        orientation = glm::rotate(orientation, glm::radians(rotation.y), glm::vec3(0.0f, 1.0f, 0.0f));
+        orientation = glm::rotate(orientation, glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
+        orientation = glm::scale(orientation, scale);
+
+        const JsonValue &grid = entry["grid"];
+        int countX = std::max(1, (int)grid["count"][0].AsNumber(1.0));
+        int countZ = std::max(1, (int)grid["count"][1].AsNumber(1.0));
+        float spacingX = (float)grid["spacing"][0].AsNumber(0.0);
+        float spacingZ = (float)grid["spacing"][1].AsNumber(0.0);
+
+        SceneInstance instance;
+        instance.asset = asset;
+        instance.name = StringTable::Instance().Intern(entry["name"].AsString());
+        instance.overrides = materialOverrides(entry["materials"]);
+
+        for (int z = 0; z < countZ; z++)
+        {
+            for (int x = 0; x < countX; x++)
+            {
+                glm::vec3 offset(x * spacingX, 0.0f, z * spacingZ);
+                instance.transform = glm::translate(glm::mat4(1.0f), position + offset) * orientation;
+                instances.push_back(instance);
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,142 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include "string_id.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+/*Index of a node in its SceneGraph*/
+typedef int SceneNode;
+
+/*Every graph starts with a root node with an identity transform*/
+const SceneNode SCENE_ROOT = 0;
+
+/**
+ * Hierarchy of transforms with cached world and normal matrices.
+ *
+ * Nodes live in structure-of-arrays form in depth-first order, so a node's
+ * parent always comes before it and its subtree is the contiguous range up
+ * to SubtreeEnd(). Changing a local transform only marks the node dirty;
+ * Update() then recomputes the dirty subtrees in one forward pass, clean
+ * subtrees are skipped whole.
+ *
+ * Nodes are appended below the last node added or one of its ancestors,
+ * which is how a recursive traversal of a file's hierarchy adds them.
+ */
+class SceneGraph
+{
+public:
+    SceneGraph()
+    {
+        parents.push_back(-1);
+        subtreeEnds.push_back(1);
+        locals.push_back(glm::mat4(1.0f));
+        worlds.push_back(glm::mat4(1.0f));
+        normals.push_back(glm::mat3(1.0f));
+        dirty.push_back(0);
+        names.push_back(StringId());
+    }
+
+    /*Adds a child of 'parent', it is dirty until the next Update()*/
+    SceneNode AddNode(SceneNode parent, const glm::mat4 &local, StringId name = StringId())
+    {
+        SceneNode node = (SceneNode)parents.size();
+
+        /*Appending keeps the depth-first order only below the open branch*/
+        if (parent < 0 || parent >= node || subtreeEnds[parent] != node)
+        {
+            std::cout << "ERROR::SCENE_GRAPH::PARENT_NOT_ON_OPEN_BRANCH " << parent << std::endl;
+            parent = SCENE_ROOT;
+        }
+
+        parents.push_back(parent);
+        subtreeEnds.push_back(node + 1);
+        locals.push_back(local);
+        worlds.push_back(glm::mat4(1.0f));
+        normals.push_back(glm::mat3(1.0f));
+        dirty.push_back(1);
+        names.push_back(name);
+
+        for (SceneNode ancestor = parent; ancestor >= 0; ancestor = parents[ancestor])
+            subtreeEnds[ancestor] = node + 1;
+        return node;
+    }
+
+    /*Moves a node relative to its parent, its subtree follows at the next Update()*/
+    void SetLocal(SceneNode node, const glm::mat4 &local)
+    {
+        locals[node] = local;
+        dirty[node] = 1;
+    }
+
+    /**
+     * Recomputes the world and normal matrices of every dirty node and its
+     * descendants, returns how many nodes were updated.
+     */
+    size_t Update()
+    {
+        size_t updated = 0;
+        SceneNode count = (SceneNode)parents.size();
+        for (SceneNode node = 0; node < count;)
+        {
+            if (!dirty[node])
+            {
+                node++;
+                continue;
+            }
+
+            /*The whole subtree depends on this node, parents are always updated before their children*/
+            SceneNode end = subtreeEnds[node];
+            for (SceneNode i = node; i < end; i++)
+            {
+                worlds[i] = parents[i] >= 0 ? worlds[parents[i]] * locals[i] : locals[i];
+                normals[i] = glm::transpose(glm::inverse(glm::mat3(worlds[i])));
+                dirty[i] = 0;
+            }
+            updated += end - node;
+            node = end;
+        }
+        return updated;
+    }
+
+    /*First node with the given name, -1 if there is none*/
+    SceneNode Find(StringId name) const
+    {
+        for (size_t i = 0; i < names.size(); i++)
+            if (names[i] == name)
+                return (SceneNode)i;
+        return -1;
+    }
+
+    const glm::mat4 &Local(SceneNode node) const { return locals[node]; }
+
+    /*Transform from the node's space to the graph's, valid after Update()*/
+    const glm::mat4 &World(SceneNode node) const { return worlds[node]; }
+
+    /*Inverse transpose of the world matrix, for normals*/
+    const glm::mat3 &Normal(SceneNode node) const { return normals[node]; }
+
+    SceneNode Parent(SceneNode node) const { return parents[node]; }
+
+    /*One past the last node of the subtree rooted at 'node'*/
+    SceneNode SubtreeEnd(SceneNode node) const { return subtreeEnds[node]; }
+
+    StringId Name(SceneNode node) const { return names[node]; }
+
+    size_t Size() const { return parents.size(); }
+
+private:
+    std::vector<SceneNode> parents;
+    std::vector<SceneNode> subtreeEnds;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    std::vector<glm::mat3> normals;
+    std::vector<uint8_t> dirty;
+    std::vector<StringId> names;
+};
+#endif
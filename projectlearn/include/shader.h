@@ -4,20 +4,251 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "program_cache.h"
+#include "resource_manager.h"
+#include "string_id.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Name of a uniform given to the Shader setters. Literals are hashed at
+ * compile time, names built at runtime are interned once and passed as their
+ * StringId, so setting a uniform never touches a string once its location is
+ * cached.
+ */
+struct UniformName
+{
+    template <size_t N>
+    constexpr UniformName(const char (&literal)[N]) : literal(literal), id(literal) {}
+    UniformName(StringId interned) : literal(nullptr), id(interned) {}
+
+    const char *Name() const
+    {
+        return literal ? literal : StringTable::Instance().Name(id).c_str();
+    }
+
+    const char *literal;
+    StringId id;
+};
 
 class Shader
 {
 public:
-    unsigned int ID;
 
+    /**
+     * Builds the shader program from vertex and fragment shader files.
+     *
+     * Every entry of 'defines' is injected as '#define <entry>' right after the
+     * '#version' line of both sources, which is how compile-time permutations of
+     * the same shader files are produced (see ShaderVariants).
+     *
+     * Programs are resources of the ResourceManager keyed by their final sources,
+     * a Shader built from the same files and defines as another one shares its
+     * program. A new program is restored from the ProgramCache when possible.
+     * Otherwise it is compiled and linked, and a 'deferred' shader leaves
+     * checking the result to Finish() so that several programs can compile at once.
+     */
+    Shader(const char *vertexPath, const char *fragmentPath, const std::vector<std::string> &defines = {}, bool deferred = false)
+    {
+        std::string vertexCode;
+        std::string fragmentCode;
+        readSources(vertexPath, fragmentPath, defines, vertexCode, fragmentCode);
 
-    Shader(const char *vertexPath, const char *fragmentPath)
+        /**
+         *********************************************************************************************************
+         *                                                                                                       *
+         *                                   Restoring Program from Binary Cache                                 *
+         *                                                                                                       *
+         *********************************************************************************************************
+         */
+
+        ProgramCache &cache = ProgramCache::Instance();
+        cacheKey = cache.Key(vertexCode, fragmentCode);
+        program = ResourceManager::Instance().Find<ResourceType::Program>(cacheKey);
+        if (program.Valid())
+            return;
+
+        /*Creating shader program object, reloading it compiles the files again*/
+        GLuint ID = glCreateProgram();
+        program = ResourceManager::Instance().Adopt<ResourceType::Program>(cacheKey, ID, reloader(vertexPath, fragmentPath, defines));
+
+        /*Programs that were linked on an earlier run are restored without compiling anything*/
+        if (cache.Load(cacheKey, ID))
+            return;
+
+        /*Compiling both stages and linking, see Finish() for the results*/
+        compile(ID, vertexCode, fragmentCode, vertex, fragment);
+
+        /**
+         * Querying the compile and link status blocks until the driver is done,
+         * a deferred shader postpones it to Finish() so that other programs can
+         * be submitted and compiled in parallel meanwhile.
+         */
+        pending = true;
+        if (!deferred)
+            Finish();
+    }
+
+    /*GL name of the program*/
+    GLuint ID() const
+    {
+        return program.Get();
+    }
+
+    /**
+     * Completes a program that missed the cache: checks the compile and link
+     * status, frees the shader objects and stores the binary for the next run.
+     *
+     * Does nothing for programs that are already complete.
+     */
+    void Finish()
+    {
+        if (!pending)
+            return;
+        pending = false;
+
+        /*Checking if there were any compilation or linking errors*/
+        GLuint ID = program.Get();
+        checkCompileErrors(vertex, "VERTEX");
+        checkCompileErrors(fragment, "FRAGMENT");
+        bool linked = checkCompileErrors(ID, "PROGRAM");
+
+        /*Free up resources used by vertex and fragement shader as they have been attached to shader program*/
+        glDetachShader(ID, vertex);
+        glDetachShader(ID, fragment);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+
+        if (linked)
+            ProgramCache::Instance().Store(cacheKey, ID);
+    }
+
+    /**
+     * True once the program can be used without stalling, only ever false
+     * for deferred programs while the driver compiles them in parallel.
+     */
+    bool IsReady() const
     {
+        if (!pending)
+            return true;
+
+        if (!ProgramCache::Instance().ParallelCompile())
+            return false;
+
+        GLint completed = GL_FALSE;
+        glGetProgramiv(program.Get(), GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
+    }
+
+    /**
+     *********************************************************************************************************
+     *                                                                                                       *
+     *                                            Member Functions                                           *
+     *                                                                                                       *
+     *********************************************************************************************************
+     */
+
+    /*Activate the shader program for rendering*/
+    void use() const
+    {
+        glUseProgram(program.Get());
+    }
+
+    /*Uniform setters, the locations are looked up once per name (see UniformName)*/
+
+    /*Set the boolean uniform value in the shader program*/
+    void setBool(const UniformName &name, bool value) const
+    {
+        glUniform1i(uniformLocation(name), (int)value);
+    }
+
+    /*Set an integr uniform value in the shader program*/
+    void setInt(const UniformName &name, int value) const
+    {
+        glUniform1i(uniformLocation(name), value);
+    }
+
+    /*Set floating-point uniform value in the shader program*/
+    void setFloat(const UniformName &name, float value) const
+    {
+        glUniform1f(uniformLocation(name), value);
+    }
+
+    /*Sets 2D vector uniform values in the shader program*/
+    void setVec2(const UniformName &name, const glm::vec2 &value) const
+    {
+        glUniform2fv(uniformLocation(name), 1, &value[0]);
+    }
+
+    void setVec2(const UniformName &name, float x, float y) const
+    {
+        glUniform2f(uniformLocation(name), x, y);
+    }
+
+    /*Sets 3D uniform values in the shader program*/
+    void setVec3(const UniformName &name, const glm::vec3 &value) const
+    {
+        glUniform3fv(uniformLocation(name), 1, &value[0]);
+    }
+    void setVec3(const UniformName &name, float x, float y, float z) const
+    {
+        glUniform3f(uniformLocation(name), x, y, z);
+    }
+
+    /*Sets 4D uniform values in the shader program*/
+    void setVec4(const UniformName &name, const glm::vec4 &value) const
+    {
+        glUniform4fv(uniformLocation(name), 1, &value[0]);
+    }
+    void setVec4(const UniformName &name, float x, float y, float z, float w) const
+    {
+        glUniform4f(uniformLocation(name), x, y, z, w);
+    }
+
+    /* Sets 2X2 matrix uniform value in the shader program*/
+    void setMat2(const UniformName &name, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+    }
 
+
+    /*Sets 3X3 uniform value in the shader program*/
+    void setMat3(const UniformName &name, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    /*Sets 4X4 uniform value in the shader program*/
+    void setMat4(const UniformName &name, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    /*Sets 'count' elements of a 4X4 matrix array uniform, 'name' is the array without index*/
+    void setMat4Array(const UniformName &name, const glm::mat4 *mats, int count) const
+    {
+        if (count > 0)
+            glUniformMatrix4fv(uniformLocation(name), count, GL_FALSE, &mats[0][0][0]);
+    }
+
+    /*Assigns a uniform block of the shader program to a uniform buffer binding point*/
+    void setBlockBinding(const char *name, unsigned int binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID(), name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID(), index, binding);
+    }
+
+private:
+    /*Reads both shader files and injects the permutation defines*/
+    static void readSources(const std::string &vertexPath, const std::string &fragmentPath, const std::vector<std::string> &defines,
+                            std::string &vertexCode, std::string &fragmentCode)
+    {
         /**
          *********************************************************************************************************
          *                                                                                                       *
@@ -25,9 +256,6 @@ public:
          *                                                                                                       *
          *********************************************************************************************************
          */
-        /*Defining the temporary variable that will be used*/
-        std::string vertexCode;
-        std::string fragmentCode;
         std::ifstream vShaderFile;
         std::ifstream fShaderFile;
 
@@ -60,6 +288,14 @@ public:
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << e.what() << std::endl;
         }
 
+        /*Injecting the permutation defines into both shader sources*/
+        injectDefines(vertexCode, defines);
+        injectDefines(fragmentCode, defines);
+    }
+
+    /*Compiles both stages and links them into 'ID' without waiting for the driver*/
+    static void compile(GLuint ID, const std::string &vertexCode, const std::string &fragmentCode, GLuint &vertex, GLuint &fragment)
+    {
         /*Converting string into C String string*/
         const char *vShaderCode = vertexCode.c_str();
         const char *fShaderCode = fragmentCode.c_str();
@@ -72,8 +308,6 @@ public:
          *********************************************************************************************************
          */
 
-        unsigned int vertex, fragment;
-
         /*Creating vertex shader object*/
         vertex = glCreateShader(GL_VERTEX_SHADER);
 
@@ -83,9 +317,6 @@ public:
         /*Compiling the attached shader code into machine code, executed by GPU*/
         glCompileShader(vertex);
 
-        /*Checking if there were any compilation errors*/
-        checkCompileErrors(vertex, "VERTEX");
-
         /*-------------------------------------------------------------------*/
 
         /*Creating vertex shader object*/
@@ -97,9 +328,6 @@ public:
         /*Compiling the atached shader code into machine mode, executed by GPU*/
         glCompileShader(fragment);
 
-        /*Checking if there were any compilation errors*/
-        checkCompileErrors(fragment, "FRAGMENT");
-
         /**
          *********************************************************************************************************
          *                                                                                                       *
@@ -108,107 +336,74 @@ public:
          *********************************************************************************************************
          */
 
-        /*Creating shader program object*/
-        ID = glCreateProgram();
-
         /*Attaching compiled shader(fragment,vertex) to shader program*/
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
 
+        /*Asking the driver to keep the binary around so that it can be cached*/
+        ProgramCache::Instance().MarkRetrievable(ID);
+
         /*Combining shader objects into complete shader program used for rendering*/
         glLinkProgram(ID);
-
-        /*Checking if there were any linking errors or not*/
-        checkCompileErrors(ID, "PROGRAM");
-
-        /*Free up resources used by vertex and fragement shader as they have been attached to shader program*/
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-    }
-
-    /**
-     *********************************************************************************************************
-     *                                                                                                       *
-     *                                            Member Functions                                           *
-     *                                                                                                       *
-     *********************************************************************************************************
-     */
-
-    /*Activate the shader program for rendering*/
-    void use() const
-    {
-        glUseProgram(ID);
-    }
-
-    /*Set the boolean uniform value in the shader program*/
-    void setBool(const std::string &name, bool value) const
-    {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
-    }
-
-    /*Set an integr uniform value in the shader program*/
-    void setInt(const std::string &name, int value) const
-    {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
-    }
-
-    /*Set floating-point uniform value in the shader program*/
-    void setFloat(const std::string &name, float value) const
-    {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
-    }
-
-    /*Sets 2D vector uniform values in the shader program*/
-    void setVec2(const std::string &name, const glm::vec2 &value) const
-    {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
     }
 
-    void setVec2(const std::string &name, float x, float y) const
+    /*Compiles the shader files into a new program, for ResourceManager::Reload()*/
+    static ResourceLoader reloader(const std::string &vertexPath, const std::string &fragmentPath, const std::vector<std::string> &defines)
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        ResourceLoader loader;
+        loader.load = [vertexPath, fragmentPath, defines]()
+        {
+            std::string vertexCode, fragmentCode;
+            readSources(vertexPath, fragmentPath, defines, vertexCode, fragmentCode);
+
+            GLuint ID = glCreateProgram();
+            GLuint vertex, fragment;
+            compile(ID, vertexCode, fragmentCode, vertex, fragment);
+
+            checkCompileErrors(vertex, "VERTEX");
+            checkCompileErrors(fragment, "FRAGMENT");
+            bool linked = checkCompileErrors(ID, "PROGRAM");
+            glDetachShader(ID, vertex);
+            glDetachShader(ID, fragment);
+            glDeleteShader(vertex);
+            glDeleteShader(fragment);
+
+            if (linked)
+                ProgramCache::Instance().Store(ProgramCache::Instance().Key(vertexCode, fragmentCode), ID);
+            return ID;
+        };
+        return loader;
     }
 
-    /*Sets 3D uniform values in the shader program*/
-    void setVec3(const std::string &name, const glm::vec3 &value) const
-    {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
-    }
-    void setVec3(const std::string &name, float x, float y, float z) const
-    {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
-    }
+    ProgramHandle program;
 
-    /*Sets 4D uniform values in the shader program*/
-    void setVec4(const std::string &name, const glm::vec4 &value) const
-    {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
-    }
-    void setVec4(const std::string &name, float x, float y, float z, float w) const
-    {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
-    }
+    /*Uniform locations of the program by name, forgotten when the program is reloaded*/
+    mutable std::unordered_map<StringId, GLint> locations;
+    mutable GLuint locationsProgram = 0;
 
-    /* Sets 2X2 matrix uniform value in the shader program*/
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    GLint uniformLocation(const UniformName &name) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-    }
+        GLuint ID = program.Get();
+        if (ID != locationsProgram)
+        {
+            locations.clear();
+            locationsProgram = ID;
+        }
 
+        auto found = locations.find(name.id);
+        if (found != locations.end())
+            return found->second;
 
-    /*Sets 3X3 uniform value in the shader program*/
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
-    {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        GLint location = glGetUniformLocation(ID, name.Name());
+        locations.emplace(name.id, location);
+        return location;
     }
 
-    /*Sets 4X4 uniform value in the shader program*/
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
-    {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-    }
+    /*State kept between the constructor and Finish() for programs compiled from source*/
+    unsigned int vertex = 0, fragment = 0;
+    uint64_t cacheKey = 0;
+    bool pending = false;
 
-private:
     /**
      *********************************************************************************************************
      *                                                                                                       *
@@ -217,8 +412,38 @@ private:
      *********************************************************************************************************
      */
 
-    /*Check for compilation or linking erros in the shader programs*/
-    void checkCompileErrors(GLuint shader, std::string type)
+    /**
+     * Inserts '#define' lines after the '#version' directive of the shader source,
+     * GLSL requires '#version' to be the first statement so it can't go on top.
+     */
+    static void injectDefines(std::string &code, const std::vector<std::string> &defines)
+    {
+        if (defines.empty())
+            return;
+
+        std::string block;
+        for (const std::string &define : defines)
+            block += "#define " + define + "\n";
+
+        /*Position right after the end of the '#version' line, or the start of file if there is none*/
+        size_t insertAt = 0;
+        size_t version = code.find("#version");
+        if (version != std::string::npos)
+        {
+            size_t lineEnd = code.find('\n', version);
+            if (lineEnd == std::string::npos)
+            {
+                code += '\n';
+                lineEnd = code.size() - 1;
+            }
+            insertAt = lineEnd + 1;
+        }
+
+        code.insert(insertAt, block);
+    }
+
+    /*Check for compilation or linking erros in the shader programs, returns true when there were none*/
+    static bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -244,6 +469,7 @@ private:
                           << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success == GL_TRUE;
     }
 };
 #endif
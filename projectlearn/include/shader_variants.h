@@ -0,0 +1,143 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "shader.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Permutation flags of the lighting shader.
+ *
+ * Each flag is turned into a '#define' when the variant is compiled, so the
+ * fragment shader resolves these cases at compile time instead of branching on
+ * uniforms for every fragment.
+ *
+ * Per-mesh flags are ordered so that transparent surfaces (glass, water) get the
+ * highest values, which makes them draw last when meshes are bucketed by variant.
+ */
+enum ShaderVariantFlags
+{
+    VARIANT_TEXTURED = 1 << 0, // material has a diffuse texture
+    VARIANT_BULB = 1 << 1,     // mesh is a light bulb, glows at night
+    VARIANT_NIGHT = 1 << 2,    // per-frame flag: sun is off, bulbs are lit
+    VARIANT_GLASS = 1 << 3,    // reflective and blended surface
+    VARIANT_WATER = 1 << 4,    // reflective surface
+    VARIANT_PROBE = 1 << 5,    // per-pass flag: drawing into a reflection probe
+    VARIANT_LIGHTMAP = 1 << 6, // per-frame flag: static lighting comes from the baked lightmap
+};
+
+/*Flags that describe the mesh itself, as opposed to the per-frame ones*/
+const unsigned int VARIANT_MESH_MASK = VARIANT_TEXTURED | VARIANT_BULB | VARIANT_GLASS | VARIANT_WATER;
+
+class ShaderVariants
+{
+public:
+    /**
+     * Stores the shader paths, variants are only compiled when first requested.
+     *
+     * 'configure' runs once on every variant after it is linked, for state that
+     * lives in the program object such as sampler units and uniform block bindings.
+     */
+    ShaderVariants(const char *vertexPath, const char *fragmentPath, std::function<void(const Shader &)> configure = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), configure(configure)
+    {
+    }
+
+    /**
+     * Returns the program compiled for the given combination of flags,
+     * compiling it on first use.
+     */
+    Shader &Get(unsigned int flags)
+    {
+        flags = Resolve(flags);
+
+        std::unique_ptr<Shader> &shader = variants[flags];
+        if (!shader)
+            shader.reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), DefinesFor(flags)));
+
+        /*Variants submitted by Prepare() are completed on first use*/
+        shader->Finish();
+
+        /*Again after the program has been reloaded, the state is lost with the old program object*/
+        GLuint &configuredProgram = configured[flags];
+        if (configure && configuredProgram != shader->ID())
+        {
+            configure(*shader);
+            configuredProgram = shader->ID();
+        }
+
+        return *shader;
+    }
+
+    /**
+     * Submits every listed variant for compilation without waiting for any of
+     * them, so the driver can compile them all at once. Cached variants are
+     * restored from their program binary right away.
+     */
+    void Prepare(const std::vector<unsigned int> &flagSets)
+    {
+        for (unsigned int flags : flagSets)
+        {
+            flags = Resolve(flags);
+            if (variants.find(flags) == variants.end())
+                variants[flags].reset(new Shader(vertexPath.c_str(), fragmentPath.c_str(), DefinesFor(flags), true));
+        }
+    }
+
+    /*Waits for every submitted variant and reports its errors*/
+    void FinishAll()
+    {
+        for (auto &variant : variants)
+            variant.second->Finish();
+    }
+
+    /**
+     * Collapses flag combinations that produce identical code onto one variant,
+     * the bulb glow is only visible at night.
+     *
+     * Reflection probes are drawn with the cheapest variants: reflective surfaces
+     * drop their reflection, which also keeps a probe from sampling itself.
+     */
+    static unsigned int Resolve(unsigned int flags)
+    {
+        if (!(flags & VARIANT_NIGHT))
+            flags &= ~VARIANT_BULB;
+        if (flags & VARIANT_PROBE)
+            flags &= ~(VARIANT_GLASS | VARIANT_WATER | VARIANT_PROBE);
+
+        return flags;
+    }
+
+    /*Converts the flags into the list of defines injected into the shader sources*/
+    static std::vector<std::string> DefinesFor(unsigned int flags)
+    {
+        std::vector<std::string> defines;
+
+        if (flags & VARIANT_TEXTURED)
+            defines.push_back("TEXTURED");
+        if (flags & VARIANT_BULB)
+            defines.push_back("BULB");
+        if (flags & VARIANT_NIGHT)
+            defines.push_back("NIGHT");
+        if (flags & VARIANT_GLASS)
+            defines.push_back("GLASS");
+        if (flags & VARIANT_WATER)
+            defines.push_back("WATER");
+        if (flags & VARIANT_LIGHTMAP)
+            defines.push_back("LIGHTMAP");
+
+        return defines;
+    }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::map<unsigned int, std::unique_ptr<Shader>> variants;
+    std::function<void(const Shader &)> configure;
+    std::map<unsigned int, GLuint> configured; // program each variant was configured on
+};
+#endif
@@ -0,0 +1,107 @@
+#ifndef STRING_ID_H
+#define STRING_ID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*64-bit FNV-1a, usable in constant expressions so literal names are hashed by the compiler*/
+constexpr uint64_t HashName(const char *name, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (uint64_t)(unsigned char)name[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/**
+ * Integer identifier of a name: bones, uniforms, material tags, texture types.
+ *
+ * Comparing and looking up ids replaces string comparisons in the code that
+ * runs every frame. Literals convert at compile time ("glass" or "glass"_id),
+ * names only known at runtime are hashed once, when they are loaded, and
+ * interned in the StringTable so the name can be found again from its id.
+ */
+class StringId
+{
+public:
+    constexpr StringId() : hash(0) {}
+    constexpr explicit StringId(uint64_t hash) : hash(hash) {}
+
+    template <size_t N>
+    constexpr StringId(const char (&literal)[N]) : hash(HashName(literal, N - 1)) {}
+
+    explicit StringId(const std::string &name) : hash(HashName(name.data(), name.size())) {}
+    StringId(const char *name, size_t length) : hash(HashName(name, length)) {}
+
+    constexpr uint64_t Hash() const { return hash; }
+    constexpr bool Valid() const { return hash != 0; }
+
+    constexpr bool operator==(const StringId &other) const { return hash == other.hash; }
+    constexpr bool operator!=(const StringId &other) const { return hash != other.hash; }
+
+private:
+    uint64_t hash;
+};
+
+constexpr StringId operator""_id(const char *name, size_t length)
+{
+    return StringId(HashName(name, length));
+}
+
+namespace std
+{
+    template <>
+    struct hash<StringId>
+    {
+        size_t operator()(const StringId &id) const { return (size_t)id.Hash(); }
+    };
+}
+
+/**
+ * Names behind the ids met at runtime. Interning happens while loading; it
+ * reports two names sharing an id, which would make them compare equal.
+ */
+class StringTable
+{
+public:
+    static StringTable &Instance()
+    {
+        static StringTable instance;
+        return instance;
+    }
+
+    StringId Intern(const std::string &name)
+    {
+        StringId id(name);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto inserted = names.emplace(id, name);
+        if (!inserted.second && inserted.first->second != name)
+            std::cout << "ERROR::STRING_ID::COLLISION '" << name << "' and '" << inserted.first->second << "'" << std::endl;
+        return id;
+    }
+
+    /*The interned name of 'id', empty when it was never interned. The reference stays valid*/
+    const std::string &Name(StringId id)
+    {
+        static const std::string unknown;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = names.find(id);
+        return found != names.end() ? found->second : unknown;
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<StringId, std::string> names;
+
+    StringTable() = default;
+};
+#endif
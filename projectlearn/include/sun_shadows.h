@@ -0,0 +1,224 @@
+#ifndef SUN_SHADOWS_H
+#define SUN_SHADOWS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+
+/*Texture units of the shadow maps, after the reflection probes (units 9 to 12)*/
+const int SUN_SHADOW_CASCADE_UNIT = 13;
+const int SUN_SHADOW_DYNAMIC_UNIT = 14;
+
+const int SUN_SHADOW_CASCADES = 3;
+const int SUN_SHADOW_CASCADE_SIZE = 2048;
+const int SUN_SHADOW_DYNAMIC_SIZE = 1024;
+
+/*Half extent of every cascade around the viewer, the last one covers the whole exterior*/
+const float SUN_SHADOW_CASCADE_RADIUS[SUN_SHADOW_CASCADES] = {8.0f, 25.0f, 80.0f};
+
+/*Distance from the cascade center to the light's near plane, so casters outside the cascade still shadow into it*/
+const float SUN_SHADOW_DEPTH = 150.0f;
+
+/**
+ * Sun shadows split into a cached static part and a per-frame dynamic part.
+ *
+ * The static geometry is rendered into cascades centered on the viewer. The
+ * cascade centers are snapped to a grid of a quarter of their radius, so a
+ * cascade is only rendered again when the sun moves or the viewer leaves its
+ * grid cell. Walking around refreshes the small near cascade now and then and
+ * the large ones almost never.
+ *
+ * Dynamic casters (the animated character) are rendered every frame into a
+ * small overlay map fitted tightly around their bounds across the light,
+ * and reaching along it to the far side of the scene so every receiver of
+ * their shadow is inside it. The lighting shader takes the darker of both
+ * maps.
+ */
+class SunShadows
+{
+public:
+    /*Draws the casters with the given light space matrix, depth only*/
+    typedef std::function<void(const glm::mat4 &lightSpace)> RenderFunction;
+
+    /**
+     * 'sceneCenter' is where the sun direction is measured from, the light is
+     * treated as directional. 'sceneRadius' bounds the receivers around it.
+     */
+    SunShadows(const glm::vec3 &sceneCenter, float sceneRadius) : sceneCenter(sceneCenter), sceneRadius(sceneRadius)
+    {
+        glGenFramebuffers(1, &framebuffer);
+
+        cascadeMaps = createDepthTexture(GL_TEXTURE_2D_ARRAY, SUN_SHADOW_CASCADE_SIZE, SUN_SHADOW_CASCADES);
+        dynamicMap = createDepthTexture(GL_TEXTURE_2D, SUN_SHADOW_DYNAMIC_SIZE, 1);
+    }
+
+    ~SunShadows()
+    {
+        glDeleteTextures(1, &cascadeMaps);
+        glDeleteTextures(1, &dynamicMap);
+        glDeleteFramebuffers(1, &framebuffer);
+    }
+
+    SunShadows(const SunShadows &) = delete;
+    SunShadows &operator=(const SunShadows &) = delete;
+
+    /*Renders every static cascade again at the next UpdateStatic(), after static geometry was added or removed*/
+    void Invalidate()
+    {
+        for (int cascade = 0; cascade < SUN_SHADOW_CASCADES; cascade++)
+            cascadeValid[cascade] = false;
+    }
+
+    /**
+     * Re-renders the static cascades whose light direction or snapped center
+     * changed since they were last rendered, nothing at all in steady state.
+     */
+    void UpdateStatic(const glm::vec3 &lightPos, const glm::vec3 &viewPos, const RenderFunction &drawStatic)
+    {
+        glm::vec3 direction = sunDirection(lightPos);
+
+        for (int cascade = 0; cascade < SUN_SHADOW_CASCADES; cascade++)
+        {
+            float radius = SUN_SHADOW_CASCADE_RADIUS[cascade];
+            float step = radius * 0.25f;
+            glm::vec3 center = glm::floor(viewPos / step + glm::vec3(0.5f)) * step;
+
+            if (cascadeValid[cascade] && center == cascadeCenter[cascade] && direction == cascadeDirection[cascade])
+                continue;
+
+            cascadeCenter[cascade] = center;
+            cascadeDirection[cascade] = direction;
+            cascadeMatrices[cascade] = lightSpace(direction, center, radius, SUN_SHADOW_DEPTH + radius);
+            cascadeValid[cascade] = true;
+
+            beginPass(SUN_SHADOW_CASCADE_SIZE);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascadeMaps, 0, cascade);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawStatic(cascadeMatrices[cascade]);
+            endPass();
+        }
+    }
+
+    /*Renders the dynamic casters contained in the sphere ('center', 'radius') into the overlay map*/
+    void UpdateDynamic(const glm::vec3 &lightPos, const glm::vec3 &center, float radius, const RenderFunction &drawDynamic)
+    {
+        /*The shadow falls within the casters' footprint across the light, but as far along it as the scene reaches*/
+        glm::vec3 direction = sunDirection(lightPos);
+        float receivers = glm::dot(center - sceneCenter, direction) + sceneRadius;
+        dynamicMatrix = lightSpace(direction, center, radius, SUN_SHADOW_DEPTH + std::max(radius, receivers));
+
+        beginPass(SUN_SHADOW_DYNAMIC_SIZE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, dynamicMap, 0);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        drawDynamic(dynamicMatrix);
+        endPass();
+    }
+
+    /*Binds both shadow maps to their texture units*/
+    void Bind() const
+    {
+        glActiveTexture(GL_TEXTURE0 + SUN_SHADOW_CASCADE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cascadeMaps);
+        glActiveTexture(GL_TEXTURE0 + SUN_SHADOW_DYNAMIC_UNIT);
+        glBindTexture(GL_TEXTURE_2D, dynamicMap);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /*Sets the light space matrices of the cascades and of the overlay*/
+    void SetUniforms(const Shader &shader) const
+    {
+        shader.setMat4Array("sunShadowMatrices", cascadeMatrices, SUN_SHADOW_CASCADES);
+        shader.setMat4("sunShadowDynamicMatrix", dynamicMatrix);
+    }
+
+    /*Points the shadow samplers of a shader at their texture units*/
+    static void ConfigureShader(const Shader &shader)
+    {
+        shader.use();
+        shader.setInt("sunShadowCascades", SUN_SHADOW_CASCADE_UNIT);
+        shader.setInt("sunShadowDynamic", SUN_SHADOW_DYNAMIC_UNIT);
+    }
+
+private:
+    glm::vec3 sceneCenter;
+    float sceneRadius;
+
+    GLuint framebuffer = 0;
+    GLuint cascadeMaps = 0;
+    GLuint dynamicMap = 0;
+    GLint viewport[4];
+
+    bool cascadeValid[SUN_SHADOW_CASCADES] = {};
+    glm::vec3 cascadeCenter[SUN_SHADOW_CASCADES];
+    glm::vec3 cascadeDirection[SUN_SHADOW_CASCADES];
+    glm::mat4 cascadeMatrices[SUN_SHADOW_CASCADES];
+    glm::mat4 dynamicMatrix = glm::mat4(1.0f);
+
+    glm::vec3 sunDirection(const glm::vec3 &lightPos) const
+    {
+        glm::vec3 direction = lightPos - sceneCenter;
+        return glm::length(direction) > 0.0f ? glm::normalize(direction) : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+
+    /**
+     * Orthographic sun view of the square of half extent 'radius' around
+     * 'center', from SUN_SHADOW_DEPTH towards the sun to 'far' away from it
+     */
+    static glm::mat4 lightSpace(const glm::vec3 &direction, const glm::vec3 &center, float radius, float far)
+    {
+        glm::vec3 up = fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 view = glm::lookAt(center + direction * SUN_SHADOW_DEPTH, center, up);
+        glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.1f, far);
+        return projection * view;
+    }
+
+    static GLuint createDepthTexture(GLenum target, int size, int layers)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(target, texture);
+        if (target == GL_TEXTURE_2D_ARRAY)
+            glTexImage3D(target, 0, GL_DEPTH_COMPONENT24, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        else
+            glTexImage2D(target, 0, GL_DEPTH_COMPONENT24, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+        /*Hardware depth comparison, linear filtering gives 2x2 percentage closer filtering for free*/
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(target, 0);
+        return texture;
+    }
+
+    void beginPass(int size)
+    {
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glViewport(0, 0, size, size);
+
+        /*Pushing the depth slightly away from the light against shadow acne*/
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+    }
+
+    void endPass()
+    {
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+};
+#endif
@@ -0,0 +1,396 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+#include "shader.h"
+#include "texture_streamer.h"
+#include "job_system.h"
+#include "resource_manager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*Texture units used by the packed texture pages, unit 0 stays reserved for the environment cube map*/
+const int TEXTURE_PAGE_UNIT = 1;
+const int MAX_TEXTURE_PAGES = 8;
+
+/*Upper bound of layers per page, GL 3.3 guarantees at least 256*/
+const int MAX_PAGE_LAYERS = 256;
+
+/**
+ * Decoded image, always expanded to 8 bit RGBA so images with a different
+ * number of channels can share a page.
+ */
+struct ImageData
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+/*Location of an image inside the packed pages, page -1 means no texture*/
+struct TextureSlot
+{
+    int page = -1;
+    int layer = 0;
+};
+
+/*Loads an image from disk as RGBA8, returns false when the file can't be decoded*/
+inline bool DecodeImage(const std::string &filename, ImageData &image)
+{
+    int width, height, nrComponents;
+    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 4);
+    if (!data)
+        return false;
+
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(data, data + (size_t)width * height * 4);
+    stbi_image_free(data);
+    return true;
+}
+
+/*Bilinear resampling of an RGBA8 image, used when an image has to join a page of another size*/
+inline ImageData ResizeImage(const ImageData &source, int width, int height)
+{
+    ImageData result;
+    result.width = width;
+    result.height = height;
+    result.pixels.resize((size_t)width * height * 4);
+
+    for (int y = 0; y < height; y++)
+    {
+        float sy = (y + 0.5f) * source.height / height - 0.5f;
+        int y0 = std::max(0, std::min(source.height - 1, (int)std::floor(sy)));
+        int y1 = std::min(source.height - 1, y0 + 1);
+        float fy = std::max(0.0f, std::min(1.0f, sy - y0));
+
+        for (int x = 0; x < width; x++)
+        {
+            float sx = (x + 0.5f) * source.width / width - 0.5f;
+            int x0 = std::max(0, std::min(source.width - 1, (int)std::floor(sx)));
+            int x1 = std::min(source.width - 1, x0 + 1);
+            float fx = std::max(0.0f, std::min(1.0f, sx - x0));
+
+            for (int c = 0; c < 4; c++)
+            {
+                float top = source.pixels[((size_t)y0 * source.width + x0) * 4 + c] * (1 - fx) + source.pixels[((size_t)y0 * source.width + x1) * 4 + c] * fx;
+                float bottom = source.pixels[((size_t)y1 * source.width + x0) * 4 + c] * (1 - fx) + source.pixels[((size_t)y1 * source.width + x1) * 4 + c] * fx;
+                result.pixels[((size_t)y * width + x) * 4 + c] = (unsigned char)(top * (1 - fy) + bottom * fy + 0.5f);
+            }
+        }
+    }
+    return result;
+}
+
+/*Next level of a mip chain, each texel is the average of a 2x2 block (clamped on odd sizes)*/
+inline ImageData DownsampleImage(const ImageData &source)
+{
+    ImageData result;
+    result.width = std::max(1, source.width / 2);
+    result.height = std::max(1, source.height / 2);
+    result.pixels.resize((size_t)result.width * result.height * 4);
+
+    for (int y = 0; y < result.height; y++)
+    {
+        int y0 = std::min(source.height - 1, y * 2);
+        int y1 = std::min(source.height - 1, y * 2 + 1);
+        for (int x = 0; x < result.width; x++)
+        {
+            int x0 = std::min(source.width - 1, x * 2);
+            int x1 = std::min(source.width - 1, x * 2 + 1);
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = source.pixels[((size_t)y0 * source.width + x0) * 4 + c] + source.pixels[((size_t)y0 * source.width + x1) * 4 + c] +
+                          source.pixels[((size_t)y1 * source.width + x0) * 4 + c] + source.pixels[((size_t)y1 * source.width + x1) * 4 + c];
+                result.pixels[((size_t)y * result.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+/*Builds the mip chain of a page, level by level, each holding all the layers back to back as glTexImage3D expects them*/
+inline std::vector<std::vector<unsigned char>> BuildPageLevels(std::vector<ImageData> current)
+{
+    std::vector<std::vector<unsigned char>> levels;
+    while (true)
+    {
+        std::vector<unsigned char> level;
+        for (const ImageData &image : current)
+            level.insert(level.end(), image.pixels.begin(), image.pixels.end());
+        levels.push_back(std::move(level));
+
+        /*Mipmaps are built per layer, so neighbouring images never bleed into each other*/
+        if (current[0].width == 1 && current[0].height == 1)
+            break;
+        JobSystem::Instance().ParallelFor(current.size(), 1, [&current](size_t i)
+                                          { current[i] = DownsampleImage(current[i]); });
+    }
+    return levels;
+}
+
+/**
+ * Packs the textures of a model into GL_TEXTURE_2D_ARRAY pages.
+ *
+ * Images of the same size go into the same page, one layer each, so a whole
+ * model samples from at most MAX_TEXTURE_PAGES textures that are bound once per
+ * draw instead of once per mesh. Materials then only need a page and a layer.
+ *
+ * Uploaded pages are resources of the ResourceManager, keyed by the paths of
+ * their layers. An image another model has already uploaded is not decoded
+ * again: Share() makes its page one of this model's pages as well.
+ */
+class TexturePages
+{
+public:
+    /*One GL_TEXTURE_2D_ARRAY holding images of a single size*/
+    struct Page
+    {
+        int width;
+        int height;
+        std::vector<ImageData> layers;
+        std::vector<std::string> paths; // source of every layer, to reload the page
+        TextureHandle texture;          // empty until uploaded, pages shared from other models arrive uploaded
+        std::vector<std::vector<unsigned char>> levels; // mip chain built by Prepare(), empty otherwise
+    };
+
+    std::vector<Page> pages;
+
+    /**
+     * Finds an image that is already in an uploaded page, by its path, and
+     * returns where it lives. The slot's page is -1 when the image has to be
+     * decoded and added, or when this model has no page left to bind another
+     * shared page.
+     */
+    TextureSlot Share(const std::string &path)
+    {
+        auto found = sharedImages().find(StringId(path).Hash());
+        if (found == sharedImages().end())
+            return TextureSlot();
+
+        TextureSlot slot;
+        slot.layer = found->second.layer;
+
+        for (size_t i = 0; i < pages.size(); i++)
+        {
+            if (pages[i].texture.Key() == found->second.page)
+            {
+                slot.page = (int)i;
+                return slot;
+            }
+        }
+
+        if (pages.size() >= MAX_TEXTURE_PAGES)
+            return TextureSlot();
+
+        /*The page might have been released since, its images are forgotten then*/
+        TextureHandle texture = ResourceManager::Instance().Find<ResourceType::Texture>(found->second.page);
+        if (!texture.Valid())
+        {
+            sharedImages().erase(found);
+            return TextureSlot();
+        }
+
+        Page page;
+        page.width = found->second.width;
+        page.height = found->second.height;
+        page.texture = std::move(texture);
+        pages.push_back(std::move(page));
+        slot.page = (int)pages.size() - 1;
+        return slot;
+    }
+
+    /**
+     * Adds a decoded image, read from 'path', and returns where it will live.
+     * Nothing is uploaded until Upload() is called.
+     */
+    TextureSlot Add(ImageData image, const std::string &path)
+    {
+        TextureSlot slot;
+
+        /*Looking for a page of the same size that still has room, uploaded pages are complete*/
+        for (size_t i = 0; i < pages.size(); i++)
+        {
+            if (!pages[i].texture.Valid() && pages[i].width == image.width && pages[i].height == image.height && pages[i].layers.size() < MAX_PAGE_LAYERS)
+            {
+                slot.page = (int)i;
+                break;
+            }
+        }
+
+        if (slot.page < 0)
+        {
+            if (pages.size() < MAX_TEXTURE_PAGES)
+            {
+                Page page;
+                page.width = image.width;
+                page.height = image.height;
+                pages.push_back(std::move(page));
+                slot.page = (int)pages.size() - 1;
+            }
+            else
+            {
+                /*Out of pages, the image is resampled to fit the first page that has room*/
+                for (size_t i = 0; i < pages.size() && slot.page < 0; i++)
+                    if (!pages[i].texture.Valid() && pages[i].layers.size() < MAX_PAGE_LAYERS)
+                        slot.page = (int)i;
+
+                if (slot.page < 0)
+                {
+                    std::cout << "ERROR::TEXTURE_PAGES::FULL" << std::endl;
+                    return TextureSlot();
+                }
+                image = ResizeImage(image, pages[slot.page].width, pages[slot.page].height);
+            }
+        }
+
+        slot.layer = (int)pages[slot.page].layers.size();
+        pages[slot.page].layers.push_back(std::move(image));
+        pages[slot.page].paths.push_back(path);
+        return slot;
+    }
+
+    /**
+     * Builds the mip chain of every new page ahead of Upload(), which only
+     * needs the context then. Can run on any thread.
+     */
+    void Prepare()
+    {
+        for (Page &page : pages)
+        {
+            if (!page.texture.Valid() && page.levels.empty())
+            {
+                page.levels = BuildPageLevels(std::move(page.layers));
+                page.layers.clear();
+            }
+        }
+    }
+
+    /**
+     * Builds the mip chain of every new page, unless Prepare() did, and hands
+     * it to the TextureStreamer, which creates the array texture with only its
+     * coarse levels resident. The decoded layers are released afterwards.
+     */
+    void Upload()
+    {
+        for (Page &page : pages)
+        {
+            if (page.texture.Valid())
+                continue;
+
+            int layers = (int)page.paths.size();
+            std::vector<std::vector<unsigned char>> levels = page.levels.empty() ? BuildPageLevels(std::move(page.layers)) : std::move(page.levels);
+            int stream = TextureStreamer::Instance().Add(page.width, page.height, layers, std::move(levels));
+
+            /*Keyed by the size and the layer paths, reloading decodes the same files again*/
+            uint64_t key = HashName((const char *)&page.width, sizeof(int)) ^ HashName((const char *)&page.height, sizeof(int));
+            for (const std::string &path : page.paths)
+                key = key * 31 + StringId(path).Hash();
+
+            page.texture = ResourceManager::Instance().Adopt<ResourceType::Texture>(key, TextureStreamer::Instance().Texture(stream), pageLoader(page));
+            for (int layer = 0; layer < layers; layer++)
+                sharedImages()[StringId(page.paths[layer]).Hash()] = {page.texture.Key(), layer, page.width, page.height};
+
+            page.layers.clear();
+            page.layers.shrink_to_fit();
+            page.levels.clear();
+            page.levels.shrink_to_fit();
+        }
+    }
+
+    /**
+     * Screen-space feedback for a page, 'uvPerUnit' is the UV density of the
+     * surface (UV units per world unit) and 'pixelsPerUnit' how many pixels a
+     * world unit covers at the surface's distance.
+     */
+    void Request(int page, float uvPerUnit, float pixelsPerUnit) const
+    {
+        if (page < 0 || page >= (int)pages.size())
+            return;
+
+        int stream = TextureStreamer::Instance().Find(pages[page].texture.Get());
+        if (stream < 0)
+            return;
+
+        float texelsPerUnit = uvPerUnit * std::max(pages[page].width, pages[page].height);
+        TextureStreamer::Instance().Request(stream, texelsPerUnit / std::max(pixelsPerUnit, 1e-6f));
+    }
+
+    /*Binds every page to its texture unit, starting at TEXTURE_PAGE_UNIT*/
+    void Bind() const
+    {
+        for (size_t i = 0; i < pages.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + TEXTURE_PAGE_UNIT + (GLenum)i);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, pages[i].texture.Get());
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /*Points the 'texturePages' sampler array of a shader at the page texture units*/
+    static void ConfigureShader(const Shader &shader)
+    {
+        shader.use();
+        for (int i = 0; i < MAX_TEXTURE_PAGES; i++)
+            shader.setInt(StringTable::Instance().Intern("texturePages[" + std::to_string(i) + "]"), TEXTURE_PAGE_UNIT + i);
+    }
+
+private:
+    /*Where an uploaded image lives, 'page' is the resource key of its page*/
+    struct SharedImage
+    {
+        uint64_t page;
+        int layer;
+        int width;
+        int height;
+    };
+
+    /*Every image uploaded by any model, by path key*/
+    static std::unordered_map<uint64_t, SharedImage> &sharedImages()
+    {
+        static std::unordered_map<uint64_t, SharedImage> images;
+        return images;
+    }
+
+    /*Decodes the layers of a page from their files again, for ResourceManager::Reload()*/
+    static ResourceLoader pageLoader(const Page &page)
+    {
+        ResourceLoader loader;
+        int width = page.width, height = page.height;
+        std::vector<std::string> paths = page.paths;
+
+        loader.load = [width, height, paths]()
+        {
+            std::vector<ImageData> layers(paths.size());
+            JobSystem::Instance().ParallelFor(paths.size(), 1, [&](size_t i)
+                                              {
+                                                  ImageData image;
+                                                  if (!DecodeImage(paths[i], image))
+                                                  {
+                                                      /*A missing file keeps its layer, as a white image*/
+                                                      image.width = image.height = 1;
+                                                      image.pixels.assign(4, 255);
+                                                  }
+                                                  layers[i] = image.width == width && image.height == height ? std::move(image) : ResizeImage(image, width, height);
+                                              });
+
+            TextureStreamer &streamer = TextureStreamer::Instance();
+            return streamer.Texture(streamer.Add(width, height, (int)layers.size(), BuildPageLevels(std::move(layers))));
+        };
+        loader.unload = [](GLuint texture)
+        {
+            TextureStreamer::Instance().Remove(texture);
+        };
+        return loader;
+    }
+};
+#endif
@@ -0,0 +1,385 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+/*Mip levels no larger than this are uploaded at load and never evicted, so every texture can always be sampled*/
+const int STREAM_RESIDENT_SIZE = 64;
+
+/*Number of pixel buffers in the upload ring*/
+const int STREAM_PBO_COUNT = 4;
+
+/*Upload volume per frame, higher mips arrive over a few frames instead of stalling one*/
+const size_t STREAM_UPLOAD_BYTES_PER_FRAME = 8u * 1024 * 1024;
+
+/*Levels being filled at the same time*/
+const size_t STREAM_MAX_ACTIVE_UPLOADS = 2;
+
+const size_t DEFAULT_TEXTURE_BUDGET = 256u * 1024 * 1024;
+
+/**
+ * Process-wide streamer of mip levels for RGBA8 texture arrays.
+ *
+ * Every texture starts with only its coarse tail resident. The renderer reports
+ * each frame how many texels per pixel a texture is seen at (Request()), and
+ * Update() brings in the finer levels that are missing, one level at a time,
+ * through a ring of pixel buffer objects guarded by fences, so uploads never
+ * wait on the GPU. GL_TEXTURE_BASE_LEVEL keeps sampling on the levels that are
+ * complete.
+ *
+ * When the resident levels would exceed the VRAM budget, the finest levels of
+ * the least recently used textures are released first. The CPU copy of every
+ * level is kept so evicted levels can be streamed back in later.
+ */
+class TextureStreamer
+{
+public:
+    /*Access to the single streamer shared by every model*/
+    static TextureStreamer &Instance()
+    {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+    /*Sets the amount of texture memory the streamed levels may occupy*/
+    void SetBudget(size_t bytes) { budget = bytes; }
+
+    size_t Budget() const { return budget; }
+    size_t ResidentBytes() const { return residentBytes; }
+
+    /**
+     * Creates a texture array from its complete mip chain and returns its handle.
+     *
+     * 'levels[l]' holds every layer of level l back to back. Only the levels no
+     * larger than STREAM_RESIDENT_SIZE are uploaded now, the rest stays on the CPU
+     * until it is requested.
+     */
+    int Add(int width, int height, int layers, std::vector<std::vector<unsigned char>> levels)
+    {
+        Entry entry;
+        entry.width = width;
+        entry.height = height;
+        entry.layers = layers;
+        entry.levels = std::move(levels);
+
+        /*Finding the first level of the always resident tail*/
+        int levelCount = (int)entry.levels.size();
+        entry.minResident = levelCount - 1;
+        for (int level = 0; level < levelCount; level++)
+        {
+            if (std::max(levelWidth(entry, level), levelHeight(entry, level)) <= STREAM_RESIDENT_SIZE)
+            {
+                entry.minResident = level;
+                break;
+            }
+        }
+        entry.resident = entry.minResident;
+        entry.wanted = entry.minResident;
+
+        glGenTextures(1, &entry.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, entry.id);
+        GLuint id = entry.id;
+
+        /*The tail is small, it is uploaded directly*/
+        for (int level = entry.minResident; level < levelCount; level++)
+        {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth(entry, level), levelHeight(entry, level), layers, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, entry.levels[level].data());
+            residentBytes += levelBytes(entry, level);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, entry.resident);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        /*Handles of removed textures are reused*/
+        int handle;
+        if (!freeHandles.empty())
+        {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+            entries[handle] = std::move(entry);
+        }
+        else
+        {
+            entries.push_back(std::move(entry));
+            handle = (int)entries.size() - 1;
+        }
+        handles[id] = handle;
+        return handle;
+    }
+
+    /*GL name of a streamed texture*/
+    GLuint Texture(int handle) const { return entries[handle].id; }
+
+    /*Handle of the streamed texture with GL name 'texture', -1 if it isn't streamed*/
+    int Find(GLuint texture) const
+    {
+        auto found = handles.find(texture);
+        return found != handles.end() ? found->second : -1;
+    }
+
+    /*Deletes a streamed texture with its levels, an upload in flight is dropped*/
+    void Remove(GLuint texture)
+    {
+        int handle = Find(texture);
+        if (handle < 0)
+            return;
+
+        Entry &entry = entries[handle];
+        for (int level = entry.resident; level < (int)entry.levels.size(); level++)
+            residentBytes -= levelBytes(entry, level);
+        if (entry.uploading >= 0)
+        {
+            residentBytes -= levelBytes(entry, entry.uploading);
+            active.erase(std::find(active.begin(), active.end(), handle));
+        }
+
+        /*Copies already issued from the ring complete into a deleted texture, which GL allows*/
+        glDeleteTextures(1, &entry.id);
+        entry = Entry();
+        handles.erase(texture);
+        freeHandles.push_back(handle);
+    }
+
+    /**
+     * Screen-space feedback: the texture is visible this frame and its level 0
+     * would be sampled at 'texelsPerPixel'. The finest level requested during
+     * the frame wins.
+     */
+    void Request(int handle, float texelsPerPixel)
+    {
+        Entry &entry = entries[handle];
+
+        int level = texelsPerPixel > 1.0f ? (int)std::floor(std::log2(texelsPerPixel)) : 0;
+        level = std::min(level, entry.minResident);
+
+        if (entry.lastUsed != frame)
+            entry.wanted = level;
+        else
+            entry.wanted = std::min(entry.wanted, level);
+        entry.lastUsed = frame;
+    }
+
+    /**
+     * Called once per frame after the requests: finishes the levels whose
+     * copies have been issued, starts new ones under the budget and moves up to
+     * STREAM_UPLOAD_BYTES_PER_FRAME through the buffer ring.
+     */
+    void Update()
+    {
+        if (ring.empty())
+            ring.resize(STREAM_PBO_COUNT);
+
+        startUploads();
+        copyLayers();
+
+        frame++;
+    }
+
+private:
+    /*A streamed texture array and its residency*/
+    struct Entry
+    {
+        GLuint id = 0;
+        int width = 0;
+        int height = 0;
+        int layers = 0;
+        std::vector<std::vector<unsigned char>> levels; // CPU copy of every level
+        int resident = 0;     // finest level that is complete on the GPU, the texture base level
+        int minResident = 0;  // first level of the tail that is never evicted
+        int wanted = 0;       // finest level requested in the last frame it was used
+        uint64_t lastUsed = 0;
+        int uploading = -1;   // level being filled, -1 when idle
+        int nextLayer = 0;    // next layer of 'uploading' to copy
+    };
+
+    /*One pixel buffer of the upload ring, reusable once its fence has signaled*/
+    struct Slot
+    {
+        GLuint pbo = 0;
+        GLsync fence = 0;
+        size_t capacity = 0;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int> freeHandles;
+    std::unordered_map<GLuint, int> handles; // by GL name
+    std::vector<Slot> ring;
+    size_t ringHead = 0;
+    std::vector<int> active; // handles of the entries with a level upload in flight
+
+    size_t budget = DEFAULT_TEXTURE_BUDGET;
+    size_t residentBytes = 0; // every allocated level, including the ones still being filled
+    uint64_t frame = 1;
+
+    TextureStreamer() = default;
+
+    static int levelWidth(const Entry &entry, int level) { return std::max(1, entry.width >> level); }
+    static int levelHeight(const Entry &entry, int level) { return std::max(1, entry.height >> level); }
+    static size_t levelBytes(const Entry &entry, int level)
+    {
+        return (size_t)levelWidth(entry, level) * levelHeight(entry, level) * entry.layers * 4;
+    }
+
+    /*Allocates the next finer level of the textures that need it most, as long as the budget allows*/
+    void startUploads()
+    {
+        FrameVector<int> candidates;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const Entry &entry = entries[i];
+            if (entry.lastUsed == frame && entry.wanted < entry.resident && entry.uploading < 0)
+                candidates.push_back((int)i);
+        }
+
+        /*The textures furthest from the level they are seen at come first*/
+        std::sort(candidates.begin(), candidates.end(), [this](int a, int b)
+                  { return entries[a].resident - entries[a].wanted > entries[b].resident - entries[b].wanted; });
+
+        for (int handle : candidates)
+        {
+            if (active.size() >= STREAM_MAX_ACTIVE_UPLOADS)
+                break;
+
+            Entry &entry = entries[handle];
+            int level = entry.resident - 1;
+            size_t bytes = levelBytes(entry, level);
+            if (!makeRoom(bytes, handle))
+                continue;
+
+            /*Allocating the level, its contents arrive through the ring*/
+            glBindTexture(GL_TEXTURE_2D_ARRAY, entry.id);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelWidth(entry, level), levelHeight(entry, level), entry.layers, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            residentBytes += bytes;
+            entry.uploading = level;
+            entry.nextLayer = 0;
+            active.push_back(handle);
+        }
+    }
+
+    /**
+     * Evicts levels until 'bytes' more fit in the budget. Textures unused for
+     * the longest time go first, then levels finer than what their texture is
+     * currently seen at. Returns false when nothing else can be released.
+     */
+    bool makeRoom(size_t bytes, int requester)
+    {
+        while (residentBytes + bytes > budget)
+        {
+            int victim = -1;
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                const Entry &entry = entries[i];
+                if ((int)i == requester || entry.uploading >= 0 || entry.resident >= entry.minResident)
+                    continue;
+
+                /*Textures seen this frame only give up levels they don't need*/
+                if (entry.lastUsed == frame && entry.resident >= entry.wanted)
+                    continue;
+
+                if (victim < 0 || entry.lastUsed < entries[victim].lastUsed)
+                    victim = (int)i;
+            }
+
+            if (victim < 0)
+                return false;
+            evictLevel(entries[victim]);
+        }
+        return true;
+    }
+
+    /*Releases the finest resident level of a texture*/
+    void evictLevel(Entry &entry)
+    {
+        int level = entry.resident;
+        entry.resident++;
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, entry.id);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, entry.resident);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, 0, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        residentBytes -= levelBytes(entry, level);
+    }
+
+    /**
+     * Copies layers of the active uploads into the ring buffers and issues the
+     * texture copies from them. Stops when the per-frame volume is reached or
+     * the next buffer in the ring is still in use by the GPU.
+     */
+    void copyLayers()
+    {
+        size_t copied = 0;
+        while (!active.empty() && copied < STREAM_UPLOAD_BYTES_PER_FRAME)
+        {
+            Slot &slot = ring[ringHead];
+            if (slot.fence)
+            {
+                GLenum status = glClientWaitSync(slot.fence, 0, 0);
+                if (status == GL_TIMEOUT_EXPIRED)
+                    break;
+                glDeleteSync(slot.fence);
+                slot.fence = 0;
+            }
+
+            int handle = active.front();
+            Entry &entry = entries[handle];
+            int level = entry.uploading;
+            int width = levelWidth(entry, level);
+            int height = levelHeight(entry, level);
+            size_t layerBytes = (size_t)width * height * 4;
+
+            if (!slot.pbo)
+                glGenBuffers(1, &slot.pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            if (slot.capacity < layerBytes)
+            {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, layerBytes, NULL, GL_STREAM_DRAW);
+                slot.capacity = layerBytes;
+            }
+
+            void *destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, layerBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (destination)
+            {
+                std::memcpy(destination, entry.levels[level].data() + layerBytes * entry.nextLayer, layerBytes);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+                glBindTexture(GL_TEXTURE_2D_ARRAY, entry.id);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, entry.nextLayer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+                slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                ringHead = (ringHead + 1) % ring.size();
+                entry.nextLayer++;
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            copied += layerBytes;
+
+            /*Copies execute in order, sampling can move to the new level as soon as its last layer is issued*/
+            if (entry.nextLayer == entry.layers)
+            {
+                entry.resident = level;
+                entry.uploading = -1;
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, entry.resident);
+                active.erase(active.begin());
+            }
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+    }
+};
+#endif
@@ -0,0 +1,478 @@
+#ifndef WORLD_STREAMER_H
+#define WORLD_STREAMER_H
+
+#include <glm/glm.hpp>
+
+#include "geometry_pool.h"
+#include "impostor.h"
+#include "job_system.h"
+#include "model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*Tuning of the WorldStreamer*/
+struct StreamingSettings
+{
+    float cellSize = 60.0f;           // side of the square cells the ground is split into
+    float loadDistance = 150.0f;      // cells closer than this are streamed in
+    float unloadDistance = 220.0f;    // cells further than this stop being drawn, their geometry stays cached
+    float lookAhead = 60.0f;          // cells in the direction of movement count as this much closer
+    size_t uploadBytes = 8 << 20;     // geometry uploaded per frame at most
+    double uploadMilliseconds = 1.0;  // time spent uploading per frame at most
+    float impostorDistance = 120.0f;  // instances further than this are only drawn as impostors
+    float impostorFade = 20.0f;       // width of the crossfade before the impostor distance
+};
+
+/*What the streamer did in the last Update(), for the debug interface*/
+struct StreamingStats
+{
+    size_t uploadedBytes = 0;
+    double uploadMilliseconds = 0.0;
+    size_t poolBytes = 0;
+    size_t poolBudget = 0;
+    int drawnCells = 0;
+    int totalCells = 0;
+    int loadingAssets = 0;
+    int impostorInstances = 0;
+};
+
+/**
+ * Streams the static models of a large scene around the viewer.
+ *
+ * The ground is split into square cells and every instance belongs to the
+ * cell under its origin. Cells are wanted by distance, cells ahead of the
+ * viewer's movement earlier. The models of a wanted cell are loaded on the
+ * job system (Model's CPU work), then their meshes go into the GeometryPool
+ * within a per-frame budget of bytes and time, so a new model never stalls a
+ * frame for long. A cell is drawn once all its models are resident; each
+ * model then draws the instances of all the drawn cells in one call per mesh.
+ *
+ * Cells past the unload distance stop being drawn, but the geometry of their
+ * models stays in the pool until room is needed: models that no drawn cell
+ * uses are then evicted, least recently used first.
+ *
+ * With an ImpostorBaker every model is baked into an impostor when it first
+ * becomes resident. Cells beyond the impostor distance draw their instances
+ * as impostors only, whether their geometry is loaded or not, and cells
+ * around it draw both while the lighting shader fades the geometry out.
+ *
+ * Used from the thread owning the context only, except for the loads.
+ */
+class WorldStreamer
+{
+public:
+    WorldStreamer(GeometryPool &pool, const StreamingSettings &settings, ImpostorBaker *impostors = nullptr)
+        : pool(pool), settings(settings), impostors(impostors)
+    {
+    }
+
+    ~WorldStreamer()
+    {
+        for (Asset &asset : assets)
+            if (asset.loading)
+                JobSystem::Instance().Wait(*asset.loading);
+    }
+
+    WorldStreamer(const WorldStreamer &) = delete;
+    WorldStreamer &operator=(const WorldStreamer &) = delete;
+
+    /**
+     * Adds a model file of the scene. It is loaded when a cell first needs
+     * it, unless 'loaded' is given: that model is already loaded and stays
+     * resident. Its impostor is baked right away, before it is placed.
+     */
+    int AddAsset(const std::string &path, Model *loaded = nullptr)
+    {
+        assets.emplace_back();
+        Asset &asset = assets.back();
+        asset.path = path;
+        asset.model = loaded;
+        asset.pinned = loaded != nullptr;
+        if (loaded)
+            bakeImpostor(asset);
+        return (int)assets.size() - 1;
+    }
+
+    /*Places one instance of an asset*/
+    void AddInstance(int asset, const glm::mat4 &transform, const std::vector<MaterialOverride> &overrides)
+    {
+        glm::vec3 position = glm::vec3(transform[3]);
+        std::pair<int, int> coordinates((int)std::floor(position.x / settings.cellSize), (int)std::floor(position.z / settings.cellSize));
+
+        auto found = cellLookup.find(coordinates);
+        if (found == cellLookup.end())
+        {
+            found = cellLookup.emplace(coordinates, (int)cells.size()).first;
+            Cell cell;
+            cell.center = glm::vec2((coordinates.first + 0.5f) * settings.cellSize, (coordinates.second + 0.5f) * settings.cellSize);
+            cells.push_back(cell);
+        }
+
+        Cell &cell = cells[found->second];
+        cell.instances.push_back((int)instances.size());
+        if (std::find(cell.assets.begin(), cell.assets.end(), asset) == cell.assets.end())
+            cell.assets.push_back(asset);
+
+        instances.push_back({asset, transform, overrides});
+    }
+
+    /**
+     * Streams the cells around 'viewPos', called once per frame. Returns true
+     * when the drawn instances changed, the models have been placed again then.
+     */
+    bool Update(const glm::vec3 &viewPos)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&start]()
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        frame++;
+        stats.uploadedBytes = 0;
+
+        /*The direction of movement on the ground, cells ahead of it are wanted earlier*/
+        glm::vec2 moved(viewPos.x - lastViewPos.x, viewPos.z - lastViewPos.z);
+        float movedDistance = glm::length(moved);
+        heading = movedDistance > 1e-4f ? moved / movedDistance : glm::vec2(0.0f);
+        lastViewPos = viewPos;
+
+        /*Collecting the wanted cells, closest first, and letting the far ones go*/
+        bool changed = false;
+        wanted.clear();
+        float halfDiagonal = settings.cellSize * 0.70710678f;
+        for (size_t i = 0; i < cells.size(); i++)
+        {
+            Cell &cell = cells[i];
+            glm::vec2 offset = cell.center - glm::vec2(viewPos.x, viewPos.z);
+            float distance = glm::length(offset);
+            float ahead = distance > 1e-4f ? std::max(0.0f, glm::dot(heading, offset / distance)) : 0.0f;
+            cell.distance = distance;
+            cell.priority = std::max(0.0f, distance - halfDiagonal) - settings.lookAhead * ahead;
+
+            if (cell.priority < settings.loadDistance)
+                wanted.push_back((int)i);
+            else if (cell.drawn && cell.priority > settings.unloadDistance)
+            {
+                setDrawn(cell, false);
+                changed = true;
+            }
+        }
+        std::sort(wanted.begin(), wanted.end(), [this](int a, int b)
+                  { return cells[a].priority < cells[b].priority; });
+
+        /*Models whose CPU work has finished can be uploaded from now on*/
+        stats.loadingAssets = 0;
+        for (Asset &asset : assets)
+        {
+            if (asset.loading && asset.loading->Done())
+            {
+                asset.loading.reset();
+                asset.model = asset.owned.get();
+            }
+            stats.loadingAssets += asset.loading ? 1 : 0;
+        }
+
+        for (int index : wanted)
+        {
+            Cell &cell = cells[index];
+            bool ready = true;
+            for (int assetIndex : cell.assets)
+            {
+                Asset &asset = assets[assetIndex];
+                asset.lastUsed = frame;
+                if (!asset.model)
+                {
+                    startLoad(asset);
+                    ready = false;
+                    continue;
+                }
+                if (asset.model->Resident())
+                {
+                    changed = bakeImpostor(asset) || changed;
+                    continue;
+                }
+
+                ready = false;
+                if (stats.uploadedBytes >= settings.uploadBytes || elapsed() >= settings.uploadMilliseconds)
+                    continue;
+
+                bool full;
+                stats.uploadedBytes += asset.model->Upload(remainingUpload(), full);
+                while (full && evictLeastRecentlyUsed())
+                    stats.uploadedBytes += asset.model->Upload(remainingUpload(), full);
+                if (full)
+                    std::cout << "ERROR::WORLD_STREAMER::POOL_TOO_SMALL " << asset.path << std::endl;
+                ready = asset.model->Resident();
+                if (ready)
+                    changed = bakeImpostor(asset) || changed;
+            }
+
+            if (ready && !cell.drawn)
+            {
+                setDrawn(cell, true);
+                changed = true;
+            }
+        }
+
+        /*Splitting the cells between geometry and impostors by their distance*/
+        for (Cell &cell : cells)
+            changed = updateDetail(cell, halfDiagonal) || changed;
+
+        /*Copying the models and impostors to the instances of their cells*/
+        if (changed)
+        {
+            for (size_t i = 0; i < assets.size(); i++)
+            {
+                Asset &asset = assets[i];
+                if (asset.placementsChanged)
+                    place(asset, (int)i);
+            }
+
+            drawnModels.clear();
+            drawnImpostors.clear();
+            stats.impostorInstances = 0;
+            for (Asset &asset : assets)
+            {
+                if (asset.drawnCells > 0 && asset.geometryInstances > 0)
+                    drawnModels.push_back(asset.model);
+                if (asset.impostor && asset.impostor->Instances() > 0)
+                {
+                    drawnImpostors.push_back(asset.impostor.get());
+                    stats.impostorInstances += (int)asset.impostor->Instances();
+                }
+            }
+        }
+
+        stats.uploadMilliseconds = elapsed();
+        stats.poolBytes = pool.UsedBytes();
+        stats.poolBudget = pool.BudgetBytes();
+        stats.totalCells = (int)cells.size();
+        stats.drawnCells = 0;
+        for (const Cell &cell : cells)
+            stats.drawnCells += cell.drawn ? 1 : 0;
+        return changed;
+    }
+
+    /*Models with instances in the drawn cells, placed there*/
+    const std::vector<Model *> &Models() const { return drawnModels; }
+
+    /*Impostors of the models with instances in the distant cells*/
+    const std::vector<Impostor *> &Impostors() const { return drawnImpostors; }
+
+    /**
+     * Distances from the viewer over which 'model' fades out into its
+     * impostor, for the 'impostorFade' uniform of the lighting shader. Zero
+     * for models without an impostor, they are never faded.
+     */
+    glm::vec2 ImpostorFade(const Model *model) const
+    {
+        for (const Asset &asset : assets)
+            if (asset.model == model && asset.impostor)
+                return glm::vec2(settings.impostorDistance - settings.impostorFade, settings.impostorDistance);
+        return glm::vec2(0.0f);
+    }
+
+    const StreamingStats &Stats() const { return stats; }
+
+private:
+    struct Asset
+    {
+        std::string path;
+        Model *model = nullptr;              // set once the model can be uploaded
+        std::unique_ptr<Model> owned;        // streamed models, written by the load job
+        std::unique_ptr<JobCounter> loading; // set while the load job runs
+        bool pinned = false;                 // loaded up front and never evicted
+        int drawnCells = 0;
+        uint64_t lastUsed = 0;               // last frame a wanted or drawn cell needed the model
+        bool placementsChanged = false;
+        size_t geometryInstances = 0;        // placements given to the model by the last place()
+        std::unique_ptr<Impostor> impostor;  // baked once the model was first resident
+        bool baked = false;                  // the bake was attempted, it fails for empty models
+    };
+
+    struct Instance
+    {
+        int asset;
+        glm::mat4 transform;
+        std::vector<MaterialOverride> overrides;
+    };
+
+    struct Cell
+    {
+        glm::vec2 center;
+        std::vector<int> instances;
+        std::vector<int> assets; // distinct assets of the instances
+        bool drawn = false;
+        float priority = 0.0f;   // distance to the viewer, less ahead of the movement
+        float distance = 0.0f;   // distance of the center to the viewer, on the ground
+        bool geometry = false;   // instances drawn as geometry, only ever in drawn cells
+        bool impostor = false;   // instances drawn as impostors
+    };
+
+    GeometryPool &pool;
+    StreamingSettings settings;
+    StreamingStats stats;
+    ImpostorBaker *impostors;
+
+    std::deque<Asset> assets; // stable addresses, the load jobs write into them
+    std::vector<Instance> instances;
+    std::vector<Cell> cells;
+    std::map<std::pair<int, int>, int> cellLookup;
+
+    std::vector<int> wanted; // kept between frames so a steady frame doesn't allocate
+    std::vector<Model *> drawnModels;
+    std::vector<Impostor *> drawnImpostors;
+
+    uint64_t frame = 0;
+    glm::vec3 lastViewPos = glm::vec3(0.0f);
+    glm::vec2 heading = glm::vec2(0.0f);
+
+    void startLoad(Asset &asset)
+    {
+        if (asset.loading)
+            return;
+
+        asset.loading.reset(new JobCounter());
+        Asset *target = &asset;
+        GeometryPool *geometry = &pool;
+        /*A long job: a frame waiting for jobs of its own never picks it up, only the workers and the destructor run it*/
+        JobSystem::Instance().Run([target, geometry]()
+                                  { target->owned.reset(new Model(target->path, false, geometry)); },
+                                  asset.loading.get());
+
+        /*Without worker threads the job has already run*/
+        if (asset.loading->Done())
+        {
+            asset.loading.reset();
+            asset.model = asset.owned.get();
+        }
+    }
+
+    /*Bakes the impostor of a resident model that has none yet, true when one was baked*/
+    bool bakeImpostor(Asset &asset)
+    {
+        if (!impostors || asset.baked)
+            return false;
+
+        asset.baked = true;
+        asset.impostor = impostors->Bake(*asset.model);
+        asset.placementsChanged = asset.impostor != nullptr;
+        return asset.impostor != nullptr;
+    }
+
+    /**
+     * Decides whether the instances of 'cell' are drawn as geometry, as
+     * impostors or both, true when that changed. Instances reach a little
+     * out of their cell, and the choice only flips back a quarter cell past
+     * where it was made so a viewer on the border doesn't place the models
+     * every frame.
+     */
+    bool updateDetail(Cell &cell, float halfDiagonal)
+    {
+        bool geometry = cell.drawn;
+        bool impostor = false;
+        if (impostors)
+        {
+            float margin = settings.cellSize * 0.5f;
+            float hysteresis = settings.cellSize * 0.25f;
+            float nearest = std::max(0.0f, cell.distance - halfDiagonal - margin);
+            float farthest = cell.distance + halfDiagonal + margin;
+
+            geometry = cell.drawn && nearest < settings.impostorDistance + (cell.geometry ? hysteresis : 0.0f);
+            impostor = farthest > settings.impostorDistance - settings.impostorFade - (cell.impostor ? hysteresis : 0.0f);
+        }
+
+        if (geometry == cell.geometry && impostor == cell.impostor)
+            return false;
+
+        cell.geometry = geometry;
+        cell.impostor = impostor;
+        for (int assetIndex : cell.assets)
+            assets[assetIndex].placementsChanged = true;
+        return true;
+    }
+
+    /*Places the model and the impostor of an asset at the instances of the cells showing them*/
+    void place(Asset &asset, int assetIndex)
+    {
+        bool resident = asset.model && asset.model->Resident();
+        std::vector<ModelPlacement> placements;
+        std::vector<glm::mat4> transforms;
+        for (const Cell &cell : cells)
+        {
+            /*Assets without an impostor keep their geometry at any distance*/
+            bool geometry = cell.geometry || (cell.drawn && !asset.impostor);
+            if (!geometry && !cell.impostor)
+                continue;
+
+            for (int index : cell.instances)
+            {
+                const Instance &instance = instances[index];
+                if (instance.asset != assetIndex)
+                    continue;
+                if (geometry && resident)
+                    placements.push_back({instance.transform, instance.overrides});
+                if (cell.impostor && asset.impostor)
+                    transforms.push_back(instance.transform);
+            }
+        }
+
+        if (resident)
+        {
+            asset.model->Place(placements);
+            asset.geometryInstances = placements.size();
+        }
+        if (asset.impostor)
+            asset.impostor->Place(transforms);
+        asset.placementsChanged = !resident;
+    }
+
+    /*A mesh is uploaded whole, so the last one of a frame may go past the budget*/
+    size_t remainingUpload() const
+    {
+        return stats.uploadedBytes < settings.uploadBytes ? settings.uploadBytes - stats.uploadedBytes : 0;
+    }
+
+    void setDrawn(Cell &cell, bool drawn)
+    {
+        cell.drawn = drawn;
+        for (int assetIndex : cell.assets)
+        {
+            Asset &asset = assets[assetIndex];
+            asset.drawnCells += drawn ? 1 : -1;
+            asset.placementsChanged = true;
+            asset.lastUsed = frame;
+        }
+    }
+
+    /*Evicts the model no drawn cell uses that was needed the longest time ago, false when there is none*/
+    bool evictLeastRecentlyUsed()
+    {
+        Asset *oldest = nullptr;
+        for (Asset &asset : assets)
+        {
+            if (asset.pinned || asset.drawnCells > 0 || !asset.model || asset.lastUsed == frame)
+                continue;
+            if (!oldest || asset.lastUsed < oldest->lastUsed)
+                oldest = &asset;
+        }
+        if (!oldest)
+            return false;
+
+        oldest->model->Evict();
+        oldest->lastUsed = frame;
+        return true;
+    }
+};
+#endif
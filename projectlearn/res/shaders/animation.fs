@@ -2,12 +2,91 @@
 #extension GL_NV_shadow_samplers_cube : enable
 out vec4 FragColor;
 
-uniform sampler2D texture_diffuse1;
+const int MAX_MATERIALS = 256;
+const int MAX_TEXTURE_PAGES = 8;
+
+struct Material{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+
+    vec4 params; // x: shininess, y: diffuse texture page, z: diffuse texture layer
+};
+
+layout (std140) uniform Materials
+{
+    Material materials[MAX_MATERIALS];
+};
+uniform sampler2DArray texturePages[MAX_TEXTURE_PAGES];
+
 in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+flat in int MaterialIndex;
 uniform vec3 girlColor;
+uniform vec3 ambientLight;
+
+// irradiance volume baked by IrradianceVolume: 9 RGB spherical harmonics coefficients per probe over 7 RGBA volumes
+const int IRRADIANCE_TEXTURES = 7;
+uniform sampler3D irradianceSH[IRRADIANCE_TEXTURES];
+uniform bool irradianceReady;
+uniform vec3 irradianceMin;
+uniform vec3 irradianceGrid;
+uniform float irradianceSpacing;
+
+// one trilinear lookup per volume, then the cosine convolved L2 harmonics evaluated in the normal direction
+vec3 Irradiance(vec3 position, vec3 n)
+{
+    vec3 uvw = ((position - irradianceMin) / irradianceSpacing + 0.5) / irradianceGrid;
+    vec4 t0 = texture(irradianceSH[0], uvw);
+    vec4 t1 = texture(irradianceSH[1], uvw);
+    vec4 t2 = texture(irradianceSH[2], uvw);
+    vec4 t3 = texture(irradianceSH[3], uvw);
+    vec4 t4 = texture(irradianceSH[4], uvw);
+    vec4 t5 = texture(irradianceSH[5], uvw);
+    vec4 t6 = texture(irradianceSH[6], uvw);
+
+    vec3 irradiance = t0.xyz * 0.282095
+                    + vec3(t0.w, t1.xy) * 0.488603 * n.y
+                    + vec3(t1.zw, t2.x) * 0.488603 * n.z
+                    + t2.yzw * 0.488603 * n.x
+                    + t3.xyz * 1.092548 * n.x * n.y
+                    + vec3(t3.w, t4.xy) * 1.092548 * n.y * n.z
+                    + vec3(t4.zw, t5.x) * 0.315392 * (3.0 * n.z * n.z - 1.0)
+                    + t5.yzw * 1.092548 * n.x * n.z
+                    + t6.xyz * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(irradiance, vec3(0.0));
+}
+
+// sampler arrays can only be indexed with constants in GLSL 3.30, the page is uniform across an instance
+vec4 SampleDiffuse(Material material, vec2 uv)
+{
+    vec3 coord = vec3(uv, material.params.z);
+    switch (int(material.params.y))
+    {
+        case 0: return texture(texturePages[0], coord);
+        case 1: return texture(texturePages[1], coord);
+        case 2: return texture(texturePages[2], coord);
+        case 3: return texture(texturePages[3], coord);
+        case 4: return texture(texturePages[4], coord);
+        case 5: return texture(texturePages[5], coord);
+        case 6: return texture(texturePages[6], coord);
+        case 7: return texture(texturePages[7], coord);
+    }
+    return vec4(1.0);
+}
 
 void main()
 {
+    Material material = materials[MaterialIndex];
+    vec4 albedo = SampleDiffuse(material, TexCoords);
 
-    FragColor = texture(texture_diffuse1,TexCoords) * vec4(girlColor,1);
+    // lit like the house: sun ambient plus the baked sun and bulbs, flat colored until the volume is baked
+    if (irradianceReady)
+    {
+        vec4 light = vec4(ambientLight, 1.0) * material.ambient + vec4(Irradiance(FragPos, normalize(Normal)), 1.0) * material.diffuse;
+        FragColor = albedo * vec4(light.rgb, 1.0);
+    }
+    else
+        FragColor = albedo * vec4(girlColor,1);
 } 
\ No newline at end of file
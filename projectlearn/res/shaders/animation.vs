@@ -6,10 +6,12 @@ layout(location = 3) in vec3 tangent;
 layout(location = 4) in vec3 bitangent;
 layout(location = 5) in ivec4 boneIds; 
 layout(location = 6) in vec4 weights;
+layout(location = 11) in int material; // per-instance index into the material buffer
 
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
+uniform mat3 normalMatrix; // inverse transpose of 'model', computed once per node on the CPU
 
 const int MAX_BONES = 100;
 const int MAX_BONE_INFLUENCE = 4;
@@ -18,10 +20,12 @@ uniform mat4 finalBonesMatrices[MAX_BONES];
 out vec2 TexCoords;
 out vec3 FragPos;
 out vec3 Normal;
+flat out int MaterialIndex;
 
 void main()
 {
     vec4 totalPosition = vec4(0.0f);
+    vec3 totalNormal = vec3(0.0f);
     for(int i = 0 ; i < MAX_BONE_INFLUENCE ; i++)
     {
         if(boneIds[i] == -1) 
@@ -29,16 +33,19 @@ void main()
         if(boneIds[i] >=MAX_BONES) 
         {
             totalPosition = vec4(pos,1.0f);
+            totalNormal = norm;
             break;
         }
         vec4 localPosition = finalBonesMatrices[boneIds[i]] * vec4(pos,1.0f);
         totalPosition += localPosition * weights[i];
         vec3 localNormal = mat3(finalBonesMatrices[boneIds[i]]) * norm;
+        totalNormal += localNormal * weights[i];
    }
 	
     mat4 viewModel = view * model;
     gl_Position =  projection * viewModel * totalPosition;
 	TexCoords = tex;
-    FragPos = vec3(model * vec4(pos,1.0));
-    Normal = mat3(transpose(inverse(model))) * norm;
+    MaterialIndex = material;
+    FragPos = vec3(model * totalPosition);
+    Normal = normalMatrix * totalNormal;
 }
\ No newline at end of file
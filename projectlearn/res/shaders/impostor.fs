@@ -0,0 +1,134 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 FragPos;
+flat in vec3 InstanceCenter;
+flat in mat3 InstanceRotation;
+flat in float InstanceScale;
+
+uniform sampler2D impostorAlbedo;
+uniform sampler2D impostorNormal;
+uniform sampler2D impostorDepth;
+uniform int impostorFrames; // views per side of the octahedral grid
+uniform float impostorRadius;
+
+uniform vec3 viewPos;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform vec3 sunPosition;
+uniform vec3 sunAmbient;
+uniform vec3 sunDiffuse;
+
+// distances over which the geometry fades into the impostors, see ImpostorFadeDiscard() in lighting.fs
+uniform vec2 impostorFade;
+
+// blended views, weighted by their coverage
+vec4 albedo = vec4(0.0);
+vec3 normal = vec3(0.0);
+vec3 surface = vec3(0.0);
+float covered = 0.0;
+
+// must match ImpostorFrameDirection() in impostor.h
+vec3 FrameDirection(vec2 frame)
+{
+    vec2 p = frame / float(impostorFrames - 1) * 2.0 - 1.0;
+    vec3 direction = vec3((p.x + p.y) * 0.5, 0.0, (p.x - p.y) * 0.5);
+    direction.y = 1.0 - abs(direction.x) - abs(direction.z);
+    return normalize(direction);
+}
+
+// grid position of the view looking from 'direction', the inverse of FrameDirection()
+vec2 FrameCoordinates(vec3 direction)
+{
+    direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+    vec2 p = vec2(direction.x + direction.z, direction.x - direction.z);
+    return (p * 0.5 + 0.5) * float(impostorFrames - 1);
+}
+
+// camera axes of a view, as built by glm::lookAt in ImpostorBaker::Bake()
+void FrameBasis(vec3 direction, out vec3 right, out vec3 up)
+{
+    vec3 reference = abs(direction.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    right = normalize(cross(reference, direction));
+    up = cross(direction, right);
+}
+
+/**
+ * Adds the view at grid cell 'frame': the ray from 'origin' along 'ray' (the
+ * model's space around its center) meets the view's plane, the texel there
+ * is moved back along the view direction by its depth
+ */
+void SampleFrame(vec2 frame, vec3 origin, vec3 ray, float weight)
+{
+    vec3 direction = FrameDirection(frame);
+    vec3 right, up;
+    FrameBasis(direction, right, up);
+
+    float facing = dot(ray, direction);
+    if (abs(facing) < 1e-4)
+        return;
+    vec3 hit = origin - ray * (dot(origin, direction) / facing);
+    vec2 uv = vec2(dot(hit, right), dot(hit, up)) / impostorRadius * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))
+        return;
+
+    // kept half a texel inside the view so the filtering doesn't reach into its neighbours
+    vec2 halfTexel = vec2(0.5 * float(impostorFrames)) / vec2(textureSize(impostorAlbedo, 0));
+    vec2 atlas = (frame + clamp(uv, halfTexel, 1.0 - halfTexel)) / float(impostorFrames);
+
+    // the albedo is filtered against the zero cleared background, so its color is premultiplied by the coverage
+    albedo += texture(impostorAlbedo, atlas) * weight;
+
+    vec4 packedNormal = texture(impostorNormal, atlas);
+    float coverage = packedNormal.a * weight;
+    float depth = texture(impostorDepth, atlas).r;
+    normal += (packedNormal.xyz * 2.0 - 1.0) * coverage;
+    surface += (hit + direction * (1.0 - 2.0 * depth) * impostorRadius) * coverage;
+    covered += coverage;
+}
+
+// ordered 4x4 dither, the same pattern decides between geometry and impostor in lighting.fs
+float Dither()
+{
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    return (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+}
+
+void main()
+{
+    // the camera in the model's space around its center, views only exist from above
+    mat3 toModel = transpose(InstanceRotation);
+    vec3 origin = toModel * (viewPos - InstanceCenter) / InstanceScale;
+    vec3 ray = normalize(toModel * (FragPos - viewPos));
+    vec3 viewDirection = normalize(vec3(origin.x, max(origin.y, 0.0), origin.z));
+
+    // bilinear blend of the four views around the viewing direction
+    vec2 grid = FrameCoordinates(viewDirection);
+    vec2 base = min(floor(grid), vec2(float(impostorFrames - 2)));
+    vec2 blend = grid - base;
+    SampleFrame(base, origin, ray, (1.0 - blend.x) * (1.0 - blend.y));
+    SampleFrame(base + vec2(1.0, 0.0), origin, ray, blend.x * (1.0 - blend.y));
+    SampleFrame(base + vec2(0.0, 1.0), origin, ray, (1.0 - blend.x) * blend.y);
+    SampleFrame(base + vec2(1.0, 1.0), origin, ray, blend.x * blend.y);
+
+    if (albedo.a < 0.5 || covered <= 0.0)
+        discard;
+
+    vec3 worldPos = InstanceCenter + InstanceRotation * (surface / covered) * InstanceScale;
+    vec3 worldNormal = normalize(InstanceRotation * normal);
+
+    // fading in where the geometry fades out, both decide on the reconstructed surface
+    float fade = clamp((length(worldPos - viewPos) - impostorFade.x) / max(impostorFade.y - impostorFade.x, 1e-4), 0.0, 1.0);
+    if (Dither() >= fade)
+        discard;
+
+    vec4 clip = projection * view * vec4(worldPos, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    // the sun's ambient and diffuse terms, distant instances are too small for highlights and bulbs
+    vec3 lightDir = normalize(sunPosition - worldPos);
+    vec3 light = sunAmbient + sunDiffuse * max(dot(worldNormal, lightDir), 0.0);
+    FragColor = vec4(albedo.rgb / albedo.a * light, 1.0);
+}
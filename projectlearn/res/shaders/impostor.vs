@@ -0,0 +1,37 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;    // corner of the quad, -1 to 1
+layout (location = 7) in mat4 aInstance; // per-instance placement, locations 7 to 10
+
+/**
+ * Camera-facing quad covering the bounding sphere of one impostor instance,
+ * the fragment shader finds the surface behind each of its pixels
+ */
+out vec3 FragPos;
+flat out vec3 InstanceCenter;
+flat out mat3 InstanceRotation;
+flat out float InstanceScale;
+
+uniform vec3 impostorCenter; // bounding sphere of the model in its own space
+uniform float impostorRadius;
+uniform vec3 viewPos;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    // placements rotate and scale uniformly, the rotation is the normalized instance matrix
+    InstanceScale = length(aInstance[0].xyz);
+    InstanceRotation = mat3(aInstance) / InstanceScale;
+    InstanceCenter = vec3(aInstance * vec4(impostorCenter, 1.0));
+
+    // grown so the quad through the center covers the sphere's silhouette in perspective
+    float radius = impostorRadius * InstanceScale;
+    float eyeDistance = length(InstanceCenter - viewPos);
+    float halfSize = radius * eyeDistance / sqrt(max(eyeDistance * eyeDistance - radius * radius, 1e-4));
+
+    vec3 cameraRight = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 cameraUp = vec3(view[0][1], view[1][1], view[2][1]);
+    FragPos = InstanceCenter + (aCorner.x * cameraRight + aCorner.y * cameraUp) * halfSize;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,53 @@
+#version 330 core
+layout (location = 0) out vec4 Albedo; // diffuse color, alpha is the coverage
+layout (location = 1) out vec4 Normal; // model space normal packed to [0, 1], alpha is the coverage
+layout (location = 2) out float Depth; // distance from the view's camera over the bounding sphere's diameter
+
+const int MAX_MATERIALS = 256;
+const int MAX_TEXTURE_PAGES = 8;
+
+struct Material{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+
+    vec4 params; // x: shininess, y: diffuse texture page, z: diffuse texture layer
+};
+
+in vec3 Normal;
+in vec2 TexCoords;
+flat in int MaterialIndex;
+
+layout (std140) uniform Materials
+{
+    Material materials[MAX_MATERIALS];
+};
+uniform sampler2DArray texturePages[MAX_TEXTURE_PAGES];
+
+// sampler arrays can only be indexed with constants in GLSL 3.30, as in lighting.fs
+vec4 SampleDiffuse(Material material, vec2 uv)
+{
+    vec3 coord = vec3(uv, material.params.z);
+    switch (int(material.params.y))
+    {
+        case 0: return texture(texturePages[0], coord);
+        case 1: return texture(texturePages[1], coord);
+        case 2: return texture(texturePages[2], coord);
+        case 3: return texture(texturePages[3], coord);
+        case 4: return texture(texturePages[4], coord);
+        case 5: return texture(texturePages[5], coord);
+        case 6: return texture(texturePages[6], coord);
+        case 7: return texture(texturePages[7], coord);
+    }
+    return vec4(1.0);
+}
+
+void main()
+{
+    Material material = materials[MaterialIndex];
+
+    // the projection is orthographic with its near plane at the camera, the window depth is linear
+    Albedo = vec4(material.diffuse.rgb * SampleDiffuse(material, TexCoords).rgb, 1.0);
+    Normal = vec4(normalize(Normal) * 0.5 + 0.5, 1.0);
+    Depth = gl_FragCoord.z;
+}
@@ -0,0 +1,32 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 aInstance; // per-instance placement in the model, locations 7 to 10
+layout (location = 11) in ivec2 aIndices; // per-instance x: index into the material buffer, y: reflection probe
+
+/**
+ * Views of the impostor atlases: the model's own space is rendered with an
+ * orthographic camera around its bounding sphere, see ImpostorBaker
+ */
+out vec3 Normal;
+out vec2 TexCoords;
+flat out int MaterialIndex;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    TexCoords = aTexCoords;
+    MaterialIndex = aIndices.x;
+
+    // Inverse transpose of the instance matrix, as in lighting.vs
+    mat3 instanceNormal = mat3(aInstance);
+    instanceNormal[0] /= dot(instanceNormal[0], instanceNormal[0]);
+    instanceNormal[1] /= dot(instanceNormal[1], instanceNormal[1]);
+    instanceNormal[2] /= dot(instanceNormal[2], instanceNormal[2]);
+    Normal = instanceNormal * aNormal;
+
+    gl_Position = projection * view * aInstance * vec4(aPos, 1.0);
+}
@@ -2,16 +2,22 @@
 // #extension GL_NV_shadow_samplers_cube : enable
 out vec4 FragColor;
 
+/**
+ * Permutation defines injected by ShaderVariants at load time:
+ * TEXTURED, BULB, NIGHT, GLASS, WATER
+ */
+
 const int MAX_BULBS = 50;
 const int MAX_POINT_BULBS = 50;
+const int MAX_MATERIALS = 256;
+const int MAX_TEXTURE_PAGES = 8;
 
 struct Material{
     vec4 ambient;
     vec4 diffuse;
     vec4 specular;
 
-    float shininess;
-    bool hasTexture;
+    vec4 params; // x: shininess, y: diffuse texture page, z: diffuse texture layer
 };
 
 struct BaseLight {
@@ -48,20 +54,125 @@ struct SpotLight{
 in vec3 FragPos;  
 in vec3 Normal;  
 in vec2 TexCoords;
+flat in int MaterialIndex;
+
+layout (std140) uniform Materials
+{
+    Material materials[MAX_MATERIALS];
+};
+uniform sampler2DArray texturePages[MAX_TEXTURE_PAGES];
+
+// material of the current instance, fetched once from the material buffer in main()
+Material material;
 
 uniform vec3 viewPos;
 uniform samplerCube cubeMap;
-uniform Material material;
+
+#if defined(GLASS) || defined(WATER)
+const int MAX_REFLECTION_PROBES = 4;
+flat in int ProbeIndex;
+uniform samplerCube reflectionProbes[MAX_REFLECTION_PROBES];
+
+// nearest dynamic probe of the instance, the static skybox when it has none
+vec4 SampleReflection(vec3 dir)
+{
+    switch (ProbeIndex)
+    {
+        case 0: return texture(reflectionProbes[0], dir);
+        case 1: return texture(reflectionProbes[1], dir);
+        case 2: return texture(reflectionProbes[2], dir);
+        case 3: return texture(reflectionProbes[3], dir);
+    }
+    return texture(cubeMap, dir);
+}
+#endif
 uniform SunLight sunLight;
 uniform SpotLight bulbs[MAX_BULBS];
 uniform PointLight pointBulbs[MAX_POINT_BULBS];
 uniform int numBulbs;
 uniform int numpBulbs;
-uniform bool isBulb;
-uniform bool isGlass;
-uniform bool isWater;
 
-uniform sampler2D texture_diffuse1;
+// cached static cascades and the per-frame overlay of the dynamic casters
+const int SUN_SHADOW_CASCADES = 3;
+uniform mat4 sunShadowMatrices[SUN_SHADOW_CASCADES];
+uniform mat4 sunShadowDynamicMatrix;
+uniform sampler2DArrayShadow sunShadowCascades;
+uniform sampler2DShadow sunShadowDynamic;
+
+#ifdef LIGHTMAP
+// sun and bulbs baked with shadows and one bounce, see LightmapBaker
+uniform sampler2D lightmap;
+in vec2 LightmapUV;
+#endif
+
+// distances over which the geometry fades into the impostors, disabled while y is not above x
+uniform vec2 impostorFade;
+
+// ordered 4x4 dither, impostor.fs keeps exactly the pixels discarded here
+bool ImpostorFadeDiscard()
+{
+    if (impostorFade.y <= impostorFade.x)
+        return false;
+    const float bayer[16] = float[16](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0, 3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+    float dither = (bayer[pixel.y * 4 + pixel.x] + 0.5) / 16.0;
+    float fade = clamp((length(FragPos - viewPos) - impostorFade.x) / (impostorFade.y - impostorFade.x), 0.0, 1.0);
+    return dither < fade;
+}
+
+const float SHADOW_BIAS = 0.0015;
+
+// true when the light space position lies inside a shadow map, with a small margin for filtering
+bool InShadowMap(vec3 coord)
+{
+    return all(greaterThan(coord, vec3(0.005))) && all(lessThan(coord, vec3(0.995)));
+}
+
+// fraction of sunlight left by the dynamic casters, the static shadows are also baked into the lightmap
+float DynamicSunVisibility()
+{
+    vec4 lightSpace = sunShadowDynamicMatrix * vec4(FragPos, 1.0);
+    vec3 coord = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+    if (InShadowMap(coord))
+        return texture(sunShadowDynamic, vec3(coord.xy, coord.z - SHADOW_BIAS));
+    return 1.0;
+}
+
+// fraction of sunlight reaching the fragment, the darker of the static and dynamic shadows
+float SunVisibility()
+{
+    float visibility = 1.0;
+    for (int i = 0; i < SUN_SHADOW_CASCADES; ++i)
+    {
+        vec4 lightSpace = sunShadowMatrices[i] * vec4(FragPos, 1.0);
+        vec3 coord = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+        if (InShadowMap(coord))
+        {
+            visibility = texture(sunShadowCascades, vec4(coord.xy, float(i), coord.z - SHADOW_BIAS));
+            break;
+        }
+    }
+
+    return min(visibility, DynamicSunVisibility());
+}
+
+// sampler arrays can only be indexed with constants in GLSL 3.30, the page is uniform across an instance
+vec4 SampleDiffuse(vec2 uv)
+{
+    vec3 coord = vec3(uv, material.params.z);
+    switch (int(material.params.y))
+    {
+        case 0: return texture(texturePages[0], coord);
+        case 1: return texture(texturePages[1], coord);
+        case 2: return texture(texturePages[2], coord);
+        case 3: return texture(texturePages[3], coord);
+        case 4: return texture(texturePages[4], coord);
+        case 5: return texture(texturePages[5], coord);
+        case 6: return texture(texturePages[6], coord);
+        case 7: return texture(texturePages[7], coord);
+    }
+    return vec4(1.0);
+}
 
 vec3 reflection(vec3 LightDir, vec3 normal)
 {
@@ -77,7 +188,7 @@ vec3 refraction(vec3 LightDir, vec3 normal)
     return reflected;
 }
 
-vec4 CalcLightInternal(BaseLight light, vec3 LightDir, vec3 normal, bool bulb)
+vec4 CalcLightInternal(BaseLight light, vec3 LightDir, vec3 normal, bool bulb, float visibility)
 {
     // vec4 ambientColor = vec4(light.Color,1.0f) * light.ambient * material.ambient.rgba;
     vec4 ambientColor = vec4(light.ambient,1.0) * material.ambient.rgba;
@@ -99,20 +210,20 @@ vec4 CalcLightInternal(BaseLight light, vec3 LightDir, vec3 normal, bool bulb)
         {
             float exp;
             if( bulb ) exp = 256.f;
-            else exp = material.shininess;
+            else exp = material.params.x;
             float spec = pow(specularFactor,exp);
             // specularColor = vec4(light.Color, 1.0f) * light.specular * material.specular.rgba * spec;
             specularColor = vec4(light.specular,1.0) * material.specular.rgba * spec;
         }
     }
 
-    return (ambientColor+diffuseColor+specularColor);
+    return (ambientColor+(diffuseColor+specularColor)*visibility);
 }
 
 vec4 CalcDirectionalLight( vec3 normal )
 {
     vec3 dir = normalize(sunLight.position-FragPos);
-    return CalcLightInternal(sunLight.base, dir, normal, false);
+    return CalcLightInternal(sunLight.base, dir, normal, false, SunVisibility());
     // vec3 dir = normalize(sunLight.direction);
     // return CalcLightInternal(sunLight.base, dir, normal, false);
 }
@@ -123,7 +234,7 @@ vec4 CalcPointLight(PointLight l, vec3 normal)
     float distance = length(LightDir);
     LightDir = normalize(LightDir);
 
-    vec4 Color = CalcLightInternal(l.base, LightDir,normal, true);
+    vec4 Color = CalcLightInternal(l.base, LightDir,normal, true, 1.0);
     float attenuationFactor = l.atten.constant + (l.atten.linear * distance) + (l.atten.exp * distance * distance);
 
     return Color/attenuationFactor;
@@ -150,49 +261,61 @@ vec4 CalcSpotLight( SpotLight l, vec3 normal )
 
 void main()
 {
+    if (ImpostorFadeDiscard())
+        discard;
+
+    material = materials[MaterialIndex];
 
     vec3 normal = normalize(Normal);
+#ifdef LIGHTMAP
+    vec4 bakedLight = vec4(texture(lightmap, LightmapUV).rgb, 1.0);
+#ifndef NIGHT
+    bakedLight.rgb *= DynamicSunVisibility();
+#endif
+    vec4 totalLight = vec4(sunLight.base.ambient, 1.0) * material.ambient + bakedLight * material.diffuse;
+#else
     vec4 totalLight = CalcDirectionalLight(normal);
 
-    bool night = sunLight.base.ambient == vec3(0.0) && sunLight.base.diffuse == vec3(0.0) && sunLight.base.specular == vec3(0.0);
-    if( night )
+#ifdef NIGHT
+    for( int i=0; i<numBulbs; ++i )
     {
-        for( int i=0; i<numBulbs; ++i )
-        {
-            // totalLight += CalcPointLight(i,normal);
-            totalLight += CalcSpotLight(bulbs[i],normal);
-        }
-        for( int i=0; i<numpBulbs; ++i )
-        {
-            // totalLight += CalcPointLight(i,normal);
-            totalLight += CalcPointLight(pointBulbs[i],normal);
-        }
-    
-        if( isBulb )
-        {
-            totalLight = vec4(255,178,0,1);
-            // totalLight = vec4(1.f);
-        }
+        // totalLight += CalcPointLight(i,normal);
+        totalLight += CalcSpotLight(bulbs[i],normal);
     }
-    if( isGlass )
+    for( int i=0; i<numpBulbs; ++i )
+    {
+        // totalLight += CalcPointLight(i,normal);
+        totalLight += CalcPointLight(pointBulbs[i],normal);
+    }
+#endif
+#endif
+
+#if defined(NIGHT) && defined(BULB)
+    totalLight = vec4(255,178,0,1);
+    // totalLight = vec4(1.f);
+#endif
+#ifdef GLASS
     {
         vec3 dir = normalize(FragPos-viewPos);
         vec3 reflected = reflection(dir,normal); 
-        totalLight *= texture(cubeMap,reflected) * 0.7;
-        // totalLight *= texture(texture_diffuse1,vec2(reflected.x,reflected.y));
+        totalLight *= SampleReflection(reflected) * 0.7;
         // reflected = refraction(dir,normal);
         // totalLight *= texture(cubeMap,reflected);
     }
-    if( isWater )
+#endif
+#ifdef WATER
     {
         vec3 dir = normalize(FragPos-viewPos);
         vec3 reflected = reflection(dir,normal); 
-        totalLight *= texture(cubeMap,reflected);
-        // totalLight *= texture(texture_diffuse1,vec2(reflected.x,reflected.y));
+        totalLight *= SampleReflection(reflected);
         // reflected = refraction(dir,normal);
         // totalLight *= texture(cubeMap,reflected);       
     }
+#endif
 
-    if ( !material.hasTexture ) FragColor = totalLight;
-    else FragColor = texture(texture_diffuse1,TexCoords) * totalLight;
+#ifdef TEXTURED
+    FragColor = SampleDiffuse(TexCoords) * totalLight;
+#else
+    FragColor = totalLight;
+#endif
 } 
\ No newline at end of file
@@ -2,20 +2,40 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in mat4 aInstance; // per-instance placement, locations 7 to 10
+layout (location = 11) in ivec2 aIndices; // per-instance x: index into the material buffer, y: reflection probe
+layout (location = 12) in vec2 aLightmapUV; // position inside the lightmap tile of the mesh
+layout (location = 13) in vec4 aLightmapST; // per-instance scale and offset of that tile in the lightmap atlas
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+flat out int MaterialIndex;
+flat out int ProbeIndex;
+out vec2 LightmapUV;
 
 uniform mat4 model;
+uniform mat3 normalMatrix; // inverse transpose of 'model', computed once per node on the CPU
 uniform mat4 view;
 uniform mat4 projection;
 
 void main()
 {
+    mat4 world = model * aInstance;
+
     TexCoords = aTexCoords;
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    MaterialIndex = aIndices.x;
+    ProbeIndex = aIndices.y;
+    LightmapUV = aLightmapUV * aLightmapST.xy + aLightmapST.zw;
+    FragPos = vec3(world * vec4(aPos, 1.0));
+
+    // Inverse transpose of the instance matrix without inverting: for rotation times scale,
+    // dividing each column by its squared length gives it (exact unless the instance is sheared)
+    mat3 instanceNormal = mat3(aInstance);
+    instanceNormal[0] /= dot(instanceNormal[0], instanceNormal[0]);
+    instanceNormal[1] /= dot(instanceNormal[1], instanceNormal[1]);
+    instanceNormal[2] /= dot(instanceNormal[2], instanceNormal[2]);
+    Normal = normalMatrix * instanceNormal * aNormal;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+/**
+ * Depth only pass of the sun shadows, SKINNED is injected for the animated
+ * character, static meshes are placed by their instance matrix
+ */
+#ifdef SKINNED
+layout (location = 5) in ivec4 boneIds;
+layout (location = 6) in vec4 weights;
+
+const int MAX_BONES = 100;
+const int MAX_BONE_INFLUENCE = 4;
+uniform mat4 finalBonesMatrices[MAX_BONES];
+#else
+layout (location = 7) in mat4 aInstance; // per-instance placement, locations 7 to 10
+#endif
+
+uniform mat4 lightSpace;
+uniform mat4 model;
+
+void main()
+{
+#ifdef SKINNED
+    vec4 position = vec4(0.0);
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        if (boneIds[i] == -1)
+            continue;
+        if (boneIds[i] >= MAX_BONES)
+        {
+            position = vec4(aPos, 1.0);
+            break;
+        }
+        position += finalBonesMatrices[boneIds[i]] * vec4(aPos, 1.0) * weights[i];
+    }
+    gl_Position = lightSpace * model * position;
+#else
+    gl_Position = lightSpace * model * aInstance * vec4(aPos, 1.0);
+#endif
+}
@@ -0,0 +1,32 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D sceneColor;
+uniform vec2 sourceSize; // pixels of the scaled scene, in the lower left corner of the texture
+uniform vec2 targetSize; // size of the texture
+uniform float sharpness; // 0 for plain bilinear filtering
+
+void main()
+{
+    // staying half a texel inside the rendered area, the rest of the texture is stale
+    vec2 texel = 1.0 / targetSize;
+    vec2 uv = clamp(TexCoords * sourceSize * texel, texel * 0.5, (sourceSize - 0.5) * texel);
+    vec3 color = texture(sceneColor, uv).rgb;
+
+    if (sharpness > 0.0)
+    {
+        // unsharp mask over the four neighbours of the source pixel, clamped to their range so edges don't ring
+        vec3 north = texture(sceneColor, uv + vec2(0.0, texel.y)).rgb;
+        vec3 south = texture(sceneColor, uv - vec2(0.0, texel.y)).rgb;
+        vec3 east = texture(sceneColor, uv + vec2(texel.x, 0.0)).rgb;
+        vec3 west = texture(sceneColor, uv - vec2(texel.x, 0.0)).rgb;
+        vec3 low = min(color, min(min(north, south), min(east, west)));
+        vec3 high = max(color, max(max(north, south), max(east, west)));
+        vec3 blurred = (north + south + east + west) * 0.25;
+        color = clamp(color + (color - blurred) * sharpness * 2.0, low, high);
+    }
+
+    FragColor = vec4(color, 1.0);
+}
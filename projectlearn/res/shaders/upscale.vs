@@ -0,0 +1,14 @@
+#version 330 core
+
+/**
+ * One triangle covering the window, generated from the vertex index so no
+ * vertex buffer is needed
+ */
+out vec2 TexCoords;
+
+void main()
+{
+    vec2 corner = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0;
+    TexCoords = corner * 0.5 + 0.5;
+    gl_Position = vec4(corner, 0.0, 1.0);
+}
@@ -9,6 +9,10 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+/*The counting allocation functions of FRAME_ALLOCATION_CHECK builds are compiled into this file*/
+#define FRAME_ARENA_IMPLEMENTATION
+#include <frame_arena.h>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -18,11 +22,28 @@
 #include "imgui_impl_opengl3.h"
 
 #include <shader.h>
+#include <shader_variants.h>
 #include <camera.h>
 #include <model.h>
+#include <scene_graph.h>
+#include <scene_file.h>
+#include <world_streamer.h>
+#include <sun_shadows.h>
+#include <lightmap_baker.h>
+#include <irradiance_volume.h>
+#include <dynamic_resolution.h>
+#include <render_graph.h>
+#include <headless.h>
+#include <camera_script.h>
+#include <benchmark.h>
+#include <frame_packet.h>
+#include <frame_pacer.h>
 #include <Animator.h>
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <thread>
 
 /**
  ***********************************************************************************************
@@ -42,33 +63,53 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-const char *lightingShadervPath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/shaders/lighting.vs";
-const char *lightingShaderfPath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/shaders/lighting.fs";
-const char *objFilePath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/models/house.obj";
-std::string skyboxFilePath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/models/textures/Cubemaps";
-const char *skyboxShadervPath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/shaders/skybox.vs";
-const char *skyboxShaderfPath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/shaders/skybox.fs";
-const char *animationFilePath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/models/Sitting.dae";
-const char *animationShadervPath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/shaders/animation.vs";
-const char *animationShaderfPath =
-    "/home/susheel/Desktop/House-Modeling-CG"
-    "/projectlearn/res/shaders/animation.fs";
+/*Longest step the animation and the camera take in one frame, the loop may have been idle for seconds*/
+const float MAX_FRAME_DELTA = 0.1f;
+
+/*Framebuffer size in pixels, kept up to date by the resize callback and passed to the render thread*/
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+
+/**
+ * Directory of the shaders, scene files and caches. Relative to the directory
+ * the program is started from, the root of the repository (see build.md),
+ * unless the build defines another one
+ */
+#ifndef RESOURCE_DIRECTORY
+#define RESOURCE_DIRECTORY "projectlearn/res"
+#endif
+const std::string resourceDirectory = RESOURCE_DIRECTORY;
+
+const std::string lightingShadervPath = resourceDirectory + "/shaders/lighting.vs";
+const std::string lightingShaderfPath = resourceDirectory + "/shaders/lighting.fs";
+const std::string skyboxFilePath = resourceDirectory + "/models/textures/Cubemaps";
+const std::string skyboxShadervPath = resourceDirectory + "/shaders/skybox.vs";
+const std::string skyboxShaderfPath = resourceDirectory + "/shaders/skybox.fs";
+const std::string animationShadervPath = resourceDirectory + "/shaders/animation.vs";
+const std::string animationShaderfPath = resourceDirectory + "/shaders/animation.fs";
+const std::string shadowShadervPath = resourceDirectory + "/shaders/shadow.vs";
+const std::string shadowShaderfPath = resourceDirectory + "/shaders/shadow.fs";
+const std::string impostorShadervPath = resourceDirectory + "/shaders/impostor.vs";
+const std::string impostorShaderfPath = resourceDirectory + "/shaders/impostor.fs";
+const std::string impostorBakeShadervPath = resourceDirectory + "/shaders/impostor_bake.vs";
+const std::string impostorBakeShaderfPath = resourceDirectory + "/shaders/impostor_bake.fs";
+const std::string upscaleShadervPath = resourceDirectory + "/shaders/upscale.vs";
+const std::string upscaleShaderfPath = resourceDirectory + "/shaders/upscale.fs";
+const std::string shaderCachePath = resourceDirectory + "/shader_cache";
+const std::string bakeCachePath = resourceDirectory + "/bake_cache";
+
+/*Scene drawn when no scene file is given on the command line: the house and the sitting character*/
+const std::string defaultScenePath = resourceDirectory + "/scenes/house.json";
+
+/*Video memory the streamed texture mip levels may occupy, the least recently used levels are evicted beyond it*/
+const size_t textureBudget = 256 * 1024 * 1024;
+
+/*Video memory the streamed model geometry may occupy, vertices and indices, the least recently used models are evicted beyond it*/
+const size_t geometryVertexBudget = 192 * 1024 * 1024;
+const size_t geometryIndexBudget = 64 * 1024 * 1024;
+
+/*Runs every job of the job system inline on the submitting thread, for deterministic debugging*/
+const bool serialJobs = false;
 
 /**
  ******************************************************************************************
@@ -115,10 +156,13 @@ void processInput(GLFWwindow *window)
 /**
  * A Callback function that used to adjust the OpenGL viewport to match the new dimension of the resized window
  *
+ * Events are processed on the main thread which doesn't own the context, the
+ * render thread applies the new size with the next frame packet
  */
 void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
 /**
@@ -151,8 +195,27 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    /**
+     * Reading the scene file, the models it references are loaded once the
+     * OpenGL context exists
+     */
+    std::string scenePath = defaultScenePath;
+    HeadlessSettings headless;
+    if (!headless.Parse(argc, argv, scenePath))
+        return -1;
+    SceneDescription sceneFile;
+    if (!sceneFile.Load(scenePath))
+        return -1;
+
+    /*Camera path of a headless run, once around the scene unless a script is given*/
+    CameraScript cameraScript;
+    if (headless.cameraScript.empty())
+        cameraScript.Orbit(camera.Position);
+    else if (!cameraScript.Load(headless.cameraScript))
+        return -1;
+
     /**
      *****************************************************************************************
      *                                                                                       *
@@ -161,36 +224,52 @@ int main()
      ****************************************************************************************
      */
 
-    /**
-     * Initialize GLFW library
-     * Set the major version of OpenGL that we will be using, i.e 3
-     * Set the minor version of OpenGL that we will be using, i.e 3
-     * Set the OpenGL profile that we will be using,
-     *  And GLFW_OPENGL_CORE_PROFILE indicates we want to used core profile of OpenGL
-     *  that include modern OpenGL feaatures and exclude deprecated functionality.
-     */
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    /* Creating GLFW Window with above mention screen width and height*/
-    GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "House Modeling", NULL, NULL);
-
-    /* Checking if window is successfully created or not*/
-    if (window == NULL)
+    GLFWwindow *window = NULL;
+    HeadlessContext headlessContext;
+    GLADloadproc loadProc = (GLADloadproc)glfwGetProcAddress;
+    if (headless.enabled)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        /*Without a window: an EGL context, the frames go into a framebuffer of the requested size*/
+        if (!headlessContext.Create())
+            return -1;
+        loadProc = HeadlessContext::Loader();
+        framebufferWidth = headless.width;
+        framebufferHeight = headless.height;
     }
-    /* Specifying GLFW window OpenGL context current for rendering*/
-    glfwMakeContextCurrent(window);
+    else
+    {
+        /**
+         * Initialize GLFW library
+         * Set the major version of OpenGL that we will be using, i.e 3
+         * Set the minor version of OpenGL that we will be using, i.e 3
+         * Set the OpenGL profile that we will be using,
+         *  And GLFW_OPENGL_CORE_PROFILE indicates we want to used core profile of OpenGL
+         *  that include modern OpenGL feaatures and exclude deprecated functionality.
+         */
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    /*Setting up callback functions for various events using the GLFW Library*/
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+        /* Creating GLFW Window with above mention screen width and height*/
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "House Modeling", NULL, NULL);
+
+        /* Checking if window is successfully created or not*/
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        /* Specifying GLFW window OpenGL context current for rendering*/
+        glfwMakeContextCurrent(window);
+
+        /*Setting up callback functions for various events using the GLFW Library*/
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+    }
 
     /**
      *************************************************************************************************
@@ -204,7 +283,7 @@ int main()
      * Initializing the GLAD library
      *  * It is used to manage OpenGL function pointer.
      */
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    if (!gladLoadGLLoader(loadProc))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
@@ -223,13 +302,52 @@ int main()
      *                                                                                                     *
      *******************************************************************************************************
      */
+    /**
+     * Setting up the program binary cache, programs linked on a previous run
+     * are restored from disk instead of being compiled again
+     */
+    ProgramCache::Instance().Init(loadProc, shaderCachePath);
+
+    /*Model textures are streamed, only their low mips are uploaded while loading*/
+    TextureStreamer::Instance().SetBudget(textureBudget);
+
+    /**
+     * Worker threads of the job system, used by model loading and the animation
+     * update. One core is left to the render thread.
+     */
+    unsigned int cores = std::thread::hardware_concurrency();
+    JobSystem::Instance().Start(serialJobs ? 0 : std::max(1u, cores) - 1);
+
     /**
      * Creating Shader object from their respective
      * fragment shader(fs) and vertices shader(vs) files
+     *
+     * They are deferred: the driver compiles them while the models are loading
+     * and their status is only checked once everything has been submitted.
+     *
+     * The lighting shader is compiled into permutations, one per combination
+     * of mesh and frame flags
      */
-    Shader lightingShader(lightingShadervPath, lightingShaderfPath);
-    Shader animationShader(animationShadervPath, animationShaderfPath);
-    Shader skyboxShader(skyboxShadervPath, skyboxShaderfPath);
+    ShaderVariants lightingShaders(lightingShadervPath.c_str(), lightingShaderfPath.c_str(), [](const Shader &shader)
+                                   {
+                                       ConfigureMaterialShader(shader);
+                                       ReflectionProbes::ConfigureShader(shader);
+                                       SunShadows::ConfigureShader(shader);
+                                       LightmapBaker::ConfigureShader(shader);
+                                   });
+    Shader animationShader(animationShadervPath.c_str(), animationShaderfPath.c_str(), {}, true);
+    Shader skyboxShader(skyboxShadervPath.c_str(), skyboxShaderfPath.c_str(), {}, true);
+
+    /*Depth only programs of the sun shadows, for the static meshes and the skinned character*/
+    Shader shadowShader(shadowShadervPath.c_str(), shadowShaderfPath.c_str(), {}, true);
+    Shader skinnedShadowShader(shadowShadervPath.c_str(), shadowShaderfPath.c_str(), {"SKINNED"}, true);
+
+    /*Impostors of the distant instances, and the program rendering the models into their atlases*/
+    Shader impostorShader(impostorShadervPath.c_str(), impostorShaderfPath.c_str(), {}, true);
+    Shader impostorBakeShader(impostorBakeShadervPath.c_str(), impostorBakeShaderfPath.c_str(), {}, true);
+
+    /*Scales the scene rendered at a dynamic resolution up to the window*/
+    Shader upscaleShader(upscaleShadervPath.c_str(), upscaleShaderfPath.c_str(), {}, true);
 
     /**
      ********************************************************************************************************
@@ -240,17 +358,205 @@ int main()
      */
 
     /**
-     * Creating Model class object called ourModel
-     * And, loading the model object we have created in blender in that object
+     * Loading the baked and the animated assets of the scene file once, however
+     * many instances of them the scene has. They are needed from the first
+     * frame, the other static assets are streamed in around the viewer into
+     * the geometry pool
+     */
+    GeometryPool geometryPool(geometryVertexBudget, geometryIndexBudget);
+    vector<std::unique_ptr<Model>> models(sceneFile.assets.size());
+    for (size_t i = 0; i < sceneFile.assets.size(); i++)
+    {
+        const SceneAsset &asset = sceneFile.assets[i];
+        if (asset.bake || !asset.animationPath.empty())
+            models[i].reset(new Model(asset.modelPath));
+    }
+
+    /**
+     * Placing the instances in the scene graph. World and normal matrices are
+     * cached, they are only computed again after a node or one of its parents
+     * has moved
+     */
+    SceneGraph scene;
+    vector<SceneNode> instanceNodes;
+    for (const SceneInstance &instance : sceneFile.instances)
+        instanceNodes.push_back(scene.AddNode(SCENE_ROOT, instance.transform, instance.name));
+    scene.Update();
+
+    /**
+     * Gathering the placements of every static model, and setting up the
+     * animated character. The animation shader draws a single skinned
+     * instance, further instances of animated assets are left out
+     */
+    vector<vector<ModelPlacement>> placements(models.size());
+    Model *animationModel = nullptr;
+    std::unique_ptr<Animation> danceAnimation;
+    std::unique_ptr<Animator> animator;
+    SceneNode characterNode = SCENE_ROOT;
+    for (size_t i = 0; i < sceneFile.instances.size(); i++)
+    {
+        const SceneInstance &instance = sceneFile.instances[i];
+        const SceneAsset &asset = sceneFile.assets[instance.asset];
+        if (asset.animationPath.empty())
+        {
+            placements[instance.asset].push_back({scene.World(instanceNodes[i]), instance.overrides});
+            continue;
+        }
+        if (animationModel)
+        {
+            std::cout << "ERROR::SCENE::ONLY_ONE_ANIMATED_INSTANCE " << asset.name << std::endl;
+            continue;
+        }
+
+        animationModel = models[instance.asset].get();
+        danceAnimation.reset(new Animation(asset.animationPath, animationModel));
+        animator.reset(new Animator(danceAnimation.get()));
+        characterNode = instanceNodes[i];
+    }
+
+    /**
+     * Collecting the static lighting of the baked asset at its first placement,
+     * before the placements are copied into its instances: every copy shows the
+     * lightmap tiles of the first one
+     */
+    BakeScene bakeScene;
+    Model *bakedModel = nullptr;
+    size_t bakedAsset = 0;
+    for (size_t i = 0; i < models.size() && !bakedModel; i++)
+    {
+        if (sceneFile.assets[i].bake && sceneFile.assets[i].animationPath.empty())
+        {
+            bakedModel = models[i].get();
+            bakedAsset = i;
+            bakeScene.Set(*bakedModel, placements[i].empty() ? glm::mat4(1.0f) : placements[i][0].transform);
+        }
+    }
+
+    /**
+     * Submitting the day and night lighting variants used by the baked model,
+     * with and without the baked lightmap, and every variant a streamed model
+     * can draw with, then waiting for every program that is still compiling.
+     * Streamed models show up in the middle of a frame, where compiling would
+     * stall it for far longer than their upload budget
+     */
+    vector<unsigned int> lightingVariants;
+    if (bakedModel)
+    {
+        for (unsigned int flags : bakedModel->GetVariantFlags())
+        {
+            for (unsigned int frame : {0u, (unsigned int)VARIANT_NIGHT})
+            {
+                for (unsigned int baked : {0u, (unsigned int)VARIANT_LIGHTMAP})
+                {
+                    lightingVariants.push_back(flags | frame | baked);
+                    lightingVariants.push_back(flags | frame | baked | VARIANT_PROBE);
+                }
+            }
+        }
+    }
+    for (unsigned int surface : {0u, (unsigned int)VARIANT_BULB, (unsigned int)VARIANT_GLASS, (unsigned int)VARIANT_WATER})
+    {
+        for (unsigned int textured : {0u, (unsigned int)VARIANT_TEXTURED})
+        {
+            for (unsigned int frame : {0u, (unsigned int)VARIANT_NIGHT})
+            {
+                lightingVariants.push_back(surface | textured | frame);
+                lightingVariants.push_back(surface | textured | frame | VARIANT_PROBE);
+            }
+        }
+    }
+    lightingShaders.Prepare(lightingVariants);
+
+    animationShader.Finish();
+    skyboxShader.Finish();
+    shadowShader.Finish();
+    skinnedShadowShader.Finish();
+    impostorShader.Finish();
+    impostorBakeShader.Finish();
+    upscaleShader.Finish();
+    lightingShaders.FinishAll();
+
+    /*Pointing the animation shader at the texture pages and material buffer of the models, and at the irradiance volume*/
+    ConfigureMaterialShader(animationShader);
+    IrradianceVolume::ConfigureShader(animationShader);
+    ConfigureMaterialShader(impostorBakeShader);
+    Impostor::ConfigureShader(impostorShader);
+    DynamicResolution::ConfigureShader(upscaleShader);
+
+    /**
+     * Handing the static models to the world streamer. From the first frame on
+     * it places each of them in the cells around the viewer only, each mesh
+     * stays one instanced draw for all of them, and the distant cells as
+     * impostors. The models loaded above stay resident and have their
+     * impostors baked here, the others are loaded when a cell first needs them.
+     *
+     * The baked model is then copied to all its placements for the reflection
+     * probes and the shadow bounds below. The instances are in world space,
+     * static models are drawn with an identity model matrix
+     */
+    ImpostorBaker impostorBaker(impostorBakeShader);
+    const StreamingSettings streamingSettings;
+    WorldStreamer worldStreamer(geometryPool, streamingSettings, &impostorBaker);
+    for (size_t i = 0; i < models.size(); i++)
+    {
+        if (!sceneFile.assets[i].animationPath.empty())
+            continue;
+        int asset = worldStreamer.AddAsset(sceneFile.assets[i].modelPath, models[i].get());
+        for (const ModelPlacement &placement : placements[i])
+            worldStreamer.AddInstance(asset, placement.transform, placement.overrides);
+    }
+    if (bakedModel)
+        bakedModel->Place(placements[bakedAsset]);
+    const vector<Model *> &staticModels = worldStreamer.Models();
+    const glm::mat4 staticTransform(1.0f);
+
+    /**
+     * Placing the reflection probes around the glass and water of the baked
+     * model, each reflective instance samples the probe closest to it. The
+     * streamed models are assigned their probes when they are placed
+     */
+    ReflectionProbes reflectionProbes;
+    vector<glm::vec3> reflectivePositions;
+    if (bakedModel)
+        reflectivePositions = bakedModel->GetReflectivePositions(staticTransform);
+    reflectionProbes.Place(reflectivePositions);
+
+    /**
+     * Setting up the sun shadows, the static models are only rendered into the
+     * cached cascades, the character goes into the per-frame overlay. The
+     * streamed models aren't loaded yet, the scene is bounded by the baked
+     * model and the origins of all static instances
      */
-    Model ourModel(objFilePath);
+    glm::vec3 sceneMinimum(0.0f), sceneMaximum(0.0f);
+    bool bounded = false;
+    if (bakedModel)
+    {
+        glm::vec3 center;
+        float radius;
+        bakedModel->GetBounds(staticTransform, center, radius);
+        sceneMinimum = center - glm::vec3(radius);
+        sceneMaximum = center + glm::vec3(radius);
+        bounded = true;
+    }
+    for (size_t i = 0; i < placements.size(); i++)
+    {
+        for (const ModelPlacement &placement : placements[i])
+        {
+            glm::vec3 origin = glm::vec3(placement.transform[3]);
+            sceneMinimum = bounded ? glm::min(sceneMinimum, origin) : origin;
+            sceneMaximum = bounded ? glm::max(sceneMaximum, origin) : origin;
+            bounded = true;
+        }
+    }
+    SunShadows sunShadows((sceneMinimum + sceneMaximum) * 0.5f, glm::length(sceneMaximum - sceneMinimum) * 0.5f);
 
     /**
-     * Loading animation model and its animation files
+     * Baking the static lighting in the background: the lightmap for the baked
+     * model, the irradiance volume for the character. The dynamic lighting is
+     * used until the bakes of the current lights are ready
      */
-    Model animationModel(animationFilePath);
-    Animation danceAnimation(animationFilePath, &animationModel);
-    Animator animator(&danceAnimation);
+    LightmapBaker lightmapBaker(bakeScene, bakeCachePath);
+    IrradianceVolume irradianceVolume(bakeScene, bakeCachePath);
 
     /**
      ***********************************************************************************************************
@@ -263,12 +569,18 @@ int main()
      * Integrating ImGui(Dear ImGui) library with OpenGL
      */
     const char *glsl_version = "#version 130"; // Defining glsl(OpenGL Shading Language) version to be used
+#ifdef FRAME_ALLOCATION_CHECK
+    ImGui::SetAllocatorFunctions(FrameAllocationScope::CountedAlloc, FrameAllocationScope::CountedFree); // ImGui allocations count as heap allocations of the frame
+#endif
     ImGui::CreateContext();                    // Initialize ImGui context, which holds the internal state used by ImGui
     ImGuiIO &io = ImGui::GetIO();              // It is used to communicate input and output between ImGui and our application
     (void)io;
     ImGui::StyleColorsDark();                   // Sets the ImGui style to the "dark" color scheme.
-    ImGui_ImplGlfw_InitForOpenGL(window, true); // Initialize ImGui integation for GLFW
-    ImGui_ImplOpenGL3_Init(glsl_version);       // Initialize ImGui integration for OpenGL 3.0
+    if (!headless.enabled)                      // Headless runs have no debug interface
+    {
+        ImGui_ImplGlfw_InitForOpenGL(window, true); // Initialize ImGui integation for GLFW
+        ImGui_ImplOpenGL3_Init(glsl_version);       // Initialize ImGui integration for OpenGL 3.0
+    }
 
     /**
      *********************************************************************************************************
@@ -474,189 +786,580 @@ int main()
     float diffuseIntensity = 0.55f;
     float specularIntensity = 0.55f;
 
+    /*Cases of a benchmark run, their lighting presets default to the values above*/
+    Benchmark benchmark;
+    BenchmarkFrame benchmarkFrame;
+    bool benchmarking = !headless.benchmarkSuite.empty();
+    if (benchmarking && !benchmark.Load(headless.benchmarkSuite, {lightPos, lightColor, ambientIntensity, diffuseIntensity, specularIntensity}))
+        return -1;
+
+    /*Resolution of the scene, lowered to hold the GPU frame time target when enabled*/
+    ResolutionSettings resolutionSettings;
+
+    /*Frame cap and render-on-demand, with what the last frame looked like to tell whether the next one differs*/
+    PacingSettings pacingSettings;
+    FramePacer framePacer;
+    bool animateCharacter = true;
+    glm::mat4 previousView(0.0f);
+    glm::mat4 previousProjection(0.0f);
+    int previousFramebufferWidth = 0;
+    int previousFramebufferHeight = 0;
+
     /**
      *******************************************************************************************************
      *                                                                                                     *
-     *                                          Application Loop                                           *
+     *                                          Render Stage                                               *
      *                                                                                                     *
      *******************************************************************************************************
      */
-    while (!glfwWindowShouldClose(window))
+    /**
+     * The render thread owns the OpenGL context: it turns the frame packets
+     * prepared by the simulation stage into GL calls and swaps the buffers,
+     * while the main thread already prepares the next frame
+     */
+    FramePipeline framePipeline;
+
+    /*Controller of the render scale, and the graph ordering the passes of a frame and providing their targets, used by the render thread only*/
+    DynamicResolution dynamicResolution(upscaleShader);
+    RenderGraph renderGraph;
+
+    /*Creating the ImGui font texture while the context is still current on this thread*/
+    if (!headless.enabled)
+        ImGui_ImplOpenGL3_NewFrame();
+
+    /*Framebuffer the headless frames go into, in place of the window's*/
+    std::unique_ptr<HeadlessTarget> headlessTarget;
+    if (headless.enabled)
+        headlessTarget.reset(new HeadlessTarget(headless.width, headless.height, headless.format));
+
+    /*Status of the previous frame, a frame only counts as steady when nothing changed since*/
+    RenderStatus previousStatus;
+
+    auto renderFrame = [&](FramePacket &frame)
     {
-        /*Clear the color and depth buffers of the OpenGL rendering context at the beginning of each frame*/
+        /*Transient allocations of the previous frame are released all at once*/
+        FrameArena::Current().Reset();
+        FrameAllocationScope allocations("render");
+        DrawStats::Instance().Reset();
+
+        /*The GPU time of the whole frame drives the render scale*/
+        dynamicResolution.BeginFrame(frame.resolution, frame.framebufferWidth, frame.framebufferHeight);
+
+        /*Following the framebuffer size reported by the resize callback, the render graph binds the targets of each pass*/
+        glViewport(0, 0, frame.framebufferWidth, frame.framebufferHeight);
+
+        /*Color the render graph clears the backbuffer and the scene targets with*/
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        /**
-         *******************************************************************************************************
-         *                                                                                                     *
-         *           Handling, Processing Input Events and Updating Scene based on Input received              *
-         *                                                                                                     *
-         *******************************************************************************************************
-         */
+        /*It is night when the sun doesn't contribute any light, that selects the night variants*/
+        unsigned int frameFlags = frame.night ? VARIANT_NIGHT : 0;
 
-        /* It is used to process the user inputs nad modify the state of application based on the input*/
-        processInput(window);
+        /*Switching to the baked lighting once the lightmap of the current lights is available*/
+        RenderStatus status;
+        BakeLights bakedLights = {frame.lightPos, frame.diffuseColor, frame.night};
+        status.lightmapReady = lightmapBaker.Request(bakedLights);
+        if (status.lightmapReady)
+            frameFlags |= VARIANT_LIGHTMAP;
+        status.irradianceReady = irradianceVolume.Request(bakedLights);
 
-        /*Create GUI within our application*/
+        /**
+         * Streaming the cells around the viewer within the upload budget of the
+         * frame. Models placed again sample the probes closest to their new
+         * instances, and the cached shadow cascades don't show them yet
+         */
+        bool streamingChanged = worldStreamer.Update(frame.viewPos);
+        if (streamingChanged)
         {
-            ImGui_ImplOpenGL3_NewFrame();
-            ImGui_ImplGlfw_NewFrame();
-            ImGui::NewFrame();
+            for (Model *model : staticModels)
+                model->AssignReflectionProbes(reflectionProbes, staticTransform);
+            sunShadows.Invalidate();
         }
 
         /**
-         * Calculating  the time elapsed between frames in rendering loop
-         *
-         * It is crucial for controlling animation and updating object position
-         * in a smooth and frame-rate-independant manner.
+         * Setting the per-frame uniforms of the animation shader that don't depend on the viewpoint
          */
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        animationShader.use();
+        animationShader.setVec3("girlColor", frame.lightColor);
+        animationShader.setVec3("ambientLight", frame.ambientColor);
+        irradianceVolume.SetUniforms(animationShader, status.irradianceReady);
 
-        /*Updating and manage animations of animator object*/
-        animator.UpdateAnimation(deltaTime);
-
-        /* Calculating diffuse, ambient and specular color for lighting in scene*/
-        glm::vec3 diffuseColor = lightColor * glm::vec3(ambientIntensity);
-        glm::vec3 ambientColor = lightColor * glm::vec3(diffuseIntensity);
-        glm::vec3 specularColor = lightColor * glm::vec3(specularIntensity);
+        /*looping through the final bone transformations computed by the simulation stage and setting the uniform*/
+        animationShader.setMat4Array("finalBonesMatrices", frame.boneMatrices.data(), (int)frame.boneMatrices.size());
 
         /**
          *******************************************************************************************************
          *                                                                                                     *
-         *                                          Lighting Shader                                            *
+         *                                          Sun Shadows                                                *
          *                                                                                                     *
          *******************************************************************************************************
          */
-        /* Activating "lightingShader"*/
-        lightingShader.use();
-
-        /* Setting the sunlight position and direction of the light */
-        lightingShader.setVec3("sunLight.position", lightPos);
-        lightingShader.setVec3("sunLight.direction", lightDir);
-
-        /*Setting the view position*/
-        lightingShader.setVec3("viewPos", camera.Position);
-
-        /*Seting the ambient, diffuse and specular lighting properties of light sources*/
-        lightingShader.setVec3("sunLight.base.ambient", ambientColor);
-        lightingShader.setVec3("sunLight.base.diffuse", diffuseColor);
-        lightingShader.setVec3("sunLight.base.specular", specularColor);
-
-        /* Calculating the projection and view matrices for camera in 3D scene*/
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-
-        /*Setting the projection and view matrix in "lightingShader"*/
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
+        /**
+         * The callbacks are handed over with std::ref, a std::function holds a
+         * reference without allocating while a larger lambda would be copied to
+         * the heap every frame
+         */
+        auto drawStaticCasters = [&](const glm::mat4 &lightSpace)
+        {
+            shadowShader.use();
+            shadowShader.setMat4("lightSpace", lightSpace);
+            shadowShader.setMat4("model", staticTransform);
+            for (Model *model : staticModels)
+                model->DrawShadowCasters();
+        };
+        auto drawDynamicCasters = [&](const glm::mat4 &lightSpace)
+        {
+            skinnedShadowShader.use();
+            skinnedShadowShader.setMat4("lightSpace", lightSpace);
+            skinnedShadowShader.setMat4("model", frame.animationTransform);
+            skinnedShadowShader.setMat4Array("finalBonesMatrices", frame.boneMatrices.data(), (int)frame.boneMatrices.size());
+            if (animationModel)
+                animationModel->DrawShadowCasters();
+        };
+
+        auto shadowPass = [&]()
+        {
+            /*The static models only go into the cascades that are out of date, which is none while the sun and viewer stay put*/
+            sunShadows.UpdateStatic(frame.lightPos, frame.viewPos, std::ref(drawStaticCasters));
 
-        /*Manipulating the model matrix for an object in the scene*/
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 1.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));     // it's a bit too big for our scene, so scale it down
+            /*The character moves every frame, it is drawn into the small overlay map fitted around it*/
+            sunShadows.UpdateDynamic(frame.lightPos, frame.characterCenter, frame.characterRadius, std::ref(drawDynamicCasters));
+        };
 
         /**
-         * Setting the model matrix as a uniform in "lightingShader"
+         * Draws the static models, the animated character and the skybox seen from 'eye'.
          *
-         * It allows shader to apply the transformation defined by model matrix
-         * to the vertices of the object we are rendering
+         * Used for the camera and for the reflection probe faces, 'passFlags' are
+         * added to the lighting variant flags of the pass.
          */
-        lightingShader.setMat4("model", model);
+        auto drawScene = [&](const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye, unsigned int passFlags)
+        {
+            /**
+             *******************************************************************************************************
+             *                                                                                                     *
+             *                                          Lighting Shader                                            *
+             *                                                                                                     *
+             *******************************************************************************************************
+             */
+            /**
+             * Setting the per-frame uniforms, called for every lighting shader variant
+             * used while drawing the model
+             */
+            glm::vec2 impostorFade(0.0f);
+            auto setupFrame = [&](Shader &lightingShader)
+            {
+                /* Setting the sunlight position and direction of the light */
+                lightingShader.setVec3("sunLight.position", frame.lightPos);
+                lightingShader.setVec3("sunLight.direction", frame.lightDir);
+
+                /*Setting the view position*/
+                lightingShader.setVec3("viewPos", eye);
+
+                /*Seting the ambient, diffuse and specular lighting properties of light sources*/
+                lightingShader.setVec3("sunLight.base.ambient", frame.ambientColor);
+                lightingShader.setVec3("sunLight.base.diffuse", frame.diffuseColor);
+                lightingShader.setVec3("sunLight.base.specular", frame.specularColor);
+
+                /*Setting the projection and view matrix in "lightingShader"*/
+                lightingShader.setMat4("projection", projection);
+                lightingShader.setMat4("view", view);
+
+                /**
+                 * Setting the model matrix as a uniform in "lightingShader"
+                 *
+                 * It allows shader to apply the transformation defined by model matrix
+                 * to the vertices of the object we are rendering
+                 */
+                lightingShader.setMat4("model", staticTransform);
+                lightingShader.setMat3("normalMatrix", glm::mat3(1.0f));
+
+                /*Light space matrices of the shadow cascades and of the character overlay*/
+                sunShadows.SetUniforms(lightingShader);
+
+                /*Distances over which the model dithers out into its impostor*/
+                lightingShader.setVec2("impostorFade", impostorFade);
+            };
+
+            /*Binding the VAO associated with the skybox to the OpenGL context*/
+            glBindVertexArray(skyboxVAO);
+
+            /* Binding the previously created cubemap texture to the OpenGL context*/
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+
+            /*Glass and water sample the reflection probe closest to them*/
+            reflectionProbes.Bind();
+            sunShadows.Bind();
+            lightmapBaker.Bind();
+
+            /**
+             * Rendering the static models using the lighting shader variants,"cubemapTexture" and applying lighting
+             * calculations during rendering. Only the baked model has tiles in the lightmap
+             */
+            for (Model *model : staticModels)
+            {
+                unsigned int modelFlags = model == bakedModel ? frameFlags : frameFlags & ~VARIANT_LIGHTMAP;
+                impostorFade = worldStreamer.ImpostorFade(model);
+                model->Draw(lightingShaders, modelFlags | passFlags, std::ref(setupFrame));
+            }
 
-        /*Binding the VAO associated with the skybox to the OpenGL context*/
-        glBindVertexArray(skyboxVAO);
+            /**
+             * Rendering the distant instances as impostors, one quad each. They
+             * write the depth of the surface they show and dither in where the
+             * geometry above dithered out
+             */
+            impostorShader.use();
+            impostorShader.setMat4("projection", projection);
+            impostorShader.setMat4("view", view);
+            impostorShader.setVec3("viewPos", eye);
+            impostorShader.setVec3("sunPosition", frame.lightPos);
+            impostorShader.setVec3("sunAmbient", frame.ambientColor);
+            impostorShader.setVec3("sunDiffuse", frame.diffuseColor);
+            impostorShader.setVec2("impostorFade", streamingSettings.impostorDistance - streamingSettings.impostorFade, streamingSettings.impostorDistance);
+            for (Impostor *impostor : worldStreamer.Impostors())
+                impostor->Draw(impostorShader);
+
+            /**
+             *******************************************************************************************************
+             *                                                                                                     *
+             *                                          Animation Shader                                           *
+             *                                                                                                     *
+             *******************************************************************************************************
+             */
+
+            /*Activating animationShader that we have defined above*/
+            animationShader.use();
+
+            /*Updating the "projection" and "view" matrix with new values*/
+            animationShader.setMat4("projection", projection);
+            animationShader.setMat4("view", view);
+
+            /*Set the "model" matrix as uniform in "animationShader"*/
+            animationShader.setMat4("model", frame.animationTransform);
+            animationShader.setMat3("normalMatrix", frame.animationNormal);
+
+            /*Render the animationModel using animationShader, lit by one lookup into the irradiance volume*/
+            irradianceVolume.Bind();
+            if (animationModel)
+                animationModel->Draw(animationShader, false);
+
+            /*Setting the depth comparision function, fragment will be visible if depth value is less than or equal to stored value */
+            glDepthFunc(GL_LEQUAL);
+
+            /**
+             *******************************************************************************************************
+             *                                                                                                     *
+             *                                          Skybox Shader                                              *
+             *                                                                                                     *
+             *******************************************************************************************************
+             */
+
+            /*Activating skyboxShader*/
+            skyboxShader.use();
+
+            /*Sets a uniform named "skyColor" in the "skyboxShader" with the value of the lightColor vector*/
+            skyboxShader.setVec3("skyColor", frame.lightColor);
+
+            /*Remove any translation components from the 'view' matrix*/
+            glm::mat4 skyView = glm::mat4(glm::mat3(view));
+
+            /*Setting 'projection' and 'view' matrix as uniform in skyShader program*/
+            glUniformMatrix4fv(glGetUniformLocation(skyboxShader.ID(), "view"), 1, GL_FALSE, glm::value_ptr(skyView));
+            glUniformMatrix4fv(glGetUniformLocation(skyboxShader.ID(), "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+            /*Binding Vertex Array Object and cubemapTexture before rendering the skybox*/
+            glBindVertexArray(skyboxVAO);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+
+            /**
+             * Render the vertices currently bounded in Vertex Array Object and the active shader program
+             * * GL_TRIANGLES : We are telling OpenGL to treat vertices as individual triangles
+             * * 0 : Starting index of the vertices with in VAO. Since we are using whole buffer,so we need to start from index 0.
+             * * 36 : number of vertices to render. As each cube made of two triangle(Six Vertices) and there are six faces in total, so we have 36 vertices
+             */
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            DrawStats::Instance().Count(12);
+
+            /*Unbound bounded vertex array object from OpenGL context*/
+            glBindVertexArray(0);
+
+            /*Restoring the deep comparision function back to default*/
+            glDepthFunc(GL_LESS);
+        };
 
-        /* Binding the previously created cubemap texture to the OpenGL context*/
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        /**
+         * Refreshing the scheduled reflection probe faces, they are drawn with the
+         * cheapest lighting variants (see VARIANT_PROBE)
+         */
+        auto probePass = [&]()
+        {
+            reflectionProbes.Update([&](const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &eye)
+                                    { drawScene(view, projection, eye, VARIANT_PROBE); });
+        };
+
+        /*Telling the texture streamer how large the textures appear from the camera, at the resolution the scene is rendered at*/
+        float screenScale = frame.screenScale * dynamicResolution.Scale();
+        for (Model *model : staticModels)
+            model->RequestTextures(staticTransform, frame.viewPos, screenScale);
+        if (animationModel)
+            animationModel->RequestTextures(frame.animationTransform, frame.viewPos, screenScale);
+
+        /*Rendering the scene from the camera, into the window or the scaled viewport of the offscreen targets*/
+        auto scenePass = [&]()
+        {
+            if (dynamicResolution.Offscreen())
+                glViewport(0, 0, dynamicResolution.ScaledWidth(), dynamicResolution.ScaledHeight());
+            drawScene(frame.view, frame.projection, frame.viewPos, 0);
+        };
 
-        /*Rendering our model using "lightingShader","cubemapTexture" and applying lighting calculations during rendering*/
-        ourModel.Draw(lightingShader, true, cubemapTexture);
+        /*Drawing the debug interface built by the simulation stage, always at the window's resolution*/
+        auto interfacePass = [&]()
+        {
+            if (frame.hasDrawData)
+                ImGui_ImplOpenGL3_RenderDrawData(&frame.drawData);
+        };
 
         /**
          *******************************************************************************************************
          *                                                                                                     *
-         *                                          Animation Shader                                           *
+         *                                          Render Graph                                               *
          *                                                                                                     *
          *******************************************************************************************************
          */
-
-        /*Activating animationShader that we have defined above*/
-        animationShader.use();
-
-        /*Updating the "projection" and "view" matrix with new values*/
-        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        view = camera.GetViewMatrix();
-
-        /*Setting various uniforms to control how the animation is being rendered*/
-        animationShader.setMat4("projection", projection);
-        animationShader.setMat4("view", view);
-        animationShader.setVec3("girlColor", lightColor);
-
-        /*Retrieving the final bone transformation matrices from animator objects*/
-        auto transforms = animator.GetFinalBoneMatrices();
-
-        /*looping through 'transforms' array which contain final bone transformations and setting the uniform*/
-        for (int i = 0; i < transforms.size(); ++i)
+        /**
+         * Declaring the passes of the frame with what they read and write. The
+         * shadow maps and probes persist across frames, their passes render
+         * into them themselves. The graph is only compiled again when the
+         * declarations change, when the window is resized or the dynamic
+         * resolution is toggled
+         */
+        renderGraph.Begin(frame.framebufferWidth, frame.framebufferHeight, headlessTarget ? headlessTarget->Framebuffer() : 0);
+        RenderResource shadowMaps = renderGraph.Import("sun shadow maps");
+        RenderResource probeCubemaps = renderGraph.Import("reflection probes");
+        renderGraph.AddPass("sun shadows", std::ref(shadowPass)).Write(shadowMaps);
+        renderGraph.AddPass("reflection probes", std::ref(probePass)).Read(shadowMaps).Write(probeCubemaps);
+
+        RenderGraph::PassBuilder scene = renderGraph.AddPass("scene", std::ref(scenePass)).Read(shadowMaps).Read(probeCubemaps);
+        RenderResource sceneColor = renderGraph.Backbuffer();
+        auto upscalePass = [&]()
+        { dynamicResolution.Upscale(renderGraph.Texture(sceneColor)); };
+        if (dynamicResolution.Offscreen())
         {
-            animationShader.setMat4("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
+            /*At the window's size, the scene only covers the scaled viewport*/
+            RenderTargetDesc colorDesc, depthDesc;
+            colorDesc.width = depthDesc.width = frame.framebufferWidth;
+            colorDesc.height = depthDesc.height = frame.framebufferHeight;
+            depthDesc.internalFormat = GL_DEPTH_COMPONENT24;
+            sceneColor = renderGraph.CreateTarget("scene color", colorDesc);
+            scene.Write(sceneColor).Write(renderGraph.CreateTarget("scene depth", depthDesc));
+            renderGraph.AddPass("upscale", std::ref(upscalePass)).Read(sceneColor).Write(renderGraph.Backbuffer());
         }
+        else
+            scene.Write(sceneColor);
+        renderGraph.AddPass("interface", std::ref(interfacePass)).Write(renderGraph.Backbuffer());
+        int graphCompilations = renderGraph.Stats().compilations;
+        renderGraph.Execute();
+        bool graphCompiled = renderGraph.Stats().compilations != graphCompilations;
+        status.gpuMeasured = dynamicResolution.EndFrame();
+
+        /*Streaming in the texture levels requested during this frame*/
+        TextureStreamer::Instance().Update();
+
+        /*Reporting back to the debug interface of the next frames*/
+        status.lightmapBaking = lightmapBaker.Baking();
+        status.irradianceBaking = irradianceVolume.Baking();
+        status.textureBytes = TextureStreamer::Instance().ResidentBytes();
+        status.textureBudget = TextureStreamer::Instance().Budget();
+        const StreamingStats &streaming = worldStreamer.Stats();
+        status.geometryBytes = streaming.poolBytes;
+        status.geometryBudget = streaming.poolBudget;
+        status.geometryUploadBytes = streaming.uploadedBytes;
+        status.geometryUploadMilliseconds = streaming.uploadMilliseconds;
+        status.drawnCells = streaming.drawnCells;
+        status.totalCells = streaming.totalCells;
+        status.loadingModels = streaming.loadingAssets;
+        status.impostorInstances = streaming.impostorInstances;
+        status.renderScale = dynamicResolution.Scale();
+        status.renderWidth = dynamicResolution.ScaledWidth();
+        status.renderHeight = dynamicResolution.ScaledHeight();
+        status.gpuMilliseconds = dynamicResolution.GpuMilliseconds();
+        status.drawCalls = DrawStats::Instance().DrawCalls();
+        status.triangles = DrawStats::Instance().Triangles();
+        const RenderGraphStats &graphStats = renderGraph.Stats();
+        status.renderPasses = graphStats.passes;
+        status.culledPasses = graphStats.culledPasses;
+        status.renderTargets = graphStats.targets;
+        status.renderTargetTextures = graphStats.textures;
+        status.renderTargetBytes = graphStats.bytes;
+
+        /*Bakes, uploads, streaming and compiling the render graph allocate, a steady frame is one where none of them happened*/
+        status.steady = !status.lightmapBaking && !status.irradianceBaking &&
+                        status.lightmapReady == previousStatus.lightmapReady && status.irradianceReady == previousStatus.irradianceReady &&
+                        status.textureBytes == previousStatus.textureBytes &&
+                        !streamingChanged && status.geometryUploadBytes == 0 && status.loadingModels == 0 && !graphCompiled;
+        framePipeline.PublishStatus(status);
+        allocations.Check(status.steady);
+        previousStatus = status;
+    };
+
+    /*A context is current on one thread at most, handing it over to the render thread*/
+    auto makeCurrent = [&](bool current)
+    {
+        if (headless.enabled)
+            headlessContext.MakeCurrent(current);
+        else
+            glfwMakeContextCurrent(current ? window : NULL);
+    };
+    makeCurrent(false);
+    std::thread renderThread([&]()
+                             {
+                                 makeCurrent(true);
+                                 std::chrono::steady_clock::time_point previousStart = std::chrono::steady_clock::now();
+                                 while (FramePacket *frame = framePipeline.BeginRead())
+                                 {
+                                     std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+                                     renderFrame(*frame);
+                                     int captureIndex = frame->captureIndex;
+                                     int benchmarkCase = frame->benchmarkCase;
+                                     framePipeline.EndRead();
+
+                                     /*Measured benchmark frames record how long recording them took, the time since the previous frame and its status*/
+                                     if (benchmarkCase >= 0)
+                                     {
+                                         std::chrono::steady_clock::time_point frameEnd = std::chrono::steady_clock::now();
+                                         benchmark.Record(benchmarkCase, std::chrono::duration<double, std::milli>(frameEnd - frameStart).count(),
+                                                          std::chrono::duration<double, std::milli>(frameStart - previousStart).count(), previousStatus);
+                                     }
+                                     previousStart = frameStart;
+
+                                     /*Writes the captured headless frames, or swaps the front and back buffers of the window*/
+                                     if (headlessTarget)
+                                     {
+                                         if (captureIndex >= 0)
+                                             headlessTarget->Capture(headless.outputDirectory, captureIndex);
+                                     }
+                                     else
+                                         glfwSwapBuffers(window);
+                                 }
+                                 makeCurrent(false);
+                             });
 
-        /*Manipulating the 'model' matrix for specific object in scene*/
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(11.09f, 2.105f, 10.0f)); // translate it down so it's at the center of the scene
-        model = glm::scale(model, glm::vec3(1.f, 1.f, 1.f));             // it's a bit too big for our scene, so scale it down
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.f, 1.f, 0.f));
-
-        /*Set the "model" matrix as uniform in "animationShader"*/
-        animationShader.setMat4("model", model);
-
-        /*Render the animationModel using animationShader and cubermapTexture, but lighting calculation won't be applied during rendering*/
-        animationModel.Draw(animationShader, false, cubemapTexture);
-
-        /*Setting the depth comparision function, fragment will be visible if depth value is less than or equal to stored value */
-        glDepthFunc(GL_LEQUAL);
+    /**
+     *******************************************************************************************************
+     *                                                                                                     *
+     *                                   Application Loop (Simulation Stage)                               *
+     *                                                                                                     *
+     *******************************************************************************************************
+     */
+    /**
+     * Input, animation and everything the render stage needs is prepared here,
+     * on the main thread which GLFW requires for window events. Waiting for a
+     * free packet first paces the simulation to the render thread.
+     *
+     * A headless run prepares the requested number of frames along the camera
+     * script instead, each a fixed step after the previous one, and a
+     * benchmark run the frames of its cases
+     */
+    int headlessFrame = 0;
+    std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+    auto running = [&]()
+    {
+        if (!headless.enabled)
+            return !glfwWindowShouldClose(window);
+        if (benchmarking)
+            return benchmark.Next(framePipeline.Status(), benchmarkFrame);
+        return headlessFrame < headless.frames;
+    };
+    while (running())
+    {
+        FramePacket &frame = framePipeline.BeginWrite();
+        FrameArena::Current().Reset();
+        FrameAllocationScope allocations("simulation");
 
         /**
          *******************************************************************************************************
          *                                                                                                     *
-         *                                          Skybox Shader                                              *
+         *           Handling, Processing Input Events and Updating Scene based on Input received              *
          *                                                                                                     *
          *******************************************************************************************************
          */
 
-        /*Activating skyboxShader*/
-        skyboxShader.use();
-
-        /*Sets a uniform named "skyColor" in the "skyboxShader" with the value of the lightColor vector*/
-        skyboxShader.setVec3("skyColor", lightColor);
-
-        /*Remove any translation components from the 'view' matrix*/
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-
-        /*Setting 'projection' and 'view' matrix as uniform in skyShader program*/
-        glUniformMatrix4fv(glGetUniformLocation(skyboxShader.ID, "view"), 1, GL_FALSE, glm::value_ptr(view));
-        glUniformMatrix4fv(glGetUniformLocation(skyboxShader.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+        /* It is used to process the user inputs nad modify the state of application based on the input*/
+        if (benchmarking)
+            benchmark.Case(benchmarkFrame.caseIndex).camera.Apply(camera, benchmarkFrame.pathPosition);
+        else if (headless.enabled)
+            cameraScript.Apply(camera, headless.frames > 1 ? (float)headlessFrame / (headless.frames - 1) : 0.0f);
+        else
+            processInput(window);
 
-        /*Binding Vertex Array Object and cubemapTexture before rendering the skybox*/
-        glBindVertexArray(skyboxVAO);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        /*Create GUI within our application*/
+        if (!headless.enabled)
+        {
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+        }
 
         /**
-         * Render the vertices currently bounded in Vertex Array Object and the active shader program
-         * * GL_TRIANGLES : We are telling OpenGL to treat vertices as individual triangles
-         * * 0 : Starting index of the vertices with in VAO. Since we are using whole buffer,so we need to start from index 0.
-         * * 36 : number of vertices to render. As each cube made of two triangle(Six Vertices) and there are six faces in total, so we have 36 vertices
+         * Calculating  the time elapsed between frames in rendering loop
+         *
+         * It is crucial for controlling animation and updating object position
+         * in a smooth and frame-rate-independant manner.
          */
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        float currentFrame = headless.enabled ? headlessFrame * HEADLESS_FRAME_DELTA : static_cast<float>(glfwGetTime());
+        deltaTime = std::min(currentFrame - lastFrame, MAX_FRAME_DELTA);
+        lastFrame = currentFrame;
 
-        /*Unbound bounded vertex array object from OpenGL context*/
-        glBindVertexArray(0);
+        /*Updating and manage animations of animator object*/
+        bool animating = animator && animateCharacter;
+        if (animating)
+            animator->UpdateAnimation(deltaTime);
 
-        /*Restoring the deep comparision function back to default*/
-        glDepthFunc(GL_LESS);
+        /*Benchmark cases set the sliders to their lighting preset*/
+        if (benchmarking)
+        {
+            const LightingPreset &lighting = benchmark.Case(benchmarkFrame.caseIndex).lighting;
+            lightPos = lighting.position;
+            lightColor = lighting.color;
+            ambientIntensity = lighting.ambientIntensity;
+            diffuseIntensity = lighting.diffuseIntensity;
+            specularIntensity = lighting.specularIntensity;
+        }
+
+        /* Calculating diffuse, ambient and specular color for lighting in scene*/
+        frame.lightPos = lightPos;
+        frame.lightDir = lightDir;
+        frame.lightColor = lightColor;
+        frame.diffuseColor = lightColor * glm::vec3(ambientIntensity);
+        frame.ambientColor = lightColor * glm::vec3(diffuseIntensity);
+        frame.specularColor = lightColor * glm::vec3(specularIntensity);
+
+        /*It is night when the sun doesn't contribute any light*/
+        frame.night = frame.ambientColor == glm::vec3(0.0f) && frame.diffuseColor == glm::vec3(0.0f) && frame.specularColor == glm::vec3(0.0f);
+
+        /*Placement of the models, only the nodes that moved since the last frame are recomputed*/
+        scene.Update();
+        frame.animationTransform = scene.World(characterNode);
+        frame.animationNormal = scene.Normal(characterNode);
+
+        /*Retrieving the final bone transformation matrices from animator objects, and the bounds of the posed character*/
+        if (animator)
+        {
+            /*Only the matrices the skinning shaders have room for, the animator keeps room for 1000*/
+            const vector<glm::mat4> &boneMatrices = animator->GetFinalBoneMatrices();
+            frame.boneMatrices.assign(boneMatrices.begin(), boneMatrices.begin() + std::min<size_t>(boneMatrices.size(), MAX_BONES));
+            animationModel->GetBounds(frame.animationTransform, frame.characterCenter, frame.characterRadius);
+        }
+
+        /* Calculating the projection and view matrices for camera in 3D scene*/
+        frame.framebufferWidth = framebufferWidth;
+        frame.framebufferHeight = framebufferHeight;
+        float viewportWidth = headless.enabled ? (float)headless.width : (float)SCR_WIDTH;
+        float viewportHeight = headless.enabled ? (float)headless.height : (float)SCR_HEIGHT;
+        frame.projection = glm::perspective(glm::radians(camera.Zoom), viewportWidth / viewportHeight, 0.1f, FAR_PLANE);
+        frame.view = camera.GetViewMatrix();
+        frame.viewPos = camera.Position;
+
+        /*Pixels covered by one unit at distance one, used to tell the texture streamer how large textures appear*/
+        frame.screenScale = viewportHeight / (2.0f * tan(glm::radians(camera.Zoom) * 0.5f));
+        frame.resolution = resolutionSettings;
 
         /**
          *******************************************************************************************************
@@ -670,24 +1373,119 @@ int main()
          * Creating a user interface using ImGUI for controlling certain parameters
          * and displaying application statistics within our graphics appliction
          */
+        RenderStatus status = framePipeline.Status();
+        bool interfaceChanged = false;
+        bool drawDataGrew = false;
+        if (headless.enabled)
+            frame.CopyDrawData(NULL);
+        else
         {
-            ImGui::SliderFloat3("LightPos", &lightPos.x, -400.f, 400.f);
-            ImGui::SliderFloat3("LightColor", &lightColor.x, 0.0f, 1.0f);
-            ImGui::SliderFloat("LightColor-ambientIntensity", &ambientIntensity, 0.0f, 1.0f);
-            ImGui::SliderFloat("LightColor-diffuseIntensity", &diffuseIntensity, 0.0f, 1.0f);
-            ImGui::SliderFloat("LightColor-specularIntensity", &specularIntensity, 0.0f, 1.0f);
+            interfaceChanged |= ImGui::SliderFloat3("LightPos", &lightPos.x, -400.f, 400.f);
+            interfaceChanged |= ImGui::SliderFloat3("LightColor", &lightColor.x, 0.0f, 1.0f);
+            interfaceChanged |= ImGui::SliderFloat("LightColor-ambientIntensity", &ambientIntensity, 0.0f, 1.0f);
+            interfaceChanged |= ImGui::SliderFloat("LightColor-diffuseIntensity", &diffuseIntensity, 0.0f, 1.0f);
+            interfaceChanged |= ImGui::SliderFloat("LightColor-specularIntensity", &specularIntensity, 0.0f, 1.0f);
+            interfaceChanged |= ImGui::Checkbox("Animate character", &animateCharacter);
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                         1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-
+            interfaceChanged |= ImGui::Checkbox("Render on demand", &pacingSettings.renderOnDemand);
+            interfaceChanged |= ImGui::SliderInt("Frame cap (0 for none)", &pacingSettings.frameCap, 0, 240);
+            const FrameTimes &frameTimes = framePacer.Times();
+            ImGui::Text("Frame time p50 %.2f, p95 %.2f, p99 %.2f ms over %d frames", frameTimes.Percentile(50.0),
+                        frameTimes.Percentile(95.0), frameTimes.Percentile(99.0), frameTimes.Count());
+            ImGui::Text("Texture memory %.1f / %.1f MB", status.textureBytes / 1048576.0, status.textureBudget / 1048576.0);
+            ImGui::Text("Geometry pool %.1f / %.1f MB, cells %d / %d, %d models loading", status.geometryBytes / 1048576.0,
+                        status.geometryBudget / 1048576.0, status.drawnCells, status.totalCells, status.loadingModels);
+            ImGui::Text("Geometry upload %.1f KB in %.3f ms (budget %.1f ms)", status.geometryUploadBytes / 1024.0,
+                        status.geometryUploadMilliseconds, streamingSettings.uploadMilliseconds);
+            interfaceChanged |= ImGui::Checkbox("Dynamic resolution", &resolutionSettings.enabled);
+            interfaceChanged |= ImGui::SliderFloat("GPU frame target (ms)", &resolutionSettings.targetMilliseconds, 4.0f, 33.0f);
+            interfaceChanged |= ImGui::SliderFloat("Upscale sharpness", &resolutionSettings.sharpness, 0.0f, 1.0f);
+            ImGui::Text("Render scale %.0f%% (%dx%d), GPU %.2f ms/frame", status.renderScale * 100.0f, status.renderWidth,
+                        status.renderHeight, status.gpuMilliseconds);
+            ImGui::Text("Draw calls %d, %.1fK triangles per frame", status.drawCalls, status.triangles / 1000.0);
+            ImGui::Text("Render graph %d passes (%d culled), %d targets in %d textures, %.1f MB", status.renderPasses,
+                        status.culledPasses, status.renderTargets, status.renderTargetTextures, status.renderTargetBytes / 1048576.0);
+            ImGui::Text("Impostors %d beyond %.0f units", status.impostorInstances, streamingSettings.impostorDistance);
+            ImGui::Text("Lighting: %s", status.lightmapReady ? "baked" : status.lightmapBaking ? "dynamic, baking lightmap" : "dynamic");
+            ImGui::Text("Character lighting: %s", status.irradianceReady ? "irradiance volume" : status.irradianceBaking ? "flat, baking volume" : "flat");
+
+            /*Dragging a widget redraws the interface even while its value stays the same*/
+            interfaceChanged |= ImGui::IsAnyItemActive();
+
+            /*Only the draw lists are built here, the render thread submits them*/
             ImGui::Render();
-            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            drawDataGrew = frame.CopyDrawData(ImGui::GetDrawData());
+        }
+
+        /*Handing the packet to the render thread*/
+        frame.captureIndex = !benchmarking && headless.Captures(headlessFrame) ? headlessFrame : -1;
+        frame.benchmarkCase = benchmarkFrame.measured ? benchmarkFrame.caseIndex : -1;
+        framePipeline.Submit();
+
+        bool resized = frame.framebufferWidth != previousFramebufferWidth || frame.framebufferHeight != previousFramebufferHeight;
+        previousFramebufferWidth = frame.framebufferWidth;
+        previousFramebufferHeight = frame.framebufferHeight;
+        if (headless.enabled)
+        {
+            /*Headless frames follow each other as fast as they render, their times go into the same percentiles*/
+            framePacer.Pace(pacingSettings, false);
+            headlessFrame++;
+        }
+        else
+        {
+            /**
+             * Anything that changes the picture keeps the loop drawing: the camera,
+             * the window size, the debug interface, the animation and the bakes and
+             * streaming of the render thread
+             */
+            bool changed = frame.view != previousView || frame.projection != previousProjection || resized || interfaceChanged ||
+                           animating || !status.steady;
+            previousView = frame.view;
+            previousProjection = frame.projection;
+            framePacer.FrameChanged(changed);
+
+            /*Process events in the event queue, waiting for the next one while nothing changes in render-on-demand mode*/
+            bool idle = framePacer.Idle(pacingSettings);
+            if (idle)
+                glfwWaitEventsTimeout(pacingSettings.idleTimeout);
+            else
+                glfwPollEvents();
+
+            /*Holding the frame cap*/
+            framePacer.Pace(pacingSettings, idle);
         }
 
-        /*Swaps the front and back buffers of the window*/
-        glfwSwapBuffers(window);
+        /*Resizing and a debug interface outgrowing its draw lists allocate, as does anything that keeps the render side unsteady*/
+        allocations.Check(status.steady && !resized && !drawDataGrew);
+    }
+
+    /*Letting the render thread finish the submitted frames, then taking the context back for the cleanup*/
+    framePipeline.Close();
+    renderThread.join();
+    makeCurrent(true);
 
-        /*Process events in the event queue*/
-        glfwPollEvents();
+    /**
+     * Summary of a headless run, for the build logs. A benchmark run writes
+     * its report and fails when it can't or when it regressed from the baseline
+     */
+    int exitCode = 0;
+    if (benchmarking)
+    {
+        std::string renderer = (const char *)glGetString(GL_RENDERER);
+        benchmark.Print();
+        if (!headless.reportPath.empty() && !benchmark.WriteReport(headless.reportPath, renderer, headless.width, headless.height))
+            exitCode = 1;
+        if (!headless.baselinePath.empty() && benchmark.Compare(headless.baselinePath, renderer) != 0)
+            exitCode = 1;
+    }
+    else if (headless.enabled)
+    {
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+        const FrameTimes &frameTimes = framePacer.Times();
+        std::cout << "Rendered " << headless.frames << " frames at " << headless.width << "x" << headless.height << " in "
+                  << milliseconds << " ms, frame time p50 " << frameTimes.Percentile(50.0) << " ms, p95 "
+                  << frameTimes.Percentile(95.0) << " ms, p99 " << frameTimes.Percentile(99.0) << " ms" << std::endl;
     }
 
     /**
@@ -700,12 +1498,18 @@ int main()
 
     /*Shutting down and cleaning ImGUI*/
     {
-        ImGui_ImplOpenGL3_Shutdown();
+        if (!headless.enabled)
+            ImGui_ImplOpenGL3_Shutdown();
         ImGui::DestroyContext();
     }
+    headlessTarget.reset();
+
+    /*Deleting the shared textures, buffers and programs while the context exists, the models and shaders outlive it*/
+    ResourceManager::Instance().Shutdown();
 
-    /*Cleaning up and terminating GLFW library*/
-    glfwTerminate();
+    /*Cleaning up and terminating GLFW library, the headless context goes with 'headlessContext'*/
+    if (!headless.enabled)
+        glfwTerminate();
 
-    return 0;
+    return exitCode;
 }